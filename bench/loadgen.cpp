@@ -0,0 +1,498 @@
+/* ************************************************************************** */
+/*                                                                            */
+/*                                                        :::      ::::::::   */
+/*   loadgen.cpp                                        :+:      :+:    :+:   */
+/*                                                    +:+ +:+         +:+     */
+/*   By: aogbi <aogbi@student.42.fr>                +#+  +:+       +#+        */
+/*                                                +#+#+#+#+#+   +#+           */
+/*   Created: 2026/10/19 00:00:00 by aogbi             #+#    #+#             */
+/*   Updated: 2026/10/19 00:00:00 by aogbi            ###   ########.fr       */
+/*                                                                            */
+/* ************************************************************************** */
+
+/*
+ * Closed-loop HTTP/1.1 load generator used by `make bench`.
+ *
+ * Every connection keeps up to `depth` requests in flight (pipelining) and
+ * picks requests from a weighted mix. When the server closes a connection
+ * the unanswered requests are replayed on a fresh one, so servers without
+ * keep-alive can still be measured. One JSON object is printed per run;
+ * "keepalive" and "pipeline" report what the server actually allowed, not
+ * just what was asked for.
+ */
+
+#include <iostream>
+#include <sstream>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <deque>
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <strings.h>
+#include <cerrno>
+#include <ctime>
+#include <unistd.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <netdb.h>
+#include <stdint.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+
+struct RequestTemplate {
+    std::string method;
+    std::string path;
+    std::string wire;
+    unsigned weight;
+};
+
+struct Options {
+    std::string host;
+    int port;
+    int connections;
+    int depth;
+    double duration;
+    bool keepAlive;
+    std::string name;
+    std::string tag;
+    std::string bodyFile;
+    std::string contentType;
+    int serverPid;
+    std::vector<RequestTemplate> mix;
+
+    Options() : host("127.0.0.1"), port(8080), connections(16), depth(1), duration(5.0),
+        keepAlive(true), name("run"), contentType("application/octet-stream"), serverPid(0) {}
+};
+
+struct Connection {
+    int fd;
+    bool connecting;
+    std::string out;
+    size_t outOffset;
+    std::string in;
+    std::deque<size_t> inflightMix;
+    std::deque<uint64_t> inflightSent;
+    unsigned served;            // responses read on this socket
+
+    Connection() : fd(-1), connecting(false), outOffset(0), served(0) {}
+};
+
+struct Stats {
+    uint64_t completed;
+    uint64_t non2xx;
+    uint64_t errors;
+    uint64_t replays;
+    uint64_t reconnects;
+    uint64_t bytesIn;
+    uint64_t reused;            // responses that were not the first on their connection
+    std::vector<uint32_t> latencies;
+
+    Stats() : completed(0), non2xx(0), errors(0), replays(0), reconnects(0), bytesIn(0), reused(0) {}
+};
+
+static uint64_t nowMicros() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return static_cast<uint64_t>(ts.tv_sec) * 1000000 + ts.tv_nsec / 1000;
+}
+
+static void usage(const char* prog) {
+    std::cerr << "Usage: " << prog << " [options] -r 'METHOD /path [weight]' ..." << std::endl
+              << "  -H host       server address (default 127.0.0.1)" << std::endl
+              << "  -p port       server port (default 8080)" << std::endl
+              << "  -c conns      concurrent connections (default 16)" << std::endl
+              << "  -P depth      pipelined requests per connection (default 1)" << std::endl
+              << "  -d seconds    run duration (default 5)" << std::endl
+              << "  -C            close after every request instead of keep-alive" << std::endl
+              << "  -b file       request body for POST/PUT entries" << std::endl
+              << "  -t type       Content-Type sent with the body" << std::endl
+              << "  -n name       scenario name reported in the output" << std::endl
+              << "  -g tag        free-form tag (e.g. commit id) reported in the output" << std::endl
+              << "  -s pid        sample RSS of this server process at the end" << std::endl;
+}
+
+static bool readFile(const std::string& path, std::string& out) {
+    std::ifstream file(path.c_str(), std::ios::binary);
+    if (!file.is_open()) {
+        return false;
+    }
+    out.assign((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+    return true;
+}
+
+static void buildRequests(Options& opts) {
+    std::string body;
+    if (!opts.bodyFile.empty() && !readFile(opts.bodyFile, body)) {
+        std::cerr << "loadgen: cannot read body file " << opts.bodyFile << std::endl;
+        std::exit(2);
+    }
+    for (size_t i = 0; i < opts.mix.size(); ++i) {
+        RequestTemplate& t = opts.mix[i];
+        bool hasBody = (t.method == "POST" || t.method == "PUT");
+        std::ostringstream req;
+        req << t.method << " " << t.path << " HTTP/1.1\r\n"
+            << "Host: " << opts.host << ":" << opts.port << "\r\n"
+            << "User-Agent: webserv-loadgen/1.0\r\n"
+            << "Accept: */*\r\n"
+            << "Connection: " << (opts.keepAlive ? "keep-alive" : "close") << "\r\n";
+        if (hasBody) {
+            req << "Content-Type: " << opts.contentType << "\r\n"
+                << "Content-Length: " << body.length() << "\r\n";
+        }
+        req << "\r\n";
+        if (hasBody) {
+            req << body;
+        }
+        t.wire = req.str();
+    }
+}
+
+static size_t pickRequest(const Options& opts, unsigned totalWeight) {
+    unsigned r = static_cast<unsigned>(std::rand()) % totalWeight;
+    for (size_t i = 0; i < opts.mix.size(); ++i) {
+        if (r < opts.mix[i].weight) {
+            return i;
+        }
+        r -= opts.mix[i].weight;
+    }
+    return 0;
+}
+
+static bool openConnection(Connection& conn, const struct sockaddr_in& addr) {
+    conn.fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (conn.fd < 0) {
+        return false;
+    }
+    int one = 1;
+    setsockopt(conn.fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    fcntl(conn.fd, F_SETFL, O_NONBLOCK);
+    conn.connecting = false;
+    if (connect(conn.fd, (const struct sockaddr*)&addr, sizeof(addr)) < 0) {
+        if (errno != EINPROGRESS) {
+            close(conn.fd);
+            conn.fd = -1;
+            return false;
+        }
+        conn.connecting = true;
+    }
+    conn.out.clear();
+    conn.outOffset = 0;
+    conn.in.clear();
+    conn.served = 0;
+    return true;
+}
+
+// Queue the unanswered requests of a dead connection again on a new socket
+static void reopen(Connection& conn, const struct sockaddr_in& addr, const Options& opts, Stats& stats) {
+    if (conn.fd >= 0) {
+        close(conn.fd);
+    }
+    std::deque<size_t> pending = conn.inflightMix;
+    conn.inflightMix.clear();
+    conn.inflightSent.clear();
+    ++stats.reconnects;
+    if (!openConnection(conn, addr)) {
+        ++stats.errors;
+        return;
+    }
+    uint64_t now = nowMicros();
+    for (size_t i = 0; i < pending.size(); ++i) {
+        conn.out += opts.mix[pending[i]].wire;
+        conn.inflightMix.push_back(pending[i]);
+        conn.inflightSent.push_back(now);
+        ++stats.replays;
+    }
+}
+
+static std::string headerValue(const std::string& head, const char* name) {
+    size_t nameLen = std::strlen(name);
+    size_t pos = 0;
+    while ((pos = head.find("\r\n", pos)) != std::string::npos) {
+        pos += 2;
+        if (head.length() - pos > nameLen && strncasecmp(head.c_str() + pos, name, nameLen) == 0
+            && head[pos + nameLen] == ':') {
+            size_t start = head.find_first_not_of(" \t", pos + nameLen + 1);
+            size_t end = head.find("\r\n", pos);
+            if (start == std::string::npos || start > end) {
+                return "";
+            }
+            return head.substr(start, end - start);
+        }
+    }
+    return "";
+}
+
+/**
+ * Consume complete responses from the input buffer.
+ * Returns false when the server announced it will close the connection.
+ */
+static bool drainResponses(Connection& conn, Stats& stats, bool eof) {
+    while (!conn.inflightSent.empty()) {
+        size_t headEnd = conn.in.find("\r\n\r\n");
+        if (headEnd == std::string::npos) {
+            return true;
+        }
+        std::string head = conn.in.substr(0, headEnd);
+        std::string lengthStr = headerValue(head, "Content-Length");
+        size_t total;
+        if (!lengthStr.empty()) {
+            total = headEnd + 4 + std::strtoul(lengthStr.c_str(), NULL, 10);
+            if (conn.in.length() < total) {
+                return true;
+            }
+        } else if (eof) {
+            total = conn.in.length();
+        } else {
+            return true;
+        }
+
+        int status = (head.length() > 12) ? std::atoi(head.c_str() + 9) : 0;
+        uint64_t latency = nowMicros() - conn.inflightSent.front();
+        stats.latencies.push_back(static_cast<uint32_t>(latency > 0xffffffffULL ? 0xffffffffULL : latency));
+        ++stats.completed;
+        if (conn.served++ > 0) {
+            ++stats.reused;
+        }
+        if (status < 200 || status >= 300) {
+            ++stats.non2xx;
+        }
+        conn.inflightSent.pop_front();
+        conn.inflightMix.pop_front();
+        conn.in.erase(0, total);
+
+        if (strcasecmp(headerValue(head, "Connection").c_str(), "close") == 0) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static long readProcStatusKb(int pid, const char* field) {
+    std::ostringstream path;
+    path << "/proc/" << pid << "/status";
+    std::ifstream status(path.str().c_str());
+    std::string line;
+    size_t len = std::strlen(field);
+    while (std::getline(status, line)) {
+        if (line.compare(0, len, field) == 0 && line.length() > len && line[len] == ':') {
+            return std::atol(line.c_str() + len + 1);
+        }
+    }
+    return -1;
+}
+
+static uint32_t percentile(const std::vector<uint32_t>& sorted, double p) {
+    if (sorted.empty()) {
+        return 0;
+    }
+    size_t idx = static_cast<size_t>(p * (sorted.size() - 1) + 0.5);
+    return sorted[std::min(idx, sorted.size() - 1)];
+}
+
+static bool parseArgs(int argc, char* argv[], Options& opts) {
+    int c;
+    while ((c = getopt(argc, argv, "H:p:c:P:d:Cb:t:n:g:s:r:")) != -1) {
+        switch (c) {
+            case 'H': opts.host = optarg; break;
+            case 'p': opts.port = std::atoi(optarg); break;
+            case 'c': opts.connections = std::atoi(optarg); break;
+            case 'P': opts.depth = std::atoi(optarg); break;
+            case 'd': opts.duration = std::atof(optarg); break;
+            case 'C': opts.keepAlive = false; break;
+            case 'b': opts.bodyFile = optarg; break;
+            case 't': opts.contentType = optarg; break;
+            case 'n': opts.name = optarg; break;
+            case 'g': opts.tag = optarg; break;
+            case 's': opts.serverPid = std::atoi(optarg); break;
+            case 'r': {
+                std::istringstream spec(optarg);
+                RequestTemplate t;
+                t.weight = 1;
+                if (!(spec >> t.method >> t.path)) {
+                    return false;
+                }
+                spec >> t.weight;
+                if (t.weight == 0) {
+                    t.weight = 1;
+                }
+                opts.mix.push_back(t);
+                break;
+            }
+            default:
+                return false;
+        }
+    }
+    if (opts.mix.empty() || opts.connections <= 0 || opts.depth <= 0 || opts.duration <= 0) {
+        return false;
+    }
+    if (!opts.keepAlive) {
+        opts.depth = 1;
+    }
+    return true;
+}
+
+int main(int argc, char* argv[]) {
+    Options opts;
+    if (!parseArgs(argc, argv, opts)) {
+        usage(argv[0]);
+        return 2;
+    }
+    buildRequests(opts);
+    std::srand(static_cast<unsigned>(nowMicros()));
+
+    unsigned totalWeight = 0;
+    for (size_t i = 0; i < opts.mix.size(); ++i) {
+        totalWeight += opts.mix[i].weight;
+    }
+
+    struct sockaddr_in addr;
+    std::memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(static_cast<uint16_t>(opts.port));
+    if (inet_pton(AF_INET, opts.host.c_str(), &addr.sin_addr) != 1) {
+        std::cerr << "loadgen: invalid address " << opts.host << std::endl;
+        return 2;
+    }
+
+    Stats stats;
+    stats.latencies.reserve(1 << 20);
+    std::vector<Connection> conns(opts.connections);
+    std::vector<struct pollfd> pfds(opts.connections);
+    for (size_t i = 0; i < conns.size(); ++i) {
+        if (!openConnection(conns[i], addr)) {
+            ++stats.errors;
+        }
+    }
+
+    uint64_t start = nowMicros();
+    uint64_t deadline = start + static_cast<uint64_t>(opts.duration * 1000000.0);
+    char buf[65536];
+
+    while (nowMicros() < deadline) {
+        for (size_t i = 0; i < conns.size(); ++i) {
+            Connection& conn = conns[i];
+            if (conn.fd < 0) {
+                reopen(conn, addr, opts, stats);
+            }
+            while (conn.fd >= 0 && conn.inflightSent.size() < static_cast<size_t>(opts.depth)) {
+                size_t pick = pickRequest(opts, totalWeight);
+                conn.out += opts.mix[pick].wire;
+                conn.inflightMix.push_back(pick);
+                conn.inflightSent.push_back(nowMicros());
+            }
+            pfds[i].fd = conn.fd;
+            pfds[i].events = POLLIN;
+            if (conn.connecting || conn.outOffset < conn.out.length()) {
+                pfds[i].events |= POLLOUT;
+            }
+            pfds[i].revents = 0;
+        }
+
+        int ready = poll(&pfds[0], pfds.size(), 100);
+        if (ready < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            std::cerr << "loadgen: poll: " << std::strerror(errno) << std::endl;
+            return 1;
+        }
+
+        for (size_t i = 0; i < conns.size(); ++i) {
+            Connection& conn = conns[i];
+            short revents = pfds[i].revents;
+            if (conn.fd < 0 || revents == 0) {
+                continue;
+            }
+            if (conn.connecting && (revents & (POLLOUT | POLLERR | POLLHUP))) {
+                int err = 0;
+                socklen_t len = sizeof(err);
+                getsockopt(conn.fd, SOL_SOCKET, SO_ERROR, &err, &len);
+                if (err != 0) {
+                    ++stats.errors;
+                    reopen(conn, addr, opts, stats);
+                    continue;
+                }
+                conn.connecting = false;
+            }
+            if ((revents & POLLOUT) && conn.outOffset < conn.out.length()) {
+                ssize_t n = send(conn.fd, conn.out.data() + conn.outOffset,
+                                 conn.out.length() - conn.outOffset, MSG_NOSIGNAL);
+                if (n > 0) {
+                    conn.outOffset += n;
+                    if (conn.outOffset == conn.out.length()) {
+                        conn.out.clear();
+                        conn.outOffset = 0;
+                    }
+                } else if (n < 0 && errno != EAGAIN && errno != EWOULDBLOCK) {
+                    reopen(conn, addr, opts, stats);
+                    continue;
+                }
+            }
+            if (revents & (POLLIN | POLLHUP | POLLERR)) {
+                ssize_t n = recv(conn.fd, buf, sizeof(buf), 0);
+                if (n > 0) {
+                    stats.bytesIn += n;
+                    conn.in.append(buf, n);
+                    if (!drainResponses(conn, stats, false)) {
+                        reopen(conn, addr, opts, stats);
+                    }
+                } else if (n == 0 || (errno != EAGAIN && errno != EWOULDBLOCK)) {
+                    drainResponses(conn, stats, true);
+                    reopen(conn, addr, opts, stats);
+                }
+            }
+        }
+    }
+
+    double elapsed = (nowMicros() - start) / 1000000.0;
+    for (size_t i = 0; i < conns.size(); ++i) {
+        if (conns[i].fd >= 0) {
+            close(conns[i].fd);
+        }
+    }
+
+    // A server that closes after every response turns keep-alive and pipelining
+    // runs into connection-per-request ones; say so rather than mislabel them
+    bool reusing = stats.reused > 0;
+    bool downgraded = !reusing && (opts.keepAlive || opts.depth > 1) && stats.completed > 0;
+
+    std::sort(stats.latencies.begin(), stats.latencies.end());
+    std::ostringstream json;
+    json << "{\"scenario\":\"" << opts.name << "\"";
+    if (!opts.tag.empty()) {
+        json << ",\"tag\":\"" << opts.tag << "\"";
+    }
+    json << ",\"connections\":" << opts.connections
+         << ",\"pipeline\":" << (reusing ? opts.depth : 1)
+         << ",\"keepalive\":" << (opts.keepAlive && reusing ? "true" : "false")
+         << ",\"requested_pipeline\":" << opts.depth
+         << ",\"requested_keepalive\":" << (opts.keepAlive ? "true" : "false")
+         << ",\"duration_s\":" << elapsed
+         << ",\"requests\":" << stats.completed
+         << ",\"rps\":" << static_cast<uint64_t>(stats.completed / (elapsed > 0 ? elapsed : 1))
+         << ",\"non2xx\":" << stats.non2xx
+         << ",\"errors\":" << stats.errors
+         << ",\"reconnects\":" << stats.reconnects
+         << ",\"replayed\":" << stats.replays
+         << ",\"reused\":" << stats.reused
+         << ",\"bytes_in\":" << stats.bytesIn
+         << ",\"latency_us\":{\"p50\":" << percentile(stats.latencies, 0.50)
+         << ",\"p99\":" << percentile(stats.latencies, 0.99)
+         << ",\"p999\":" << percentile(stats.latencies, 0.999)
+         << ",\"max\":" << (stats.latencies.empty() ? 0 : stats.latencies.back()) << "}";
+    if (opts.serverPid > 0) {
+        json << ",\"rss_kb\":" << readProcStatusKb(opts.serverPid, "VmRSS")
+             << ",\"peak_rss_kb\":" << readProcStatusKb(opts.serverPid, "VmHWM");
+    }
+    if (downgraded) {
+        json << ",\"note\":\"server closed after every response: one request per connection,"
+             << " not keep-alive or pipelining numbers\"";
+    }
+    json << "}";
+    std::cout << json.str() << std::endl;
+    return 0;
+}
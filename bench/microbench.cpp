@@ -0,0 +1,420 @@
+/* ************************************************************************** */
+/*                                                                            */
+/*                                                        :::      ::::::::   */
+/*   microbench.cpp                                     :+:      :+:    :+:   */
+/*                                                    +:+ +:+         +:+     */
+/*   By: aogbi <aogbi@student.42.fr>                +#+  +:+       +#+        */
+/*                                                +#+#+#+#+#+   +#+           */
+/*   Created: 2026/10/19 00:00:00 by aogbi             #+#    #+#             */
+/*   Updated: 2026/10/19 00:00:00 by aogbi            ###   ########.fr       */
+/*                                                                            */
+/* ************************************************************************** */
+
+/*
+ * Microbenchmarks for the per-request CPU paths: request parsing, request
+ * completeness checks, response serialization, location routing and MIME
+ * lookup. Links the server objects directly and replaces the global
+ * operator new/delete so every case reports allocations per operation.
+ * The head scans are then repeated at every ByteScan level the CPU
+ * supports, suffixed [scalar], [sse2] or [avx2].
+ *
+ *   ./bench/microbench [filter]
+ */
+
+#include "request.hpp"
+#include "response.hpp"
+#include "config.hpp"
+#include "connection_manager.hpp"
+#include "http_handler.hpp"
+#include "metrics.hpp"
+#include "byte_scan.hpp"
+#include <iostream>
+#include <iomanip>
+#include <sstream>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <new>
+#include <cstdlib>
+#include <cstdio>
+#include <unistd.h>
+
+// --- allocation accounting ---------------------------------------------------
+
+static uint64_t g_allocCount = 0;
+static uint64_t g_allocBytes = 0;
+
+// Every form of new and delete goes through this malloc/free pair, so each
+// delete frees exactly what its matching new allocated
+static void* countedAlloc(std::size_t size) {
+    ++g_allocCount;
+    g_allocBytes += size;
+    void* p = std::malloc(size ? size : 1);
+    if (!p) {
+        throw std::bad_alloc();
+    }
+    return p;
+}
+
+static void countedFree(void* p) {
+    std::free(p);
+}
+
+void* operator new(std::size_t size) throw(std::bad_alloc) {
+    return countedAlloc(size);
+}
+
+void* operator new[](std::size_t size) throw(std::bad_alloc) {
+    return countedAlloc(size);
+}
+
+void operator delete(void* p) throw() {
+    countedFree(p);
+}
+
+void operator delete[](void* p) throw() {
+    countedFree(p);
+}
+
+// --- harness -------------------------------------------------------------------
+
+typedef void (*BenchFn)(void* ctx);
+
+struct BenchCase {
+    std::string name;
+    BenchFn fn;
+    void* ctx;
+};
+
+static volatile size_t g_sink = 0;
+
+static void runCase(const BenchCase& bc, const std::string& suffix = "") {
+    // Warm up and calibrate until one batch takes at least ~200ms
+    size_t iterations = 1;
+    uint64_t elapsed = 0;
+    for (;;) {
+        uint64_t start = Metrics::nowMicros();
+        for (size_t i = 0; i < iterations; ++i) {
+            bc.fn(bc.ctx);
+        }
+        elapsed = Metrics::nowMicros() - start;
+        if (elapsed >= 200000 || iterations >= (1u << 26)) {
+            break;
+        }
+        iterations *= (elapsed < 1000) ? 16 : 2;
+    }
+
+    uint64_t allocsBefore = g_allocCount;
+    uint64_t bytesBefore = g_allocBytes;
+    uint64_t start = Metrics::nowMicros();
+    for (size_t i = 0; i < iterations; ++i) {
+        bc.fn(bc.ctx);
+    }
+    elapsed = Metrics::nowMicros() - start;
+    double allocs = static_cast<double>(g_allocCount - allocsBefore) / iterations;
+    double bytes = static_cast<double>(g_allocBytes - bytesBefore) / iterations;
+    double nsPerOp = elapsed * 1000.0 / iterations;
+
+    std::cout << std::left << std::setw(52) << bc.name + suffix << std::right
+              << std::setw(12) << std::fixed << std::setprecision(1) << nsPerOp
+              << std::setw(12) << std::setprecision(1) << allocs
+              << std::setw(14) << std::setprecision(0) << bytes
+              << std::setw(12) << iterations << std::endl;
+}
+
+// --- corpora -------------------------------------------------------------------
+
+static std::string browserRequest() {
+    return "GET /tours/tours1.html HTTP/1.1\r\n"
+           "Host: localhost:8080\r\n"
+           "Connection: keep-alive\r\n"
+           "Cache-Control: max-age=0\r\n"
+           "sec-ch-ua: \"Chromium\";v=\"128\", \"Not;A=Brand\";v=\"24\", \"Google Chrome\";v=\"128\"\r\n"
+           "sec-ch-ua-mobile: ?0\r\n"
+           "sec-ch-ua-platform: \"Linux\"\r\n"
+           "Upgrade-Insecure-Requests: 1\r\n"
+           "User-Agent: Mozilla/5.0 (X11; Linux x86_64) AppleWebKit/537.36 (KHTML, like Gecko) "
+           "Chrome/128.0.0.0 Safari/537.36\r\n"
+           "Accept: text/html,application/xhtml+xml,application/xml;q=0.9,image/avif,image/webp,"
+           "image/apng,*/*;q=0.8,application/signed-exchange;v=b3;q=0.7\r\n"
+           "Sec-Fetch-Site: same-origin\r\n"
+           "Sec-Fetch-Mode: navigate\r\n"
+           "Sec-Fetch-User: ?1\r\n"
+           "Sec-Fetch-Dest: document\r\n"
+           "Referer: http://localhost:8080/index.html\r\n"
+           "Accept-Encoding: gzip, deflate, br, zstd\r\n"
+           "Accept-Language: en-US,en;q=0.9,fr;q=0.8\r\n"
+           "\r\n";
+}
+
+static std::string hugeCookieRequest() {
+    std::string cookie;
+    for (int i = 0; cookie.length() < 8000; ++i) {
+        std::ostringstream kv;
+        kv << (i ? "; " : "") << "session_fragment_" << i << "=" << std::string(48, 'a' + (i % 26));
+        cookie += kv.str();
+    }
+    std::string req = browserRequest();
+    req.insert(req.length() - 2, "Cookie: " + cookie + "\r\n");
+    return req;
+}
+
+static std::string postRequest() {
+    std::string body(4096, 'x');
+    std::ostringstream req;
+    req << "POST /uploads HTTP/1.1\r\n"
+        << "Host: localhost:8080\r\n"
+        << "Content-Type: application/octet-stream\r\n"
+        << "Content-Length: " << body.length() << "\r\n"
+        << "\r\n" << body;
+    return req.str();
+}
+
+static std::string pipelinedBatch() {
+    std::string batch;
+    for (int i = 0; i < 16; ++i) {
+        batch += browserRequest();
+    }
+    return batch;
+}
+
+static std::string writeLocationsConfig(int count) {
+    char path[] = "/tmp/webserv-microbench-XXXXXX";
+    int fd = mkstemp(path);
+    if (fd < 0) {
+        std::perror("mkstemp");
+        std::exit(1);
+    }
+    close(fd);
+    std::ofstream conf(path);
+    conf << "server {\n    listen 8080;\n    root docs/fusion_web/;\n";
+    for (int i = 0; i < count; ++i) {
+        conf << "    location /app" << i << "/section" << (i % 7) << " {\n"
+             << "        allow_methods GET POST;\n"
+             << "        autoindex off;\n"
+             << "    }\n";
+    }
+    conf << "    location / {\n        allow_methods GET;\n    }\n}\n";
+    return path;
+}
+
+// --- cases -------------------------------------------------------------------
+
+struct ParseCtx {
+    std::string raw;
+    Request req;
+};
+
+static void benchParse(void* p) {
+    ParseCtx* ctx = static_cast<ParseCtx*>(p);
+    g_sink += ctx->req.parse(ctx->raw);
+}
+
+struct HeadEndCtx {
+    std::string raw;
+};
+
+static void benchHeadEnd(void* p) {
+    HeadEndCtx* ctx = static_cast<HeadEndCtx*>(p);
+    size_t separator;
+    g_sink += ByteScan::findHeadEnd(ctx->raw.data(), ctx->raw.length(), separator);
+}
+
+// The search ByteScan::findHeadEnd replaced
+static void benchHeadEndFind(void* p) {
+    HeadEndCtx* ctx = static_cast<HeadEndCtx*>(p);
+    size_t headerEnd = ctx->raw.find("\r\n\r\n");
+    if (headerEnd == std::string::npos) {
+        headerEnd = ctx->raw.find("\n\n");
+    }
+    g_sink += headerEnd;
+}
+
+struct TokenCtx {
+    std::vector<std::string> names;
+};
+
+static void benchIsToken(void* p) {
+    TokenCtx* ctx = static_cast<TokenCtx*>(p);
+    for (size_t i = 0; i < ctx->names.size(); ++i) {
+        g_sink += ByteScan::isToken(ctx->names[i].data(), ctx->names[i].length());
+    }
+}
+
+struct CompleteCtx {
+    std::string raw;
+    ConnectionManager* manager;
+};
+
+static void benchComplete(void* p) {
+    CompleteCtx* ctx = static_cast<CompleteCtx*>(p);
+    g_sink += ctx->manager->isRequestComplete(ctx->raw);
+}
+
+struct ResponseCtx {
+    Response response;
+};
+
+static void benchToString(void* p) {
+    ResponseCtx* ctx = static_cast<ResponseCtx*>(p);
+    g_sink += ctx->response.toString().length();
+}
+
+struct RouteCtx {
+    Config* config;
+    std::vector<std::string> paths;
+    size_t next;
+};
+
+static void benchFindLocation(void* p) {
+    RouteCtx* ctx = static_cast<RouteCtx*>(p);
+    const Location* loc = ctx->config->findLocation(ctx->paths[ctx->next]);
+    ctx->next = (ctx->next + 1) % ctx->paths.size();
+    g_sink += reinterpret_cast<size_t>(loc);
+}
+
+struct MimeCtx {
+    HttpHandler* handler;
+    std::vector<std::string> names;
+    size_t next;
+};
+
+static void benchMimeType(void* p) {
+    MimeCtx* ctx = static_cast<MimeCtx*>(p);
+    g_sink += ctx->handler->getMimeType(ctx->names[ctx->next]).length();
+    ctx->next = (ctx->next + 1) % ctx->names.size();
+}
+
+int main(int argc, char* argv[]) {
+    std::string filter = (argc > 1) ? argv[1] : "";
+    std::vector<BenchCase> cases;
+
+    ParseCtx parseBrowser, parseCookie, parsePost, parsePipelined;
+    parseBrowser.raw = browserRequest();
+    parseCookie.raw = hugeCookieRequest();
+    parsePost.raw = postRequest();
+    parsePipelined.raw = pipelinedBatch();
+    BenchCase pc1 = { "Request::parse/browser", benchParse, &parseBrowser };
+    BenchCase pc2 = { "Request::parse/huge_cookie", benchParse, &parseCookie };
+    BenchCase pc3 = { "Request::parse/post_4k", benchParse, &parsePost };
+    BenchCase pc4 = { "Request::parse/pipelined_x16", benchParse, &parsePipelined };
+    cases.push_back(pc1);
+    cases.push_back(pc2);
+    cases.push_back(pc3);
+    cases.push_back(pc4);
+
+    Metrics metrics;
+    RequestLimits limits;
+    ConnectionManager manager(-1, metrics, limits);
+    CompleteCtx completeBrowser, completeCookie, completePost, completePartial;
+    completeBrowser.raw = parseBrowser.raw;
+    completeCookie.raw = parseCookie.raw;
+    completePost.raw = parsePost.raw;
+    completePartial.raw = parseCookie.raw.substr(0, parseCookie.raw.length() - 4);
+    completeBrowser.manager = completeCookie.manager = completePost.manager = completePartial.manager = &manager;
+    BenchCase cc1 = { "ConnectionManager::isRequestComplete/browser", benchComplete, &completeBrowser };
+    BenchCase cc2 = { "ConnectionManager::isRequestComplete/huge_cookie", benchComplete, &completeCookie };
+    BenchCase cc3 = { "ConnectionManager::isRequestComplete/post_4k", benchComplete, &completePost };
+    BenchCase cc4 = { "ConnectionManager::isRequestComplete/partial", benchComplete, &completePartial };
+    cases.push_back(cc1);
+    cases.push_back(cc2);
+    cases.push_back(cc3);
+    cases.push_back(cc4);
+
+    ResponseCtx smallResponse, largeResponse;
+    smallResponse.response.setStatus(200, "OK");
+    smallResponse.response.setContentType("text/html");
+    smallResponse.response.setHeader("Cache-Control", "no-cache");
+    smallResponse.response.setBody(std::string(1024, 'a'));
+    largeResponse.response = smallResponse.response;
+    largeResponse.response.setBody(std::string(256 * 1024, 'b'));
+    BenchCase rc1 = { "Response::toString/1k", benchToString, &smallResponse };
+    BenchCase rc2 = { "Response::toString/256k", benchToString, &largeResponse };
+    cases.push_back(rc1);
+    cases.push_back(rc2);
+
+    std::string confPath = writeLocationsConfig(500);
+    Config config(confPath);
+    config.parseConfig();
+    std::remove(confPath.c_str());
+    RouteCtx route;
+    route.config = &config;
+    route.next = 0;
+    for (int i = 0; i < 64; ++i) {
+        std::ostringstream path;
+        path << "/app" << (i * 37 % 500) << "/section" << (i * 37 % 500 % 7) << "/page.html";
+        route.paths.push_back(path.str());
+    }
+    route.paths.push_back("/index.html");
+    route.paths.push_back("/missing/deep/path/file.css");
+    BenchCase lc1 = { "Config::findLocation/500_locations", benchFindLocation, &route };
+    cases.push_back(lc1);
+
+    EpochDomain epochs;
+    OpenFileCache openFiles(epochs);
+    HttpHandler handler(config, metrics, openFiles);
+    MimeCtx mime;
+    mime.handler = &handler;
+    mime.next = 0;
+    const char* names[] = {
+        "docs/fusion_web/index.html", "assets/app.css", "assets/app.js", "img/photo.JPG",
+        "img/logo.png", "fonts/inter.woff2", "media/clip.mp4", "data/report.json",
+        "archive.tar.gz", "README", "img/hero.webp", "module.wasm"
+    };
+    for (size_t i = 0; i < sizeof(names) / sizeof(names[0]); ++i) {
+        mime.names.push_back(names[i]);
+    }
+    BenchCase mc1 = { "HttpHandler::getMimeType/mixed", benchMimeType, &mime };
+    cases.push_back(mc1);
+
+    // Head scans, repeated per ByteScan level below
+    std::vector<BenchCase> scanCases;
+    HeadEndCtx headEndCookie, headEndPartial;
+    headEndCookie.raw = parseCookie.raw;
+    headEndPartial.raw = completePartial.raw;
+    TokenCtx tokens;
+    const char* headerNames[] = {
+        "Host", "Connection", "Cache-Control", "sec-ch-ua", "Upgrade-Insecure-Requests", "User-Agent",
+        "Accept", "Sec-Fetch-Site", "Referer", "Accept-Encoding", "Accept-Language", "Cookie",
+        "X-Request-Correlation-Identifier-For-Tracing"
+    };
+    for (size_t i = 0; i < sizeof(headerNames) / sizeof(headerNames[0]); ++i) {
+        tokens.names.push_back(headerNames[i]);
+    }
+    BenchCase hb1 = { "std::string::find/huge_cookie_head_end", benchHeadEndFind, &headEndCookie };
+    BenchCase hb2 = { "std::string::find/partial_head_end", benchHeadEndFind, &headEndPartial };
+    cases.push_back(hb1);
+    cases.push_back(hb2);
+    BenchCase sc1 = { "ByteScan::findHeadEnd/huge_cookie", benchHeadEnd, &headEndCookie };
+    BenchCase sc2 = { "ByteScan::findHeadEnd/partial", benchHeadEnd, &headEndPartial };
+    BenchCase sc3 = { "ByteScan::isToken/13_header_names", benchIsToken, &tokens };
+    scanCases.push_back(sc1);
+    scanCases.push_back(sc2);
+    scanCases.push_back(sc3);
+    scanCases.push_back(pc1);
+    scanCases.push_back(pc2);
+    scanCases.push_back(cc2);
+    scanCases.push_back(cc4);
+
+    std::cout << std::left << std::setw(52) << "benchmark" << std::right
+              << std::setw(12) << "ns/op" << std::setw(12) << "allocs/op"
+              << std::setw(14) << "bytes/op" << std::setw(12) << "iters" << std::endl;
+    for (size_t i = 0; i < cases.size(); ++i) {
+        if (filter.empty() || cases[i].name.find(filter) != std::string::npos) {
+            runCase(cases[i]);
+        }
+    }
+
+    ByteScan::Level best = ByteScan::level();
+    for (int level = ByteScan::SCALAR; level <= best; ++level) {
+        ByteScan::setLevel(static_cast<ByteScan::Level>(level));
+        std::string suffix = std::string(" [") + ByteScan::levelName(ByteScan::level()) + "]";
+        for (size_t i = 0; i < scanCases.size(); ++i) {
+            if (filter.empty() || (scanCases[i].name + suffix).find(filter) != std::string::npos) {
+                runCase(scanCases[i], suffix);
+            }
+        }
+    }
+    ByteScan::setLevel(best);
+    return 0;
+}
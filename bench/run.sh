@@ -0,0 +1,185 @@
+#!/bin/bash
+# Reproducible benchmark for Webserv, driven by `make bench`.
+#
+# Builds a throwaway docroot, starts ./Webserv against it and runs the load
+# generator once per scenario. Every scenario appends one JSON line to
+# $BENCH_OUT so runs from different commits can be diffed directly.
+#
+# Tunables (environment):
+#   BENCH_PORT      listen port for the server under test   (default 18080)
+#   BENCH_DURATION  seconds per scenario                    (default 5)
+#   BENCH_CONNS     concurrent connections                  (default 32)
+#   BENCH_OUT       result file                             (default bench_output.txt)
+#   BENCH_ONLY      run only scenarios whose name matches this pattern
+#   BENCH_WORKERS   worker_threads of the server under test (default 1)
+#   BENCH_BACKEND   event_backend of the server under test  (default poll;
+#                   BENCH_BACKEND=io_uring BENCH_WORKERS=4 covers both together)
+
+set -eu
+
+ROOT_DIR="$(cd "$(dirname "$0")/.." && pwd)"
+WEBSERV="$ROOT_DIR/Webserv"
+LOADGEN="$ROOT_DIR/bench/loadgen"
+PORT="${BENCH_PORT:-18080}"
+DURATION="${BENCH_DURATION:-5}"
+CONNS="${BENCH_CONNS:-32}"
+OUT="${BENCH_OUT:-$ROOT_DIR/bench_output.txt}"
+ONLY="${BENCH_ONLY:-}"
+WORKERS="${BENCH_WORKERS:-1}"
+BACKEND="${BENCH_BACKEND:-poll}"
+TAG="$(git -C "$ROOT_DIR" rev-parse --short HEAD 2>/dev/null || echo unknown)"
+if ! git -C "$ROOT_DIR" diff --quiet 2>/dev/null; then
+    TAG="$TAG-dirty"
+fi
+
+UPSTREAM_PORT=$((PORT + 1))
+
+WORK="$(mktemp -d "${TMPDIR:-/tmp}/webserv-bench.XXXXXX")"
+SERVER_PID=""
+UPSTREAM_PIDS=""
+
+cleanup() {
+    if [ -n "$SERVER_PID" ]; then
+        kill "$SERVER_PID" 2>/dev/null || true
+        wait "$SERVER_PID" 2>/dev/null || true
+    fi
+    for pid in $UPSTREAM_PIDS; do
+        kill "$pid" 2>/dev/null || true
+        wait "$pid" 2>/dev/null || true
+    done
+    rm -rf "$WORK"
+}
+trap cleanup EXIT INT TERM
+
+# --- fixture docroot -------------------------------------------------------
+DOCROOT="$WORK/docroot"
+mkdir -p "$DOCROOT/uploads" "$DOCROOT/listing" "$WORK/cgi-bin" "$WORK/cgi-cached"
+
+head -c 1024 /dev/zero | tr '\0' 'a' > "$DOCROOT/small.html"
+head -c 1048576 /dev/urandom > "$DOCROOT/large.bin"
+cp "$DOCROOT/small.html" "$DOCROOT/index.html"
+for i in $(seq 1 2000); do
+    : > "$DOCROOT/listing/file_$i.txt"
+done
+
+cat > "$WORK/cgi-bin/hello.py" <<'PY'
+#!/usr/bin/python3
+print("Content-Type: text/plain")
+print()
+print("hello from cgi")
+PY
+
+cp "$WORK/cgi-bin/hello.py" "$WORK/cgi-cached/hello.py"
+
+BOUNDARY="webservbench"
+{
+    printf -- '--%s\r\n' "$BOUNDARY"
+    printf 'Content-Disposition: form-data; name="file"; filename="bench.bin"\r\n'
+    printf 'Content-Type: application/octet-stream\r\n\r\n'
+    head -c 65536 /dev/urandom
+    printf '\r\n--%s--\r\n' "$BOUNDARY"
+} > "$WORK/upload.body"
+
+cat > "$WORK/bench.conf" <<CONF
+server {
+    listen $PORT;
+    server_name localhost;
+    host 127.0.0.1;
+    root $DOCROOT/;
+    index index.html;
+    client_max_body_size 10000000;
+    worker_threads $WORKERS;
+    event_backend $BACKEND;
+
+    upstream backend {
+        server 127.0.0.1:$UPSTREAM_PORT;
+        server 127.0.0.1:$((UPSTREAM_PORT + 1));
+    }
+
+    location / {
+        allow_methods GET HEAD;
+        autoindex off;
+    }
+
+    location /uploads {
+        allow_methods GET HEAD POST;
+        upload_dir uploads;
+    }
+
+    location /listing {
+        allow_methods GET HEAD;
+        autoindex on;
+        index none.html;
+    }
+
+    location /cgi-bin {
+        root $WORK/;
+        allow_methods GET POST;
+        cgi_path /usr/bin/python3;
+        cgi_ext .py;
+    }
+
+    location /cgi-cached {
+        root $WORK/;
+        allow_methods GET;
+        cgi_path /usr/bin/python3;
+        cgi_ext .py;
+        cgi_cache 10s;
+    }
+
+    location /proxy/ {
+        allow_methods GET POST;
+        proxy_pass http://backend/;
+    }
+}
+CONF
+
+# --- server ------------------------------------------------------------------
+for port in "$UPSTREAM_PORT" $((UPSTREAM_PORT + 1)); do
+    "$ROOT_DIR/bench/upstream_stub.py" "$port" > /dev/null 2>&1 &
+    UPSTREAM_PIDS="$UPSTREAM_PIDS $!"
+done
+"$WEBSERV" "$WORK/bench.conf" > "$WORK/webserv.log" 2>&1 &
+SERVER_PID=$!
+for _ in $(seq 1 50); do
+    if (exec 3<>"/dev/tcp/127.0.0.1/$PORT") 2>/dev/null; then
+        break
+    fi
+    sleep 0.1
+done
+if ! kill -0 "$SERVER_PID" 2>/dev/null; then
+    echo "bench: Webserv failed to start, log follows" >&2
+    cat "$WORK/webserv.log" >&2
+    exit 1
+fi
+
+# --- scenarios -----------------------------------------------------------
+run() {
+    local name="$1"
+    shift
+    if [ -n "$ONLY" ] && [[ "$name" != *$ONLY* ]]; then
+        return
+    fi
+    local line
+    line="$("$LOADGEN" -p "$PORT" -d "$DURATION" -n "$name" -g "$TAG" -s "$SERVER_PID" "$@")"
+    echo "$line" | tee -a "$OUT"
+}
+
+# The server closes after every response, so keep-alive and pipelined runs reconnect
+# per request; loadgen reports them with "keepalive":false and a note until it doesn't
+run static_small     -c "$CONNS" -r "GET /small.html"
+run static_pipelined -c "$CONNS" -P 8 -r "GET /small.html"
+run static_large     -c "$CONNS" -r "GET /large.bin"
+run static_close     -c "$CONNS" -C -r "GET /small.html"
+run upload           -c "$CONNS" -b "$WORK/upload.body" \
+                     -t "multipart/form-data; boundary=$BOUNDARY" -r "POST /uploads"
+run dirlist          -c "$CONNS" -r "GET /listing/"
+run cgi              -c "$CONNS" -r "GET /cgi-bin/hello.py"
+run cgi_cached       -c "$CONNS" -r "GET /cgi-cached/hello.py"
+run proxy            -c "$CONNS" -r "GET /proxy/hello"
+run proxy_stream     -c "$CONNS" -r "GET /proxy/stream?bytes=1048576"
+run proxy_upload     -c "$CONNS" -b "$WORK/upload.body" -r "POST /proxy/echo"
+run mixed            -c "$CONNS" -r "GET /small.html 8" -r "GET /large.bin 1" \
+                     -r "GET /listing/ 1" -r "GET /cgi-bin/hello.py 1"
+
+echo "bench: results appended to $OUT" >&2
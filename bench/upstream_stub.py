@@ -0,0 +1,82 @@
+#!/usr/bin/python3
+"""Minimal keep-alive HTTP/1.1 backend for exercising proxy_pass.
+
+Usage: upstream_stub.py PORT
+
+  GET  /any/path          small text body naming the port and path
+  GET  /stream?bytes=N    N bytes sent with chunked transfer coding
+  POST /echo              echoes the request body (Content-Length or chunked)
+  GET  /slow?ms=N         answers after N milliseconds
+"""
+
+import sys
+import time
+from http.server import BaseHTTPRequestHandler, ThreadingHTTPServer
+from urllib.parse import urlsplit, parse_qs
+
+
+class Handler(BaseHTTPRequestHandler):
+    protocol_version = "HTTP/1.1"
+    disable_nagle_algorithm = True
+
+    def log_message(self, fmt, *args):
+        pass
+
+    def _query(self, name, default):
+        values = parse_qs(urlsplit(self.path).query).get(name)
+        return int(values[0]) if values else default
+
+    def _read_body(self):
+        if "chunked" in self.headers.get("Transfer-Encoding", ""):
+            body = b""
+            while True:
+                size = int(self.rfile.readline().split(b";")[0], 16)
+                if size == 0:
+                    while self.rfile.readline() not in (b"\r\n", b"\n", b""):
+                        pass
+                    return body
+                body += self.rfile.read(size)
+                self.rfile.readline()
+        return self.rfile.read(int(self.headers.get("Content-Length", 0)))
+
+    def _send(self, status, body, content_type="text/plain"):
+        self.send_response(status)
+        self.send_header("Content-Type", content_type)
+        self.send_header("Content-Length", str(len(body)))
+        self.end_headers()
+        if self.command != "HEAD":
+            self.wfile.write(body)
+
+    def do_GET(self):
+        path = urlsplit(self.path).path
+        if path.endswith("/stream"):
+            remaining = self._query("bytes", 1 << 20)
+            self.send_response(200)
+            self.send_header("Content-Type", "application/octet-stream")
+            self.send_header("Transfer-Encoding", "chunked")
+            self.end_headers()
+            block = b"x" * 16384
+            while remaining > 0:
+                piece = block[:min(remaining, len(block))]
+                self.wfile.write(b"%x\r\n%s\r\n" % (len(piece), piece))
+                remaining -= len(piece)
+            self.wfile.write(b"0\r\n\r\n")
+            return
+        if path.endswith("/slow"):
+            time.sleep(self._query("ms", 1000) / 1000.0)
+        body = "upstream %d %s %s\n" % (self.server.server_port, self.command, self.path)
+        body += "x-forwarded-for: %s\n" % self.headers.get("X-Forwarded-For", "")
+        self._send(200, body.encode())
+
+    do_HEAD = do_GET
+
+    def do_POST(self):
+        self._send(200, self._read_body(), "application/octet-stream")
+
+    do_PUT = do_POST
+
+
+if __name__ == "__main__":
+    ThreadingHTTPServer.daemon_threads = True
+    ThreadingHTTPServer.request_queue_size = 128
+    ThreadingHTTPServer(("127.0.0.1", int(sys.argv[1])), Handler).serve_forever()
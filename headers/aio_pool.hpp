@@ -0,0 +1,150 @@
+/* ************************************************************************** */
+/*                                                                            */
+/*                                                        :::      ::::::::   */
+/*   aio_pool.hpp                                       :+:      :+:    :+:   */
+/*                                                    +:+ +:+         +:+     */
+/*   By: aogbi <aogbi@student.42.fr>                +#+  +:+       +#+        */
+/*                                                +#+#+#+#+#+   +#+           */
+/*   Created: 2026/10/19 00:00:00 by aogbi             #+#    #+#             */
+/*   Updated: 2026/10/19 00:00:00 by aogbi            ###   ########.fr       */
+/*                                                                            */
+/* ************************************************************************** */
+
+#ifndef AIO_POOL_HPP
+#define AIO_POOL_HPP
+
+#include <string>
+#include <vector>
+#include <deque>
+#include <pthread.h>
+#include <stdint.h>
+#include "open_file_cache.hpp"
+#include "directory_listing.hpp"
+#include "upload_writer.hpp"
+#include "body_source.hpp"
+
+/**
+ * @brief File system work of one request, run away from the poll loop
+ *
+ * The HttpHandler fills in the inputs, a worker makes the blocking calls
+ * and fills in the results, and the HttpHandler turns those into the
+ * response back on the loop thread. Workers never touch the caches: what
+ * they load is stored by the loop once the task completes.
+ */
+struct AioTask {
+    enum Kind {
+        AIO_SERVE,      // stat and open path (and the index of a directory), read the file
+        AIO_LIST,       // read the entries of a directory
+        AIO_DELETE,     // unlink an uploaded file
+        AIO_UPLOAD,     // create the upload directory and write the file
+        AIO_SYNC        // make the files of an upload_fsync batch durable
+    };
+
+    Kind kind;
+    int clientFd;
+    bool cancelled;             // the client went away; the result only updates the caches
+    uint64_t started;           // Metrics::nowMicros() when the request was handled
+
+    // Inputs
+    std::string path;           // file, directory or upload target
+    std::string indexPath;      // index file tried when path is a directory
+    std::string dir;            // upload directory
+    std::string requestPath;
+    std::string query;
+    std::string filename;
+    BodySource body;            // request body holding the uploaded file
+    size_t dataOffset;          // where the file content sits in it
+    size_t dataLength;
+    bool head;
+    bool loaded;                // file came from the open_file_cache, only read it
+    UploadWriter::CacheMode cacheMode;
+    UploadWriter::FsyncPolicy fsync;
+
+    // Results
+    OpenFile file;
+    OpenFile index;
+    std::string content;
+    std::vector<DirectoryEntry> entries;
+    int error;                  // errno of a failed delete, upload, sync or listing
+    std::vector<AioTask*> batch;    // AIO_SYNC: the written uploads, owned, each given its sync error
+
+    AioTask* next;              // completion list link
+
+    explicit AioTask(Kind kind);
+    ~AioTask();
+
+    /**
+     * @brief Make the blocking calls; runs on a worker thread
+     * @param writer The calling thread's writer (it keeps an O_DIRECT buffer)
+     */
+    void run(UploadWriter& writer);
+
+    /**
+     * @brief Whether a directory is served through its index file
+     */
+    bool servesIndex() const;
+
+    /**
+     * @brief The file whose content is sent: the index of a directory, or the file itself
+     */
+    OpenFile& readTarget() { return servesIndex() ? index : file; }
+};
+
+/**
+ * @brief Worker threads for blocking file system calls (aio threads)
+ *
+ * Tasks wait in a bounded queue under a mutex; submit() fails once
+ * max_queue tasks are waiting and the caller runs the task itself.
+ * Finished tasks are pushed on a lock-free list, and the push that finds
+ * the list empty writes the eventfd, so the poll loop wakes once per
+ * batch and takes the whole list with a single compare-and-swap.
+ */
+class AioPool {
+private:
+    pthread_mutex_t lock;
+    pthread_cond_t wake;
+    std::deque<AioTask*> queue;
+    std::vector<pthread_t> threads;
+    size_t maxQueue;
+    bool stopping;
+    AioTask* volatile completed;    // pushed by workers, taken by the loop
+    int eventFd;
+
+    static void* workerMain(void* arg);
+    void work();
+    void complete(AioTask* task);
+
+    AioPool(const AioPool&);
+    AioPool& operator=(const AioPool&);
+
+public:
+    AioPool();
+    ~AioPool();
+
+    /**
+     * @param threadCount Worker threads (thread_pool threads=)
+     * @param maxQueue Tasks that may wait for a worker (thread_pool max_queue=)
+     * @return false if the eventfd or the first thread could not be created
+     */
+    bool start(size_t threadCount, size_t maxQueue);
+
+    /**
+     * @brief Join the workers; tasks still queued are dropped
+     */
+    void stop();
+
+    bool running() const { return eventFd >= 0; }
+    int getEventFd() const { return eventFd; }
+
+    /**
+     * @return false when the queue is full
+     */
+    bool submit(AioTask* task);
+
+    /**
+     * @brief Collect finished tasks in completion order; call when the eventfd is readable
+     */
+    void takeCompleted(std::vector<AioTask*>& out);
+};
+
+#endif // AIO_POOL_HPP
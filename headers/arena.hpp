@@ -0,0 +1,151 @@
+/* ************************************************************************** */
+/*                                                                            */
+/*                                                        :::      ::::::::   */
+/*   arena.hpp                                          :+:      :+:    :+:   */
+/*                                                    +:+ +:+         +:+     */
+/*   By: aogbi <aogbi@student.42.fr>                +#+  +:+       +#+        */
+/*                                                +#+#+#+#+#+   +#+           */
+/*   Created: 2026/10/19 00:00:00 by aogbi             #+#    #+#             */
+/*   Updated: 2026/10/19 00:00:00 by aogbi            ###   ########.fr       */
+/*                                                                            */
+/* ************************************************************************** */
+
+#ifndef ARENA_HPP
+#define ARENA_HPP
+
+#include <cstddef>
+#include <new>
+#include <string>
+#include <map>
+#include <functional>
+
+/**
+ * @brief Bump-pointer allocator for data that dies all at once
+ *
+ * Allocations advance a cursor through the caller's inline storage, then
+ * through heap blocks of growing size; nothing is freed one by one.
+ * reset() drops every block and rewinds to the inline storage, so an
+ * object that embeds its storage allocates nothing in the common case.
+ * Whatever lives in the arena must be destroyed before the reset.
+ */
+class Arena {
+private:
+    struct Block {
+        Block* next;
+    };
+
+    char* initial;
+    size_t initialSize;
+    char* cursor;
+    char* limit;
+    Block* blocks;
+    size_t nextBlockSize;
+
+    static const size_t ALIGN = 2 * sizeof(void*);
+    static const size_t FIRST_BLOCK = 4096;
+    static const size_t MAX_BLOCK = 64 * 1024;
+
+    void* grow(size_t size);
+    void* newBlock(size_t size);
+
+    Arena(const Arena&);
+    Arena& operator=(const Arena&);
+
+public:
+    /**
+     * @param storage Inline storage used before any heap block, or NULL
+     */
+    Arena(char* storage = NULL, size_t size = 0);
+    ~Arena();
+
+    void* allocate(size_t size) {
+        size = (size + ALIGN - 1) & ~(ALIGN - 1);
+        if (size > static_cast<size_t>(limit - cursor)) {
+            return grow(size);
+        }
+        void* p = cursor;
+        cursor += size;
+        return p;
+    }
+
+    /**
+     * @brief Free every heap block and start over in the inline storage
+     */
+    void reset();
+};
+
+/**
+ * @brief Standard allocator handing out arena memory
+ *
+ * deallocate() is a no-op: memory comes back with Arena::reset(). A
+ * default-constructed allocator has no arena and uses the heap, so
+ * containers built without one behave like their std:: counterparts.
+ */
+template <class T>
+class ArenaAllocator {
+public:
+    typedef T value_type;
+    typedef T* pointer;
+    typedef const T* const_pointer;
+    typedef T& reference;
+    typedef const T& const_reference;
+    typedef size_t size_type;
+    typedef ptrdiff_t difference_type;
+
+    template <class U>
+    struct rebind {
+        typedef ArenaAllocator<U> other;
+    };
+
+    ArenaAllocator(Arena* arena = NULL) : arena(arena) {}
+    template <class U>
+    ArenaAllocator(const ArenaAllocator<U>& other) : arena(other.getArena()) {}
+
+    Arena* getArena() const { return arena; }
+
+    pointer address(reference value) const { return &value; }
+    const_pointer address(const_reference value) const { return &value; }
+    size_type max_size() const { return static_cast<size_type>(-1) / sizeof(T); }
+
+    pointer allocate(size_type count, const void* = 0) {
+        if (!arena) {
+            return static_cast<pointer>(::operator new(count * sizeof(T)));
+        }
+        return static_cast<pointer>(arena->allocate(count * sizeof(T)));
+    }
+
+    void deallocate(pointer p, size_type) {
+        if (!arena) {
+            ::operator delete(p);
+        }
+    }
+
+    void construct(pointer p, const T& value) { new (static_cast<void*>(p)) T(value); }
+    void destroy(pointer p) { p->~T(); }
+
+private:
+    Arena* arena;
+};
+
+template <class T, class U>
+bool operator==(const ArenaAllocator<T>& a, const ArenaAllocator<U>& b) {
+    return a.getArena() == b.getArena();
+}
+
+template <class T, class U>
+bool operator!=(const ArenaAllocator<T>& a, const ArenaAllocator<U>& b) {
+    return a.getArena() != b.getArena();
+}
+
+typedef std::basic_string<char, std::char_traits<char>, ArenaAllocator<char> > ArenaString;
+typedef std::map<ArenaString, ArenaString, std::less<ArenaString>,
+                 ArenaAllocator<std::pair<const ArenaString, ArenaString> > > ArenaHeaderMap;
+
+/**
+ * @brief Copy an arena string out to the heap, for callers that keep it
+ */
+inline std::string toStdString(const ArenaString& value) {
+    return std::string(value.data(), value.length());
+}
+
+#endif // ARENA_HPP
@@ -0,0 +1,84 @@
+/* ************************************************************************** */
+/*                                                                            */
+/*                                                        :::      ::::::::   */
+/*   body_framing.hpp                                   :+:      :+:    :+:   */
+/*                                                    +:+ +:+         +:+     */
+/*   By: aogbi <aogbi@student.42.fr>                +#+  +:+       +#+        */
+/*                                                +#+#+#+#+#+   +#+           */
+/*   Created: 2026/10/19 00:00:00 by aogbi             #+#    #+#             */
+/*   Updated: 2026/10/19 00:00:00 by aogbi            ###   ########.fr       */
+/*                                                                            */
+/* ************************************************************************** */
+
+#ifndef BODY_FRAMING_HPP
+#define BODY_FRAMING_HPP
+
+#include <cstddef>
+#include <string>
+#include <stdint.h>
+
+/**
+ * @brief Incremental scanner for the chunked transfer coding
+ *
+ * Follows chunk boundaries without copying or decoding the data, so a
+ * chunked body can be relayed verbatim while we still learn where it ends.
+ */
+class ChunkedScanner {
+private:
+    enum State {
+        SIZE, EXTENSION, SIZE_LF, DATA, DATA_CR, DATA_LF,
+        TRAILER_START, TRAILER_LINE, FINAL_LF, DONE, FAILED
+    };
+
+    State state;
+    uint64_t remaining;
+    bool sawDigit;
+
+    void endSizeLine();
+
+public:
+    ChunkedScanner();
+
+    /**
+     * @brief Advance over the next bytes of the body
+     * @param payload When set, receives the chunk data without the framing
+     * @return How many of the bytes belong to the body (less than length
+     *         only once the terminating chunk has been seen)
+     */
+    size_t feed(const char* data, size_t length, std::string* payload = NULL);
+    bool done() const { return state == DONE; }
+    bool failed() const { return state == FAILED; }
+};
+
+/**
+ * @brief Tracks where an HTTP message body ends
+ */
+class BodyFraming {
+public:
+    enum Mode { NONE, LENGTH, CHUNKED, UNTIL_CLOSE };
+
+private:
+    Mode mode;
+    uint64_t remaining;
+    ChunkedScanner chunks;
+
+public:
+    BodyFraming() : mode(NONE), remaining(0) {}
+
+    void setNone() { mode = NONE; }
+    void setLength(uint64_t length) { mode = LENGTH; remaining = length; }
+    void setChunked() { mode = CHUNKED; chunks = ChunkedScanner(); }
+    void setUntilClose() { mode = UNTIL_CLOSE; }
+    Mode getMode() const { return mode; }
+
+    /**
+     * @brief Account for received bytes
+     * @return How many of them belong to this body; the rest is whatever
+     *         the peer sent after the message
+     */
+    size_t consume(const char* data, size_t length);
+    bool complete() const;
+    bool failed() const { return mode == CHUNKED && chunks.failed(); }
+};
+
+#endif // BODY_FRAMING_HPP
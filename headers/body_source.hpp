@@ -0,0 +1,85 @@
+/* ************************************************************************** */
+/*                                                                            */
+/*                                                        :::      ::::::::   */
+/*   body_source.hpp                                    :+:      :+:    :+:   */
+/*                                                    +:+ +:+         +:+     */
+/*   By: aogbi <aogbi@student.42.fr>                +#+  +:+       +#+        */
+/*                                                +#+#+#+#+#+   +#+           */
+/*   Created: 2026/10/19 00:00:00 by aogbi             #+#    #+#             */
+/*   Updated: 2026/10/19 00:00:00 by aogbi            ###   ########.fr       */
+/*                                                                            */
+/* ************************************************************************** */
+
+#ifndef BODY_SOURCE_HPP
+#define BODY_SOURCE_HPP
+
+#include <string>
+#include <sys/types.h>
+#include "string_view.hpp"
+
+/**
+ * @brief A request body held in memory or spooled to a temporary file
+ *
+ * The file is created with O_TMPFILE (or unlinked right after creation
+ * where the file system lacks it), so it has no name and goes away with
+ * its last descriptor. Copies share the file through a descriptor of
+ * their own, which makes handing a large body to a CGI session or a
+ * worker thread cost a dup(). Only the original appends.
+ */
+class BodySource {
+private:
+    std::string memory;
+    int fd;                         // spool file, -1 while the body is in memory
+    size_t fileLength;
+    mutable const char* mapped;     // the file as mapped by view(), NULL until then
+    mutable size_t mappedLength;
+
+    void unmap() const;
+
+public:
+    BodySource();
+    BodySource(const BodySource& other);
+    BodySource& operator=(const BodySource& other);
+    ~BodySource();
+
+    size_t size() const { return fd >= 0 ? fileLength : memory.length(); }
+    bool empty() const { return size() == 0; }
+    bool spooled() const { return fd >= 0; }
+
+    /**
+     * @brief Replace the body with bytes kept in memory
+     */
+    void assign(const char* data, size_t length);
+
+    /**
+     * @brief Add bytes at the end, written through to the file once spooled
+     * @return false if the file could not take them
+     */
+    bool append(const char* data, size_t length);
+
+    /**
+     * @brief Move the body, and everything appended later, to a temporary file in dir
+     * @return false if the file could not be created or written
+     */
+    bool spool(const std::string& dir);
+
+    void clear();
+    void swap(BodySource& other);
+
+    /**
+     * @brief The whole body; a spooled one is mapped read-only on first use
+     * @return An empty view if the mapping fails
+     */
+    StringView view() const;
+
+    /**
+     * @brief Copy part of the body to a descriptor, like write(2)
+     *
+     * A spooled body goes through splice() (sendfile() where outFd is not
+     * a pipe), so its bytes never pass through user space.
+     * @return Bytes written, or -1 with errno set (EAGAIN when outFd is full)
+     */
+    ssize_t writeTo(int outFd, size_t offset, size_t count) const;
+};
+
+#endif // BODY_SOURCE_HPP
@@ -0,0 +1,59 @@
+/* ************************************************************************** */
+/*                                                                            */
+/*                                                        :::      ::::::::   */
+/*   byte_scan.hpp                                      :+:      :+:    :+:   */
+/*                                                    +:+ +:+         +:+     */
+/*   By: aogbi <aogbi@student.42.fr>                +#+  +:+       +#+        */
+/*                                                +#+#+#+#+#+   +#+           */
+/*   Created: 2026/10/19 00:00:00 by aogbi             #+#    #+#             */
+/*   Updated: 2026/10/19 00:00:00 by aogbi            ###   ########.fr       */
+/*                                                                            */
+/* ************************************************************************** */
+
+#ifndef BYTE_SCAN_HPP
+#define BYTE_SCAN_HPP
+
+#include <cstddef>
+
+/**
+ * @brief Delimiter search and token validation over request heads
+ *
+ * Each scan looks at 32 bytes per step with AVX2 or 16 with SSE2, picked
+ * once at startup from what the CPU supports, and falls back to a byte
+ * loop elsewhere (and for the last few bytes of a buffer). Results do not
+ * depend on the level in use.
+ */
+class ByteScan {
+public:
+    enum Level { SCALAR, SSE2, AVX2 };
+
+    static const size_t npos = static_cast<size_t>(-1);
+
+    static Level level();
+    static const char* levelName(Level level);
+
+    /**
+     * @brief Switch implementations, for benchmarks
+     * @return false if the CPU cannot run that level
+     */
+    static bool setLevel(Level level);
+
+    /**
+     * @brief Offset of the blank line ending a head: the first "\r\n\r\n", else the first "\n\n"
+     * @param separator Set to the length of the blank line found, 4 or 2
+     * @return npos if there is neither
+     */
+    static size_t findHeadEnd(const char* data, size_t length, size_t& separator);
+
+    /**
+     * @brief Offset of the first ':' or '\n', or length if there is none
+     */
+    static size_t findColonOrNewline(const char* data, size_t length);
+
+    /**
+     * @brief Whether the bytes form a non-empty token (RFC 9110 tchar)
+     */
+    static bool isToken(const char* data, size_t length);
+};
+
+#endif // BYTE_SCAN_HPP
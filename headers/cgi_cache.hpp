@@ -0,0 +1,116 @@
+/* ************************************************************************** */
+/*                                                                            */
+/*                                                        :::      ::::::::   */
+/*   cgi_cache.hpp                                      :+:      :+:    :+:   */
+/*                                                    +:+ +:+         +:+     */
+/*   By: aogbi <aogbi@student.42.fr>                +#+  +:+       +#+        */
+/*                                                +#+#+#+#+#+   +#+           */
+/*   Created: 2026/10/19 00:00:00 by aogbi             #+#    #+#             */
+/*   Updated: 2026/10/19 00:00:00 by aogbi            ###   ########.fr       */
+/*                                                                            */
+/* ************************************************************************** */
+
+#ifndef CGI_CACHE_HPP
+#define CGI_CACHE_HPP
+
+#include <string>
+#include <ctime>
+#include <stdint.h>
+#include "request.hpp"
+
+/**
+ * @brief CGI response cache in a shared-memory zone
+ *
+ * The zone is one MAP_SHARED anonymous mapping created before any worker
+ * is forked, so every process started from the server sees the same
+ * entries; the reactors of worker_threads share a single CgiCache. It is split into fixed-size slots (entry header, key, serialized
+ * response); a key hashes to a short window of slots and the least recently
+ * used one in that window is replaced. A process-shared robust mutex guards
+ * the zone.
+ *
+ * Coalescing: the first miss for a key marks the slot FILLING with its pid
+ * and thread id. Other lookups of that key are told to wait and retry
+ * instead of running the script too; the fill is taken over after
+ * LOCK_TIMEOUT or if the filling process died.
+ */
+class CgiCache {
+public:
+    enum Lookup {
+        HIT,        // response copied out
+        FILL,       // caller runs the script, then calls store() or abandon()
+        BYPASS      // caller runs the script and does not store the result
+    };
+
+private:
+    struct Zone;
+    struct Slot;
+
+    Zone* zone;
+    size_t mappedBytes;
+
+    static const size_t PROBE_WINDOW = 8;
+    static const int LOCK_TIMEOUT = 5;
+
+    Slot* slotAt(size_t index) const;
+    Slot* findSlot(uint64_t hash, const std::string& key) const;
+    Slot* victimSlot(uint64_t hash, time_t now) const;
+    static bool keyEquals(const Slot* slot, const std::string& key);
+    static bool fillerAlive(const Slot* slot, time_t now);
+    static bool ownsFill(const Slot* slot);
+
+    void lock();
+    void unlock();
+
+    CgiCache(const CgiCache&);
+    CgiCache& operator=(const CgiCache&);
+
+public:
+    CgiCache();
+    ~CgiCache();
+
+    /**
+     * @brief Map the shared zone
+     * @param zoneBytes Total size of the zone
+     * @param entryBytes Largest key + response that can be stored
+     * @return false if the mapping or mutex setup failed
+     */
+    bool init(size_t zoneBytes, size_t entryBytes);
+    bool enabled() const { return zone != NULL; }
+
+    /**
+     * @brief Build a cache key from an nginx-style template
+     *
+     * Recognized variables: $request_method, $request_uri, $uri, $args,
+     * $host and $http_<header> (dashes written as underscores).
+     */
+    static std::string buildKey(const std::string& keyTemplate, const Request& req);
+
+    /**
+     * @brief TTL a CGI response may be cached for
+     * @param response Serialized response
+     * @param defaultTtl Location's cgi_cache TTL
+     * @return Seconds to keep it, 0 if the response must not be cached
+     */
+    static int responseTtl(const std::string& response, int defaultTtl);
+
+    /**
+     * @brief Look a key up without blocking
+     * @param key Cache key
+     * @param response Receives the cached response on HIT
+     * @param waiting Set (with BYPASS) while another request fills the key;
+     *                the caller parks the request and retries later
+     */
+    Lookup acquire(const std::string& key, std::string& response, bool& waiting);
+
+    /**
+     * @brief Publish the response for a key acquired with FILL
+     */
+    void store(const std::string& key, const std::string& response, int ttl);
+
+    /**
+     * @brief Release a FILL without storing anything
+     */
+    void abandon(const std::string& key);
+};
+
+#endif // CGI_CACHE_HPP
@@ -6,7 +6,7 @@
 /*   By: aogbi <aogbi@student.42.fr>                +#+  +:+       +#+        */
 /*                                                +#+#+#+#+#+   +#+           */
 /*   Created: 2025/09/06 00:00:00 by aogbi             #+#    #+#             */
-/*   Updated: 2025/09/06 10:58:47 by aogbi            ###   ########.fr       */
+/*   Updated: 2026/10/19 00:00:00 by aogbi            ###   ########.fr       */
 /*                                                                            */
 /* ************************************************************************** */
 
@@ -16,36 +16,156 @@
 #include <string>
 #include <vector>
 #include <map>
+#include <ctime>
+#include <stdint.h>
+#include <sys/types.h>
 #include "request.hpp"
+#include "response.hpp"
 #include "config.hpp"
+#include "metrics.hpp"
+#include "cgi_cache.hpp"
+#include "cgi_spawner.hpp"
+#include "connection_manager.hpp"
 
+/**
+ * @brief Runs CGI scripts as part of the poll loop
+ *
+ * The request body is written to the script's stdin and its stdout is read
+ * through non-blocking pipes watched by the ConnectionManager. The CGI
+ * header block is parsed as it arrives; once it ends the response head is
+ * sent and the body is forwarded as the script produces it, chunked for
+ * HTTP/1.1 clients unless the script sets Content-Length. Reading stops
+ * while the client has more than HIGH_WATER bytes queued.
+ *
+ * Requests for a cgi_cache key that is being filled are parked and retried
+ * instead of blocking the loop.
+ */
 class CgiHandler {
 private:
+    struct Session {
+        int clientFd;
+        pid_t pid;
+        bool warmChild;
+        std::string interpreter;
+        int stdinFd;                // -1 once the body is written
+        int stdoutFd;
+        BodySource body;            // fed to stdin, spliced from its file when spooled
+        size_t bodyOffset;
+        
+        std::string head;           // script output until the end of its header block
+        bool headersSent;
+        bool chunked;
+        bool headRequest;
+        bool clientHttp11;
+        bool paused;
+        
+        std::string cacheKey;       // set while this script fills a cgi_cache slot
+        int cacheTtl;
+        Response cacheHead;
+        std::string cacheBody;
+        bool cacheOverflow;
+        
+        uint64_t startMicros;
+    };
+    
+    struct Waiter {
+        int clientFd;
+        Request req;
+        const Location* location;
+        std::string key;
+    };
+    
     const Config& config;
+    Metrics& metrics;
+    ConnectionManager* connections;
+    CgiCache& cache;                // shared by every reactor
+    CgiSpawner spawner;
+    std::map<int, Session*> byClient;
+    std::map<int, Session*> byPipe;
+    std::vector<Waiter> waiters;
+    std::map<const Location*, std::vector<std::string> > envTemplates;
+    
+    static const size_t HIGH_WATER = 256 * 1024;
+    static const size_t MAX_CGI_HEAD = 64 * 1024;
     
     /**
-     * @brief Set up CGI environment variables
+     * @brief Build a script's environment: the location's template plus the request's variables
+     * @param arena Holds the request's entries, in one block, and the pointer array
      * @param req The HTTP request
+     * @param location The matched location block
      * @param scriptPath Path to the CGI script
-     * @return Vector of environment variables
+     * @param pathInfo What follows the script in the request path
+     * @param client The connection the request came in on, for REMOTE_ADDR and REMOTE_PORT
+     * @return NULL-terminated array for execve, valid while the arena is
      */
-    std::vector<std::string> setupCgiEnvironment(const Request& req, const std::string& scriptPath);
+    char** setupCgiEnvironment(Arena& arena, const Request& req, const Location* location,
+                               const std::string& scriptPath, const std::string& pathInfo,
+                               const ClientConnection* client);
     
     /**
-     * @brief Convert vector of strings to char* array for execve
-     * @param env Vector of environment variables
-     * @return char* array (must be freed after use)
+     * @brief The entries every script under a location gets, built on first use
+     *
+     * Server variables, DOCUMENT_ROOT and the parent environment variables a
+     * script may need (PATH, locale, time zone and interpreter search paths).
+     */
+    const std::vector<std::string>& envTemplate(const Location* location);
+    
+    /**
+     * @brief Map a request path to the script file under the location root
+     * @param path The request path
+     * @param location The matched location block
+     * @return Filesystem path of the script
      */
-    char** vectorToCharArray(const std::vector<std::string>& env);
+    std::string resolveScriptPath(const std::string& path, const Location* location);
     
     /**
-     * @brief Free char* array
-     * @param arr The array to free
+     * @brief Length of the part of a path naming the script: up to the first
+     *        segment ending in a CGI extension, the rest being PATH_INFO
+     * @return StringView::npos if no segment has a CGI extension
      */
-    void freeCharArray(char** arr);
+    static size_t scriptLength(const StringView& path, const Location* location);
+    
+    /**
+     * @brief Serve a request from cgi_cache, park it, or start its script
+     * @return false if the request was parked behind another fill
+     */
+    bool dispatch(int clientFd, const Request& req, const Location* location);
+    
+    /**
+     * @brief Spawn the interpreter for a script and register its pipes
+     * @param cacheKey Non-empty when the output should fill that cache key
+     * @return Error response, or an empty string once the script is running
+     */
+    std::string runScript(int clientFd, const Request& req, const Location* location, const std::string& cacheKey);
+    
+    /**
+     * @brief Parse a CGI header block (Status, Content-Type, ...) into a response
+     * @return true if the script set Content-Length
+     */
+    bool parseCgiHeaders(const std::string& headers, Response& response);
+    
+    void respond(int clientFd, const std::string& response);
+    
+    // These return false once the session has been finished or destroyed
+    bool readScript(Session* session);
+    bool sendHead(Session* session, size_t headerEnd);
+    bool forwardBody(Session* session, const char* data, size_t length);
+    
+    void writeScript(Session* session);
+    void closeStdin(Session* session);
+    void finishScript(Session* session);
+    std::string releaseCache(Session* session, bool success);
+    void destroy(Session* session, bool terminate);
+    void retryWaiters(const std::string& key);
 
 public:
-    CgiHandler(const Config& config);
+    CgiHandler(const Config& config, Metrics& metrics, CgiCache& cache);
+    
+    /**
+     * @brief Start cgi_warm interpreters and build the environment templates
+     * @param manager Poll set the script pipes are registered with
+     */
+    void setup(ConnectionManager* manager);
     
     /**
      * @brief Check if a request should be handled by CGI
@@ -53,7 +173,7 @@ public:
      * @param location The matched location block
      * @return true if CGI should handle this request
      */
-    bool isCgiRequest(const std::string& path, const Location* location);
+    bool isCgiRequest(const StringView& path, const Location* location);
     
     /**
      * @brief Get the CGI interpreter for a file extension
@@ -64,13 +184,32 @@ public:
     std::string getCgiInterpreter(const std::string& extension, const Location* location);
     
     /**
-     * @brief Execute CGI script and return the output
-     * @param scriptPath Path to the CGI script
+     * @brief Answer a complete CGI request
+     *
+     * The response is queued on the client as it is produced; the
+     * connection is finished once the script's output has been forwarded.
+     * @param clientFd Client socket
      * @param req The HTTP request
      * @param location The matched location block
-     * @return CGI output as HTTP response
      */
-    std::string executeCgi(const std::string& scriptPath, const Request& req, const Location* location);
+    void start(int clientFd, const Request& req, const Location* location);
+    
+    bool hasSession(int clientFd) const;
+    bool ownsFd(int fd) const { return byPipe.find(fd) != byPipe.end(); }
+    bool hasWaiters() const { return !waiters.empty(); }
+    
+    void onClientDrained(int clientFd);
+    void onClientClosed(int clientFd);
+    
+    /**
+     * @brief Dispatch poll events for a script's stdin or stdout pipe
+     */
+    void handleEvent(int fd, short revents);
+    
+    /**
+     * @brief Retry requests parked behind a cgi_cache fill in another process
+     */
+    void handleTimeouts();
 };
 
 #endif // CGI_HANDLER_HPP
@@ -0,0 +1,86 @@
+/* ************************************************************************** */
+/*                                                                            */
+/*                                                        :::      ::::::::   */
+/*   cgi_spawner.hpp                                    :+:      :+:    :+:   */
+/*                                                    +:+ +:+         +:+     */
+/*   By: aogbi <aogbi@student.42.fr>                +#+  +:+       +#+        */
+/*                                                +#+#+#+#+#+   +#+           */
+/*   Created: 2026/10/19 00:00:00 by aogbi             #+#    #+#             */
+/*   Updated: 2026/10/19 00:00:00 by aogbi            ###   ########.fr       */
+/*                                                                            */
+/* ************************************************************************** */
+
+#ifndef CGI_SPAWNER_HPP
+#define CGI_SPAWNER_HPP
+
+#include <string>
+#include <map>
+#include <sys/types.h>
+
+/**
+ * @brief Starts CGI processes without forking the server image
+ *
+ * Cold spawns go through posix_spawn, which glibc implements with a
+ * CLONE_VFORK child that shares the parent's memory until exec, so the
+ * cost does not grow with the server's RSS.
+ *
+ * Extensions listed in cgi_warm are served by a warm interpreter: a small
+ * Python zygote started once at setup (before any cache is allocated) that
+ * forks an already initialized child per request. The server hands it the
+ * script, the environment and the two pipe ends over a SOCK_SEQPACKET
+ * socket (the descriptors travel as SCM_RIGHTS); the zygote answers with
+ * the child's pid and later with its wait status.
+ */
+class CgiSpawner {
+private:
+    struct WarmInterpreter {
+        pid_t pid;
+        int fd;
+        std::map<pid_t, int> exited;    // statuses read while waiting for something else
+    };
+
+    std::map<std::string, WarmInterpreter> warm;
+
+    bool launchWarm(const std::string& interpreter, WarmInterpreter& zygote);
+    void stopWarm(WarmInterpreter& zygote);
+    bool readMessage(WarmInterpreter& zygote, char& type, pid_t& pid, int& status);
+    pid_t spawnWarm(WarmInterpreter& zygote, const std::string& scriptFile, char** envp,
+                    int stdinFd, int stdoutFd);
+
+    CgiSpawner(const CgiSpawner&);
+    CgiSpawner& operator=(const CgiSpawner&);
+
+public:
+    CgiSpawner();
+    ~CgiSpawner();
+
+    /**
+     * @brief Start a warm interpreter (Python only)
+     * @param interpreter Interpreter path from cgi_path
+     * @return false if the interpreter is not Python or failed to start
+     */
+    bool startWarm(const std::string& interpreter);
+
+    /**
+     * @brief Start a CGI process
+     * @param interpreter Interpreter path
+     * @param scriptFile Script on disk
+     * @param envp Environment for the script
+     * @param stdinFd Becomes the child's stdin
+     * @param stdoutFd Becomes the child's stdout
+     * @param useWarm Fork from the warm interpreter if one is running
+     * @param warmChild Set when the child belongs to a warm interpreter
+     * @return Child pid, or -1 on failure
+     */
+    pid_t spawn(const std::string& interpreter, const std::string& scriptFile, char** envp,
+                int stdinFd, int stdoutFd, bool useWarm, bool& warmChild);
+
+    /**
+     * @brief Wait for a spawned CGI process to exit
+     * @param status Receives the wait status
+     * @return false if the status could not be collected
+     */
+    bool wait(const std::string& interpreter, pid_t pid, bool warmChild, int& status);
+};
+
+#endif // CGI_SPAWNER_HPP
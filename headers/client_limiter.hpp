@@ -0,0 +1,85 @@
+/* ************************************************************************** */
+/*                                                                            */
+/*                                                        :::      ::::::::   */
+/*   client_limiter.hpp                                 :+:      :+:    :+:   */
+/*                                                    +:+ +:+         +:+     */
+/*   By: aogbi <aogbi@student.42.fr>                +#+  +:+       +#+        */
+/*                                                +#+#+#+#+#+   +#+           */
+/*   Created: 2026/10/19 00:00:00 by aogbi             #+#    #+#             */
+/*   Updated: 2026/10/19 00:00:00 by aogbi            ###   ########.fr       */
+/*                                                                            */
+/* ************************************************************************** */
+
+#ifndef CLIENT_LIMITER_HPP
+#define CLIENT_LIMITER_HPP
+
+#include <cstddef>
+#include <stdint.h>
+#include <pthread.h>
+
+/**
+ * @brief Per-client connection counts and request token buckets
+ *
+ * One fixed array of 32-byte entries sized from limit_zone, allocated at
+ * setup and never grown. An entry is keyed by (IPv4 address, zone), where
+ * zone 0 holds the connection count and the server-wide limit_req bucket
+ * and zone N + 1 the bucket of location N when it has its own limit_req.
+ * A key hashes to a window of PROBE_WINDOW entries; when none matches, an
+ * empty entry or the least recently used one without open connections is
+ * taken over, so every check touches a bounded number of entries.
+ *
+ * Buckets hold milli-requests: a request costs 1000, capacity is
+ * (burst + 1) * 1000 and they refill at the configured rate.
+ *
+ * The reactors of worker_threads share one table, so a client's limits
+ * hold whichever reactor its connections land on; a mutex guards it.
+ */
+class ClientLimiter {
+private:
+    struct Entry;
+
+    Entry* entries;
+    size_t entryCount;
+    uint64_t clock;                 // LRU stamp source
+    size_t connectionLimit;
+    pthread_mutex_t lock;
+
+    static const size_t PROBE_WINDOW = 8;
+
+    Entry* find(uint32_t addr, uint32_t zone, bool create);
+    bool takeToken(Entry* entry, int rate, size_t burst);
+
+    ClientLimiter(const ClientLimiter&);
+    ClientLimiter& operator=(const ClientLimiter&);
+
+public:
+    ClientLimiter();
+    ~ClientLimiter();
+
+    /**
+     * @brief Allocate the table
+     * @param zoneBytes Memory for the table (limit_zone)
+     * @param connLimit Connections allowed per address, 0 = unlimited
+     */
+    void init(size_t zoneBytes, size_t connLimit);
+    bool enabled() const { return entries != NULL; }
+    bool limitsConnections() const { return entries != NULL && connectionLimit > 0; }
+
+    /**
+     * @brief Count a new connection from an address
+     * @return false if the address is already at limit_conn
+     */
+    bool acquireConnection(uint32_t addr);
+    void releaseConnection(uint32_t addr);
+
+    /**
+     * @brief Take one request from an address's bucket
+     * @param zone 0 for the server's limit_req, location index + 1 otherwise
+     * @param rate Refill rate in milli-requests per second
+     * @param burst Requests allowed above the rate
+     * @return false if the request must be rejected
+     */
+    bool allowRequest(uint32_t addr, uint32_t zone, int rate, size_t burst);
+};
+
+#endif // CLIENT_LIMITER_HPP
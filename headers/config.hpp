@@ -6,7 +6,7 @@
 /*   By: aogbi <aogbi@student.42.fr>                +#+  +:+       +#+        */
 /*                                                +#+#+#+#+#+   +#+           */
 /*   Created: 2025/09/06 00:00:00 by aogbi             #+#    #+#             */
-/*   Updated: 2025/09/06 10:58:47 by aogbi            ###   ########.fr       */
+/*   Updated: 2026/10/19 00:00:00 by aogbi            ###   ########.fr       */
 /*                                                                            */
 /* ************************************************************************** */
 
@@ -20,6 +20,9 @@
 #include <sstream>
 #include <iostream>
 #include <stdint.h>
+#include "mime_types.hpp"
+#include "upload_writer.hpp"
+#include "string_view.hpp"
 
 struct Location {
     std::string path;
@@ -30,28 +33,92 @@ struct Location {
     std::string redirect;
     std::vector<std::string> cgiPath;
     std::vector<std::string> cgiExt;
+    std::vector<std::string> cgiWarmExt;    // extensions run by a pre-started interpreter
     std::string uploadDir;
+    UploadWriter::CacheMode uploadCache;
+    UploadWriter::FsyncPolicy uploadFsync;
+    bool stubStatus;
+    size_t autoindexPageSize;
+    std::string proxyPass;      // "http://host:port[/prefix]" or "http://upstream_name[/prefix]"
+    int proxyTimeout;           // seconds without upstream progress before 504
+    int cgiCacheTtl;            // 0 = CGI responses are not cached
+    std::string cgiCacheKey;
+    int limitReqRate;           // milli-requests per second; -1 = server's limit_req, 0 = off
+    size_t limitReqBurst;
     
-    Location() : autoindex(false) {}
+    Location() : autoindex(false), uploadCache(UploadWriter::CACHE_KEEP), uploadFsync(UploadWriter::FSYNC_OFF),
+                 stubStatus(false), autoindexPageSize(1000), proxyTimeout(60),
+                 cgiCacheTtl(0), cgiCacheKey("$request_method$request_uri"),
+                 limitReqRate(-1), limitReqBurst(0) {}
+};
+
+struct Upstream {
+    std::string name;
+    std::vector<std::string> servers;   // "host:port"
+    bool leastConn;
+    size_t keepalive;                   // idle connections kept per server
+    
+    Upstream() : leastConn(false), keepalive(32) {}
 };
 
 class Config {
 private:
     std::string configFile;
     uint16_t port;
+    bool ssl;                   // listen PORT ssl
+    std::string sslCertificate;
+    std::string sslCertificateKey;
+    size_t sslSessionCache;     // sessions kept for resumption by id, 0 = off
+    int sslSessionTimeout;
+    bool sslSessionTickets;
+    bool sslKtls;
+    bool http2;                 // h2 via ALPN, h2c by prior knowledge or Upgrade
     std::string serverName;
     std::string host;
     std::string root;
     std::string index;
     std::map<int, std::string> errorPages;
-    size_t clientMaxBodySize;
+    size_t clientMaxBodySize;   // 0 = unlimited
+    size_t largeHeaderBuffers;
+    size_t largeHeaderBufferSize;
+    int clientHeaderTimeout;
+    int clientBodyTimeout;
+    size_t clientBodyMinRate;   // bytes per second, 0 = only idle bodies time out
+    size_t clientBodyBufferSize;    // larger bodies are spooled to a file, 0 = never
+    std::string clientBodyTempPath;
+    size_t openFileCacheMax;    // 0 = open_file_cache off
+    int openFileCacheInactive;
+    int openFileCacheValid;
+    bool openFileCacheErrors;
+    bool aioThreads;            // aio threads: file system calls run on the thread pool
+    size_t threadPoolThreads;
+    size_t threadPoolMaxQueue;
+    bool ioUring;               // event_backend io_uring, falls back to poll where unavailable
+    size_t workerThreads;       // reactor threads, each with its own listener and connections
     std::vector<Location> locations;
+    std::map<std::string, Upstream> upstreams;
+    MimeTypes mimeTypes;
+    bool typesConfigured;
+    size_t cgiCacheZoneSize;
+    size_t cgiCacheEntrySize;
+    size_t limitZoneSize;
+    size_t limitConn;           // connections per client address, 0 = unlimited
+    int limitReqRate;           // milli-requests per second, 0 = off
+    size_t limitReqBurst;
     
     // Helper methods
     std::string trim(const std::string& str);
     std::string removeSemicolon(const std::string& str);
+    std::string resolveIncludePath(const std::string& path) const;
+    void parseTypesEntry(const std::string& type, std::istringstream& extensions);
+    bool parseTypesFile(const std::string& path);
+    static size_t parseSize(const std::string& value);
+    static int parseSeconds(const std::string& value);
+    static bool parseLimitReq(std::istringstream& args, int& rate, size_t& burst);
 
 public:
+    static const int MAX_WORKER_THREADS = 256;   // reader slots of the EpochDomain
+    
     Config(const std::string& configFile);
     
     // Parse configuration file
@@ -59,17 +126,49 @@ public:
     
     // Getters
     uint16_t getPort() const { return port; }
+    bool isSsl() const { return ssl; }
+    const std::string& getSslCertificate() const { return sslCertificate; }
+    const std::string& getSslCertificateKey() const { return sslCertificateKey; }
+    size_t getSslSessionCache() const { return sslSessionCache; }
+    int getSslSessionTimeout() const { return sslSessionTimeout; }
+    bool getSslSessionTickets() const { return sslSessionTickets; }
+    bool getSslKtls() const { return sslKtls; }
+    bool getHttp2() const { return http2; }
     const std::string& getServerName() const { return serverName; }
     const std::string& getHost() const { return host; }
     const std::string& getRoot() const { return root; }
     const std::string& getIndex() const { return index; }
     const std::map<int, std::string>& getErrorPages() const { return errorPages; }
     size_t getClientMaxBodySize() const { return clientMaxBodySize; }
+    size_t getLargeHeaderBuffers() const { return largeHeaderBuffers; }
+    size_t getLargeHeaderBufferSize() const { return largeHeaderBufferSize; }
+    int getClientHeaderTimeout() const { return clientHeaderTimeout; }
+    int getClientBodyTimeout() const { return clientBodyTimeout; }
+    size_t getClientBodyMinRate() const { return clientBodyMinRate; }
+    size_t getClientBodyBufferSize() const { return clientBodyBufferSize; }
+    const std::string& getClientBodyTempPath() const { return clientBodyTempPath; }
+    size_t getOpenFileCacheMax() const { return openFileCacheMax; }
+    int getOpenFileCacheInactive() const { return openFileCacheInactive; }
+    int getOpenFileCacheValid() const { return openFileCacheValid; }
+    bool getOpenFileCacheErrors() const { return openFileCacheErrors; }
+    bool getAioThreads() const { return aioThreads; }
+    size_t getThreadPoolThreads() const { return threadPoolThreads; }
+    size_t getThreadPoolMaxQueue() const { return threadPoolMaxQueue; }
+    bool getIoUring() const { return ioUring; }
+    size_t getWorkerThreads() const { return workerThreads; }
     const std::vector<Location>& getLocations() const { return locations; }
+    const std::map<std::string, Upstream>& getUpstreams() const { return upstreams; }
+    const MimeTypes& getMimeTypes() const { return mimeTypes; }
+    size_t getCgiCacheZoneSize() const { return cgiCacheZoneSize; }
+    size_t getCgiCacheEntrySize() const { return cgiCacheEntrySize; }
+    size_t getLimitZoneSize() const { return limitZoneSize; }
+    size_t getLimitConn() const { return limitConn; }
+    int getLimitReqRate() const { return limitReqRate; }
+    size_t getLimitReqBurst() const { return limitReqBurst; }
     
     // Location methods
-    const Location* findLocation(const std::string& path) const;
-    bool isMethodAllowed(const std::string& method, const Location* loc) const;
+    const Location* findLocation(const StringView& path) const;
+    bool isMethodAllowed(const StringView& method, const Location* loc) const;
 };
 
 #endif // CONFIG_HPP
@@ -6,7 +6,7 @@
 /*   By: aogbi <aogbi@student.42.fr>                +#+  +:+       +#+        */
 /*                                                +#+#+#+#+#+   +#+           */
 /*   Created: 2025/09/06 00:00:00 by aogbi             #+#    #+#             */
-/*   Updated: 2025/09/12 17:56:39 by aogbi            ###   ########.fr       */
+/*   Updated: 2026/10/19 00:00:00 by aogbi            ###   ########.fr       */
 /*                                                                            */
 /* ************************************************************************** */
 
@@ -18,28 +18,165 @@
 #include <poll.h>
 #include <ctime>
 #include <string>
+#include <stdint.h>
+#include <sys/types.h>
+#include "metrics.hpp"
+#include "client_limiter.hpp"
+#include "tls_context.hpp"
+#include "event_ring.hpp"
+#include "body_source.hpp"
+
+/**
+ * @brief How much and how slowly a client may send a request
+ *
+ * Header lines longer than headerLineSize or a header block over
+ * headerBlockSize are refused (414/431) as soon as the limit is crossed,
+ * and so is a buffered body over maxBodySize (413). The header block must
+ * arrive within headerTimeout seconds of the accept; the body must keep
+ * up bodyMinRate bytes per second over every bodyTimeout window (408).
+ * A body bigger than bodyBufferSize is spooled to a file in bodyTempPath.
+ */
+struct RequestLimits {
+    size_t headerLineSize;      // large_client_header_buffers SIZE
+    size_t headerBlockSize;     // large_client_header_buffers N * SIZE
+    size_t maxBodySize;         // client_max_body_size, 0 = unlimited
+    int headerTimeout;
+    int bodyTimeout;
+    size_t bodyMinRate;
+    size_t bodyBufferSize;      // client_body_buffer_size, 0 = always in memory
+    std::string bodyTempPath;   // client_body_temp_path
+
+    RequestLimits() : headerLineSize(8192), headerBlockSize(4 * 8192), maxBodySize(1000000),
+                      headerTimeout(10), bodyTimeout(10), bodyMinRate(1024), bodyBufferSize(128 * 1024),
+                      bodyTempPath("/tmp") {}
+};
 
 struct ClientConnection {
     int fd;
-    std::string buffer;
+    std::string buffer;       // request head; the body too when proxied, until spoolBody() otherwise
+    BodySource body;          // body bytes taken out of buffer by spoolBody()
     time_t lastActivity;
-    bool requestComplete;
+    time_t acceptedAt;
+    bool requestComplete;     // whole request read (or, when proxied, relayed)
+    size_t headerEnd;         // offset past the blank line, npos while headers arrive
+    size_t lineStart;         // start of the first header line not yet checked
+    time_t rateWindowStart;   // min-rate window for the header and body phases
+    size_t rateWindowBytes;
+    bool headersRouted;       // request line/headers already checked for a proxy location
+    std::string remoteAddr;
+    uint16_t remotePort;
+    uint32_t peerAddr;        // IPv4 address in network order, the limit_conn/limit_req key
+    bool countedByLimiter;
+    std::string outBuffer;    // queued response bytes not yet accepted by the socket
+    size_t outOffset;
+    bool closeAfterWrite;
+    uint64_t writeStart;
+    SSL* ssl;                 // set on a listen ... ssl server
+    bool handshaking;
+    int parentFd;             // HTTP/2 connection carrying this stream client, -1 for sockets
+    size_t streams;           // stream clients open on an HTTP/2 connection
     
-    ClientConnection() : fd(-1), lastActivity(0), requestComplete(false) {}
-    ClientConnection(int socket_fd) : fd(socket_fd), lastActivity(time(NULL)), requestComplete(false) {}
+    ClientConnection() : fd(-1), lastActivity(0), acceptedAt(0), requestComplete(false),
+                         headerEnd(std::string::npos), lineStart(0), rateWindowStart(0), rateWindowBytes(0),
+                         headersRouted(false), remotePort(0), peerAddr(0), countedByLimiter(false), outOffset(0),
+                         closeAfterWrite(false), writeStart(0), ssl(NULL), handshaking(false), parentFd(-1),
+                         streams(0) {}
+    ClientConnection(int socket_fd) : fd(socket_fd), lastActivity(time(NULL)), acceptedAt(lastActivity),
+                                      requestComplete(false), headerEnd(std::string::npos), lineStart(0),
+                                      rateWindowStart(lastActivity), rateWindowBytes(0), headersRouted(false),
+                                      remotePort(0), peerAddr(0), countedByLimiter(false), outOffset(0),
+                                      closeAfterWrite(false), writeStart(0), ssl(NULL), handshaking(false),
+                                      parentFd(-1), streams(0) {}
+
+    size_t pendingOutput() const { return outBuffer.length() - outOffset; }
 };
 
 class ConnectionManager {
 private:
     std::map<int, ClientConnection> clients;
     std::vector<struct pollfd> pollFds;
+    std::map<int, size_t> pollIndex;    // fd -> slot in pollFds
+    Metrics& metrics;
+    RequestLimits limits;
+    ClientLimiter* limiter;
+    TlsContext* tls;
+    EventRing* ring;
+    int nextStreamId;
+    std::vector<int> streamUpdates;     // stream clients with new output or removed
     static const int CLIENT_TIMEOUT = 30;
+
+    void addPollFd(int fd, short events, bool receive = false);
+    void removePollFd(int fd);
+    bool tooSlow(ClientConnection& client, time_t now);
+    void rejectRequest(int clientFd, int statusCode, const std::string& message);
+    ssize_t transmit(ClientConnection& client, const char* data, size_t length);
     
 public:
-    ConnectionManager(int serverFd);
-    void addClient(int clientFd);
+    /**
+     * @param ring With event_backend io_uring: mirrors the poll set, reads plain clients and closes them
+     */
+    ConnectionManager(int serverFd, Metrics& metrics, const RequestLimits& limits, ClientLimiter* limiter = NULL,
+                      TlsContext* tls = NULL, EventRing* ring = NULL);
+
+    /**
+     * @brief Register an accepted client
+     *
+     * A client over limit_conn gets a fixed 503 written straight to the
+     * socket (just a close under TLS) and is closed without ever entering
+     * the poll set. On a TLS server the client starts out handshaking.
+     * @param clientFd Accepted socket, already non-blocking and close-on-exec
+     * @param peerAddr IPv4 address in network order
+     * @param remotePort Client port, host order
+     * @return false if the connection was refused
+     */
+    bool addClient(int clientFd, const std::string& remoteAddr = "", uint32_t peerAddr = 0, uint16_t remotePort = 0);
     void removeClient(int clientFd);
     
+    /**
+     * @brief Register an HTTP/2 stream as a client of its own
+     *
+     * Stream clients get negative ids, so they never collide with a
+     * descriptor, and are never polled: queued output stays in their
+     * outBuffer until the Http2Handler frames it, and finishing the
+     * response only marks it. They go away with their connection.
+     * @return Id of the stream client
+     */
+    int addStream(int parentFd);
+    
+    /**
+     * @brief Collect stream clients that got output, finished or were removed since the last call
+     */
+    void takeStreamUpdates(std::vector<int>& ids);
+    
+    /**
+     * @brief Advance a client's TLS handshake, waiting for POLLIN or POLLOUT as OpenSSL asks
+     * @return false if the handshake failed
+     */
+    bool continueHandshake(int clientFd);
+    
+    /**
+     * @brief Read request bytes, decrypting on TLS connections
+     *
+     * With the ring's multishot recv, plain clients never get here: their
+     * bytes come with RingEvents::received.
+     * @return Like read(2); -1 with EAGAIN when nothing can be read yet
+     */
+    ssize_t receive(int clientFd, char* buffer, size_t length);
+
+    /**
+     * @brief Watch a non-client descriptor (upstream socket, pipe) in the poll set
+     * @param fd Descriptor owned by the caller; it is never closed here
+     * @param events Initial poll events
+     */
+    void addWatch(int fd, short events) { addPollFd(fd, events); }
+    void removeWatch(int fd) { removePollFd(fd); }
+    
+    /**
+     * @brief Replace the poll events of a client or watched descriptor
+     */
+    void setEvents(int fd, short events);
+    short getEvents(int fd) const;
+    
     /**
      * @brief Get the poll file descriptors
      * @return Reference to the poll fds vector
@@ -51,13 +188,78 @@ public:
      * @return Reference to the clients map
      */
     std::map<int, ClientConnection>& getClients() { return clients; }
-    void handleTimeouts();
+    ClientConnection* findClient(int clientFd);
+
+    /**
+     * @brief Drop idle clients and answer 408 to ones sending a request too slowly
+     *
+     * A slow client whose response has already started is closed instead.
+     * @return Descriptors that were closed or answered, so their owners can clean up
+     */
+    std::vector<int> handleTimeouts();
+
+    /**
+     * @brief Check newly buffered request bytes against the RequestLimits
+     *
+     * Scans only the header lines not seen before and sets headerEnd once
+     * the blank line arrives. An oversized request is answered right away.
+     * @return false if the request was rejected
+     */
+    bool checkRequestLimits(int clientFd);
+    /**
+     * @brief Move body bytes past headerEnd from the buffer into the client's BodySource
+     *
+     * The body stays in memory up to bodyBufferSize and is spooled to a
+     * temporary file beyond that, so a large body costs no more memory
+     * than a small one. Not for proxied requests, which relay the buffer.
+     * @return false if the body could not be spooled
+     */
+    bool spoolBody(ClientConnection& client);
+
     /**
      * @brief Check if HTTP request is complete
      * @param buffer The request buffer
+     * @param spooled Body bytes already moved out of the buffer
      * @return true if request is complete
      */
-    bool isRequestComplete(const std::string& buffer); 
+    bool isRequestComplete(const std::string& buffer, size_t spooled = 0);
+
+    /**
+     * @brief Offset just past the blank line ending the request headers
+     * @return Header length, or std::string::npos if headers are incomplete
+     */
+    static size_t findHeaderEnd(const std::string& buffer);
+
+    /**
+     * @brief Queue bytes for a client and try to send them right away
+     *
+     * Client sockets are non-blocking: whatever the kernel does not accept
+     * stays in the client's outBuffer and POLLOUT is enabled until it drains.
+     * @return false if the connection failed and was not removed yet
+     */
+    bool queueWrite(int clientFd, const char* data, size_t length);
+    bool queueWrite(int clientFd, const std::string& data) { return queueWrite(clientFd, data.c_str(), data.length()); }
+
+    /**
+     * @brief Send as much queued output as the socket accepts
+     * @return false on a socket error
+     */
+    bool flush(int clientFd);
+
+    /**
+     * @brief Mark the current response as complete
+     *
+     * The connection is closed as soon as the queued output has drained,
+     * which may be right away.
+     */
+    void finishResponse(int clientFd);
+
+    /**
+     * @brief Close a finished connection whose output has drained
+     * @return true if the client was removed
+     */
+    bool closeIfFlushed(int clientFd);
+
     /**
      * @brief Send error response to client
      * @param clientFd Client socket file descriptor
@@ -69,8 +271,9 @@ public:
     /**
      * @brief Update client activity timestamp
      * @param clientFd Client socket file descriptor
+     * @param bytesRead Request bytes just read, counted toward the min-rate window
      */
-    void updateClientActivity(int clientFd);
+    void updateClientActivity(int clientFd, size_t bytesRead = 0);
 };
 
 #endif // CONNECTION_MANAGER_HPP
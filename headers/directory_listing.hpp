@@ -0,0 +1,119 @@
+/* ************************************************************************** */
+/*                                                                            */
+/*                                                        :::      ::::::::   */
+/*   directory_listing.hpp                              :+:      :+:    :+:   */
+/*                                                    +:+ +:+         +:+     */
+/*   By: aogbi <aogbi@student.42.fr>                +#+  +:+       +#+        */
+/*                                                +#+#+#+#+#+   +#+           */
+/*   Created: 2026/10/19 00:00:00 by aogbi             #+#    #+#             */
+/*   Updated: 2026/10/19 00:00:00 by aogbi            ###   ########.fr       */
+/*                                                                            */
+/* ************************************************************************** */
+
+#ifndef DIRECTORY_LISTING_HPP
+#define DIRECTORY_LISTING_HPP
+
+#include <string>
+#include <vector>
+#include <map>
+#include <ctime>
+#include <stdint.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include "metrics.hpp"
+
+struct DirectoryEntry {
+    std::string name;
+    off_t size;
+    time_t mtime;
+    bool isDir;
+
+    DirectoryEntry() : size(0), mtime(0), isDir(false) {}
+};
+
+/**
+ * @brief Autoindex options taken from the query string
+ *
+ * Recognized parameters: sort=name|size|mtime, order=asc|desc,
+ * page=N (1-based) and format=html|json.
+ */
+struct ListingOptions {
+    enum SortKey { SORT_NAME, SORT_SIZE, SORT_MTIME };
+
+    SortKey sort;
+    bool descending;
+    size_t page;
+    size_t pageSize;
+    bool json;
+
+    ListingOptions() : sort(SORT_NAME), descending(false), page(1), pageSize(0), json(false) {}
+    static ListingOptions fromQuery(const std::string& query, size_t pageSize);
+};
+
+/**
+ * @brief Per-directory cache of autoindex snapshots
+ *
+ * A snapshot holds the sorted entries of a directory with their size and
+ * mtime. It stays valid as long as the directory's own mtime and inode are
+ * unchanged, so a cache hit costs only the stat() the caller already did.
+ * Only the requested page is rendered.
+ */
+class DirectoryListingCache {
+private:
+    struct Snapshot {
+        time_t mtimeSec;
+        long mtimeNsec;
+        ino_t inode;
+        std::vector<DirectoryEntry> entries;  // directories first, then by name
+        std::vector<uint32_t> bySize;         // built on first use
+        std::vector<uint32_t> byMtime;        // built on first use
+        unsigned long lastUsed;
+
+        Snapshot() : mtimeSec(0), mtimeNsec(0), inode(0), lastUsed(0) {}
+    };
+
+    std::map<std::string, Snapshot> snapshots;
+    size_t maxDirectories;
+    unsigned long useClock;
+    Metrics& metrics;
+
+    void fill(Snapshot& snapshot, const struct stat& dirStat);
+    const std::vector<uint32_t>* sortOrder(Snapshot& snapshot, ListingOptions::SortKey key);
+    void evictIfFull();
+
+    static void renderHtml(std::string& out, const Snapshot& snapshot, const std::vector<uint32_t>* order,
+                           const std::string& requestPath, const ListingOptions& opts,
+                           size_t first, size_t last, size_t pages);
+    static void renderJson(std::string& out, const Snapshot& snapshot, const std::vector<uint32_t>* order,
+                           const std::string& requestPath, const ListingOptions& opts,
+                           size_t first, size_t last, size_t pages);
+
+public:
+    DirectoryListingCache(Metrics& metrics, size_t maxDirectories = 64);
+
+    /**
+     * @brief Render one page of a directory listing
+     * @param dirPath Directory on disk
+     * @param dirStat stat() result the caller already has for dirPath
+     * @param requestPath URL path of the directory
+     * @param opts Sorting, paging and output format
+     * @param out Receives the rendered page
+     * @param scanned Entries already read with scan(), used instead of reading the directory
+     * @return false if the directory could not be read
+     */
+    bool render(const std::string& dirPath, const struct stat& dirStat, const std::string& requestPath,
+                const ListingOptions& opts, std::string& out, std::vector<DirectoryEntry>* scanned = NULL);
+
+    /**
+     * @brief Whether render() can answer from the snapshot without reading the directory
+     */
+    bool isFresh(const std::string& dirPath, const struct stat& dirStat) const;
+
+    /**
+     * @brief Read a directory's entries with their size and mtime, sorted by name
+     * @return false if the directory could not be opened
+     */
+    static bool scan(const std::string& dirPath, std::vector<DirectoryEntry>& entries);
+};
+
+#endif // DIRECTORY_LISTING_HPP
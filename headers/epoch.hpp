@@ -0,0 +1,92 @@
+/* ************************************************************************** */
+/*                                                                            */
+/*                                                        :::      ::::::::   */
+/*   epoch.hpp                                          :+:      :+:    :+:   */
+/*                                                    +:+ +:+         +:+     */
+/*   By: aogbi <aogbi@student.42.fr>                +#+  +:+       +#+        */
+/*                                                +#+#+#+#+#+   +#+           */
+/*   Created: 2026/10/19 00:00:00 by aogbi             #+#    #+#             */
+/*   Updated: 2026/10/19 00:00:00 by aogbi            ###   ########.fr       */
+/*                                                                            */
+/* ************************************************************************** */
+
+#ifndef EPOCH_HPP
+#define EPOCH_HPP
+
+#include <vector>
+#include <pthread.h>
+
+/**
+ * @brief Deferred reclamation for structures read without locks (quiescent-state RCU)
+ *
+ * Readers are the reactor threads. Each one announces a quiescent state at
+ * the top of its loop, where it holds no pointer into a shared structure,
+ * and goes offline while it blocks in poll() so an idle reactor never holds
+ * reclamation up. A writer unlinks an object and retires it; the object is
+ * only reclaimed once every online reader has announced the epoch opened by
+ * that retire. Reads cost nothing but the once-per-iteration store.
+ */
+class EpochDomain {
+public:
+    typedef void (*Reclaim)(void* object);
+    static const int MAX_READERS = 256;
+
+private:
+    // One cache line per reader: announcing must not bounce the other readers' lines
+    struct Reader {
+        unsigned long epoch;    // last epoch seen at a quiescent point, 0 while offline
+        char pad[64 - sizeof(unsigned long)];
+    };
+
+    struct Retired {
+        void* object;
+        Reclaim reclaim;
+        unsigned long epoch;
+    };
+
+    Reader* readers;                // MAX_READERS of them, on a cache line boundary
+    int readerCount;
+    unsigned long epoch;
+    unsigned long pending;          // retired objects not reclaimed yet
+    std::vector<Retired> retired;
+    pthread_mutex_t lock;
+
+    unsigned long oldestSeen() const;
+    void reclaimLocked();
+
+    EpochDomain(const EpochDomain&);
+    EpochDomain& operator=(const EpochDomain&);
+
+public:
+    EpochDomain();
+    ~EpochDomain();
+
+    /**
+     * @brief Take a reader slot; called before the reader threads start
+     * @return Slot index, -1 when all MAX_READERS are taken
+     */
+    int addReader();
+
+    /**
+     * @brief The reader holds no shared pointer; reclaims what that releases
+     */
+    void quiescent(int reader);
+
+    /**
+     * @brief The reader is about to block and holds no shared pointer until online()
+     */
+    void offline(int reader);
+    void online(int reader);
+
+    /**
+     * @brief Hand an unlinked object over; reclaim(object) runs once no reader can see it
+     */
+    void retire(void* object, Reclaim reclaim);
+
+    /**
+     * @brief Reclaim the retired objects every online reader is past
+     */
+    void reclaim();
+};
+
+#endif // EPOCH_HPP
@@ -0,0 +1,203 @@
+/* ************************************************************************** */
+/*                                                                            */
+/*                                                        :::      ::::::::   */
+/*   event_ring.hpp                                     :+:      :+:    :+:   */
+/*                                                    +:+ +:+         +:+     */
+/*   By: aogbi <aogbi@student.42.fr>                +#+  +:+       +#+        */
+/*                                                +#+#+#+#+#+   +#+           */
+/*   Created: 2026/10/19 00:00:00 by aogbi             #+#    #+#             */
+/*   Updated: 2026/10/19 00:00:00 by aogbi            ###   ########.fr       */
+/*                                                                            */
+/* ************************************************************************** */
+
+#ifndef EVENT_RING_HPP
+#define EVENT_RING_HPP
+
+#include <cstddef>
+#include <map>
+#include <set>
+#include <vector>
+#include <poll.h>
+#include <stdint.h>
+#include <sys/types.h>
+#include <linux/io_uring.h>
+
+/**
+ * @brief Bytes a multishot recv delivered, valid until the next EventRing::wait()
+ */
+struct RingRecv {
+    int fd;
+    const char* data;
+    ssize_t length;             // 0 at end of stream, -errno on error
+};
+
+/**
+ * @brief A file read submitted with EventRing::read() that has finished
+ */
+struct RingRead {
+    void* owner;
+    ssize_t result;             // bytes read, or -errno if nothing could be read
+};
+
+/**
+ * @brief What one EventRing::wait() collected
+ */
+struct RingEvents {
+    std::vector<struct pollfd> ready;   // readiness, as poll() would report it
+    std::vector<int> accepted;          // sockets from the multishot accept, non-blocking and close-on-exec
+    std::vector<RingRecv> received;
+    std::vector<RingRead> reads;
+
+    void clear() { ready.clear(); accepted.clear(); received.clear(); reads.clear(); }
+};
+
+/**
+ * @brief io_uring event backend (event_backend io_uring)
+ *
+ * Mirrors the ConnectionManager's poll set: every descriptor gets a
+ * one-shot poll request that is re-armed after it fires, and all new
+ * requests, re-arms and cancellations go to the kernel with the wait
+ * itself, so one io_uring_enter replaces the poll() of each iteration.
+ * On top of readiness:
+ *
+ * - The listening socket (a registered file) has a multishot accept, so
+ *   new connections arrive without an accept() call each.
+ * - Plain client sockets read through a multishot recv into a ring of
+ *   provided buffers, so request bytes arrive without a read() each.
+ * - Closes of client sockets and reads of static files are queued too.
+ *
+ * init() fails on kernels without io_uring (or where it is filtered),
+ * and the server keeps using poll(). Multishot accept and recv fall back
+ * to readiness on their own when the kernel refuses them.
+ */
+class EventRing {
+private:
+    enum OpKind { OP_POLL, OP_RECV, OP_ACCEPT, OP_READ };
+
+    struct Op {
+        OpKind kind;
+        int fd;
+        unsigned serial;        // of the watch it was armed for
+        void* owner;            // OP_READ
+        char* buffer;
+        size_t length;
+        size_t done;
+    };
+
+    struct Watch {
+        unsigned serial;        // tells a reused descriptor from the one late completions belong to
+        short events;
+        bool receive;           // POLLIN is served by a multishot recv
+        Op* poll;
+        short pollMask;
+        Op* recv;
+
+        Watch() : serial(0), events(0), receive(false), poll(NULL), pollMask(0), recv(NULL) {}
+    };
+
+    int ringFd;
+    int enterFd;                // registered ring index, or ringFd
+    unsigned enterFlags;
+    void* sqRing;
+    size_t sqRingSize;
+    void* cqRing;
+    size_t cqRingSize;
+    struct io_uring_sqe* sqes;
+    size_t sqesSize;
+    unsigned* sqHead;
+    unsigned* sqTail;
+    unsigned sqMask;
+    unsigned sqEntries;
+    unsigned sqLocalTail;
+    unsigned* cqHead;
+    unsigned* cqTail;
+    unsigned cqMask;
+    struct io_uring_cqe* cqes;
+    bool disabled;              // created with IORING_SETUP_R_DISABLED, until start()
+
+    struct io_uring_buf* bufRing;           // provided buffer ring; the tail overlays bufRing[0].resv
+    char* bufMemory;
+    unsigned short bufTail;
+    std::vector<unsigned short> handedOut;  // buffers delivered by the last wait()
+
+    int listenFd;
+    bool listenFixed;                       // registered as fixed file 0
+    Op* acceptOp;
+    unsigned nextSerial;
+    bool acceptMultishot;
+    bool recvMultishot;
+    std::map<int, Watch> watches;
+    std::set<int> dirty;                    // watches to arm or re-arm before waiting
+
+    static const unsigned ENTRIES = 1024;
+    static const unsigned CQ_ENTRIES = 8192;
+    static const unsigned BUFFER_COUNT = 256;
+    static const size_t BUFFER_SIZE = 16384;
+    static const unsigned short BUFFER_GROUP = 0;
+
+    bool setupRings(const struct io_uring_params& params);
+    bool setupBuffers();
+    void release();
+    struct io_uring_sqe* nextSqe();
+    int enter(unsigned minComplete, unsigned flags, void* arg, size_t argSize);
+    Op* newOp(OpKind kind, int fd, unsigned serial);
+    void submitPoll(Watch& watch, int fd, short mask);
+    void submitRecv(Watch& watch, int fd);
+    void submitAccept();
+    void submitRead(Op* op);
+    void cancel(Op* op);
+    void arm(int fd);
+    void provide(unsigned short bufferId);
+    void publishBuffers();
+    void complete(const struct io_uring_cqe& cqe, RingEvents& out);
+
+    EventRing(const EventRing&);
+    EventRing& operator=(const EventRing&);
+
+public:
+    EventRing();
+    ~EventRing();
+
+    /**
+     * @param listenFd Listening socket, registered and served by a multishot accept
+     * @return false if io_uring (or a feature the loop relies on) is unavailable
+     */
+    bool init(int listenFd);
+
+    /**
+     * @brief Enable the ring on the thread that will drive it, before the first wait()
+     *
+     * The single issuer and the registered ring descriptor both belong to
+     * the calling thread, so init() may run on another one.
+     */
+    bool start();
+    bool enabled() const { return ringFd >= 0; }
+
+    /**
+     * @brief Start watching a descriptor, like adding its pollfd entry
+     * @param receive Plain client socket: deliver POLLIN as received bytes
+     */
+    void watch(int fd, short events, bool receive = false);
+    void setEvents(int fd, short events);
+    void unwatch(int fd);
+
+    /**
+     * @brief Close an unwatched descriptor from the ring, after its requests are cancelled
+     */
+    void closeFd(int fd);
+
+    /**
+     * @brief Read length bytes from offset 0 of a file; reported in RingEvents::reads
+     */
+    void read(int fd, char* buffer, size_t length, void* owner);
+
+    /**
+     * @brief Submit pending requests and wait for completions
+     *
+     * Buffers of the previous RingEvents::received are given back first.
+     * @return Number of events collected, 0 on timeout or signal, -1 with errno on failure
+     */
+    int wait(int timeoutMs, RingEvents& out);
+};
+
+#endif // EVENT_RING_HPP
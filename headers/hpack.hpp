@@ -0,0 +1,101 @@
+/* ************************************************************************** */
+/*                                                                            */
+/*                                                        :::      ::::::::   */
+/*   hpack.hpp                                          :+:      :+:    :+:   */
+/*                                                    +:+ +:+         +:+     */
+/*   By: aogbi <aogbi@student.42.fr>                +#+  +:+       +#+        */
+/*                                                +#+#+#+#+#+   +#+           */
+/*   Created: 2026/10/19 00:00:00 by aogbi             #+#    #+#             */
+/*   Updated: 2026/10/19 00:00:00 by aogbi            ###   ########.fr       */
+/*                                                                            */
+/* ************************************************************************** */
+
+#ifndef HPACK_HPP
+#define HPACK_HPP
+
+#include <string>
+#include <vector>
+#include <deque>
+#include <utility>
+#include <cstddef>
+
+typedef std::pair<std::string, std::string> HeaderField;
+typedef std::vector<HeaderField> HeaderList;
+
+/**
+ * @brief Static plus dynamic header table shared by the HPACK coder pair
+ *
+ * Indices are 1-based: the 61 static entries come first, then the dynamic
+ * ones from newest to oldest. Entries cost their name and value length
+ * plus 32 bytes, and the oldest ones are evicted to stay under maxSize.
+ */
+class HpackTable {
+private:
+    std::deque<HeaderField> entries;
+    size_t size;
+    size_t maxSize;
+
+    void evict(size_t limit);
+
+public:
+    static const size_t STATIC_COUNT = 61;
+
+    explicit HpackTable(size_t maxSize = 4096) : size(0), maxSize(maxSize) {}
+
+    bool get(size_t index, HeaderField& field) const;
+    void add(const std::string& name, const std::string& value);
+    void resize(size_t newMaxSize);
+    size_t getMaxSize() const { return maxSize; }
+
+    /**
+     * @brief Find a header in the table
+     * @param exact Set when the value matches too
+     * @return Index of the best match, or 0 if even the name is unknown
+     */
+    size_t find(const std::string& name, const std::string& value, bool& exact) const;
+};
+
+/**
+ * @brief Header block decoder for one HTTP/2 connection (RFC 7541)
+ */
+class HpackDecoder {
+private:
+    HpackTable table;
+    size_t settingsLimit;       // our SETTINGS_HEADER_TABLE_SIZE
+
+public:
+    HpackDecoder() : table(4096), settingsLimit(4096) {}
+
+    /**
+     * @brief Decode a complete header block
+     * @return false on a compression error, which is fatal for the connection
+     */
+    bool decode(const unsigned char* data, size_t length, HeaderList& headers);
+};
+
+/**
+ * @brief Header block encoder for one HTTP/2 connection
+ *
+ * Headers that repeat between responses (server, content-type, ...) are
+ * added to the dynamic table so later responses send them as one byte;
+ * per-response values like date and content-length are sent literally
+ * without being indexed. Strings are Huffman-coded when that is shorter.
+ */
+class HpackEncoder {
+private:
+    HpackTable table;
+    size_t pendingResize;       // table size update owed to the peer, or NO_RESIZE
+
+    static const size_t NO_RESIZE = static_cast<size_t>(-1);
+
+public:
+    HpackEncoder() : table(4096), pendingResize(NO_RESIZE) {}
+
+    /**
+     * @brief Apply the peer's SETTINGS_HEADER_TABLE_SIZE
+     */
+    void setMaxTableSize(size_t size);
+    void encode(const HeaderList& headers, std::string& out);
+};
+
+#endif // HPACK_HPP
@@ -0,0 +1,208 @@
+/* ************************************************************************** */
+/*                                                                            */
+/*                                                        :::      ::::::::   */
+/*   http2_handler.hpp                                  :+:      :+:    :+:   */
+/*                                                    +:+ +:+         +:+     */
+/*   By: aogbi <aogbi@student.42.fr>                +#+  +:+       +#+        */
+/*                                                +#+#+#+#+#+   +#+           */
+/*   Created: 2026/10/19 00:00:00 by aogbi             #+#    #+#             */
+/*   Updated: 2026/10/19 00:00:00 by aogbi            ###   ########.fr       */
+/*                                                                            */
+/* ************************************************************************** */
+
+#ifndef HTTP2_HANDLER_HPP
+#define HTTP2_HANDLER_HPP
+
+#include <string>
+#include <vector>
+#include <map>
+#include <set>
+#include <stdint.h>
+#include "config.hpp"
+#include "request.hpp"
+#include "metrics.hpp"
+#include "hpack.hpp"
+#include "body_framing.hpp"
+#include "connection_manager.hpp"
+
+/**
+ * @brief Stream clients the Server has to act on after Http2Handler::pump
+ */
+struct Http2Events {
+    std::vector<int> ready;     // request complete: dispatch it like an HTTP/1.1 request
+    std::vector<int> drained;   // queued output was framed, handlers may resume
+    std::vector<int> closed;    // stream ended or was reset, handler sessions must go
+
+    bool empty() const { return ready.empty() && drained.empty() && closed.empty(); }
+    void clear() { ready.clear(); drained.clear(); closed.clear(); }
+};
+
+/**
+ * @brief HTTP/2 connections (h2 via ALPN, h2c by prior knowledge or Upgrade)
+ *
+ * Every stream becomes a stream client of the ConnectionManager whose
+ * buffer holds the request rewritten as HTTP/1.1, so the Server dispatches
+ * it to the HttpHandler, CgiHandler or ProxyHandler exactly like a request
+ * read from a socket. Responses those handlers queue on the stream client
+ * are parsed back into a HEADERS frame and DATA frames (chunked bodies are
+ * unchunked) and multiplexed onto the connection within the peer's flow
+ * control windows. Ready streams are served by urgency (the priority
+ * header), then behind the stream they depend on, then in proportion to
+ * their weight. Raw output only leaves a stream client once it can be
+ * sent, so a stalled stream pauses its CGI script or upstream as usual.
+ */
+class Http2Handler {
+public:
+    enum Preface { PREFACE_NONE, PREFACE_PARTIAL, PREFACE_FULL };
+
+private:
+    struct Stream {
+        uint32_t id;
+        int clientId;               // stream client once dispatched, 0 before
+        HeaderList headers;
+        std::string body;
+        bool remoteClosed;          // END_STREAM received
+        bool refused;               // body over client_max_body_size, the rest is dropped
+        int64_t sendWindow;
+        int64_t recvWindow;
+        uint32_t dependsOn;
+        int weight;
+        int urgency;                // 0 (highest) to 7, priority header
+        uint64_t sentBytes;
+
+        bool headRequest;
+        bool headersSent;
+        bool chunked;
+        BodyFraming framing;
+        ChunkedScanner chunks;
+        std::string data;           // unchunked body bytes waiting for window
+        bool bodyDone;
+        bool truncated;             // output ended before the body did
+        bool endSent;
+    };
+
+    struct Connection {
+        int fd;
+        bool prefaceSeen;
+        bool settingsSeen;
+        std::string in;
+        std::string out;
+        HpackDecoder decoder;
+        HpackEncoder encoder;
+        std::map<uint32_t, Stream*> streams;
+        uint32_t lastStreamId;
+        uint32_t headerStream;      // stream whose header block continues, 0 otherwise
+        std::string headerBlock;
+        uint8_t headerFlags;
+        int64_t sendWindow;
+        int64_t recvWindow;
+        uint32_t peerInitialWindow;
+        uint32_t peerMaxFrame;
+        bool peerGoaway;
+    };
+
+    const Config& config;
+    Metrics& metrics;
+    ConnectionManager* connections;
+    bool http2;
+    size_t maxHeaderBlock;
+    std::map<int, Connection*> byClient;
+    std::map<int, Connection*> byStream;    // stream client id -> connection
+    std::set<int> awake;                    // connections with output to frame
+    Http2Events events;
+
+    static const uint32_t MAX_CONCURRENT_STREAMS = 128;
+    static const uint32_t MAX_FRAME_SIZE = 16384;
+    static const int64_t STREAM_WINDOW = 256 * 1024;
+    static const int64_t CONNECTION_WINDOW = 1024 * 1024;
+    static const size_t HIGH_WATER = 256 * 1024;
+
+    Connection* createConnection(int clientFd);
+    void destroy(Connection* conn);
+    void connectionError(Connection* conn, uint32_t code);
+    void resetStream(Connection* conn, Stream* stream, uint32_t code);
+    void closeStream(Connection* conn, Stream* stream);
+    Stream* createStream(Connection* conn, uint32_t id);
+    bool flushOut(Connection* conn);
+
+    // These return false once the connection has been torn down
+    bool processInput(Connection* conn);
+    bool handleFrame(Connection* conn, uint8_t type, uint8_t flags, uint32_t streamId,
+                     const unsigned char* payload, size_t length);
+    bool handleHeaders(Connection* conn, uint8_t flags, uint32_t streamId,
+                       const unsigned char* payload, size_t length);
+    bool handleData(Connection* conn, uint8_t flags, uint32_t streamId,
+                    const unsigned char* payload, size_t length);
+    bool handleSettings(Connection* conn, uint8_t flags, const unsigned char* payload, size_t length);
+    bool handleWindowUpdate(Connection* conn, uint32_t streamId, const unsigned char* payload, size_t length);
+    bool endHeaderBlock(Connection* conn);
+    bool applySetting(Connection* conn, uint16_t id, uint32_t value);
+
+    void dispatch(Connection* conn, Stream* stream);
+    std::string buildRequest(const Stream* stream, bool& malformed) const;
+    bool send(Connection* conn);
+    void sendData(Connection* conn, Stream* stream);
+    bool pullOutput(Connection* conn, Stream* stream);
+    bool sendResponseHead(Connection* conn, Stream* stream, ClientConnection& client, size_t headEnd);
+    Stream* nextToSend(Connection* conn) const;
+    bool canSend(const Connection* conn, const Stream* stream) const;
+
+    Http2Handler(const Http2Handler&);
+    Http2Handler& operator=(const Http2Handler&);
+
+public:
+    Http2Handler(const Config& config, Metrics& metrics);
+    ~Http2Handler();
+
+    /**
+     * @param manager Where stream clients are registered and frames queued
+     */
+    void setup(ConnectionManager* manager);
+    bool enabled() const { return http2; }
+
+    /**
+     * @brief Check whether a client buffer starts with the HTTP/2 connection preface
+     */
+    static Preface matchPreface(const std::string& buffer);
+
+    /**
+     * @brief Check for an h2c Upgrade the server can take (cleartext, no request body)
+     */
+    bool canUpgrade(const Request& req) const;
+
+    /**
+     * @brief Speak HTTP/2 on a client, after ALPN or a prior-knowledge preface
+     *
+     * The server SETTINGS are queued right away; bytes already read are
+     * passed to onClientData.
+     */
+    void open(int clientFd);
+
+    /**
+     * @brief Answer 101 to an h2c Upgrade and serve the request as stream 1
+     * @param rawHead Header block of the upgrading request
+     */
+    void upgrade(int clientFd, const Request& req, const std::string& rawHead);
+
+    bool hasSession(int clientFd) const { return byClient.find(clientFd) != byClient.end(); }
+
+    /**
+     * @brief Parse frames read from the connection
+     */
+    void onClientData(int clientFd, const char* data, size_t length);
+    void onClientDrained(int clientFd);
+
+    /**
+     * @brief Forget a closed connection
+     * @param closedStreams Receives the stream clients that were dropped with it
+     */
+    void onClientClosed(int clientFd, std::vector<int>& closedStreams);
+
+    /**
+     * @brief Frame the output queued on stream clients and collect what the Server must handle
+     * @return false when there was nothing to do
+     */
+    bool pump(Http2Events& out);
+};
+
+#endif // HTTP2_HANDLER_HPP
@@ -6,7 +6,7 @@
 /*   By: aogbi <aogbi@student.42.fr>                +#+  +:+       +#+        */
 /*                                                +#+#+#+#+#+   +#+           */
 /*   Created: 2025/09/06 00:00:00 by aogbi             #+#    #+#             */
-/*   Updated: 2025/09/06 11:58:02 by aogbi            ###   ########.fr       */
+/*   Updated: 2026/10/19 00:00:00 by aogbi            ###   ########.fr       */
 /*                                                                            */
 /* ************************************************************************** */
 
@@ -20,28 +20,70 @@
 #include <sstream>
 #include <sys/stat.h>
 #include <dirent.h>
+#include <ctime>
 #include "request.hpp"
 #include "response.hpp"
 #include "config.hpp"
+#include "metrics.hpp"
+#include "directory_listing.hpp"
+#include "open_file_cache.hpp"
+#include "aio_pool.hpp"
 
 class HttpHandler {
 private:
     const Config& config;
+    Metrics& metrics;
+    DirectoryListingCache dirListingCache;
+    UploadWriter uploadWriter;      // the loop's, never waits for writeback
+    OpenFileCache& openFiles;       // shared by every reactor
+    std::vector<AioTask*> syncBatch;    // upload_fsync batch uploads written since the last AIO_SYNC
+    time_t lastSync;
+    bool syncing;                   // an AIO_SYNC is running; the next batch waits for it
+    
+    static const int SYNC_INTERVAL = 1;
     
     // File serving methods
-    std::string serveFile(const std::string& requestPath, const Request& req);
-    std::string generateDirectoryListing(const std::string& dirPath, const std::string& requestPath);
-    std::string getMimeType(const std::string& filename);
+    std::string serveFile(const Request& req);
+    void resolveTarget(const Request& req, std::string& requestPath, std::string& query,
+                       std::string& fullPath) const;
+    std::string fileResponse(const OpenFile& file, const std::string& fullPath, const std::string& content, bool head);
+    std::string listingResponse(const std::string& dirPath, const struct stat& dirStat, const std::string& requestPath,
+                                const std::string& query, bool head, std::vector<DirectoryEntry>* scanned);
+    bool autoindexOn(const std::string& requestPath) const;
+    bool openCached(const std::string& path, OpenFile& file);
+    bool lookupCached(const std::string& path, OpenFile& file);
+    
+    static const size_t MAX_UPLOAD_SIZE = 10 * 1024 * 1024;
     
-    // File upload methods
+    // File upload and delete methods
+    static bool isUpload(const Request& req, const Location* location);
+    std::string uploadDirFor(const Location* location) const;
     std::string handleFileUpload(const Request& req, const Location* location);
-    bool saveUploadedFile(const std::string& content, const std::string& filename, const std::string& uploadDir);
+    std::string parseUpload(const Request& req, std::string& filename, size_t& contentStart, size_t& contentLength);
+    std::string uploadResponse(bool saved, const std::string& filename, size_t size, const std::string& uploadDir);
+    std::string uploadTooLarge(size_t bodyLength);
+    bool saveUploadedFile(const char* content, size_t length, const std::string& filename,
+                          const std::string& uploadDir, const Location* location);
+    std::string deleteTarget(const Request& req, const Location* location, std::string& fullPath,
+                             std::string& filename);
+    std::string deleteResponse(const std::string& fullPath, const std::string& filename, int error);
+    
+    // aio threads
+    AioTask* startServe(const Request& req, std::string& response);
+    AioTask* startUpload(const Request& req, const Location* location, std::string& response);
+    AioTask* startDelete(const Request& req, const Location* location, std::string& response);
+    bool finishServe(AioTask& task, std::string& response);
     
     // Error handling
     std::string generateErrorPage(int statusCode, const std::string& message);
+    std::string errorResponse(int statusCode, const std::string& reason, const std::string& message, bool withBody);
+    
+    // Built-in status page
+    std::string handleStubStatus(const Request& req);
 
 public:
-    HttpHandler(const Config& config);
+    HttpHandler(const Config& config, Metrics& metrics, OpenFileCache& openFiles);
+    ~HttpHandler();
     
     /**
      * @brief Handle HTTP request and generate response
@@ -50,6 +92,60 @@ public:
      */
     std::string handleRequest(const Request& req);
     
+    /**
+     * @brief Refuse a request from its headers alone, before its body is read
+     *
+     * Checks allow_methods, a Content-Length over client_max_body_size and
+     * uploads over the upload size limit.
+     * @param req Request with at least its headers parsed
+     * @param location The matched location block
+     * @return Error response (405, 413), or an empty string if the body may be sent
+     */
+    std::string checkRequestHead(const Request& req, const Location* location);
+    
+    /**
+     * @brief Handle a request without blocking on the file system (aio threads)
+     *
+     * Everything that needs no file system call is answered right away;
+     * otherwise the returned task carries the stat/open/read, opendir,
+     * unlink or upload write to a worker, and finishTask() builds the
+     * response from its results.
+     * @param response Receives the response when no task is returned
+     * @return Task to run, or NULL if the response is complete
+     */
+    AioTask* startRequest(const Request& req, std::string& response);
+    
+    /**
+     * @brief Build the response of a task that has run, and update the caches with its results
+     *
+     * An upload under upload_fsync batch is kept for the next AIO_SYNC;
+     * its response comes from finishUpload() once that has run.
+     * @return false when the task has to run again (a directory listing must be read first),
+     *         or waits for its batch's sync (an upload)
+     */
+    bool finishTask(AioTask& task, std::string& response);
+    
+    /**
+     * @brief Response of an upload whose file is written, and synced when required
+     */
+    std::string finishUpload(const AioTask& task);
+    
+    /**
+     * @brief Run a task on the loop thread, when the thread pool queue is full
+     */
+    void runTask(AioTask& task) { task.run(uploadWriter); }
+    
+    /**
+     * @brief Take the upload_fsync batch once SYNC_INTERVAL has passed since the last sync
+     * @return AIO_SYNC task owning the waiting uploads, or NULL when none is due
+     */
+    AioTask* takeSyncBatch();
+    
+    /**
+     * @brief Whether uploads wait for their batch's sync
+     */
+    bool hasSyncBatch() const { return !syncBatch.empty(); }
+    
     /**
      * @brief Handle GET requests
      * @param req The HTTP request
@@ -73,6 +169,13 @@ public:
      * @return HTTP response as string
      */
     std::string handleDeleteRequest(const Request& req, const Location* location);
+    
+    /**
+     * @brief Map a filename to its Content-Type
+     * @param filename File name or path
+     * @return MIME type from the configured types table, or default_type
+     */
+    const std::string& getMimeType(const std::string& filename);
 };
 
 #endif // HTTP_HANDLER_HPP
@@ -0,0 +1,152 @@
+/* ************************************************************************** */
+/*                                                                            */
+/*                                                        :::      ::::::::   */
+/*   metrics.hpp                                        :+:      :+:    :+:   */
+/*                                                    +:+ +:+         +:+     */
+/*   By: aogbi <aogbi@student.42.fr>                +#+  +:+       +#+        */
+/*                                                +#+#+#+#+#+   +#+           */
+/*   Created: 2026/10/19 00:00:00 by aogbi             #+#    #+#             */
+/*   Updated: 2026/10/19 00:00:00 by aogbi            ###   ########.fr       */
+/*                                                                            */
+/* ************************************************************************** */
+
+#ifndef METRICS_HPP
+#define METRICS_HPP
+
+#include <string>
+#include <vector>
+#include <stdint.h>
+#include "string_view.hpp"
+
+/**
+ * @brief Add to a counter only its own reactor writes
+ *
+ * A relaxed store is a plain store on every target we build for, yet lets
+ * the metrics page read the counters of the other reactors without a race.
+ */
+inline void bumpCounter(uint64_t& counter, uint64_t amount = 1) {
+    __atomic_store_n(&counter, counter + amount, __ATOMIC_RELAXED);
+}
+
+inline void dropCounter(uint64_t& counter) {
+    __atomic_store_n(&counter, counter - 1, __ATOMIC_RELAXED);
+}
+
+/**
+ * @brief Fixed-bucket latency histogram
+ *
+ * Bucket bounds are compile-time constants, so observing a sample is a
+ * short linear scan over a plain array and never allocates.
+ */
+struct LatencyHistogram {
+    static const int BUCKET_COUNT = 15;
+    static const uint64_t BUCKET_BOUNDS_US[BUCKET_COUNT];
+    static const char* const BUCKET_LABELS[BUCKET_COUNT];
+
+    uint64_t buckets[BUCKET_COUNT + 1]; // last slot is +Inf
+    uint64_t count;
+    uint64_t sumMicros;
+
+    LatencyHistogram();
+    void observe(uint64_t micros);
+    void addTo(LatencyHistogram& total) const;
+};
+
+/**
+ * @brief Counters of one reactor
+ *
+ * With worker_threads every reactor counts into its own Metrics, so the
+ * request path never shares a cache line with another core; the metrics
+ * page sums the whole group when it is rendered.
+ */
+class Metrics {
+public:
+    enum Phase { PHASE_PARSE, PHASE_HANDLE, PHASE_WRITE, PHASE_CGI, PHASE_UPSTREAM, PHASE_COUNT };
+    enum Method { METHOD_GET, METHOD_HEAD, METHOD_POST, METHOD_DELETE, METHOD_OTHER, METHOD_COUNT };
+    enum CacheKind { CACHE_DIRLIST, CACHE_CGI, CACHE_OPEN_FILE, CACHE_KIND_COUNT };
+    enum LimitKind { LIMIT_CONN, LIMIT_REQ, LIMIT_KIND_COUNT };
+    static const int STATUS_MIN = 100;
+    static const int STATUS_MAX = 599;
+
+private:
+    uint64_t acceptedConnections;
+    uint64_t activeConnections;
+    uint64_t idleConnections;
+    uint64_t requestsByMethod[METHOD_COUNT];
+    uint64_t responsesByStatus[STATUS_MAX - STATUS_MIN + 1];
+    uint64_t bytesIn;
+    uint64_t bytesOut;
+    uint64_t cgiSpawns;
+    uint64_t cgiFailures;
+    uint64_t upstreamConnects;
+    uint64_t upstreamReuses;
+    uint64_t upstreamFailures;
+    uint64_t tlsHandshakes;
+    uint64_t tlsResumed;
+    uint64_t tlsKtls;
+    uint64_t tlsFailures;
+    uint64_t http2Connections;
+    uint64_t http2Streams;
+    uint64_t cacheHits[CACHE_KIND_COUNT];
+    uint64_t cacheMisses[CACHE_KIND_COUNT];
+    uint64_t limitRejections[LIMIT_KIND_COUNT];
+    LatencyHistogram phases[PHASE_COUNT];
+    const std::vector<const Metrics*>* group;   // every reactor's counters, NULL when alone
+
+    static Method methodIndex(const StringView& method);
+    void addTo(Metrics& total) const;
+
+public:
+    Metrics();
+
+    /**
+     * @brief Monotonic clock in microseconds, for phase timing
+     */
+    static uint64_t nowMicros();
+
+    // Connection lifecycle (idle = connected but no request bytes yet)
+    void connectionOpened();
+    void connectionBusy();
+    void connectionClosed(bool wasIdle);
+
+    void recordRequest(const StringView& method);
+    void recordStatus(int statusCode);
+    void recordBytesIn(size_t bytes) { bumpCounter(bytesIn, bytes); }
+    void recordBytesOut(size_t bytes) { bumpCounter(bytesOut, bytes); }
+    void recordCgiSpawn() { bumpCounter(cgiSpawns); }
+    void recordCgiFailure() { bumpCounter(cgiFailures); }
+    void recordUpstreamConnect(bool reused) { bumpCounter(reused ? upstreamReuses : upstreamConnects); }
+    void recordUpstreamFailure() { bumpCounter(upstreamFailures); }
+    void recordTlsHandshake(bool resumed, bool ktls) {
+        bumpCounter(tlsHandshakes);
+        bumpCounter(tlsResumed, resumed);
+        bumpCounter(tlsKtls, ktls);
+    }
+    void recordTlsFailure() { bumpCounter(tlsFailures); }
+    void recordHttp2Connection() { bumpCounter(http2Connections); }
+    void recordHttp2Stream() { bumpCounter(http2Streams); }
+    void recordCacheHit(CacheKind kind) { bumpCounter(cacheHits[kind]); }
+    void recordCacheMiss(CacheKind kind) { bumpCounter(cacheMisses[kind]); }
+    void recordLimitRejection(LimitKind kind) { bumpCounter(limitRejections[kind]); }
+
+    /**
+     * @brief Record the duration of a request phase
+     * @param phase Which phase the sample belongs to
+     * @param startMicros Value of nowMicros() taken when the phase began
+     */
+    void observePhase(Phase phase, uint64_t startMicros);
+
+    /**
+     * @brief Render the group's counters from every reactor instead of this one's alone
+     * @param group Metrics of all reactors, including this one; must outlive this object
+     */
+    void setGroup(const std::vector<const Metrics*>* group) { this->group = group; }
+
+    /**
+     * @brief Render all counters in Prometheus text exposition format
+     * @return Metrics page body, summed over the group when there is one
+     */
+    std::string renderPrometheus() const;
+};
+
+#endif // METRICS_HPP
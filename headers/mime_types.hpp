@@ -0,0 +1,82 @@
+/* ************************************************************************** */
+/*                                                                            */
+/*                                                        :::      ::::::::   */
+/*   mime_types.hpp                                     :+:      :+:    :+:   */
+/*                                                    +:+ +:+         +:+     */
+/*   By: aogbi <aogbi@student.42.fr>                +#+  +:+       +#+        */
+/*                                                +#+#+#+#+#+   +#+           */
+/*   Created: 2026/10/19 00:00:00 by aogbi             #+#    #+#             */
+/*   Updated: 2026/10/19 00:00:00 by aogbi            ###   ########.fr       */
+/*                                                                            */
+/* ************************************************************************** */
+
+#ifndef MIME_TYPES_HPP
+#define MIME_TYPES_HPP
+
+#include <string>
+#include <vector>
+#include <stdint.h>
+
+/**
+ * @brief Extension -> Content-Type table
+ *
+ * Open-addressing hash table with linear probing, keyed by the lowercased
+ * extension (without the dot). The table is only written while the
+ * configuration loads; lookups hash the caller's bytes in place and
+ * compare case-insensitively, so they never allocate.
+ */
+class MimeTypes {
+private:
+    struct Entry {
+        std::string extension;
+        std::string type;
+        uint32_t hash;
+        bool used;
+
+        Entry() : hash(0), used(false) {}
+    };
+
+    std::vector<Entry> table;
+    size_t count;
+    std::string defaultType;
+
+    static bool equalsLower(const std::string& stored, const char* ext, size_t len);
+    void grow();
+
+public:
+    MimeTypes();
+
+    /**
+     * @brief Register (or replace) the type for an extension
+     * @param extension Extension without the leading dot, any case
+     * @param type MIME type
+     */
+    void add(const std::string& extension, const std::string& type);
+
+    /**
+     * @brief Register the built-in types used when no types block is configured
+     */
+    void loadDefaults();
+
+    void clear();
+    void setDefaultType(const std::string& type) { defaultType = type; }
+    const std::string& getDefaultType() const { return defaultType; }
+    size_t size() const { return count; }
+
+    /**
+     * @brief Look up a type by extension
+     * @param ext Extension bytes without the dot (not NUL-terminated)
+     * @param len Extension length
+     * @return Registered type, or NULL when unknown
+     */
+    const std::string* find(const char* ext, size_t len) const;
+
+    /**
+     * @brief Content-Type for a file name or path
+     * @param filename File name or path; only the last segment is inspected
+     * @return Registered type, or the default type
+     */
+    const std::string& lookup(const std::string& filename) const;
+};
+
+#endif // MIME_TYPES_HPP
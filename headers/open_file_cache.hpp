@@ -0,0 +1,152 @@
+/* ************************************************************************** */
+/*                                                                            */
+/*                                                        :::      ::::::::   */
+/*   open_file_cache.hpp                                :+:      :+:    :+:   */
+/*                                                    +:+ +:+         +:+     */
+/*   By: aogbi <aogbi@student.42.fr>                +#+  +:+       +#+        */
+/*                                                +#+#+#+#+#+   +#+           */
+/*   Created: 2026/10/19 00:00:00 by aogbi             #+#    #+#             */
+/*   Updated: 2026/10/19 00:00:00 by aogbi            ###   ########.fr       */
+/*                                                                            */
+/* ************************************************************************** */
+
+#ifndef OPEN_FILE_CACHE_HPP
+#define OPEN_FILE_CACHE_HPP
+
+#include <string>
+#include <ctime>
+#include <pthread.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include "epoch.hpp"
+
+/**
+ * @brief Result of looking up a file to serve
+ *
+ * statError is set when the path does not exist (or cannot be stat'ed);
+ * otherwise info holds its stat result and fd is an open descriptor for
+ * regular files, or -1 if it could not be opened. Descriptors may be
+ * shared between requests, so they are read with pread only.
+ */
+struct OpenFile {
+    int fd;
+    int statError;
+    struct stat info;
+    bool cached;            // fd belongs to the cache; otherwise the caller closes it
+
+    OpenFile() : fd(-1), statError(0), cached(false) {}
+};
+
+/**
+ * @brief Open descriptors and stat results of recently served paths (open_file_cache)
+ *
+ * A hit younger than the validity interval costs no system call at all.
+ * An older one is revalidated with a single stat(): the descriptor is kept
+ * while the inode, size and mtime are unchanged. Entries unused for the
+ * inactive time are closed, and the least recently used one makes room
+ * when maxEntries is reached. Failed lookups are cached too when enabled
+ * (open_file_cache_errors).
+ *
+ * One cache serves every reactor of worker_threads. Lookups take no lock:
+ * the chains of the fixed bucket array are published with release stores,
+ * and a hit only writes its own entry's use time, and only when it moved.
+ * Inserts, removals and sweeps take the write lock; a removed entry (and
+ * its descriptor, which a reactor may still be reading) is handed to the
+ * EpochDomain and closed once every reactor has passed a quiescent point.
+ */
+class OpenFileCache {
+private:
+    struct Entry {
+        Entry* next;
+        size_t hash;
+        std::string path;
+        OpenFile file;
+        time_t validated;       // these three are refreshed by lookups, with relaxed stores
+        time_t lastUsed;
+        unsigned long useStamp;
+    };
+
+    Entry** buckets;
+    size_t bucketMask;
+    size_t count;
+    size_t maxEntries;              // 0 = cache disabled
+    int inactive;
+    int validity;
+    bool cacheErrors;
+    unsigned long useClock;         // moved by inserts only, so hits share no counter
+    time_t lastSweep;
+    EpochDomain& epochs;
+    pthread_mutex_t writeLock;
+
+    static bool sameFile(const struct stat& a, const struct stat& b);
+    static void reclaimEntry(void* entry);
+    Entry* find(const std::string& path, size_t hash) const;
+    void touch(Entry* entry, time_t now);
+    void sweep(time_t now);
+    void evictIfFull();
+    void unlink(Entry* entry);
+    void remove(Entry* entry);
+    void destroy();
+
+    OpenFileCache(const OpenFileCache&);
+    OpenFileCache& operator=(const OpenFileCache&);
+
+public:
+    OpenFileCache(EpochDomain& epochs);
+    ~OpenFileCache();
+
+    /**
+     * @brief Size the bucket array; called before the reactors start
+     * @param maxEntries Paths kept, 0 disables the cache
+     * @param inactive Seconds an unused entry is kept
+     * @param validity Seconds before an entry is checked against the file system again
+     * @param cacheErrors Also cache paths that do not exist
+     */
+    void configure(size_t maxEntries, int inactive, int validity, bool cacheErrors);
+    bool enabled() const { return maxEntries > 0; }
+
+    /**
+     * @brief Look up a path, opening regular files
+     * @param file Receives the result; close file.fd afterwards unless file.cached.
+     *             A cached descriptor stays open until the caller's next quiescent point
+     * @return true on a cache hit
+     */
+    bool open(const std::string& path, OpenFile& file);
+    
+    /**
+     * @brief Look up a path without touching the file system
+     * @return true only for an entry still inside its validity interval
+     */
+    bool lookup(const std::string& path, OpenFile& file);
+    
+    /**
+     * @brief Keep the result of a load() done elsewhere (aio threads)
+     *
+     * Sets file.cached when the cache took the descriptor; otherwise the
+     * caller still closes it.
+     */
+    void store(const std::string& path, OpenFile& file);
+    
+    /**
+     * @brief stat() a path and open it if it is a regular file, bypassing the cache
+     */
+    static void load(const std::string& path, OpenFile& file);
+    
+    /**
+     * @brief Read a whole regular file with pread, so shared descriptors keep their offset
+     */
+    static void readContent(const OpenFile& file, std::string& content);
+
+    /**
+     * @brief Read a whole regular file only if none of it has to come from disk
+     * @return false, with content cleared, when a read would block (RWF_NOWAIT)
+     */
+    static bool readCached(const OpenFile& file, std::string& content);
+
+    /**
+     * @brief Forget everything, e.g. after an upload or delete changed the tree
+     */
+    void clear();
+};
+
+#endif // OPEN_FILE_CACHE_HPP
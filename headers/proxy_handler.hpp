@@ -0,0 +1,190 @@
+/* ************************************************************************** */
+/*                                                                            */
+/*                                                        :::      ::::::::   */
+/*   proxy_handler.hpp                                  :+:      :+:    :+:   */
+/*                                                    +:+ +:+         +:+     */
+/*   By: aogbi <aogbi@student.42.fr>                +#+  +:+       +#+        */
+/*                                                +#+#+#+#+#+   +#+           */
+/*   Created: 2026/10/19 00:00:00 by aogbi             #+#    #+#             */
+/*   Updated: 2026/10/19 00:00:00 by aogbi            ###   ########.fr       */
+/*                                                                            */
+/* ************************************************************************** */
+
+#ifndef PROXY_HANDLER_HPP
+#define PROXY_HANDLER_HPP
+
+#include <string>
+#include <vector>
+#include <map>
+#include <ctime>
+#include <stdint.h>
+#include <netinet/in.h>
+#include "config.hpp"
+#include "request.hpp"
+#include "metrics.hpp"
+#include "body_framing.hpp"
+#include "connection_manager.hpp"
+
+/**
+ * @brief One upstream server and its idle keep-alive connections
+ */
+struct UpstreamPeer {
+    struct IdleConnection {
+        int fd;
+        time_t since;
+    };
+
+    std::string address;            // "host:port", for logs
+    struct sockaddr_in addr;
+    size_t active;                  // connections currently carrying a request
+    std::vector<IdleConnection> idle;
+
+    UpstreamPeer() : active(0) {}
+};
+
+/**
+ * @brief Servers of one upstream group plus the balancing state
+ */
+struct UpstreamPool {
+    std::vector<UpstreamPeer> peers;
+    bool leastConn;
+    size_t keepalive;
+    size_t next;                    // round-robin cursor
+
+    UpstreamPool() : leastConn(false), keepalive(32), next(0) {}
+};
+
+/**
+ * @brief Reverse proxy for proxy_pass locations
+ *
+ * Every proxied request is a small state machine driven by the poll loop:
+ * the upstream socket is non-blocking and watched through the
+ * ConnectionManager, request body bytes are relayed as the client sends
+ * them and response bytes are queued on the client as they arrive. Both
+ * directions stop reading when the other side has more than a high-water
+ * mark pending, so neither body is ever fully buffered.
+ *
+ * Finished upstream connections go back to an idle pool per server when
+ * the response allows it; a pooled connection that turns out to be closed
+ * is retried once on a fresh connection.
+ */
+class ProxyHandler {
+private:
+    struct Target {
+        UpstreamPool* pool;
+        std::string pathPrefix;     // replaces the location prefix when set
+        bool hasPath;
+    };
+
+    struct Session {
+        int clientFd;
+        int upstreamFd;
+        UpstreamPool* pool;
+        size_t peer;
+        size_t attempts;
+        bool reused;
+        bool connecting;
+
+        std::string toUpstream;     // request bytes, kept from the start while replayable
+        size_t toUpstreamOffset;
+        bool replayable;
+        BodyFraming requestBody;
+        size_t requestBodyBytes;    // checked against client_max_body_size
+        bool requestDone;
+
+        std::string responseHead;   // upstream header bytes until the blank line
+        bool headersForwarded;
+        bool responseStarted;       // any upstream byte seen on this attempt
+        BodyFraming responseBody;
+        bool upstreamKeepAlive;
+        bool headRequest;
+        bool clientHttp11;
+
+        bool clientPaused;
+        bool upstreamPaused;
+        int timeout;
+        time_t lastActivity;
+        uint64_t startMicros;
+    };
+
+    const Config& config;
+    Metrics& metrics;
+    ConnectionManager* connections;
+    std::map<std::string, UpstreamPool> pools;      // by upstream name or "host:port"
+    std::map<std::string, Target> targets;          // by proxy_pass value
+    std::map<int, Session*> byClient;
+    std::map<int, Session*> byUpstream;
+    std::map<int, std::pair<UpstreamPool*, size_t> > idleOwners;
+
+    static const size_t HIGH_WATER = 256 * 1024;
+    static const int IDLE_TIMEOUT = 60;
+
+    bool addPeer(UpstreamPool& pool, const std::string& address);
+    const Target* resolveTarget(const std::string& proxyPass);
+    size_t selectPeer(UpstreamPool& pool);
+    bool connectUpstream(Session* session, bool allowPooled);
+    void releaseUpstream(Session* session, bool reusable);
+    void finish(Session* session);
+    void fail(Session* session, int statusCode, const std::string& message);
+    void destroy(Session* session);
+
+    // These return false once the session has been finished or destroyed
+    bool relayBody(Session* session, const char* data, size_t length);
+    bool retryOrFail(Session* session);
+    bool upstreamError(Session* session);
+    bool writeUpstream(Session* session);
+    bool readUpstream(Session* session);
+    bool sendResponseHead(Session* session, size_t headerEnd);
+    bool forwardBody(Session* session, const char* data, size_t length);
+
+    void updateUpstreamEvents(Session* session);
+    void handleIdleEvent(int fd);
+
+    std::string buildRequestHead(const Request& req, const Location* location,
+                                 const Target& target, const std::string& rawHeaders,
+                                 const std::string& remoteAddr) const;
+
+public:
+    ProxyHandler(const Config& config, Metrics& metrics);
+    ~ProxyHandler();
+
+    /**
+     * @brief Resolve upstream groups and proxy_pass targets from the parsed config
+     * @param manager Poll set the upstream sockets are registered with
+     * @return false if an upstream address cannot be resolved
+     */
+    bool setup(ConnectionManager* manager);
+
+    static bool isProxyLocation(const Location* location) {
+        return location && !location->proxyPass.empty();
+    }
+
+    /**
+     * @brief Start forwarding a request as soon as its headers are complete
+     * @param clientFd Client socket
+     * @param req Request parsed from the client buffer (body may be partial)
+     * @param location Matched proxy_pass location
+     * @param headerEnd Length of the header block in the client buffer
+     */
+    void start(int clientFd, const Request& req, const Location* location, size_t headerEnd);
+
+    bool enabled() const { return !targets.empty(); }
+    bool hasSession(int clientFd) const { return byClient.find(clientFd) != byClient.end(); }
+    bool ownsFd(int fd) const;
+
+    /**
+     * @brief Relay request body bytes read from the client
+     */
+    void onClientData(int clientFd, const char* data, size_t length);
+    void onClientEof(int clientFd);
+    void onClientDrained(int clientFd);
+    void onClientClosed(int clientFd);
+
+    /**
+     * @brief Dispatch poll events for an upstream or pooled descriptor
+     */
+    void handleEvent(int fd, short revents);
+    void handleTimeouts();
+};
+
+#endif // PROXY_HANDLER_HPP
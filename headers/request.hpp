@@ -6,7 +6,7 @@
 /*   By: aogbi <aogbi@student.42.fr>                +#+  +:+       +#+        */
 /*                                                +#+#+#+#+#+   +#+           */
 /*   Created: 2025/08/19 23:02:12 by aogbi             #+#    #+#             */
-/*   Updated: 2025/09/05 16:40:38 by aogbi            ###   ########.fr       */
+/*   Updated: 2026/10/19 00:00:00 by aogbi            ###   ########.fr       */
 /*                                                                            */
 /* ************************************************************************** */
 
@@ -14,35 +14,111 @@
 #define REQUEST_HPP
 
 #include <iostream>
-#include <map>
-#include <sstream>
-#include <fstream>
+#include <vector>
 #include <cctype>
 #include <cstdlib>
+#include <stdint.h>
+#include "arena.hpp"
+#include "string_view.hpp"
+#include "body_source.hpp"
 
+/**
+ * @brief Parsed request head and body
+ *
+ * parse() copies the head once into the request's arena and records the
+ * request line and every header as (offset, length) spans into that copy,
+ * in a flat array with the hash of each lowercased name; the headers the
+ * server asks for by name have a direct slot. Accessors return views into
+ * the copy, so lookups neither allocate nor copy, and a typical request is
+ * parsed without touching the heap. The views are valid until the next
+ * parse() or the request's destruction; copies get their own arena.
+ * Names compare case-insensitively and keep the client's spelling.
+ *
+ * The request target is split once into path and query. The path is
+ * percent-decoded and has its dot segments and repeated slashes removed
+ * in a second copy at the end of the head; the query stays as sent.
+ *
+ * The body is a BodySource: whatever followed the head in parse(), or the
+ * body the connection buffered or spooled, handed over by takeBody().
+ */
 class Request {
 public:
+	enum HeaderId {
+		HEADER_HOST,
+		HEADER_CONTENT_LENGTH,
+		HEADER_CONTENT_TYPE,
+		HEADER_TRANSFER_ENCODING,
+		HEADER_CONNECTION,
+		HEADER_EXPECT,
+		HEADER_UPGRADE,
+		HEADER_HTTP2_SETTINGS,
+		HEADER_X_FORWARDED_FOR,
+		HEADER_COUNT
+	};
+	
 	Request();
-	bool parse(const std::string &raw);
-	std::string getMethod() const;
-	std::string getPath() const;
-	std::string getVersion() const;
-	std::string getHeader(const std::string &key) const;
-	std::string getBody() const;
-	const std::map<std::string, std::string>& getHeaders() const;
+	Request(const Request &other);
+	Request &operator=(const Request &other);
+	bool parse(const std::string &raw, bool withBody = true);	// withBody false: the head only
+	StringView getMethod() const;
+	StringView getTarget() const;	// as sent, query included
+	StringView getPath() const;		// decoded and normalized, without query or fragment
+	StringView getQuery() const;	// raw, without the '?'
+	StringView getVersion() const;
+	StringView getHeader(const StringView &key) const;
+	StringView getHeader(HeaderId id) const;
+	StringView getBody() const;
+	const BodySource &getBodySource() const;
+	void takeBody(BodySource &source);
+	
+	// Header lines in arrival order, a repeated name keeping its last value
+	size_t getHeaderCount() const;
+	StringView getHeaderName(size_t index) const;
+	StringView getHeaderValue(size_t index) const;
 	
 	// Additional utility methods
-	bool hasHeader(const std::string &key) const;
+	bool hasHeader(const StringView &key) const;
+	bool hasHeader(HeaderId id) const;
 	size_t getContentLength() const;
 	bool isChunked() const;
 	bool isKeepAlive() const;
-	std::string getContentType() const;
+	StringView getContentType() const;
 private:
-	std::string method;
-	std::string path;
-	std::string version;
-	std::map<std::string, std::string> headers;
-	std::string body;
+	static const size_t INLINE_ARENA = 2048;
+	static const size_t INLINE_FIELDS = 16;
+	
+	struct Span {
+		uint32_t offset;
+		uint32_t length;
+	};
+	
+	struct HeaderField {
+		uint32_t hash;			// of the lowercased name
+		Span name;
+		Span value;
+	};
+	
+	typedef std::vector<HeaderField, ArenaAllocator<HeaderField> > FieldList;
+	
+	void clear();
+	void copyFrom(const Request &other);
+	static Span makeSpan(size_t start, size_t end);
+	StringView view(const Span &span) const;
+	int findField(const StringView &name, uint32_t hash) const;
+	int lookup(const StringView &name) const;
+	bool splitTarget();
+	
+	char storage[INLINE_ARENA];
+	Arena arena;
+	ArenaString head;			// request line and header lines, the spans point into it
+	Span method;
+	Span target;
+	Span path;
+	Span query;
+	Span version;
+	FieldList fields;
+	int known[HEADER_COUNT];	// index into fields, or -1
+	BodySource body;
 };
 
 
@@ -6,7 +6,7 @@
 /*   By: aogbi <aogbi@student.42.fr>                +#+  +:+       +#+        */
 /*                                                +#+#+#+#+#+   +#+           */
 /*   Created: 2025/09/04 12:00:17 by aogbi             #+#    #+#             */
-/*   Updated: 2025/09/05 16:40:38 by aogbi            ###   ########.fr       */
+/*   Updated: 2026/10/19 00:00:00 by aogbi            ###   ########.fr       */
 /*                                                                            */
 /* ************************************************************************** */
 
@@ -14,17 +14,28 @@
 #define RESPONSE_HPP
 
 #include <string>
-#include <map>
-#include <sstream>
 #include <ctime>
+#include "arena.hpp"
 
+/**
+ * @brief Status line, headers and body of one response
+ *
+ * The status message and headers live in an arena inside the object, so
+ * building a typical response allocates only its body and the output
+ * string; copies rebuild their fields in their own arena.
+ */
 class Response {
 public:
 	Response();
+	Response(const Response &other);
+	Response &operator=(const Response &other);
 	void setStatus(int code, const std::string &message);
 	void setHeader(const std::string &key, const std::string &value);
 	void setBody(const std::string &body);
+	void setContentLength(size_t length);
 	std::string toString() const;
+	// Status line and headers only, without a default Content-Length (streamed bodies)
+	std::string headToString() const;
 	
 	// Additional utility methods
 	void setContentType(const std::string &mimeType);
@@ -34,9 +45,17 @@ public:
 	void setServer(const std::string &serverName = "Webserv/1.0");
 	int getStatusCode() const;
 private:
+	static const size_t INLINE_ARENA = 512;
+	
+	void putHeader(const char *key, size_t keyLength, const char *value, size_t valueLength);
+	size_t headLength() const;
+	void writeHead(std::string &out, bool addContentLength) const;
+	
+	char storage[INLINE_ARENA];
+	mutable Arena arena;
 	int statusCode;
-	std::string statusMessage;
-	std::map<std::string, std::string> headers;
+	ArenaString statusMessage;
+	ArenaHeaderMap headers;
 	std::string body;
 };
 
@@ -6,7 +6,7 @@
 /*   By: aogbi <aogbi@student.42.fr>                +#+  +:+       +#+        */
 /*                                                +#+#+#+#+#+   +#+           */
 /*   Created: 2025/08/19 18:42:43 by aogbi             #+#    #+#             */
-/*   Updated: 2025/09/06 10:58:47 by aogbi            ###   ########.fr       */
+/*   Updated: 2026/10/19 00:00:00 by aogbi            ###   ########.fr       */
 /*                                                                            */
 /* ************************************************************************** */
 
@@ -17,6 +17,7 @@
 #include <cstring>
 #include <unistd.h>
 #include <string>
+#include <map>
 #include <stdlib.h>
 #include <netdb.h>
 #include <sstream>
@@ -28,16 +29,80 @@
 #include "http_handler.hpp"
 #include "cgi_handler.hpp"
 #include "connection_manager.hpp"
+#include "proxy_handler.hpp"
+#include "metrics.hpp"
+#include "client_limiter.hpp"
+#include "tls_context.hpp"
+#include "http2_handler.hpp"
+#include "aio_pool.hpp"
+#include "event_ring.hpp"
+#include "epoch.hpp"
+#include "open_file_cache.hpp"
+#include "cgi_cache.hpp"
 
-// Global flag for graceful shutdown
+// Global flag for graceful shutdown; read and written with __atomic_load_n / __atomic_store_n
 extern volatile bool g_running;
 
+/**
+ * @brief What the reactors of worker_threads share, built once before they start
+ *
+ * The parsed configuration (with the MIME table inside it) is only read
+ * once the reactors run. The open file cache is read without locks and
+ * reclaims through the EpochDomain; the limiter table and the cgi_cache
+ * zone take their own locks; an SSL_CTX is safe to share as it is.
+ * Connections, handlers, the event loop, the aio pool, directory listings,
+ * upstream pools and warm interpreters belong to one reactor.
+ */
+struct ServerShared {
+    Config config;
+    EpochDomain epochs;                     // declared before openFiles, which retires into it
+    OpenFileCache openFiles;
+    ClientLimiter limiter;
+    TlsContext tls;
+    CgiCache cgiCache;
+    std::vector<const Metrics*> metrics;    // one per reactor, summed by the metrics page
+
+    /**
+     * @brief Parse the configuration file
+     * @throws std::runtime_error if it does not parse
+     */
+    explicit ServerShared(const std::string& configFile);
+
+    /**
+     * @brief Size the caches and tables, load the certificate
+     * @return false if the TLS context or the cgi_cache zone could not be set up
+     */
+    bool setup();
+
+private:
+    ServerShared(const ServerShared&);
+    ServerShared& operator=(const ServerShared&);
+};
+
+/**
+ * @brief One reactor: a listener, its connections and an event loop
+ *
+ * With worker_threads N there are N of them, one per thread, each bound to
+ * the port through SO_REUSEPORT so the kernel spreads new connections over
+ * their listeners. A reactor owns every connection it accepts until it
+ * closes.
+ */
 class Server {
 private:
-    Config config;
+    ServerShared& shared;
+    const Config& config;
+    int reader;                         // slot in shared.epochs
+    Metrics metrics;
     HttpHandler httpHandler;
     CgiHandler cgiHandler;
+    ProxyHandler proxyHandler;
+    Http2Handler http2Handler;
     ConnectionManager* connectionManager;
+    AioPool aioPool;
+    std::map<int, AioTask*> aioTasks;   // client -> file system work in flight, or upload waiting for its sync
+    EventRing ring;                     // event_backend io_uring
+    RingEvents ringEvents;
+    int wakeFd;                         // eventfd written by wake(), ends the poll wait
     
     int server_fd;
     struct addrinfo hints;
@@ -46,13 +111,41 @@ private:
     socklen_t addrlen;
 
 public:
-    Server(const std::string& configFile);
+    explicit Server(ServerShared& shared);
     ~Server();
 
     bool setup();
     int getSocket() const;
-    int acceptClient();
+    int acceptClient(std::string& remoteAddr, uint32_t& peerAddr, uint16_t& remotePort);
     void run();
+    
+    /**
+     * @brief End the current poll wait so g_running is checked now; safe from any thread
+     */
+    void wake();
+
+private:
+    void registerClient(int clientFd, const std::string& remoteAddr, uint32_t peerAddr, uint16_t remotePort);
+    void serveRing();
+    void handleClientEvent(int clientFd, short revents);
+    void readClient(int clientFd);
+    void clientData(int clientFd, const char* data, size_t length);
+    bool startHttp2(int clientFd, ClientConnection& client);
+    void serveHttp2();
+    void processRequest(int clientFd, ClientConnection& client);
+    bool routeHeaders(int clientFd, ClientConnection& client);
+    void sendContinue(int clientFd, ClientConnection& client, const Request& req);
+    bool rejectedByLimit(int clientFd, const ClientConnection& client, const Location* location);
+    void handleRequest(int clientFd, ClientConnection& client);
+    void sendResponse(int clientFd, const std::string& responseStr);
+    void submitTask(AioTask* task);
+    void finishTask(AioTask* task);
+    void syncUploads();
+    void finishSync(AioTask* task);
+    void completeTasks();
+    void cancelTask(int clientFd);
+    void releaseClient(int clientFd);
+    void closeClient(int clientFd);
 };
 
 #endif
@@ -0,0 +1,116 @@
+/* ************************************************************************** */
+/*                                                                            */
+/*                                                        :::      ::::::::   */
+/*   string_view.hpp                                    :+:      :+:    :+:   */
+/*                                                    +:+ +:+         +:+     */
+/*   By: aogbi <aogbi@student.42.fr>                +#+  +:+       +#+        */
+/*                                                +#+#+#+#+#+   +#+           */
+/*   Created: 2026/10/19 00:00:00 by aogbi             #+#    #+#             */
+/*   Updated: 2026/10/19 00:00:00 by aogbi            ###   ########.fr       */
+/*                                                                            */
+/* ************************************************************************** */
+
+#ifndef STRING_VIEW_HPP
+#define STRING_VIEW_HPP
+
+#include <cstddef>
+#include <cstring>
+#include <string>
+
+/**
+ * @brief Non-owning view of a run of characters
+ *
+ * Valid as long as whatever it points into; str() makes an owned copy
+ * for callers that keep the value.
+ */
+class StringView {
+public:
+    static const size_t npos = static_cast<size_t>(-1);
+
+    StringView() : text(""), textLength(0) {}
+    StringView(const char* text, size_t length) : text(text), textLength(length) {}
+    StringView(const char* text) : text(text), textLength(std::strlen(text)) {}
+    StringView(const std::string& value) : text(value.data()), textLength(value.length()) {}
+
+    const char* data() const { return text; }
+    size_t length() const { return textLength; }
+    size_t size() const { return textLength; }
+    bool empty() const { return textLength == 0; }
+    char operator[](size_t i) const { return text[i]; }
+
+    std::string str() const { return std::string(text, textLength); }
+
+    StringView substr(size_t pos, size_t count = npos) const {
+        if (pos > textLength) {
+            pos = textLength;
+        }
+        if (count > textLength - pos) {
+            count = textLength - pos;
+        }
+        return StringView(text + pos, count);
+    }
+
+    size_t find(char c, size_t pos = 0) const {
+        if (pos >= textLength) {
+            return npos;
+        }
+        const void* found = std::memchr(text + pos, c, textLength - pos);
+        return found ? static_cast<const char*>(found) - text : npos;
+    }
+
+    size_t rfind(char c) const {
+        for (size_t i = textLength; i > 0; --i) {
+            if (text[i - 1] == c) {
+                return i - 1;
+            }
+        }
+        return npos;
+    }
+
+    size_t find(const StringView& needle, size_t pos = 0) const {
+        if (needle.textLength == 0) {
+            return pos <= textLength ? pos : npos;
+        }
+        while (pos + needle.textLength <= textLength) {
+            pos = find(needle.text[0], pos);
+            if (pos == npos || pos + needle.textLength > textLength) {
+                return npos;
+            }
+            if (std::memcmp(text + pos, needle.text, needle.textLength) == 0) {
+                return pos;
+            }
+            ++pos;
+        }
+        return npos;
+    }
+
+    bool equalsIgnoreCase(const StringView& other) const {
+        if (textLength != other.textLength) {
+            return false;
+        }
+        for (size_t i = 0; i < textLength; ++i) {
+            if (lower(text[i]) != lower(other.text[i])) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    static char lower(char c) {
+        return (c >= 'A' && c <= 'Z') ? static_cast<char>(c + ('a' - 'A')) : c;
+    }
+
+private:
+    const char* text;
+    size_t textLength;
+};
+
+inline bool operator==(const StringView& a, const StringView& b) {
+    return a.length() == b.length() && std::memcmp(a.data(), b.data(), a.length()) == 0;
+}
+
+inline bool operator!=(const StringView& a, const StringView& b) {
+    return !(a == b);
+}
+
+#endif // STRING_VIEW_HPP
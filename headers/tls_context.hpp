@@ -0,0 +1,69 @@
+/* ************************************************************************** */
+/*                                                                            */
+/*                                                        :::      ::::::::   */
+/*   tls_context.hpp                                    :+:      :+:    :+:   */
+/*                                                    +:+ +:+         +:+     */
+/*   By: aogbi <aogbi@student.42.fr>                +#+  +:+       +#+        */
+/*                                                +#+#+#+#+#+   +#+           */
+/*   Created: 2026/10/19 00:00:00 by aogbi             #+#    #+#             */
+/*   Updated: 2026/10/19 00:00:00 by aogbi            ###   ########.fr       */
+/*                                                                            */
+/* ************************************************************************** */
+
+#ifndef TLS_CONTEXT_HPP
+#define TLS_CONTEXT_HPP
+
+#include <openssl/types.h>
+#include "config.hpp"
+
+/**
+ * @brief OpenSSL server context for `listen PORT ssl`
+ *
+ * Holds the certificate, the in-memory session cache and the session
+ * ticket keys, so resumed handshakes skip the key exchange whether the
+ * client offers a session id or a ticket. With ssl_ktls on, OpenSSL moves
+ * record encryption into the kernel after the handshake when the kernel
+ * has the tls module; connections without it stay in user space. With
+ * http2 on, ALPN offers h2 ahead of http/1.1.
+ */
+class TlsContext {
+private:
+    SSL_CTX* ctx;
+
+    TlsContext(const TlsContext&);
+    TlsContext& operator=(const TlsContext&);
+
+public:
+    TlsContext();
+    ~TlsContext();
+
+    /**
+     * @brief Load the certificate and key and apply the session settings
+     * @return false if the certificate or key could not be loaded
+     */
+    bool init(const Config& config);
+    bool enabled() const { return ctx != NULL; }
+
+    /**
+     * @brief Start the server side of a handshake on an accepted socket
+     * @return Session driven with SSL_do_handshake, or NULL on failure
+     */
+    SSL* accept(int fd);
+
+    /**
+     * @brief Whether a connection's records are encrypted by the kernel
+     */
+    static bool usesKtls(SSL* ssl);
+
+    /**
+     * @brief Whether ALPN settled on h2 for a connection
+     */
+    static bool negotiatedHttp2(SSL* ssl);
+
+    /**
+     * @brief Log and clear OpenSSL's error queue
+     */
+    static void logErrors(const char* context);
+};
+
+#endif // TLS_CONTEXT_HPP
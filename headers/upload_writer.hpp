@@ -0,0 +1,96 @@
+/* ************************************************************************** */
+/*                                                                            */
+/*                                                        :::      ::::::::   */
+/*   upload_writer.hpp                                  :+:      :+:    :+:   */
+/*                                                    +:+ +:+         +:+     */
+/*   By: aogbi <aogbi@student.42.fr>                +#+  +:+       +#+        */
+/*                                                +#+#+#+#+#+   +#+           */
+/*   Created: 2026/10/19 00:00:00 by aogbi             #+#    #+#             */
+/*   Updated: 2026/10/19 00:00:00 by aogbi            ###   ########.fr       */
+/*                                                                            */
+/* ************************************************************************** */
+
+#ifndef UPLOAD_WRITER_HPP
+#define UPLOAD_WRITER_HPP
+
+#include <string>
+
+/**
+ * @brief Writes uploaded files to disk
+ *
+ * The file's extent is reserved with fallocate before the first write so
+ * concurrent uploads do not interleave blocks, and data goes out in CHUNK
+ * sized writes. How the page cache is used (upload_cache) and when the
+ * data is made durable (upload_fsync) are chosen per location:
+ *
+ * - CACHE_KEEP writes through the page cache as usual.
+ * - CACHE_DROP starts writeback after each chunk and drops the previous
+ *   chunk's pages once written, so an upload never evicts hot files. A
+ *   writer on the poll loop (blocking=false) does not wait for that
+ *   writeback: pages still being written stay cached.
+ * - CACHE_DIRECT writes the block-aligned part with O_DIRECT from an
+ *   aligned buffer and the tail through the cache (then dropped); file
+ *   systems without O_DIRECT, or that refuse the direct write, fall back
+ *   to CACHE_DROP.
+ *
+ * FSYNC_BATCH leaves the sync to the caller, which collects the files and
+ * makes them durable together with syncFile() and syncDir().
+ */
+class UploadWriter {
+public:
+    enum CacheMode { CACHE_KEEP, CACHE_DROP, CACHE_DIRECT };
+    enum FsyncPolicy { FSYNC_OFF, FSYNC_ON, FSYNC_BATCH };
+
+private:
+    char* alignedBuffer;        // CHUNK bytes, ALIGNMENT aligned, allocated on first direct write
+    bool blocking;              // may wait for writeback (a worker thread, not the poll loop)
+
+    static const size_t CHUNK = 1024 * 1024;
+    static const size_t ALIGNMENT = 4096;
+
+    bool writeAll(int fd, const char* data, size_t length, CacheMode mode, size_t& offset);
+    bool writeDirect(int fd, const char* data, size_t length, size_t& offset);
+    void dropWritten(int fd, size_t offset, size_t length, bool wait);
+
+    UploadWriter(const UploadWriter&);
+    UploadWriter& operator=(const UploadWriter&);
+
+public:
+    explicit UploadWriter(bool blocking = true);
+    ~UploadWriter();
+
+    /**
+     * @brief Create or replace a file with the given content
+     * @param dir Directory holding the file, synced for FSYNC_ON
+     * @param path Full path of the file
+     * @param data Content, possibly part of a mapped request body
+     * @return false if the file could not be written completely
+     */
+    bool write(const std::string& dir, const std::string& path, const char* data, size_t length,
+               CacheMode mode, FsyncPolicy fsync);
+
+    /**
+     * @brief Create the upload directory if it does not exist yet
+     */
+    static bool makeDir(const std::string& dir);
+
+    /**
+     * @brief Delete an uploaded file
+     * @return 0, ENOENT if it does not exist, EISDIR if it is not a regular file, or unlink's errno
+     */
+    static int remove(const std::string& path);
+
+    /**
+     * @brief fdatasync a file written under FSYNC_BATCH
+     * @return 0, or the errno of the open or the sync
+     */
+    static int syncFile(const std::string& path);
+
+    /**
+     * @brief fsync a directory so the entries of new files are durable
+     * @return 0, or the errno of the open or the sync
+     */
+    static int syncDir(const std::string& dir);
+};
+
+#endif // UPLOAD_WRITER_HPP
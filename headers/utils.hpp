@@ -6,7 +6,7 @@
 /*   By: aogbi <aogbi@student.42.fr>                +#+  +:+       +#+        */
 /*                                                +#+#+#+#+#+   +#+           */
 /*   Created: 2025/09/06 00:00:00 by aogbi             #+#    #+#             */
-/*   Updated: 2025/09/12 17:47:27 by aogbi            ###   ########.fr       */
+/*   Updated: 2026/10/19 00:00:00 by aogbi            ###   ########.fr       */
 /*                                                                            */
 /* ************************************************************************** */
 
@@ -15,6 +15,8 @@
 
 #include <iostream>
 #include <string>
+#include <stdint.h>
+#include "string_view.hpp"
 
 /**
  * @brief Print usage information for the program
@@ -32,4 +34,40 @@ bool validateArguments(int argc, char* argv[]);
 
 std::string getConfigFile(int argc, char* argv[]);
 
+/**
+ * @brief ASCII lowercase copy; header names and tokens are ASCII whatever the locale
+ */
+std::string toLower(const StringView& value);
+void toLowerInPlace(std::string& value);
+
+/**
+ * @brief Strict decimal: one or more ASCII digits, no sign, blanks or overflow
+ * @return false (value untouched) for anything else
+ */
+bool parseDigits(const StringView& text, size_t& value);
+
+/**
+ * @brief FNV-1a over the lowercased bytes, for case-insensitive lookups
+ */
+inline uint32_t hashLower(const StringView& text) {
+    uint32_t hash = 2166136261u;
+    for (size_t i = 0; i < text.length(); ++i) {
+        hash ^= static_cast<unsigned char>(StringView::lower(text[i]));
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+/**
+ * @brief 64-bit FNV-1a over the bytes as they are
+ */
+inline uint64_t hashBytes(const StringView& text) {
+    uint64_t hash = 14695981039346656037ULL;
+    for (size_t i = 0; i < text.length(); ++i) {
+        hash ^= static_cast<unsigned char>(text[i]);
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
 #endif
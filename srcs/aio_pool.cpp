@@ -0,0 +1,229 @@
+/* ************************************************************************** */
+/*                                                                            */
+/*                                                        :::      ::::::::   */
+/*   aio_pool.cpp                                       :+:      :+:    :+:   */
+/*                                                    +:+ +:+         +:+     */
+/*   By: aogbi <aogbi@student.42.fr>                +#+  +:+       +#+        */
+/*                                                +#+#+#+#+#+   +#+           */
+/*   Created: 2026/10/19 00:00:00 by aogbi             #+#    #+#             */
+/*   Updated: 2026/10/19 00:00:00 by aogbi            ###   ########.fr       */
+/*                                                                            */
+/* ************************************************************************** */
+
+#include "aio_pool.hpp"
+#include <iostream>
+#include <algorithm>
+#include <set>
+#include <cstring>
+#include <cerrno>
+#include <csignal>
+#include <unistd.h>
+#include <sys/eventfd.h>
+
+AioTask::AioTask(Kind kind)
+    : kind(kind), clientFd(-1), cancelled(false), started(0), dataOffset(0), dataLength(0), head(false), loaded(false),
+      cacheMode(UploadWriter::CACHE_KEEP), fsync(UploadWriter::FSYNC_OFF), error(0), next(NULL) {
+    index.statError = ENOENT;
+}
+
+AioTask::~AioTask() {
+    for (size_t i = 0; i < batch.size(); ++i) {
+        delete batch[i];
+    }
+}
+
+bool AioTask::servesIndex() const {
+    return !file.statError && S_ISDIR(file.info.st_mode) && !index.statError && S_ISREG(index.info.st_mode);
+}
+
+void AioTask::run(UploadWriter& writer) {
+    switch (kind) {
+    case AIO_SERVE: {
+        if (!loaded) {
+            OpenFileCache::load(path, file);
+            if (!file.statError && S_ISDIR(file.info.st_mode)) {
+                OpenFileCache::load(indexPath, index);
+            }
+        }
+        const OpenFile& target = readTarget();
+        if (!head && !target.statError && S_ISREG(target.info.st_mode) && target.fd >= 0) {
+            OpenFileCache::readContent(target, content);
+        }
+        break;
+    }
+    case AIO_LIST:
+        error = DirectoryListingCache::scan(path, entries) ? 0 : (errno ? errno : EACCES);
+        break;
+    case AIO_DELETE:
+        error = UploadWriter::remove(path);
+        break;
+    case AIO_UPLOAD: {
+        // Under FSYNC_BATCH the file joins the loop's next AIO_SYNC once written
+        StringView all = body.view();
+        bool ok = all.length() >= dataOffset + dataLength && UploadWriter::makeDir(dir)
+                  && writer.write(dir, path, all.data() + dataOffset, dataLength, cacheMode, fsync);
+        error = ok ? 0 : EIO;
+        body.clear();
+        break;
+    }
+    case AIO_SYNC: {
+        // The data of each file, then each directory once for the new entries
+        std::set<std::string> dirs;
+        for (size_t i = 0; i < batch.size(); ++i) {
+            batch[i]->error = UploadWriter::syncFile(batch[i]->path);
+            dirs.insert(batch[i]->dir);
+        }
+        for (std::set<std::string>::iterator it = dirs.begin(); it != dirs.end(); ++it) {
+            int dirError = UploadWriter::syncDir(*it);
+            for (size_t i = 0; dirError && i < batch.size(); ++i) {
+                if (batch[i]->dir == *it && !batch[i]->error) {
+                    batch[i]->error = dirError;
+                }
+            }
+        }
+        break;
+    }
+    }
+}
+
+AioPool::AioPool() : maxQueue(0), stopping(false), completed(NULL), eventFd(-1) {
+    pthread_mutex_init(&lock, NULL);
+    pthread_cond_init(&wake, NULL);
+}
+
+AioPool::~AioPool() {
+    stop();
+    pthread_cond_destroy(&wake);
+    pthread_mutex_destroy(&lock);
+}
+
+bool AioPool::start(size_t threadCount, size_t maxQueue) {
+    eventFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (eventFd < 0) {
+        std::cerr << "eventfd failed: " << strerror(errno) << std::endl;
+        return false;
+    }
+    this->maxQueue = maxQueue;
+    stopping = false;
+
+    // Signals stay with the loop thread
+    sigset_t all;
+    sigset_t previous;
+    sigfillset(&all);
+    pthread_sigmask(SIG_BLOCK, &all, &previous);
+    for (size_t i = 0; i < threadCount; ++i) {
+        pthread_t thread;
+        int rc = pthread_create(&thread, NULL, workerMain, this);
+        if (rc != 0) {
+            std::cerr << "pthread_create failed: " << strerror(rc) << std::endl;
+            break;
+        }
+        threads.push_back(thread);
+    }
+    pthread_sigmask(SIG_SETMASK, &previous, NULL);
+
+    if (threads.empty()) {
+        close(eventFd);
+        eventFd = -1;
+        return false;
+    }
+    return true;
+}
+
+void AioPool::stop() {
+    if (eventFd < 0) {
+        return;
+    }
+    pthread_mutex_lock(&lock);
+    stopping = true;
+    pthread_cond_broadcast(&wake);
+    pthread_mutex_unlock(&lock);
+    for (size_t i = 0; i < threads.size(); ++i) {
+        pthread_join(threads[i], NULL);
+    }
+    threads.clear();
+
+    for (size_t i = 0; i < queue.size(); ++i) {
+        delete queue[i];
+    }
+    queue.clear();
+    std::vector<AioTask*> done;
+    takeCompleted(done);
+    for (size_t i = 0; i < done.size(); ++i) {
+        delete done[i];
+    }
+    close(eventFd);
+    eventFd = -1;
+}
+
+bool AioPool::submit(AioTask* task) {
+    pthread_mutex_lock(&lock);
+    if (queue.size() >= maxQueue) {
+        pthread_mutex_unlock(&lock);
+        return false;
+    }
+    queue.push_back(task);
+    pthread_cond_signal(&wake);
+    pthread_mutex_unlock(&lock);
+    return true;
+}
+
+void* AioPool::workerMain(void* arg) {
+    static_cast<AioPool*>(arg)->work();
+    return NULL;
+}
+
+void AioPool::work() {
+    UploadWriter writer;
+    pthread_mutex_lock(&lock);
+    while (true) {
+        while (queue.empty() && !stopping) {
+            pthread_cond_wait(&wake, &lock);
+        }
+        if (stopping) {
+            break;
+        }
+        AioTask* task = queue.front();
+        queue.pop_front();
+        pthread_mutex_unlock(&lock);
+
+        task->run(writer);
+        complete(task);
+
+        pthread_mutex_lock(&lock);
+    }
+    pthread_mutex_unlock(&lock);
+}
+
+void AioPool::complete(AioTask* task) {
+    AioTask* head;
+    do {
+        head = completed;
+        task->next = head;
+    } while (!__sync_bool_compare_and_swap(&completed, head, task));
+
+    // Only the push onto an empty list wakes the loop; it takes the rest with it
+    if (head == NULL) {
+        uint64_t one = 1;
+        while (write(eventFd, &one, sizeof(one)) < 0 && errno == EINTR) {
+        }
+    }
+}
+
+void AioPool::takeCompleted(std::vector<AioTask*>& out) {
+    // Reset the eventfd before taking the list, so a push after the swap wakes the loop again
+    uint64_t count;
+    while (read(eventFd, &count, sizeof(count)) < 0 && errno == EINTR) {
+    }
+    AioTask* list;
+    do {
+        list = completed;
+    } while (!__sync_bool_compare_and_swap(&completed, list, static_cast<AioTask*>(NULL)));
+
+    // The list is newest first
+    size_t first = out.size();
+    for (; list; list = list->next) {
+        out.push_back(list);
+    }
+    std::reverse(out.begin() + first, out.end());
+}
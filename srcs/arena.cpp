@@ -0,0 +1,65 @@
+/* ************************************************************************** */
+/*                                                                            */
+/*                                                        :::      ::::::::   */
+/*   arena.cpp                                          :+:      :+:    :+:   */
+/*                                                    +:+ +:+         +:+     */
+/*   By: aogbi <aogbi@student.42.fr>                +#+  +:+       +#+        */
+/*                                                +#+#+#+#+#+   +#+           */
+/*   Created: 2026/10/19 00:00:00 by aogbi             #+#    #+#             */
+/*   Updated: 2026/10/19 00:00:00 by aogbi            ###   ########.fr       */
+/*                                                                            */
+/* ************************************************************************** */
+
+#include "arena.hpp"
+#include <stdint.h>
+
+Arena::Arena(char* storage, size_t size)
+    : initial(storage), initialSize(size), blocks(NULL), nextBlockSize(FIRST_BLOCK) {
+    // Inline storage is a char array; allocations start on the first aligned byte
+    size_t skew = reinterpret_cast<uintptr_t>(storage) & (ALIGN - 1);
+    if (storage && skew) {
+        size_t pad = ALIGN - skew;
+        initial += pad;
+        initialSize = initialSize > pad ? initialSize - pad : 0;
+    }
+    cursor = initial;
+    limit = initial + initialSize;
+}
+
+Arena::~Arena() {
+    reset();
+}
+
+void* Arena::newBlock(size_t size) {
+    // The block header takes one alignment unit, so the data that follows stays aligned
+    char* memory = static_cast<char*>(::operator new(ALIGN + size));
+    Block* block = reinterpret_cast<Block*>(memory);
+    block->next = blocks;
+    blocks = block;
+    return memory + ALIGN;
+}
+
+void* Arena::grow(size_t size) {
+    // Large allocations (a request body) get a block of their own; the current one keeps serving small ones
+    if (size >= nextBlockSize) {
+        return newBlock(size);
+    }
+    char* data = static_cast<char*>(newBlock(nextBlockSize));
+    cursor = data + size;
+    limit = data + nextBlockSize;
+    if (nextBlockSize < MAX_BLOCK) {
+        nextBlockSize *= 2;
+    }
+    return data;
+}
+
+void Arena::reset() {
+    while (blocks) {
+        Block* next = blocks->next;
+        ::operator delete(blocks);
+        blocks = next;
+    }
+    cursor = initial;
+    limit = initial + initialSize;
+    nextBlockSize = FIRST_BLOCK;
+}
@@ -0,0 +1,167 @@
+/* ************************************************************************** */
+/*                                                                            */
+/*                                                        :::      ::::::::   */
+/*   body_framing.cpp                                   :+:      :+:    :+:   */
+/*                                                    +:+ +:+         +:+     */
+/*   By: aogbi <aogbi@student.42.fr>                +#+  +:+       +#+        */
+/*                                                +#+#+#+#+#+   +#+           */
+/*   Created: 2026/10/19 00:00:00 by aogbi             #+#    #+#             */
+/*   Updated: 2026/10/19 00:00:00 by aogbi            ###   ########.fr       */
+/*                                                                            */
+/* ************************************************************************** */
+
+#include "body_framing.hpp"
+
+// Chunk sizes beyond this are treated as malformed rather than overflowing
+static const uint64_t MAX_CHUNK_SIZE = static_cast<uint64_t>(1) << 48;
+
+static int hexValue(char c) {
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+    return -1;
+}
+
+ChunkedScanner::ChunkedScanner() : state(SIZE), remaining(0), sawDigit(false) {
+}
+
+void ChunkedScanner::endSizeLine() {
+    if (!sawDigit) {
+        state = FAILED;
+    } else if (remaining == 0) {
+        state = TRAILER_START;
+    } else {
+        state = DATA;
+    }
+}
+
+size_t ChunkedScanner::feed(const char* data, size_t length, std::string* payload) {
+    size_t i = 0;
+    while (i < length && state != DONE && state != FAILED) {
+        if (state == DATA) {
+            // Skip chunk data in one step instead of byte by byte
+            size_t take = length - i;
+            if (take > remaining) {
+                take = static_cast<size_t>(remaining);
+            }
+            if (payload) {
+                payload->append(data + i, take);
+            }
+            i += take;
+            remaining -= take;
+            if (remaining == 0) {
+                state = DATA_CR;
+            }
+            continue;
+        }
+
+        char c = data[i++];
+        switch (state) {
+            case SIZE: {
+                int digit = hexValue(c);
+                if (digit >= 0) {
+                    remaining = remaining * 16 + digit;
+                    sawDigit = true;
+                    if (remaining > MAX_CHUNK_SIZE) {
+                        state = FAILED;
+                    }
+                } else if (c == ';' || c == ' ' || c == '\t') {
+                    state = EXTENSION;
+                } else if (c == '\r') {
+                    state = SIZE_LF;
+                } else if (c == '\n') {
+                    endSizeLine();
+                } else {
+                    state = FAILED;
+                }
+                break;
+            }
+            case EXTENSION:
+                if (c == '\r') {
+                    state = SIZE_LF;
+                } else if (c == '\n') {
+                    endSizeLine();
+                }
+                break;
+            case SIZE_LF:
+                if (c == '\n') {
+                    endSizeLine();
+                } else {
+                    state = FAILED;
+                }
+                break;
+            case DATA_CR:
+                if (c == '\r') {
+                    state = DATA_LF;
+                } else if (c == '\n') {
+                    state = SIZE;
+                    sawDigit = false;
+                } else {
+                    state = FAILED;
+                }
+                break;
+            case DATA_LF:
+                if (c == '\n') {
+                    state = SIZE;
+                    sawDigit = false;
+                } else {
+                    state = FAILED;
+                }
+                break;
+            case TRAILER_START:
+                if (c == '\r') {
+                    state = FINAL_LF;
+                } else if (c == '\n') {
+                    state = DONE;
+                } else {
+                    state = TRAILER_LINE;
+                }
+                break;
+            case TRAILER_LINE:
+                if (c == '\n') {
+                    state = TRAILER_START;
+                }
+                break;
+            case FINAL_LF:
+                state = (c == '\n') ? DONE : FAILED;
+                break;
+            default:
+                break;
+        }
+    }
+    return i;
+}
+
+size_t BodyFraming::consume(const char* data, size_t length) {
+    switch (mode) {
+        case NONE:
+            return 0;
+        case LENGTH: {
+            size_t take = length;
+            if (take > remaining) {
+                take = static_cast<size_t>(remaining);
+            }
+            remaining -= take;
+            return take;
+        }
+        case CHUNKED:
+            return chunks.feed(data, length);
+        case UNTIL_CLOSE:
+            return length;
+    }
+    return 0;
+}
+
+bool BodyFraming::complete() const {
+    switch (mode) {
+        case NONE:
+            return true;
+        case LENGTH:
+            return remaining == 0;
+        case CHUNKED:
+            return chunks.done();
+        case UNTIL_CLOSE:
+            return false;
+    }
+    return true;
+}
@@ -0,0 +1,154 @@
+/* ************************************************************************** */
+/*                                                                            */
+/*                                                        :::      ::::::::   */
+/*   body_source.cpp                                    :+:      :+:    :+:   */
+/*                                                    +:+ +:+         +:+     */
+/*   By: aogbi <aogbi@student.42.fr>                +#+  +:+       +#+        */
+/*                                                +#+#+#+#+#+   +#+           */
+/*   Created: 2026/10/19 00:00:00 by aogbi             #+#    #+#             */
+/*   Updated: 2026/10/19 00:00:00 by aogbi            ###   ########.fr       */
+/*                                                                            */
+/* ************************************************************************** */
+
+#include "body_source.hpp"
+#include <iostream>
+#include <vector>
+#include <algorithm>
+#include <cstring>
+#include <cstdlib>
+#include <cerrno>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/sendfile.h>
+
+BodySource::BodySource() : fd(-1), fileLength(0), mapped(NULL), mappedLength(0) {
+}
+
+BodySource::BodySource(const BodySource& other)
+    : memory(other.memory), fd(-1), fileLength(other.fileLength), mapped(NULL), mappedLength(0) {
+    if (other.fd >= 0) {
+        fd = fcntl(other.fd, F_DUPFD_CLOEXEC, 0);
+    }
+}
+
+BodySource& BodySource::operator=(const BodySource& other) {
+    if (this != &other) {
+        BodySource copy(other);
+        swap(copy);
+    }
+    return *this;
+}
+
+BodySource::~BodySource() {
+    clear();
+}
+
+void BodySource::unmap() const {
+    if (mapped) {
+        munmap(const_cast<char*>(mapped), mappedLength);
+        mapped = NULL;
+        mappedLength = 0;
+    }
+}
+
+void BodySource::clear() {
+    unmap();
+    if (fd >= 0) {
+        close(fd);
+        fd = -1;
+    }
+    fileLength = 0;
+    std::string().swap(memory);
+}
+
+void BodySource::swap(BodySource& other) {
+    memory.swap(other.memory);
+    std::swap(fd, other.fd);
+    std::swap(fileLength, other.fileLength);
+    std::swap(mapped, other.mapped);
+    std::swap(mappedLength, other.mappedLength);
+}
+
+void BodySource::assign(const char* data, size_t length) {
+    clear();
+    memory.assign(data, length);
+}
+
+bool BodySource::append(const char* data, size_t length) {
+    if (fd < 0) {
+        memory.append(data, length);
+        return true;
+    }
+    // A mapping taken earlier would not cover the new bytes
+    unmap();
+    while (length > 0) {
+        ssize_t written = pwrite(fd, data, length, fileLength);
+        if (written < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            std::cerr << "Failed to spool request body: " << strerror(errno) << std::endl;
+            return false;
+        }
+        data += written;
+        length -= written;
+        fileLength += written;
+    }
+    return true;
+}
+
+bool BodySource::spool(const std::string& dir) {
+    if (fd >= 0) {
+        return true;
+    }
+    int file = open(dir.c_str(), O_TMPFILE | O_RDWR | O_CLOEXEC, 0600);
+    if (file < 0 && (errno == EOPNOTSUPP || errno == EISDIR || errno == EINVAL)) {
+        // File systems without O_TMPFILE: a named file, unlinked right away
+        std::string pattern = dir + "/webserv-body-XXXXXX";
+        std::vector<char> name(pattern.begin(), pattern.end());
+        name.push_back('\0');
+        file = mkostemp(&name[0], O_CLOEXEC);
+        if (file >= 0) {
+            unlink(&name[0]);
+        }
+    }
+    if (file < 0) {
+        std::cerr << "Failed to create body file in " << dir << ": " << strerror(errno) << std::endl;
+        return false;
+    }
+    fd = file;
+    fileLength = 0;
+    std::string buffered;
+    buffered.swap(memory);
+    return append(buffered.data(), buffered.length());
+}
+
+StringView BodySource::view() const {
+    if (fd < 0) {
+        return StringView(memory.data(), memory.length());
+    }
+    if (!mapped && fileLength > 0) {
+        void* map = mmap(NULL, fileLength, PROT_READ, MAP_SHARED, fd, 0);
+        if (map == MAP_FAILED) {
+            std::cerr << "Failed to map request body: " << strerror(errno) << std::endl;
+            return StringView();
+        }
+        mapped = static_cast<const char*>(map);
+        mappedLength = fileLength;
+    }
+    return StringView(mapped ? mapped : "", mappedLength);
+}
+
+ssize_t BodySource::writeTo(int outFd, size_t offset, size_t count) const {
+    if (fd < 0) {
+        return write(outFd, memory.data() + offset, count);
+    }
+    loff_t from = offset;
+    ssize_t written = splice(fd, &from, outFd, NULL, count, SPLICE_F_NONBLOCK);
+    if (written < 0 && errno == EINVAL) {
+        off_t position = offset;
+        written = sendfile(outFd, fd, &position, count);
+    }
+    return written;
+}
@@ -0,0 +1,381 @@
+/* ************************************************************************** */
+/*                                                                            */
+/*                                                        :::      ::::::::   */
+/*   byte_scan.cpp                                      :+:      :+:    :+:   */
+/*                                                    +:+ +:+         +:+     */
+/*   By: aogbi <aogbi@student.42.fr>                +#+  +:+       +#+        */
+/*                                                +#+#+#+#+#+   +#+           */
+/*   Created: 2026/10/19 00:00:00 by aogbi             #+#    #+#             */
+/*   Updated: 2026/10/19 00:00:00 by aogbi            ###   ########.fr       */
+/*                                                                            */
+/* ************************************************************************** */
+
+#include "byte_scan.hpp"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || (defined(__i386__) && defined(__SSE2__)))
+#define BYTE_SCAN_X86 1
+#include <immintrin.h>
+#endif
+
+// --- scalar ----------------------------------------------------------------------
+
+// tchar: "!#$%&'*+-.^_`|~", digits and letters
+static bool tokenTable[256];
+
+static bool buildTokenTable() {
+    static const char extra[] = "!#$%&'*+-.^_`|~";
+    for (int c = 0; c < 256; ++c) {
+        tokenTable[c] = (c >= '0' && c <= '9') || (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z');
+    }
+    for (size_t i = 0; i < sizeof(extra) - 1; ++i) {
+        tokenTable[static_cast<unsigned char>(extra[i])] = true;
+    }
+    return true;
+}
+
+static const bool tokenTableReady = buildTokenTable();
+
+// Looks at the '\n' bytes in [from, to); lf keeps the first "\n\n" until a "\r\n\r\n" turns up
+static size_t headEndScalar(const char* data, size_t from, size_t to, size_t& lf, size_t& separator) {
+    for (size_t i = from; i < to; ++i) {
+        if (data[i] != '\n') {
+            continue;
+        }
+        if (i >= 3 && data[i - 1] == '\r' && data[i - 2] == '\n' && data[i - 3] == '\r') {
+            separator = 4;
+            return i - 3;
+        }
+        if (lf == ByteScan::npos && i >= 1 && data[i - 1] == '\n') {
+            lf = i - 1;
+        }
+    }
+    return ByteScan::npos;
+}
+
+static size_t finishHeadEnd(size_t lf, size_t& separator) {
+    if (lf != ByteScan::npos) {
+        separator = 2;
+    }
+    return lf;
+}
+
+static size_t findHeadEndScalar(const char* data, size_t length, size_t& separator) {
+    size_t lf = ByteScan::npos;
+    size_t found = headEndScalar(data, 0, length, lf, separator);
+    return (found != ByteScan::npos) ? found : finishHeadEnd(lf, separator);
+}
+
+static size_t colonOrNewlineScalar(const char* data, size_t from, size_t length) {
+    for (size_t i = from; i < length; ++i) {
+        if (data[i] == ':' || data[i] == '\n') {
+            return i;
+        }
+    }
+    return length;
+}
+
+static size_t findColonOrNewlineScalar(const char* data, size_t length) {
+    return colonOrNewlineScalar(data, 0, length);
+}
+
+static bool tokenScalar(const char* data, size_t from, size_t length) {
+    for (size_t i = from; i < length; ++i) {
+        if (!tokenTable[static_cast<unsigned char>(data[i])]) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static bool isTokenScalar(const char* data, size_t length) {
+    return length > 0 && tokenScalar(data, 0, length);
+}
+
+#ifdef BYTE_SCAN_X86
+
+// --- SSE2 ------------------------------------------------------------------------
+
+static size_t findHeadEndSse2(const char* data, size_t length, size_t& separator) {
+    const __m128i cr = _mm_set1_epi8('\r');
+    const __m128i lf = _mm_set1_epi8('\n');
+    size_t lfFound = ByteScan::npos;
+    // Lanes start at 3 so that the three bytes before each one can be loaded too
+    size_t found = headEndScalar(data, 0, length < 3 ? length : 3, lfFound, separator);
+    if (found != ByteScan::npos) {
+        return found;
+    }
+    size_t pos = 3;
+    for (; pos + 16 <= length; pos += 16) {
+        // Runs without a newline (cookies, long values) are skipped 64 bytes at a time
+        while (pos + 64 <= length) {
+            const __m128i* block = reinterpret_cast<const __m128i*>(data + pos);
+            __m128i any = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(_mm_loadu_si128(block), lf),
+                                                    _mm_cmpeq_epi8(_mm_loadu_si128(block + 1), lf)),
+                                       _mm_or_si128(_mm_cmpeq_epi8(_mm_loadu_si128(block + 2), lf),
+                                                    _mm_cmpeq_epi8(_mm_loadu_si128(block + 3), lf)));
+            if (_mm_movemask_epi8(any)) {
+                break;
+            }
+            pos += 64;
+        }
+        if (pos + 16 > length) {
+            break;
+        }
+        __m128i at = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + pos));
+        __m128i back1 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + pos - 1));
+        __m128i isLf = _mm_cmpeq_epi8(at, lf);
+        if (_mm_movemask_epi8(isLf) == 0) {
+            continue;
+        }
+        __m128i back2 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + pos - 2));
+        __m128i back3 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + pos - 3));
+        __m128i crlf = _mm_and_si128(_mm_and_si128(isLf, _mm_cmpeq_epi8(back1, cr)),
+                                     _mm_and_si128(_mm_cmpeq_epi8(back2, lf), _mm_cmpeq_epi8(back3, cr)));
+        int mask = _mm_movemask_epi8(crlf);
+        if (mask) {
+            separator = 4;
+            return pos + __builtin_ctz(mask) - 3;
+        }
+        if (lfFound == ByteScan::npos) {
+            mask = _mm_movemask_epi8(_mm_and_si128(isLf, _mm_cmpeq_epi8(back1, lf)));
+            if (mask) {
+                lfFound = pos + __builtin_ctz(mask) - 1;
+            }
+        }
+    }
+    if (pos < length) {
+        found = headEndScalar(data, pos, length, lfFound, separator);
+        if (found != ByteScan::npos) {
+            return found;
+        }
+    }
+    return finishHeadEnd(lfFound, separator);
+}
+
+static size_t findColonOrNewlineSse2(const char* data, size_t length) {
+    const __m128i colon = _mm_set1_epi8(':');
+    const __m128i lf = _mm_set1_epi8('\n');
+    size_t pos = 0;
+    for (; pos + 16 <= length; pos += 16) {
+        __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + pos));
+        int mask = _mm_movemask_epi8(_mm_or_si128(_mm_cmpeq_epi8(chunk, colon), _mm_cmpeq_epi8(chunk, lf)));
+        if (mask) {
+            return pos + __builtin_ctz(mask);
+        }
+    }
+    return colonOrNewlineScalar(data, pos, length);
+}
+
+// Bytes of chunk that are not tchar: outside '!'..'~', or one of "(),/:;<=>?@[\]{}
+static __m128i nonTokenSse2(__m128i chunk) {
+    // Signed compares: bytes >= 0x80 are negative and fall outside every range
+    __m128i printable = _mm_and_si128(_mm_cmpgt_epi8(chunk, _mm_set1_epi8(0x20)),
+                                      _mm_cmplt_epi8(chunk, _mm_set1_epi8(0x7f)));
+    __m128i parens = _mm_and_si128(_mm_cmpgt_epi8(chunk, _mm_set1_epi8('(' - 1)),
+                                   _mm_cmplt_epi8(chunk, _mm_set1_epi8(')' + 1)));
+    __m128i colonToAt = _mm_and_si128(_mm_cmpgt_epi8(chunk, _mm_set1_epi8(':' - 1)),
+                                      _mm_cmplt_epi8(chunk, _mm_set1_epi8('@' + 1)));
+    __m128i brackets = _mm_and_si128(_mm_cmpgt_epi8(chunk, _mm_set1_epi8('[' - 1)),
+                                     _mm_cmplt_epi8(chunk, _mm_set1_epi8(']' + 1)));
+    __m128i singles = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(chunk, _mm_set1_epi8('"')),
+                                                _mm_cmpeq_epi8(chunk, _mm_set1_epi8(','))),
+                                   _mm_or_si128(_mm_cmpeq_epi8(chunk, _mm_set1_epi8('/')),
+                                                _mm_or_si128(_mm_cmpeq_epi8(chunk, _mm_set1_epi8('{')),
+                                                             _mm_cmpeq_epi8(chunk, _mm_set1_epi8('}')))));
+    __m128i separators = _mm_or_si128(_mm_or_si128(parens, colonToAt), _mm_or_si128(brackets, singles));
+    return _mm_or_si128(_mm_andnot_si128(printable, _mm_set1_epi8(-1)), separators);
+}
+
+static bool isTokenSse2(const char* data, size_t length) {
+    if (length == 0) {
+        return false;
+    }
+    size_t pos = 0;
+    for (; pos + 16 <= length; pos += 16) {
+        __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + pos));
+        if (_mm_movemask_epi8(nonTokenSse2(chunk))) {
+            return false;
+        }
+    }
+    return tokenScalar(data, pos, length);
+}
+
+// --- AVX2 ------------------------------------------------------------------------
+
+__attribute__((target("avx2")))
+static size_t findHeadEndAvx2(const char* data, size_t length, size_t& separator) {
+    const __m256i cr = _mm256_set1_epi8('\r');
+    const __m256i lf = _mm256_set1_epi8('\n');
+    size_t lfFound = ByteScan::npos;
+    size_t found = headEndScalar(data, 0, length < 3 ? length : 3, lfFound, separator);
+    if (found != ByteScan::npos) {
+        return found;
+    }
+    size_t pos = 3;
+    for (; pos + 32 <= length; pos += 32) {
+        while (pos + 64 <= length) {
+            const __m256i* block = reinterpret_cast<const __m256i*>(data + pos);
+            __m256i any = _mm256_or_si256(_mm256_cmpeq_epi8(_mm256_loadu_si256(block), lf),
+                                          _mm256_cmpeq_epi8(_mm256_loadu_si256(block + 1), lf));
+            if (_mm256_movemask_epi8(any)) {
+                break;
+            }
+            pos += 64;
+        }
+        if (pos + 32 > length) {
+            break;
+        }
+        __m256i at = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + pos));
+        __m256i isLf = _mm256_cmpeq_epi8(at, lf);
+        if (_mm256_movemask_epi8(isLf) == 0) {
+            continue;
+        }
+        __m256i back1 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + pos - 1));
+        __m256i back2 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + pos - 2));
+        __m256i back3 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + pos - 3));
+        __m256i crlf = _mm256_and_si256(_mm256_and_si256(isLf, _mm256_cmpeq_epi8(back1, cr)),
+                                        _mm256_and_si256(_mm256_cmpeq_epi8(back2, lf), _mm256_cmpeq_epi8(back3, cr)));
+        unsigned mask = static_cast<unsigned>(_mm256_movemask_epi8(crlf));
+        if (mask) {
+            separator = 4;
+            return pos + __builtin_ctz(mask) - 3;
+        }
+        if (lfFound == ByteScan::npos) {
+            mask = static_cast<unsigned>(_mm256_movemask_epi8(_mm256_and_si256(isLf, _mm256_cmpeq_epi8(back1, lf))));
+            if (mask) {
+                lfFound = pos + __builtin_ctz(mask) - 1;
+            }
+        }
+    }
+    if (pos < length) {
+        found = headEndScalar(data, pos, length, lfFound, separator);
+        if (found != ByteScan::npos) {
+            return found;
+        }
+    }
+    return finishHeadEnd(lfFound, separator);
+}
+
+__attribute__((target("avx2")))
+static size_t findColonOrNewlineAvx2(const char* data, size_t length) {
+    const __m256i colon = _mm256_set1_epi8(':');
+    const __m256i lf = _mm256_set1_epi8('\n');
+    size_t pos = 0;
+    for (; pos + 32 <= length; pos += 32) {
+        __m256i chunk = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + pos));
+        unsigned mask = static_cast<unsigned>(_mm256_movemask_epi8(
+            _mm256_or_si256(_mm256_cmpeq_epi8(chunk, colon), _mm256_cmpeq_epi8(chunk, lf))));
+        if (mask) {
+            return pos + __builtin_ctz(mask);
+        }
+    }
+    return colonOrNewlineScalar(data, pos, length);
+}
+
+__attribute__((target("avx2")))
+static bool isTokenAvx2(const char* data, size_t length) {
+    if (length == 0) {
+        return false;
+    }
+    // tchar bitmap: byte b is a token character when bits[b & 0x0f] has bit (b >> 4) set
+    static const unsigned char bits[16] = {
+        0xe8, 0xfc, 0xf8, 0xfc, 0xfc, 0xfc, 0xfc, 0xfc,
+        0xf8, 0xf8, 0xf4, 0x54, 0xd0, 0x54, 0xf4, 0x70
+    };
+    const __m256i table = _mm256_broadcastsi128_si256(_mm_loadu_si128(reinterpret_cast<const __m128i*>(bits)));
+    // 1 << high nibble; bytes >= 0x80 get 0 and so match nothing
+    const __m256i highBits = _mm256_setr_epi8(
+        1, 2, 4, 8, 16, 32, 64, -128, 0, 0, 0, 0, 0, 0, 0, 0,
+        1, 2, 4, 8, 16, 32, 64, -128, 0, 0, 0, 0, 0, 0, 0, 0);
+    const __m256i lowMask = _mm256_set1_epi8(0x0f);
+    size_t pos = 0;
+    for (; pos + 32 <= length; pos += 32) {
+        __m256i chunk = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + pos));
+        __m256i row = _mm256_shuffle_epi8(table, _mm256_and_si256(chunk, lowMask));
+        __m256i column = _mm256_shuffle_epi8(highBits, _mm256_and_si256(_mm256_srli_epi16(chunk, 4), lowMask));
+        __m256i miss = _mm256_cmpeq_epi8(_mm256_and_si256(row, column), _mm256_setzero_si256());
+        if (_mm256_movemask_epi8(miss)) {
+            return false;
+        }
+    }
+    return tokenScalar(data, pos, length);
+}
+
+#endif // BYTE_SCAN_X86
+
+// --- dispatch --------------------------------------------------------------------
+
+struct ScanKernels {
+    ByteScan::Level level;
+    size_t (*findHeadEnd)(const char*, size_t, size_t&);
+    size_t (*findColonOrNewline)(const char*, size_t);
+    bool (*isToken)(const char*, size_t);
+};
+
+static bool supported(ByteScan::Level level) {
+#ifdef BYTE_SCAN_X86
+    __builtin_cpu_init();
+    if (level == ByteScan::AVX2) {
+        return __builtin_cpu_supports("avx2");
+    }
+    return true;
+#else
+    return level == ByteScan::SCALAR;
+#endif
+}
+
+static ScanKernels kernelsFor(ByteScan::Level level) {
+    ScanKernels kernels = { ByteScan::SCALAR, findHeadEndScalar, findColonOrNewlineScalar, isTokenScalar };
+#ifdef BYTE_SCAN_X86
+    if (level == ByteScan::SSE2) {
+        ScanKernels sse2 = { ByteScan::SSE2, findHeadEndSse2, findColonOrNewlineSse2, isTokenSse2 };
+        kernels = sse2;
+    } else if (level == ByteScan::AVX2) {
+        ScanKernels avx2 = { ByteScan::AVX2, findHeadEndAvx2, findColonOrNewlineAvx2, isTokenAvx2 };
+        kernels = avx2;
+    }
+#endif
+    return kernels;
+}
+
+static ScanKernels bestKernels() {
+    if (supported(ByteScan::AVX2)) {
+        return kernelsFor(ByteScan::AVX2);
+    }
+    return kernelsFor(supported(ByteScan::SSE2) ? ByteScan::SSE2 : ByteScan::SCALAR);
+}
+
+// Chosen during static initialization, before any thread exists
+static ScanKernels kernels = bestKernels();
+
+ByteScan::Level ByteScan::level() {
+    return kernels.level;
+}
+
+const char* ByteScan::levelName(Level level) {
+    switch (level) {
+        case AVX2: return "avx2";
+        case SSE2: return "sse2";
+        default: return "scalar";
+    }
+}
+
+bool ByteScan::setLevel(Level level) {
+    if (!supported(level)) {
+        return false;
+    }
+    kernels = kernelsFor(level);
+    return true;
+}
+
+size_t ByteScan::findHeadEnd(const char* data, size_t length, size_t& separator) {
+    return kernels.findHeadEnd(data, length, separator);
+}
+
+size_t ByteScan::findColonOrNewline(const char* data, size_t length) {
+    return kernels.findColonOrNewline(data, length);
+}
+
+bool ByteScan::isToken(const char* data, size_t length) {
+    return kernels.isToken(data, length);
+}
@@ -0,0 +1,346 @@
+/* ************************************************************************** */
+/*                                                                            */
+/*                                                        :::      ::::::::   */
+/*   cgi_cache.cpp                                      :+:      :+:    :+:   */
+/*                                                    +:+ +:+         +:+     */
+/*   By: aogbi <aogbi@student.42.fr>                +#+  +:+       +#+        */
+/*                                                +#+#+#+#+#+   +#+           */
+/*   Created: 2026/10/19 00:00:00 by aogbi             #+#    #+#             */
+/*   Updated: 2026/10/19 00:00:00 by aogbi            ###   ########.fr       */
+/*                                                                            */
+/* ************************************************************************** */
+
+#include "cgi_cache.hpp"
+#include "utils.hpp"
+#include <sys/mman.h>
+#include <pthread.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <cerrno>
+#include <cstring>
+#include <cstdlib>
+#include <cctype>
+#include <iostream>
+
+enum SlotState { SLOT_EMPTY = 0, SLOT_READY, SLOT_FILLING };
+
+static const size_t ALIGNMENT = 64;
+
+static size_t alignUp(size_t value) {
+    return (value + ALIGNMENT - 1) & ~(ALIGNMENT - 1);
+}
+
+struct CgiCache::Zone {
+    pthread_mutex_t mutex;
+    uint32_t slotCount;
+    uint32_t slotSize;      // bytes per slot, header included
+    uint64_t clock;         // LRU stamp source
+};
+
+struct CgiCache::Slot {
+    uint64_t hash;
+    uint64_t lastUsed;
+    int64_t expires;
+    int64_t fillStarted;
+    uint32_t keyLength;
+    uint32_t dataLength;
+    int32_t state;
+    int32_t fillerPid;
+    int32_t fillerTid;      // the reactor thread, as the reactors of worker_threads share a pid
+    // key bytes, then the serialized response
+
+    char* payload() { return reinterpret_cast<char*>(this + 1); }
+    const char* payload() const { return reinterpret_cast<const char*>(this + 1); }
+};
+
+static int32_t threadId() {
+    return static_cast<int32_t>(syscall(SYS_gettid));
+}
+
+CgiCache::CgiCache() : zone(NULL), mappedBytes(0) {
+}
+
+CgiCache::~CgiCache() {
+    if (zone) {
+        munmap(zone, mappedBytes);
+    }
+}
+
+bool CgiCache::init(size_t zoneBytes, size_t entryBytes) {
+    size_t headerBytes = alignUp(sizeof(Zone));
+    size_t slotSize = alignUp(sizeof(Slot) + entryBytes);
+    size_t slotCount = zoneBytes > headerBytes ? (zoneBytes - headerBytes) / slotSize : 0;
+    if (slotCount < PROBE_WINDOW) {
+        slotCount = PROBE_WINDOW;
+    }
+
+    mappedBytes = headerBytes + slotCount * slotSize;
+    void* memory = mmap(NULL, mappedBytes, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (memory == MAP_FAILED) {
+        std::cerr << "Error: cgi_cache zone mmap failed: " << strerror(errno) << std::endl;
+        return false;
+    }
+
+    // Anonymous mappings start zeroed, so every slot is already SLOT_EMPTY
+    Zone* mapped = static_cast<Zone*>(memory);
+    pthread_mutexattr_t attr;
+    pthread_mutexattr_init(&attr);
+    pthread_mutexattr_setpshared(&attr, PTHREAD_PROCESS_SHARED);
+    pthread_mutexattr_setrobust(&attr, PTHREAD_MUTEX_ROBUST);
+    int rc = pthread_mutex_init(&mapped->mutex, &attr);
+    pthread_mutexattr_destroy(&attr);
+    if (rc != 0) {
+        std::cerr << "Error: cgi_cache mutex init failed: " << strerror(rc) << std::endl;
+        munmap(memory, mappedBytes);
+        return false;
+    }
+    mapped->slotCount = static_cast<uint32_t>(slotCount);
+    mapped->slotSize = static_cast<uint32_t>(slotSize);
+    mapped->clock = 0;
+    zone = mapped;
+    return true;
+}
+
+void CgiCache::lock() {
+    // A worker that died holding the lock leaves slots intact but maybe FILLING;
+    // those are reclaimed by the pid/timeout check, so just mark the mutex usable
+    if (pthread_mutex_lock(&zone->mutex) == EOWNERDEAD) {
+        pthread_mutex_consistent(&zone->mutex);
+    }
+}
+
+void CgiCache::unlock() {
+    pthread_mutex_unlock(&zone->mutex);
+}
+
+CgiCache::Slot* CgiCache::slotAt(size_t index) const {
+    char* base = reinterpret_cast<char*>(zone) + alignUp(sizeof(Zone));
+    return reinterpret_cast<Slot*>(base + index * zone->slotSize);
+}
+
+bool CgiCache::keyEquals(const Slot* slot, const std::string& key) {
+    return slot->keyLength == key.length() && std::memcmp(slot->payload(), key.data(), key.length()) == 0;
+}
+
+bool CgiCache::fillerAlive(const Slot* slot, time_t now) {
+    if (now - slot->fillStarted > LOCK_TIMEOUT) {
+        return false;
+    }
+    return kill(slot->fillerPid, 0) == 0 || errno == EPERM;
+}
+
+bool CgiCache::ownsFill(const Slot* slot) {
+    return slot->state == SLOT_FILLING && slot->fillerPid == getpid() && slot->fillerTid == threadId();
+}
+
+CgiCache::Slot* CgiCache::findSlot(uint64_t hash, const std::string& key) const {
+    for (size_t i = 0; i < PROBE_WINDOW; ++i) {
+        Slot* slot = slotAt((hash + i) % zone->slotCount);
+        if (slot->state != SLOT_EMPTY && slot->hash == hash && keyEquals(slot, key)) {
+            return slot;
+        }
+    }
+    return NULL;
+}
+
+CgiCache::Slot* CgiCache::victimSlot(uint64_t hash, time_t now) const {
+    // Empty beats expired beats least recently used; live fills are never taken
+    Slot* best = NULL;
+    int bestRank = 0;
+    for (size_t i = 0; i < PROBE_WINDOW; ++i) {
+        Slot* slot = slotAt((hash + i) % zone->slotCount);
+        int rank;
+        if (slot->state == SLOT_EMPTY) {
+            return slot;
+        } else if (slot->state == SLOT_FILLING) {
+            if (fillerAlive(slot, now)) {
+                continue;
+            }
+            rank = 3;
+        } else if (slot->expires <= now) {
+            rank = 2;
+        } else {
+            rank = 1;
+        }
+        if (!best || rank > bestRank || (rank == bestRank && slot->lastUsed < best->lastUsed)) {
+            best = slot;
+            bestRank = rank;
+        }
+    }
+    return best;
+}
+
+CgiCache::Lookup CgiCache::acquire(const std::string& key, std::string& response, bool& waiting) {
+    waiting = false;
+    if (!zone) {
+        return BYPASS;
+    }
+    uint64_t hash = hashBytes(key);
+    time_t now = time(NULL);
+    size_t capacity = zone->slotSize - sizeof(Slot);
+
+    lock();
+    Slot* slot = findSlot(hash, key);
+    if (slot && slot->state == SLOT_READY && slot->expires > now) {
+        response.assign(slot->payload() + slot->keyLength, slot->dataLength);
+        slot->lastUsed = ++zone->clock;
+        unlock();
+        return HIT;
+    }
+    if (slot && slot->state == SLOT_FILLING && fillerAlive(slot, now)) {
+        unlock();
+        waiting = true;
+        return BYPASS;
+    }
+    if (!slot) {
+        slot = victimSlot(hash, now);
+    }
+    if (!slot || key.length() > capacity) {
+        unlock();
+        return BYPASS;
+    }
+
+    slot->hash = hash;
+    slot->keyLength = static_cast<uint32_t>(key.length());
+    std::memcpy(slot->payload(), key.data(), key.length());
+    slot->dataLength = 0;
+    slot->state = SLOT_FILLING;
+    slot->fillerPid = getpid();
+    slot->fillerTid = threadId();
+    slot->fillStarted = now;
+    slot->lastUsed = ++zone->clock;
+    unlock();
+    return FILL;
+}
+
+void CgiCache::store(const std::string& key, const std::string& response, int ttl) {
+    if (!zone) {
+        return;
+    }
+    uint64_t hash = hashBytes(key);
+    lock();
+    Slot* slot = findSlot(hash, key);
+    if (slot && ownsFill(slot)) {
+        if (slot->keyLength + response.length() <= zone->slotSize - sizeof(Slot)) {
+            std::memcpy(slot->payload() + slot->keyLength, response.data(), response.length());
+            slot->dataLength = static_cast<uint32_t>(response.length());
+            slot->expires = time(NULL) + ttl;
+            slot->state = SLOT_READY;
+        } else {
+            slot->state = SLOT_EMPTY;
+        }
+    }
+    unlock();
+}
+
+void CgiCache::abandon(const std::string& key) {
+    if (!zone) {
+        return;
+    }
+    uint64_t hash = hashBytes(key);
+    lock();
+    Slot* slot = findSlot(hash, key);
+    if (slot && ownsFill(slot)) {
+        slot->state = SLOT_EMPTY;
+    }
+    unlock();
+}
+
+std::string CgiCache::buildKey(const std::string& keyTemplate, const Request& req) {
+    const StringView target = req.getTarget();
+
+    std::string key;
+    key.reserve(keyTemplate.length() + target.length());
+    size_t i = 0;
+    while (i < keyTemplate.length()) {
+        if (keyTemplate[i] != '$') {
+            key += keyTemplate[i++];
+            continue;
+        }
+        size_t start = ++i;
+        while (i < keyTemplate.length() && (std::isalnum(static_cast<unsigned char>(keyTemplate[i])) || keyTemplate[i] == '_')) {
+            ++i;
+        }
+        std::string name = keyTemplate.substr(start, i - start);
+        StringView value;
+        if (name == "request_method") {
+            value = req.getMethod();
+        } else if (name == "request_uri") {
+            value = target;
+        } else if (name == "uri") {
+            value = req.getPath();
+        } else if (name == "args") {
+            value = req.getQuery();
+        } else if (name == "host") {
+            value = req.getHeader(Request::HEADER_HOST);
+        } else if (name.compare(0, 5, "http_") == 0) {
+            std::string header = name.substr(5);
+            for (size_t j = 0; j < header.length(); ++j) {
+                header[j] = (header[j] == '_') ? '-' : StringView::lower(header[j]);
+            }
+            value = req.getHeader(header);
+        }
+        key.append(value.data(), value.length());
+    }
+    return key;
+}
+
+int CgiCache::responseTtl(const std::string& response, int defaultTtl) {
+    if (response.compare(0, 5, "HTTP/") != 0 || response.length() < 12) {
+        return 0;
+    }
+    int status = std::atoi(response.c_str() + 9);
+    if (status != 200 && status != 301 && status != 302) {
+        return 0;
+    }
+
+    size_t headerEnd = response.find("\r\n\r\n");
+    if (headerEnd == std::string::npos) {
+        return 0;
+    }
+    int ttl = defaultTtl;
+    size_t pos = response.find("\r\n") + 2;
+    while (pos < headerEnd) {
+        size_t eol = response.find("\r\n", pos);
+        std::string line = response.substr(pos, eol - pos);
+        pos = eol + 2;
+        for (size_t i = 0; i < line.length() && line[i] != ':'; ++i) {
+            line[i] = StringView::lower(line[i]);
+        }
+        if (line.compare(0, 11, "set-cookie:") == 0) {
+            return 0; // per-user responses are never shared
+        }
+        if (line.compare(0, 14, "cache-control:") != 0) {
+            continue;
+        }
+
+        // The script's own directives win over the configured TTL
+        std::string value = toLower(StringView(line).substr(14));
+        bool sharedMaxAge = false;
+        size_t start = 0;
+        while (start < value.length()) {
+            size_t comma = value.find(',', start);
+            if (comma == std::string::npos) {
+                comma = value.length();
+            }
+            std::string directive = value.substr(start, comma - start);
+            start = comma + 1;
+            size_t first = directive.find_first_not_of(" \t");
+            if (first == std::string::npos) {
+                continue;
+            }
+            directive = directive.substr(first, directive.find_last_not_of(" \t") - first + 1);
+            if (directive == "no-store" || directive == "no-cache" || directive == "private") {
+                return 0;
+            }
+            if (directive.compare(0, 9, "s-maxage=") == 0) {
+                ttl = std::atoi(directive.c_str() + 9);
+                sharedMaxAge = true;
+            } else if (directive.compare(0, 8, "max-age=") == 0 && !sharedMaxAge) {
+                ttl = std::atoi(directive.c_str() + 8);
+            }
+        }
+    }
+    return ttl > 0 ? ttl : 0;
+}
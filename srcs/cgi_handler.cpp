@@ -6,62 +6,189 @@
 /*   By: aogbi <aogbi@student.42.fr>                +#+  +:+       +#+        */
 /*                                                +#+#+#+#+#+   +#+           */
 /*   Created: 2025/09/06 00:00:00 by aogbi             #+#    #+#             */
-/*   Updated: 2025/09/06 12:26:14 by aogbi            ###   ########.fr       */
+/*   Updated: 2026/10/19 00:00:00 by aogbi            ###   ########.fr       */
 /*                                                                            */
 /* ************************************************************************** */
 
 #include "cgi_handler.hpp"
 #include "response.hpp"
+#include "utils.hpp"
 #include <iostream>
 #include <unistd.h>
 #include <sys/wait.h>
 #include <cstdlib>
 #include <cstring>
 #include <sstream>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <algorithm>
+#include <cerrno>
+#include <cctype>
+#include <cstdio>
+#include <signal.h>
+#include <poll.h>
 
-CgiHandler::CgiHandler(const Config& config) : config(config) {
+CgiHandler::CgiHandler(const Config& config, Metrics& metrics, CgiCache& cache)
+    : config(config), metrics(metrics), connections(NULL), cache(cache) {
 }
 
-bool CgiHandler::isCgiRequest(const std::string& path, const Location* location) {
+bool CgiHandler::isCgiRequest(const StringView& path, const Location* location) {
+    return location && scriptLength(path, location) != StringView::npos;
+}
+
+size_t CgiHandler::scriptLength(const StringView& path, const Location* location) {
+    // "/cgi-bin/app.py/users/7" runs app.py with PATH_INFO "/users/7"
+    size_t end = 0;
+    while (end < path.length()) {
+        end = path.find('/', end + 1);
+        if (end == StringView::npos) {
+            end = path.length();
+        }
+        for (size_t i = 0; i < location->cgiExt.size(); ++i) {
+            const std::string& extension = location->cgiExt[i];
+            if (end >= extension.length() && path.substr(end - extension.length(), extension.length()) == extension) {
+                return end;
+            }
+        }
+    }
+    return StringView::npos;
+}
+
+std::string CgiHandler::getCgiInterpreter(const std::string& extension, const Location* location) {
     if (!location) {
-        return false;
+        return "";
     }
     
-    // Find file extension
-    size_t pos = path.find_last_of('.');
-    if (pos == std::string::npos) {
-        return false;
+    // Find matching extension and return corresponding interpreter
+    for (size_t i = 0; i < location->cgiExt.size() && i < location->cgiPath.size(); ++i) {
+        if (extension == location->cgiExt[i]) {
+            return location->cgiPath[i];
+        }
     }
     
-    std::string extension = path.substr(pos);
+    return "";
+}
+
+std::string CgiHandler::resolveScriptPath(const std::string& path, const Location* location) {
+    std::string root = (location && !location->root.empty()) ? location->root : config.getRoot();
+    if (!root.empty() && root[root.length() - 1] == '/' && !path.empty() && path[0] == '/') {
+        root.erase(root.length() - 1);
+    }
+    return root + path;
+}
+
+void CgiHandler::setup(ConnectionManager* manager) {
+    connections = manager;
+    const std::vector<Location>& locations = config.getLocations();
     
-    // Check if extension is in CGI extensions list
-    for (size_t i = 0; i < location->cgiExt.size(); ++i) {
-        if (location->cgiExt[i] == extension) {
-            return true;
+    // Every reactor has interpreters of its own: it reaps their children through their socket
+    for (size_t i = 0; i < locations.size(); ++i) {
+        for (size_t j = 0; j < locations[i].cgiWarmExt.size(); ++j) {
+            std::string interpreter = getCgiInterpreter(locations[i].cgiWarmExt[j], &locations[i]);
+            if (interpreter.empty()) {
+                std::cerr << "Warning: cgi_warm " << locations[i].cgiWarmExt[j]
+                          << " has no cgi_path in location " << locations[i].path << std::endl;
+                continue;
+            }
+            spawner.startWarm(interpreter);
         }
     }
     
+    // Environment templates are built at config load rather than on the first request
+    for (size_t i = 0; i < locations.size(); ++i) {
+        if (!locations[i].cgiExt.empty()) {
+            envTemplate(&locations[i]);
+        }
+    }
+}
+
+bool CgiHandler::hasSession(int clientFd) const {
+    if (byClient.find(clientFd) != byClient.end()) {
+        return true;
+    }
+    for (size_t i = 0; i < waiters.size(); ++i) {
+        if (waiters[i].clientFd == clientFd) {
+            return true;
+        }
+    }
     return false;
 }
 
-std::string CgiHandler::getCgiInterpreter(const std::string& extension, const Location* location) {
-    if (!location) {
-        return "";
+void CgiHandler::start(int clientFd, const Request& req, const Location* location) {
+    if (dispatch(clientFd, req, location)) {
+        return;
     }
+    // Another request is filling this cache key; retried when that fill ends
+    Waiter waiter;
+    waiter.clientFd = clientFd;
+    waiter.req = req;
+    waiter.location = location;
+    waiter.key = CgiCache::buildKey(location->cgiCacheKey, req);
+    waiters.push_back(waiter);
+}
+
+bool CgiHandler::dispatch(int clientFd, const Request& req, const Location* location) {
+    const StringView method = req.getMethod();
+    std::string fillKey;
     
-    // Find matching extension and return corresponding interpreter
-    for (size_t i = 0; i < location->cgiExt.size() && i < location->cgiPath.size(); ++i) {
-        if (location->cgiExt[i] == extension) {
-            return location->cgiPath[i];
+    if (location && location->cgiCacheTtl > 0 && cache.enabled() && (method == "GET" || method == "HEAD")) {
+        std::string key = CgiCache::buildKey(location->cgiCacheKey, req);
+        std::string response;
+        bool waiting;
+        CgiCache::Lookup lookup = cache.acquire(key, response, waiting);
+        if (waiting) {
+            return false;
+        }
+        if (lookup == CgiCache::HIT) {
+            metrics.recordCacheHit(Metrics::CACHE_CGI);
+            respond(clientFd, response);
+            return true;
+        }
+        metrics.recordCacheMiss(Metrics::CACHE_CGI);
+        if (lookup == CgiCache::FILL) {
+            fillKey = key;
         }
     }
     
-    return "";
+    std::string error = runScript(clientFd, req, location, fillKey);
+    if (!error.empty()) {
+        respond(clientFd, error);
+        if (!fillKey.empty()) {
+            cache.abandon(fillKey);
+            retryWaiters(fillKey);
+        }
+    }
+    return true;
+}
+
+void CgiHandler::retryWaiters(const std::string& key) {
+    std::vector<Waiter> parked;
+    parked.swap(waiters);
+    for (size_t i = 0; i < parked.size(); ++i) {
+        bool matches = key.empty() || parked[i].key == key;
+        if (!matches || !dispatch(parked[i].clientFd, parked[i].req, parked[i].location)) {
+            waiters.push_back(parked[i]);
+        }
+    }
+}
+
+void CgiHandler::respond(int clientFd, const std::string& response) {
+    if (response.length() > 12 && response.compare(0, 5, "HTTP/") == 0) {
+        metrics.recordStatus(std::atoi(response.c_str() + 9));
+    }
+    if (!connections->queueWrite(clientFd, response)) {
+        connections->removeClient(clientFd);
+        return;
+    }
+    connections->finishResponse(clientFd);
 }
 
-std::string CgiHandler::executeCgi(const std::string& scriptPath, const Request& req, const Location* location) {
+std::string CgiHandler::runScript(int clientFd, const Request& req, const Location* location, const std::string& cacheKey) {
     Response response;
+    const StringView path = req.getPath();
+    size_t scriptEnd = scriptLength(path, location);
+    const std::string scriptPath = path.substr(0, scriptEnd).str();
+    const std::string pathInfo = scriptEnd == StringView::npos ? "" : path.substr(scriptEnd).str();
     
     // Get file extension
     size_t pos = scriptPath.find_last_of('.');
@@ -76,200 +203,575 @@ std::string CgiHandler::executeCgi(const std::string& scriptPath, const Request&
     std::string interpreter = getCgiInterpreter(extension, location);
     
     if (interpreter.empty()) {
+        metrics.recordCgiFailure();
         response.setStatus(500, "Internal Server Error");
         response.setContentType("text/html");
         response.setBody("<html><body><h1>500 Internal Server Error</h1><p>No CGI interpreter found</p></body></html>");
         return response.toString();
     }
     
-    // Create pipes for communication
+    // The request path is relative to the location root on disk
+    std::string scriptFile = resolveScriptPath(scriptPath, location);
+    struct stat scriptStat;
+    if (stat(scriptFile.c_str(), &scriptStat) != 0 || !S_ISREG(scriptStat.st_mode)) {
+        response.setStatus(404, "Not Found");
+        response.setContentType("text/html");
+        response.setBody("<html><body><h1>404 Not Found</h1><p>CGI script not found</p></body></html>");
+        return response.toString();
+    }
+    
+    // Create pipes for communication; close-on-exec keeps them out of other children
     int pipeIn[2], pipeOut[2];
-    if (pipe(pipeIn) == -1 || pipe(pipeOut) == -1) {
+    if (pipe2(pipeIn, O_CLOEXEC) == -1) {
+        pipeIn[0] = pipeIn[1] = -1;
+    }
+    if (pipeIn[0] == -1 || pipe2(pipeOut, O_CLOEXEC) == -1) {
+        if (pipeIn[0] != -1) {
+            close(pipeIn[0]); close(pipeIn[1]);
+        }
+        metrics.recordCgiFailure();
         response.setStatus(500, "Internal Server Error");
         response.setContentType("text/html");
         response.setBody("<html><body><h1>500 Internal Server Error</h1><p>Pipe creation failed</p></body></html>");
         return response.toString();
     }
     
-    pid_t pid = fork();
+    // Build the environment here so the child only has to exec
+    char envStorage[4096];
+    Arena envArena(envStorage, sizeof(envStorage));
+    char** envp = setupCgiEnvironment(envArena, req, location, scriptPath, pathInfo,
+                                      connections->findClient(clientFd));
+    
+    uint64_t cgiStart = Metrics::nowMicros();
+    bool useWarm = std::find(location->cgiWarmExt.begin(), location->cgiWarmExt.end(), extension)
+                   != location->cgiWarmExt.end();
+    bool warmChild;
+    pid_t pid = spawner.spawn(interpreter, scriptFile, envp, pipeIn[0], pipeOut[1], useWarm, warmChild);
+    close(pipeIn[0]);  // Child ends now belong to the script
+    close(pipeOut[1]);
     if (pid == -1) {
-        close(pipeIn[0]); close(pipeIn[1]);
-        close(pipeOut[0]); close(pipeOut[1]);
+        close(pipeIn[1]);
+        close(pipeOut[0]);
+        metrics.recordCgiFailure();
         response.setStatus(500, "Internal Server Error");
         response.setContentType("text/html");
-        response.setBody("<html><body><h1>500 Internal Server Error</h1><p>Fork failed</p></body></html>");
+        response.setBody("<html><body><h1>500 Internal Server Error</h1><p>Spawn failed</p></body></html>");
         return response.toString();
     }
+    metrics.recordCgiSpawn();
     
-    if (pid == 0) {
-        // Child process
-        close(pipeIn[1]);  // Close write end of input pipe
-        close(pipeOut[0]); // Close read end of output pipe
-        
-        // Redirect stdin and stdout
-        dup2(pipeIn[0], STDIN_FILENO);
-        dup2(pipeOut[1], STDOUT_FILENO);
-        
-        close(pipeIn[0]);
-        close(pipeOut[1]);
-        
-        // Set up environment
-        std::vector<std::string> envVars = setupCgiEnvironment(req, scriptPath);
-        char** envp = vectorToCharArray(envVars);
-        
-        // Execute CGI script
-        char* args[] = {const_cast<char*>(interpreter.c_str()), const_cast<char*>(scriptPath.c_str()), NULL};
-        execve(interpreter.c_str(), args, envp);
-        
-        // If we reach here, execve failed
-        freeCharArray(envp);
-        _exit(1);
+    // Our ends are driven by poll(); the script's stay blocking
+    fcntl(pipeIn[1], F_SETFL, fcntl(pipeIn[1], F_GETFL, 0) | O_NONBLOCK);
+    fcntl(pipeOut[0], F_SETFL, fcntl(pipeOut[0], F_GETFL, 0) | O_NONBLOCK);
+    
+    Session* session = new Session();
+    session->clientFd = clientFd;
+    session->pid = pid;
+    session->warmChild = warmChild;
+    session->interpreter = interpreter;
+    session->stdinFd = -1;
+    session->stdoutFd = pipeOut[0];
+    session->body = req.getBodySource();
+    session->bodyOffset = 0;
+    session->headersSent = false;
+    session->chunked = false;
+    session->headRequest = (req.getMethod() == "HEAD");
+    session->clientHttp11 = (req.getVersion() == "HTTP/1.1");
+    session->paused = false;
+    session->cacheKey = cacheKey;
+    session->cacheTtl = location->cgiCacheTtl;
+    session->cacheOverflow = false;
+    session->startMicros = cgiStart;
+    
+    byClient[clientFd] = session;
+    byPipe[pipeOut[0]] = session;
+    connections->addWatch(pipeOut[0], POLLIN);
+    if (session->body.empty()) {
+        close(pipeIn[1]);
     } else {
-        // Parent process
-        close(pipeIn[0]);  // Close read end of input pipe
-        close(pipeOut[1]); // Close write end of output pipe
-        
-        // Send request body to CGI script if it's a POST request
-        if (req.getMethod() == "POST" && !req.getBody().empty()) {
-            write(pipeIn[1], req.getBody().c_str(), req.getBody().length());
+        session->stdinFd = pipeIn[1];
+        byPipe[pipeIn[1]] = session;
+        connections->addWatch(pipeIn[1], POLLOUT);
+        writeScript(session);
+    }
+    return "";
+}
+
+void CgiHandler::writeScript(Session* session) {
+    while (session->bodyOffset < session->body.size()) {
+        ssize_t written = session->body.writeTo(session->stdinFd, session->bodyOffset,
+                                                session->body.size() - session->bodyOffset);
+        if (written < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                return;
+            }
+            break; // EPIPE: the script does not read the rest of its input
+        }
+        if (written == 0) {
+            break; // the spool file came up short
+        }
+        session->bodyOffset += written;
+    }
+    closeStdin(session);
+}
+
+void CgiHandler::closeStdin(Session* session) {
+    byPipe.erase(session->stdinFd);
+    connections->removeWatch(session->stdinFd);
+    close(session->stdinFd);
+    session->stdinFd = -1;
+    session->body.clear();
+}
+
+bool CgiHandler::parseCgiHeaders(const std::string& headers, Response& response) {
+    bool hasLength = false;
+    bool hasStatus = false;
+    std::istringstream headerStream(headers);
+    std::string line;
+    while (std::getline(headerStream, line) && !line.empty()) {
+        if (line[line.length() - 1] == '\r') {
+            line.erase(line.length() - 1);
         }
-        close(pipeIn[1]);
-        
-        // Read output from CGI script
-        std::string output;
-        char buffer[4096];
-        ssize_t bytesRead;
         
-        while ((bytesRead = read(pipeOut[0], buffer, sizeof(buffer) - 1)) > 0) {
-            buffer[bytesRead] = '\0';
-            output += buffer;
+        size_t colonPos = line.find(':');
+        if (colonPos == std::string::npos) {
+            continue;
         }
-        close(pipeOut[0]);
+        std::string key = line.substr(0, colonPos);
+        std::string value = line.substr(colonPos + 1);
         
-        // Wait for child process to finish
-        int status;
-        waitpid(pid, &status, 0);
+        // Trim whitespace
+        while (!value.empty() && value[0] == ' ') value.erase(0, 1);
+        while (!value.empty() && value[value.length() - 1] == ' ') value.erase(value.length() - 1);
         
-        if (WEXITSTATUS(status) != 0) {
-            response.setStatus(500, "Internal Server Error");
-            response.setContentType("text/html");
-            response.setBody("<html><body><h1>500 Internal Server Error</h1><p>CGI script execution failed</p></body></html>");
-            return response.toString();
+        std::string name = toLower(key);
+        if (name == "status") {
+            // "Status: 404 Not Found" sets the status line instead of a header
+            int code = std::atoi(value.c_str());
+            size_t space = value.find(' ');
+            if (code >= 100 && code < 600) {
+                response.setStatus(code, space != std::string::npos ? value.substr(space + 1) : "OK");
+                hasStatus = true;
+            }
+            continue;
         }
-        
-        // Parse CGI output (should include headers and body)
-        size_t headerEnd = output.find("\r\n\r\n");
+        if (name == "location" && !hasStatus) {
+            response.setStatus(302, "Found");
+        }
+        if (name == "content-length") {
+            hasLength = true;
+        }
+        response.setHeader(key, value);
+    }
+    return hasLength;
+}
+
+bool CgiHandler::sendHead(Session* session, size_t headerEnd) {
+    Response response;
+    bool hasLength = false;
+    if (headerEnd == std::string::npos) {
+        // No header block: the whole output is the body
+        response.setContentType("text/html");
+        headerEnd = 0;
+    } else {
+        hasLength = parseCgiHeaders(session->head.substr(0, headerEnd), response);
+    }
+    if (!session->cacheKey.empty()) {
+        session->cacheHead = response;
+    }
+    
+    // Without a length the body is chunked; HTTP/1.0 clients read until close
+    session->chunked = !hasLength && session->clientHttp11;
+    if (session->chunked) {
+        response.setHeader("Transfer-Encoding", "chunked");
+    }
+    session->headersSent = true;
+    metrics.recordStatus(response.getStatusCode());
+    
+    if (!connections->queueWrite(session->clientFd, response.headToString())) {
+        int clientFd = session->clientFd;
+        destroy(session, true);
+        connections->removeClient(clientFd);
+        return false;
+    }
+    std::string rest = session->head.substr(headerEnd);
+    std::string().swap(session->head);
+    if (!rest.empty()) {
+        return forwardBody(session, rest.data(), rest.length());
+    }
+    return true;
+}
+
+bool CgiHandler::forwardBody(Session* session, const char* data, size_t length) {
+    if (!session->cacheKey.empty() && !session->cacheOverflow) {
+        if (session->cacheBody.length() + length > config.getCgiCacheEntrySize()) {
+            session->cacheOverflow = true;
+            std::string().swap(session->cacheBody);
+        } else {
+            session->cacheBody.append(data, length);
+        }
+    }
+    if (session->headRequest) {
+        return true;
+    }
+    
+    bool queued;
+    if (session->chunked) {
+        char size[24];
+        int sizeLength = std::snprintf(size, sizeof(size), "%lx\r\n", static_cast<unsigned long>(length));
+        std::string chunk;
+        chunk.reserve(sizeLength + length + 2);
+        chunk.append(size, sizeLength);
+        chunk.append(data, length);
+        chunk.append("\r\n", 2);
+        queued = connections->queueWrite(session->clientFd, chunk);
+    } else {
+        queued = connections->queueWrite(session->clientFd, data, length);
+    }
+    if (!queued) {
+        int clientFd = session->clientFd;
+        destroy(session, true);
+        connections->removeClient(clientFd);
+        return false;
+    }
+    
+    // Stop reading the script until the client catches up; the pipe is
+    // dropped from the poll set because POLLHUP is reported regardless of events
+    ClientConnection* client = connections->findClient(session->clientFd);
+    if (client && client->pendingOutput() > HIGH_WATER && !session->paused) {
+        session->paused = true;
+        connections->removeWatch(session->stdoutFd);
+    }
+    return true;
+}
+
+bool CgiHandler::readScript(Session* session) {
+    char buffer[65536];
+    ssize_t received = read(session->stdoutFd, buffer, sizeof(buffer));
+    if (received < 0) {
+        if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR) {
+            return true;
+        }
+        received = 0;
+    }
+    if (received == 0) {
+        finishScript(session);
+        return false;
+    }
+    connections->updateClientActivity(session->clientFd);
+    
+    if (session->headersSent) {
+        return forwardBody(session, buffer, received);
+    }
+    session->head.append(buffer, received);
+    size_t headerEnd = ConnectionManager::findHeaderEnd(session->head);
+    if (headerEnd == std::string::npos && session->head.length() <= MAX_CGI_HEAD) {
+        return true;
+    }
+    return sendHead(session, headerEnd);
+}
+
+void CgiHandler::finishScript(Session* session) {
+    int clientFd = session->clientFd;
+    byPipe.erase(session->stdoutFd);
+    if (!session->paused) {
+        connections->removeWatch(session->stdoutFd);
+    }
+    close(session->stdoutFd);
+    session->stdoutFd = -1;
+    if (session->stdinFd >= 0) {
+        closeStdin(session);
+    }
+    
+    // stdout is closed, so the script is exiting
+    int status = 0;
+    bool reaped = spawner.wait(session->interpreter, session->pid, session->warmChild, status);
+    session->pid = -1;
+    metrics.observePhase(Metrics::PHASE_CGI, session->startMicros);
+    bool success = reaped && WIFEXITED(status) && WEXITSTATUS(status) == 0;
+    if (!success) {
+        metrics.recordCgiFailure();
+    }
+    
+    std::string out;
+    if (!session->headersSent && !success) {
+        Response response;
+        response.setStatus(500, "Internal Server Error");
+        response.setContentType("text/html");
+        response.setBody("<html><body><h1>500 Internal Server Error</h1><p>CGI script execution failed</p></body></html>");
+        out = response.toString();
+        metrics.recordStatus(500);
+    } else if (!session->headersSent) {
+        // Short output that ended before a header block was complete
+        Response response;
+        size_t headerEnd = ConnectionManager::findHeaderEnd(session->head);
         if (headerEnd == std::string::npos) {
-            headerEnd = output.find("\n\n");
-            if (headerEnd == std::string::npos) {
-                // No headers found, treat entire output as body
-                response.setStatus(200, "OK");
-                response.setContentType("text/html");
-                response.setBody(output);
-                return response.toString();
-            } else {
-                headerEnd += 2;
-            }
+            response.setContentType("text/html");
+            headerEnd = 0;
         } else {
-            headerEnd += 4;
+            parseCgiHeaders(session->head.substr(0, headerEnd), response);
         }
-        
-        // Extract headers and body
-        std::string headers = output.substr(0, headerEnd);
-        std::string body = output.substr(headerEnd);
-        
-        // Create response with CGI output
-        response.setStatus(200, "OK");
-        response.setBody(body);
-        
-        // Parse and set headers from CGI output
-        std::istringstream headerStream(headers);
-        std::string line;
-        while (std::getline(headerStream, line) && !line.empty()) {
-            if (line[line.length() - 1] == '\r') {
-                line.erase(line.length() - 1);
-            }
-            
-            size_t colonPos = line.find(':');
-            if (colonPos != std::string::npos) {
-                std::string key = line.substr(0, colonPos);
-                std::string value = line.substr(colonPos + 1);
-                
-                // Trim whitespace
-                while (!value.empty() && value[0] == ' ') value.erase(0, 1);
-                while (!value.empty() && value[value.length() - 1] == ' ') value.erase(value.length() - 1);
-                
-                response.setHeader(key, value);
-            }
+        if (!session->cacheKey.empty()) {
+            session->cacheHead = response;
+            session->cacheBody = session->head.substr(headerEnd);
         }
-        
-        return response.toString();
+        response.setBody(session->head.substr(headerEnd));
+        if (session->headRequest) {
+            std::ostringstream length;
+            length << session->head.length() - headerEnd;
+            response.setHeader("Content-Length", length.str());
+            response.setBody("");
+        }
+        out = response.toString();
+        metrics.recordStatus(response.getStatusCode());
+    } else if (success && session->chunked && !session->headRequest) {
+        out = "0\r\n\r\n";
+    }
+    // A failed script whose head is already out gets no terminating chunk,
+    // so the client sees a truncated response
+    
+    std::string key = releaseCache(session, success);
+    destroy(session, false);
+    if (!out.empty() && !connections->queueWrite(clientFd, out)) {
+        connections->removeClient(clientFd);
+    } else {
+        connections->finishResponse(clientFd);
+    }
+    if (!key.empty()) {
+        retryWaiters(key);
     }
 }
 
-std::vector<std::string> CgiHandler::setupCgiEnvironment(const Request& req, const std::string& scriptPath) {
-    std::vector<std::string> env;
+std::string CgiHandler::releaseCache(Session* session, bool success) {
+    std::string key;
+    key.swap(session->cacheKey);
+    if (key.empty()) {
+        return key;
+    }
+    if (success && !session->cacheOverflow) {
+        session->cacheHead.setBody(session->cacheBody);
+        std::string response = session->cacheHead.toString();
+        int ttl = CgiCache::responseTtl(response, session->cacheTtl);
+        if (ttl > 0) {
+            cache.store(key, response, ttl);
+            return key;
+        }
+    }
+    cache.abandon(key);
+    return key;
+}
+
+void CgiHandler::destroy(Session* session, bool terminate) {
+    std::string key = releaseCache(session, false);
+    if (session->stdinFd >= 0) {
+        closeStdin(session);
+    }
+    if (session->stdoutFd >= 0) {
+        byPipe.erase(session->stdoutFd);
+        if (!session->paused) {
+            connections->removeWatch(session->stdoutFd);
+        }
+        close(session->stdoutFd);
+    }
+    if (session->pid > 0) {
+        if (terminate) {
+            kill(session->pid, SIGKILL);
+        }
+        int status;
+        spawner.wait(session->interpreter, session->pid, session->warmChild, status);
+    }
+    byClient.erase(session->clientFd);
+    delete session;
+    if (!key.empty()) {
+        retryWaiters(key);
+    }
+}
+
+void CgiHandler::onClientDrained(int clientFd) {
+    std::map<int, Session*>::iterator it = byClient.find(clientFd);
+    if (it == byClient.end() || !it->second->paused) {
+        return;
+    }
+    ClientConnection* client = connections->findClient(clientFd);
+    if (client && client->pendingOutput() < HIGH_WATER / 2) {
+        it->second->paused = false;
+        connections->addWatch(it->second->stdoutFd, POLLIN);
+    }
+}
+
+void CgiHandler::onClientClosed(int clientFd) {
+    for (size_t i = 0; i < waiters.size(); ++i) {
+        if (waiters[i].clientFd == clientFd) {
+            waiters.erase(waiters.begin() + i);
+            return;
+        }
+    }
+    std::map<int, Session*>::iterator it = byClient.find(clientFd);
+    if (it != byClient.end()) {
+        destroy(it->second, true);
+    }
+}
+
+void CgiHandler::handleEvent(int fd, short revents) {
+    std::map<int, Session*>::iterator it = byPipe.find(fd);
+    if (it == byPipe.end()) {
+        return;
+    }
+    Session* session = it->second;
+    if (fd == session->stdinFd) {
+        // POLLERR/POLLHUP here mean the script closed stdin; write() reports EPIPE
+        writeScript(session);
+        return;
+    }
+    if (revents & (POLLIN | POLLHUP | POLLERR)) {
+        readScript(session);
+    }
+}
+
+void CgiHandler::handleTimeouts() {
+    if (!waiters.empty()) {
+        retryWaiters("");
+    }
+}
+
+// Parent environment variables scripts still see; anything else (HTTP_PROXY included) stays out
+static const char* const INHERITED_ENV[] = {
+    "PATH", "LANG", "LANGUAGE", "TZ", "TMPDIR", "LD_LIBRARY_PATH", "PYTHONPATH", "PYTHONHOME", "PERL5LIB", NULL
+};
+
+static bool inheritedEnv(const char* entry) {
+    if (std::strncmp(entry, "LC_", 3) == 0) {
+        return true;
+    }
+    const char* equals = std::strchr(entry, '=');
+    size_t nameLength = equals ? static_cast<size_t>(equals - entry) : std::strlen(entry);
+    for (size_t i = 0; INHERITED_ENV[i] != NULL; ++i) {
+        if (std::strlen(INHERITED_ENV[i]) == nameLength && std::strncmp(entry, INHERITED_ENV[i], nameLength) == 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+const std::vector<std::string>& CgiHandler::envTemplate(const Location* location) {
+    std::map<const Location*, std::vector<std::string> >::iterator found = envTemplates.find(location);
+    if (found != envTemplates.end()) {
+        return found->second;
+    }
+    std::vector<std::string>& env = envTemplates[location];
     
     // Basic CGI environment variables
     env.push_back("GATEWAY_INTERFACE=CGI/1.1");
     env.push_back("SERVER_SOFTWARE=Webserv/1.0");
-    env.push_back("SERVER_PROTOCOL=HTTP/1.1");
-    env.push_back("REQUEST_METHOD=" + req.getMethod());
-    env.push_back("REQUEST_URI=" + req.getPath());
-    env.push_back("SCRIPT_NAME=" + scriptPath);
-    env.push_back("QUERY_STRING="); // TODO: Extract from URL
     
     // Server-specific environment variables from config
     env.push_back("SERVER_NAME=" + config.getServerName());
-    
     std::stringstream portStr;
     portStr << config.getPort();
     env.push_back("SERVER_PORT=" + portStr.str());
-    
-    // Content-related variables
-    if (req.hasHeader("content-length")) {
-        env.push_back("CONTENT_LENGTH=" + req.getHeader("content-length"));
-    }
-    if (req.hasHeader("content-type")) {
-        env.push_back("CONTENT_TYPE=" + req.getHeader("content-type"));
+    if (config.isSsl()) {
+        env.push_back("HTTPS=on");
     }
+    env.push_back("DOCUMENT_ROOT=" + ((location && !location->root.empty()) ? location->root : config.getRoot()));
     
-    // HTTP headers as environment variables
-    const std::map<std::string, std::string>& headers = req.getHeaders();
-    for (std::map<std::string, std::string>::const_iterator it = headers.begin(); it != headers.end(); ++it) {
-        std::string key = "HTTP_" + it->first;
-        // Convert to uppercase and replace - with _
-        for (size_t i = 0; i < key.length(); ++i) {
-            if (key[i] == '-') {
-                key[i] = '_';
-            } else {
-                key[i] = std::toupper(key[i]);
-            }
+    for (char** entry = environ; *entry != NULL; ++entry) {
+        if (inheritedEnv(*entry)) {
+            env.push_back(*entry);
         }
-        env.push_back(key + "=" + it->second);
     }
-    
-    // Copy existing environment
-    for (char** envp = environ; *envp != NULL; ++envp) {
-        env.push_back(std::string(*envp));
-    }
-    
     return env;
 }
 
-char** CgiHandler::vectorToCharArray(const std::vector<std::string>& env) {
-    char** arr = new char*[env.size() + 1];
-    for (size_t i = 0; i < env.size(); ++i) {
-        arr[i] = new char[env[i].length() + 1];
-        std::strcpy(arr[i], env[i].c_str());
-    }
-    arr[env.size()] = NULL;
-    return arr;
+// Copy "name" + value + NUL to cursor and advance it; returns where the entry starts
+static char* putEntry(char*& cursor, const char* name, const StringView& value) {
+    char* entry = cursor;
+    size_t nameLength = std::strlen(name);
+    std::memcpy(cursor, name, nameLength);
+    cursor += nameLength;
+    std::memcpy(cursor, value.data(), value.length());
+    cursor += value.length();
+    *cursor++ = '\0';
+    return entry;
 }
 
-void CgiHandler::freeCharArray(char** arr) {
-    for (int i = 0; arr[i] != NULL; ++i) {
-        delete[] arr[i];
+// A "Proxy:" request header must not become HTTP_PROXY, which HTTP clients read as their proxy (httpoxy)
+static bool exportedHeader(const StringView& name) {
+    return !name.equalsIgnoreCase("proxy");
+}
+
+char** CgiHandler::setupCgiEnvironment(Arena& arena, const Request& req, const Location* location,
+                                       const std::string& scriptPath, const std::string& pathInfo,
+                                       const ClientConnection* client) {
+    const std::vector<std::string>& fixed = envTemplate(location);
+    char port[8];
+    size_t portLength = 0;
+    if (client) {
+        portLength = static_cast<size_t>(std::snprintf(port, sizeof(port), "%u", client->remotePort));
+    }
+    
+    // Request variables, with the client address and the two content headers when known
+    const char* const names[] = {
+        "REQUEST_METHOD=", "REQUEST_URI=", "SCRIPT_NAME=", "PATH_INFO=", "QUERY_STRING=", "SERVER_PROTOCOL=",
+        "REMOTE_ADDR=", "REMOTE_PORT=", "CONTENT_LENGTH=", "CONTENT_TYPE="
+    };
+    const StringView values[] = {
+        req.getMethod(), req.getTarget(), scriptPath, pathInfo, req.getQuery(), req.getVersion(),
+        client ? StringView(client->remoteAddr) : StringView(), StringView(port, portLength),
+        req.getHeader(Request::HEADER_CONTENT_LENGTH), req.getHeader(Request::HEADER_CONTENT_TYPE)
+    };
+    const bool present[] = {
+        true, true, true, true, true, true,
+        client && !client->remoteAddr.empty(), client && !client->remoteAddr.empty(),
+        req.hasHeader(Request::HEADER_CONTENT_LENGTH), req.hasHeader(Request::HEADER_CONTENT_TYPE)
+    };
+    const size_t variableCount = sizeof(names) / sizeof(names[0]);
+    
+    // Size everything first so the request's entries go in one block
+    size_t count = fixed.size();
+    size_t bytes = 0;
+    for (size_t i = 0; i < variableCount; ++i) {
+        if (present[i]) {
+            ++count;
+            bytes += std::strlen(names[i]) + values[i].length() + 1;
+        }
+    }
+    for (size_t h = 0; h < req.getHeaderCount(); ++h) {
+        if (exportedHeader(req.getHeaderName(h))) {
+            ++count;
+            bytes += 5 + req.getHeaderName(h).length() + 1 + req.getHeaderValue(h).length() + 1;
+        }
+    }
+    
+    char** envp = static_cast<char**>(arena.allocate((count + 1) * sizeof(char*)));
+    char* cursor = static_cast<char*>(arena.allocate(bytes));
+    size_t n = 0;
+    for (size_t i = 0; i < fixed.size(); ++i) {
+        envp[n++] = const_cast<char*>(fixed[i].c_str());
+    }
+    for (size_t i = 0; i < variableCount; ++i) {
+        if (present[i]) {
+            envp[n++] = putEntry(cursor, names[i], values[i]);
+        }
+    }
+    
+    // HTTP headers as HTTP_NAME=value, uppercased with - turned into _
+    for (size_t h = 0; h < req.getHeaderCount(); ++h) {
+        StringView name = req.getHeaderName(h);
+        if (!exportedHeader(name)) {
+            continue;
+        }
+        envp[n++] = cursor;
+        std::memcpy(cursor, "HTTP_", 5);
+        cursor += 5;
+        for (size_t i = 0; i < name.length(); ++i) {
+            char c = name[i];
+            *cursor++ = c == '-' ? '_' : (c >= 'a' && c <= 'z') ? static_cast<char>(c - ('a' - 'A')) : c;
+        }
+        putEntry(cursor, "=", req.getHeaderValue(h));
     }
-    delete[] arr;
+    envp[n] = NULL;
+    return envp;
 }
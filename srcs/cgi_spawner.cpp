@@ -0,0 +1,326 @@
+/* ************************************************************************** */
+/*                                                                            */
+/*                                                        :::      ::::::::   */
+/*   cgi_spawner.cpp                                    :+:      :+:    :+:   */
+/*                                                    +:+ +:+         +:+     */
+/*   By: aogbi <aogbi@student.42.fr>                +#+  +:+       +#+        */
+/*                                                +#+#+#+#+#+   +#+           */
+/*   Created: 2026/10/19 00:00:00 by aogbi             #+#    #+#             */
+/*   Updated: 2026/10/19 00:00:00 by aogbi            ###   ########.fr       */
+/*                                                                            */
+/* ************************************************************************** */
+
+#include "cgi_spawner.hpp"
+#include <spawn.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <signal.h>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+
+extern char** environ;
+
+// Descriptor number the zygote finds its control socket on
+static const int ZYGOTE_FD = 3;
+
+// The server ignores SIGPIPE; scripts get the default disposition back
+static void initSpawnAttr(posix_spawnattr_t* attr) {
+    sigset_t defaults;
+    sigemptyset(&defaults);
+    sigaddset(&defaults, SIGPIPE);
+    posix_spawnattr_init(attr);
+    posix_spawnattr_setsigdefault(attr, &defaults);
+    posix_spawnattr_setflags(attr, POSIX_SPAWN_SETSIGDEF);
+}
+
+/*
+ * Warm interpreter loop. Each request is one SEQPACKET message
+ * "script\0KEY=VALUE\0..." carrying the CGI's stdin and stdout as SCM_RIGHTS.
+ * The zygote forks, the child runs the script as __main__ on those
+ * descriptors, and the zygote answers "S <pid>" right away and
+ * "E <pid> <wait status>" from its SIGCHLD handler. pkgutil is what runpy
+ * imports lazily on first use; gc.freeze() keeps the preloaded objects out
+ * of the collector so children do not dirty those pages.
+ */
+static const char* const ZYGOTE_SOURCE =
+    "import os, sys, gc, socket, signal, runpy, traceback\n"
+    "import pkgutil, datetime, json, html, urllib.parse\n"
+    "gc.freeze()\n"
+    "sock = socket.socket(socket.AF_UNIX, socket.SOCK_SEQPACKET, fileno=int(sys.argv[1]))\n"
+    "signal.signal(signal.SIGINT, signal.SIG_IGN)\n"
+    "def reap(signum, frame):\n"
+    "    while True:\n"
+    "        try:\n"
+    "            pid, status = os.waitpid(-1, os.WNOHANG)\n"
+    "        except ChildProcessError:\n"
+    "            return\n"
+    "        if pid == 0:\n"
+    "            return\n"
+    "        try:\n"
+    "            sock.send(b'E %d %d' % (pid, status))\n"
+    "        except OSError:\n"
+    "            pass\n"
+    "signal.signal(signal.SIGCHLD, reap)\n"
+    "sys.stdout.flush()\n"
+    "while True:\n"
+    "    msg, fds, flags, addr = socket.recv_fds(sock, 1 << 20, 2)\n"
+    "    if not msg:\n"
+    "        break\n"
+    "    parts = msg.split(b'\\0')\n"
+    "    script = parts[0].decode('utf-8', 'surrogateescape')\n"
+    "    pid = os.fork()\n"
+    "    if pid == 0:\n"
+    "        signal.signal(signal.SIGCHLD, signal.SIG_DFL)\n"
+    "        signal.signal(signal.SIGINT, signal.SIG_DFL)\n"
+    "        sock.close()\n"
+    "        os.dup2(fds[0], 0)\n"
+    "        os.dup2(fds[1], 1)\n"
+    "        for fd in fds:\n"
+    "            os.close(fd)\n"
+    "        os.environ.clear()\n"
+    "        for entry in parts[1:]:\n"
+    "            key, sep, value = entry.partition(b'=')\n"
+    "            if sep:\n"
+    "                os.environb[key] = value\n"
+    "        sys.stdin = open(0, 'r', closefd=False)\n"
+    "        sys.stdout = open(1, 'w', closefd=False)\n"
+    "        sys.argv = [script]\n"
+    "        code = 0\n"
+    "        try:\n"
+    "            runpy.run_path(script, run_name='__main__')\n"
+    "        except SystemExit as e:\n"
+    "            code = e.code if isinstance(e.code, int) else (0 if e.code is None else 1)\n"
+    "        except BaseException:\n"
+    "            traceback.print_exc()\n"
+    "            code = 1\n"
+    "        try:\n"
+    "            sys.stdout.flush()\n"
+    "        except BaseException:\n"
+    "            code = code or 1\n"
+    "        os._exit(code)\n"
+    "    for fd in fds:\n"
+    "        os.close(fd)\n"
+    "    sock.send(b'S %d' % pid)\n";
+
+CgiSpawner::CgiSpawner() {
+}
+
+CgiSpawner::~CgiSpawner() {
+    for (std::map<std::string, WarmInterpreter>::iterator it = warm.begin(); it != warm.end(); ++it) {
+        stopWarm(it->second);
+    }
+}
+
+bool CgiSpawner::launchWarm(const std::string& interpreter, WarmInterpreter& zygote) {
+    int sv[2];
+    if (socketpair(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0, sv) < 0) {
+        std::cerr << "Error: warm interpreter socketpair failed: " << strerror(errno) << std::endl;
+        return false;
+    }
+
+    posix_spawn_file_actions_t actions;
+    posix_spawn_file_actions_init(&actions);
+    posix_spawn_file_actions_adddup2(&actions, sv[1], ZYGOTE_FD);
+    posix_spawn_file_actions_addopen(&actions, STDIN_FILENO, "/dev/null", O_RDONLY, 0);
+
+    char fdArg[16];
+    std::snprintf(fdArg, sizeof(fdArg), "%d", ZYGOTE_FD);
+    char* argv[] = { const_cast<char*>(interpreter.c_str()), const_cast<char*>("-c"),
+                     const_cast<char*>(ZYGOTE_SOURCE), fdArg, NULL };
+    posix_spawnattr_t attr;
+    initSpawnAttr(&attr);
+    pid_t pid;
+    int rc = posix_spawn(&pid, interpreter.c_str(), &actions, &attr, argv, environ);
+    posix_spawnattr_destroy(&attr);
+    posix_spawn_file_actions_destroy(&actions);
+    close(sv[1]);
+    if (rc != 0) {
+        std::cerr << "Error: cannot start warm interpreter " << interpreter << ": " << strerror(rc) << std::endl;
+        close(sv[0]);
+        return false;
+    }
+
+    zygote.pid = pid;
+    zygote.fd = sv[0];
+    zygote.exited.clear();
+    return true;
+}
+
+void CgiSpawner::stopWarm(WarmInterpreter& zygote) {
+    // EOF on the control socket makes the zygote leave its loop
+    close(zygote.fd);
+    kill(zygote.pid, SIGTERM);
+    while (waitpid(zygote.pid, NULL, 0) < 0 && errno == EINTR) {
+    }
+}
+
+bool CgiSpawner::startWarm(const std::string& interpreter) {
+    if (warm.find(interpreter) != warm.end()) {
+        return true;
+    }
+    size_t slash = interpreter.find_last_of('/');
+    std::string name = (slash == std::string::npos) ? interpreter : interpreter.substr(slash + 1);
+    if (name.compare(0, 6, "python") != 0) {
+        std::cerr << "Warning: cgi_warm needs a Python interpreter, ignoring " << interpreter << std::endl;
+        return false;
+    }
+
+    WarmInterpreter zygote;
+    if (!launchWarm(interpreter, zygote)) {
+        return false;
+    }
+    warm[interpreter] = zygote;
+    std::cout << "Warm CGI interpreter " << interpreter << " started (pid " << zygote.pid << ")" << std::endl;
+    return true;
+}
+
+bool CgiSpawner::readMessage(WarmInterpreter& zygote, char& type, pid_t& pid, int& status) {
+    char buffer[64];
+    ssize_t received;
+    do {
+        received = recv(zygote.fd, buffer, sizeof(buffer) - 1, 0);
+    } while (received < 0 && errno == EINTR);
+    if (received <= 0) {
+        return false;
+    }
+    buffer[received] = '\0';
+    int parsedPid = 0;
+    status = 0;
+    type = buffer[0];
+    if (std::sscanf(buffer + 1, "%d %d", &parsedPid, &status) < 1) {
+        return false;
+    }
+    pid = parsedPid;
+    return true;
+}
+
+pid_t CgiSpawner::spawnWarm(WarmInterpreter& zygote, const std::string& scriptFile, char** envp,
+                            int stdinFd, int stdoutFd) {
+    std::string payload = scriptFile;
+    payload += '\0';
+    for (char** entry = envp; *entry != NULL; ++entry) {
+        payload += *entry;
+        payload += '\0';
+    }
+
+    struct iovec iov;
+    iov.iov_base = const_cast<char*>(payload.data());
+    iov.iov_len = payload.length();
+
+    int fds[2] = { stdinFd, stdoutFd };
+    char control[CMSG_SPACE(sizeof(fds))];
+    std::memset(control, 0, sizeof(control));
+
+    struct msghdr msg;
+    std::memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control;
+    msg.msg_controllen = sizeof(control);
+    struct cmsghdr* cmsg = CMSG_FIRSTHDR(&msg);
+    cmsg->cmsg_level = SOL_SOCKET;
+    cmsg->cmsg_type = SCM_RIGHTS;
+    cmsg->cmsg_len = CMSG_LEN(sizeof(fds));
+    std::memcpy(CMSG_DATA(cmsg), fds, sizeof(fds));
+
+    if (sendmsg(zygote.fd, &msg, MSG_NOSIGNAL) < 0) {
+        return -1;
+    }
+
+    // A fast child can be reaped before its start is acknowledged
+    char type;
+    pid_t pid;
+    int status;
+    while (readMessage(zygote, type, pid, status)) {
+        if (type == 'S') {
+            return pid;
+        }
+        if (type == 'E') {
+            zygote.exited[pid] = status;
+        }
+    }
+    return -1;
+}
+
+pid_t CgiSpawner::spawn(const std::string& interpreter, const std::string& scriptFile, char** envp,
+                        int stdinFd, int stdoutFd, bool useWarm, bool& warmChild) {
+    warmChild = false;
+
+    std::map<std::string, WarmInterpreter>::iterator zygote = useWarm ? warm.find(interpreter) : warm.end();
+    if (zygote != warm.end()) {
+        pid_t pid = spawnWarm(zygote->second, scriptFile, envp, stdinFd, stdoutFd);
+        if (pid < 0) {
+            // The zygote died; restart it once before falling back to a cold spawn
+            std::cerr << "Warm CGI interpreter " << interpreter << " lost, restarting" << std::endl;
+            stopWarm(zygote->second);
+            if (launchWarm(interpreter, zygote->second)) {
+                pid = spawnWarm(zygote->second, scriptFile, envp, stdinFd, stdoutFd);
+            } else {
+                warm.erase(zygote);
+            }
+        }
+        if (pid > 0) {
+            warmChild = true;
+            return pid;
+        }
+    }
+
+    posix_spawn_file_actions_t actions;
+    posix_spawn_file_actions_init(&actions);
+    posix_spawn_file_actions_adddup2(&actions, stdinFd, STDIN_FILENO);
+    posix_spawn_file_actions_adddup2(&actions, stdoutFd, STDOUT_FILENO);
+
+    char* argv[] = { const_cast<char*>(interpreter.c_str()), const_cast<char*>(scriptFile.c_str()), NULL };
+    posix_spawnattr_t attr;
+    initSpawnAttr(&attr);
+    pid_t pid;
+    int rc = posix_spawn(&pid, interpreter.c_str(), &actions, &attr, argv, envp);
+    posix_spawnattr_destroy(&attr);
+    posix_spawn_file_actions_destroy(&actions);
+    if (rc != 0) {
+        errno = rc;
+        return -1;
+    }
+    return pid;
+}
+
+bool CgiSpawner::wait(const std::string& interpreter, pid_t pid, bool warmChild, int& status) {
+    if (!warmChild) {
+        while (waitpid(pid, &status, 0) < 0) {
+            if (errno != EINTR) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    std::map<std::string, WarmInterpreter>::iterator zygote = warm.find(interpreter);
+    if (zygote == warm.end()) {
+        return false;
+    }
+    std::map<pid_t, int>::iterator early = zygote->second.exited.find(pid);
+    if (early != zygote->second.exited.end()) {
+        status = early->second;
+        zygote->second.exited.erase(early);
+        return true;
+    }
+
+    char type;
+    pid_t exitedPid;
+    int exitStatus;
+    while (readMessage(zygote->second, type, exitedPid, exitStatus)) {
+        if (type != 'E') {
+            continue;
+        }
+        if (exitedPid == pid) {
+            status = exitStatus;
+            return true;
+        }
+        zygote->second.exited[exitedPid] = exitStatus;
+    }
+    return false;
+}
@@ -0,0 +1,142 @@
+/* ************************************************************************** */
+/*                                                                            */
+/*                                                        :::      ::::::::   */
+/*   client_limiter.cpp                                 :+:      :+:    :+:   */
+/*                                                    +:+ +:+         +:+     */
+/*   By: aogbi <aogbi@student.42.fr>                +#+  +:+       +#+        */
+/*                                                +#+#+#+#+#+   +#+           */
+/*   Created: 2026/10/19 00:00:00 by aogbi             #+#    #+#             */
+/*   Updated: 2026/10/19 00:00:00 by aogbi            ###   ########.fr       */
+/*                                                                            */
+/* ************************************************************************** */
+
+#include "client_limiter.hpp"
+#include <ctime>
+#include <cstring>
+
+struct ClientLimiter::Entry {
+    uint32_t addr;
+    uint32_t zone;              // 0 = unused entry, otherwise zone + 1
+    uint32_t connections;
+    uint32_t tokens;            // milli-requests
+    uint64_t refilled;          // milliseconds; 0 = bucket not started yet
+    uint64_t lastUsed;
+};
+
+static const uint32_t REQUEST_COST = 1000;
+
+static uint64_t nowMillis() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return static_cast<uint64_t>(ts.tv_sec) * 1000 + ts.tv_nsec / 1000000;
+}
+
+static uint64_t hashKey(uint32_t addr, uint32_t zone) {
+    uint64_t key = (static_cast<uint64_t>(zone) << 32) | addr;
+    key ^= key >> 33;
+    key *= 0xff51afd7ed558ccdULL;
+    key ^= key >> 33;
+    return key;
+}
+
+ClientLimiter::ClientLimiter() : entries(NULL), entryCount(0), clock(0), connectionLimit(0) {
+    pthread_mutex_init(&lock, NULL);
+}
+
+ClientLimiter::~ClientLimiter() {
+    delete[] entries;
+    pthread_mutex_destroy(&lock);
+}
+
+void ClientLimiter::init(size_t zoneBytes, size_t connLimit) {
+    entryCount = zoneBytes / sizeof(Entry);
+    if (entryCount < PROBE_WINDOW) {
+        entryCount = PROBE_WINDOW;
+    }
+    entries = new Entry[entryCount];
+    std::memset(entries, 0, entryCount * sizeof(Entry));
+    connectionLimit = connLimit;
+}
+
+ClientLimiter::Entry* ClientLimiter::find(uint32_t addr, uint32_t zone, bool create) {
+    size_t start = hashKey(addr, zone) % entryCount;
+    Entry* victim = NULL;
+    for (size_t i = 0; i < PROBE_WINDOW; ++i) {
+        Entry* entry = &entries[(start + i) % entryCount];
+        if (entry->zone == zone + 1 && entry->addr == addr) {
+            entry->lastUsed = ++clock;
+            return entry;
+        }
+        // Empty beats least recently used; entries holding connections are never taken
+        if (entry->zone == 0) {
+            if (!victim || victim->zone != 0) {
+                victim = entry;
+            }
+        } else if (entry->connections == 0 && (!victim || (victim->zone != 0 && entry->lastUsed < victim->lastUsed))) {
+            victim = entry;
+        }
+    }
+    if (!create || !victim) {
+        return NULL;
+    }
+    victim->addr = addr;
+    victim->zone = zone + 1;
+    victim->connections = 0;
+    victim->tokens = 0;
+    victim->refilled = 0;
+    victim->lastUsed = ++clock;
+    return victim;
+}
+
+bool ClientLimiter::acquireConnection(uint32_t addr) {
+    pthread_mutex_lock(&lock);
+    Entry* entry = find(addr, 0, true);
+    // A window full of live connections fails open rather than refusing everyone
+    bool allowed = !entry || entry->connections < connectionLimit;
+    if (entry && allowed) {
+        ++entry->connections;
+    }
+    pthread_mutex_unlock(&lock);
+    return allowed;
+}
+
+void ClientLimiter::releaseConnection(uint32_t addr) {
+    pthread_mutex_lock(&lock);
+    Entry* entry = find(addr, 0, false);
+    if (entry && entry->connections > 0) {
+        --entry->connections;
+    }
+    pthread_mutex_unlock(&lock);
+}
+
+bool ClientLimiter::allowRequest(uint32_t addr, uint32_t zone, int rate, size_t burst) {
+    pthread_mutex_lock(&lock);
+    bool allowed = takeToken(find(addr, zone, true), rate, burst);
+    pthread_mutex_unlock(&lock);
+    return allowed;
+}
+
+bool ClientLimiter::takeToken(Entry* entry, int rate, size_t burst) {
+    if (!entry) {
+        return true;
+    }
+    uint64_t capacity = (static_cast<uint64_t>(burst) + 1) * REQUEST_COST;
+    uint64_t now = nowMillis();
+    if (entry->refilled == 0) {
+        entry->tokens = static_cast<uint32_t>(capacity);
+        entry->refilled = now;
+    } else {
+        // Only whole milli-requests are added, so slow rates still accumulate
+        uint64_t added = (now - entry->refilled) * static_cast<uint64_t>(rate) / 1000;
+        if (added > 0) {
+            uint64_t tokens = entry->tokens + added;
+            entry->tokens = static_cast<uint32_t>(tokens < capacity ? tokens : capacity);
+            entry->refilled = now;
+        }
+    }
+    if (entry->tokens < REQUEST_COST) {
+        return false;
+    }
+    entry->tokens -= REQUEST_COST;
+    return true;
+}
@@ -6,15 +6,24 @@
 /*   By: aogbi <aogbi@student.42.fr>                +#+  +:+       +#+        */
 /*                                                +#+#+#+#+#+   +#+           */
 /*   Created: 2025/09/06 00:00:00 by aogbi             #+#    #+#             */
-/*   Updated: 2025/09/06 10:58:47 by aogbi            ###   ########.fr       */
+/*   Updated: 2026/10/19 00:00:00 by aogbi            ###   ########.fr       */
 /*                                                                            */
 /* ************************************************************************** */
 
 #include "config.hpp"
+#include <cstdlib>
+#include <cctype>
+#include <unistd.h>
 
 Config::Config(const std::string& configFile) 
-    : configFile(configFile), port(8080), serverName("localhost"), 
-      host("127.0.0.1"), root("./"), index("index.html"), clientMaxBodySize(1000000) {
+    : configFile(configFile), port(8080), ssl(false), sslSessionCache(20480), sslSessionTimeout(300),
+      sslSessionTickets(true), sslKtls(false), http2(false), serverName("localhost"), 
+      host("127.0.0.1"), root("./"), index("index.html"), clientMaxBodySize(1000000),
+      largeHeaderBuffers(4), largeHeaderBufferSize(8192), clientHeaderTimeout(10), clientBodyTimeout(10),
+      clientBodyMinRate(1024), clientBodyBufferSize(128 * 1024), clientBodyTempPath("/tmp"), openFileCacheMax(0),
+      openFileCacheInactive(20), openFileCacheValid(60), openFileCacheErrors(false), aioThreads(false), threadPoolThreads(32), threadPoolMaxQueue(65536),
+      ioUring(false), workerThreads(1), typesConfigured(false), cgiCacheZoneSize(16 * 1024 * 1024), cgiCacheEntrySize(64 * 1024),
+      limitZoneSize(1024 * 1024), limitConn(0), limitReqRate(0), limitReqBurst(0) {
 }
 
 bool Config::parseConfig() {
@@ -27,6 +36,9 @@ bool Config::parseConfig() {
     std::string line;
     Location currentLocation;
     bool inLocationBlock = false;
+    bool inTypesBlock = false;
+    Upstream currentUpstream;
+    bool inUpstreamBlock = false;
     
     while (std::getline(file, line)) {
         line = trim(line);
@@ -37,8 +49,38 @@ bool Config::parseConfig() {
         std::istringstream iss(line);
         std::string directive;
         iss >> directive;
+        directive = removeSemicolon(directive);
         
-        if (directive == "server") {
+        if (inTypesBlock) {
+            if (directive == "}") {
+                inTypesBlock = false;
+            } else {
+                parseTypesEntry(directive, iss);
+            }
+            continue;
+        }
+        
+        if (inUpstreamBlock) {
+            if (directive == "}") {
+                upstreams[currentUpstream.name] = currentUpstream;
+                inUpstreamBlock = false;
+            } else if (directive == "server") {
+                std::string address;
+                iss >> address;
+                currentUpstream.servers.push_back(removeSemicolon(address));
+            } else if (directive == "least_conn") {
+                currentUpstream.leastConn = true;
+            } else if (directive == "keepalive") {
+                iss >> currentUpstream.keepalive;
+            }
+            continue;
+        }
+        
+        if (directive == "upstream") {
+            currentUpstream = Upstream();
+            iss >> currentUpstream.name;
+            inUpstreamBlock = true;
+        } else if (directive == "server") {
             continue;
         } else if (directive == "location") {
             if (inLocationBlock) {
@@ -54,7 +96,36 @@ bool Config::parseConfig() {
                 inLocationBlock = false;
             }
         } else if (directive == "listen") {
-            iss >> port;
+            std::string flag;
+            iss >> port >> flag;
+            ssl = (removeSemicolon(flag) == "ssl");
+        } else if (directive == "ssl_certificate") {
+            iss >> sslCertificate;
+            sslCertificate = removeSemicolon(sslCertificate);
+        } else if (directive == "ssl_certificate_key") {
+            iss >> sslCertificateKey;
+            sslCertificateKey = removeSemicolon(sslCertificateKey);
+        } else if (directive == "ssl_session_cache") {
+            std::string value;
+            iss >> value;
+            value = removeSemicolon(value);
+            sslSessionCache = (value == "off") ? 0 : static_cast<size_t>(std::strtoul(value.c_str(), NULL, 10));
+        } else if (directive == "ssl_session_timeout") {
+            std::string value;
+            iss >> value;
+            sslSessionTimeout = parseSeconds(removeSemicolon(value));
+        } else if (directive == "ssl_session_tickets") {
+            std::string value;
+            iss >> value;
+            sslSessionTickets = (removeSemicolon(value) != "off");
+        } else if (directive == "ssl_ktls") {
+            std::string value;
+            iss >> value;
+            sslKtls = (removeSemicolon(value) == "on");
+        } else if (directive == "http2") {
+            std::string value;
+            iss >> value;
+            http2 = (removeSemicolon(value) == "on");
         } else if (directive == "server_name") {
             iss >> serverName;
             serverName = removeSemicolon(serverName);
@@ -80,7 +151,107 @@ bool Config::parseConfig() {
                 index = indexFile;
             }
         } else if (directive == "client_max_body_size") {
-            iss >> clientMaxBodySize;
+            std::string size;
+            iss >> size;
+            clientMaxBodySize = parseSize(removeSemicolon(size));
+        } else if (directive == "large_client_header_buffers") {
+            std::string size;
+            iss >> largeHeaderBuffers >> size;
+            largeHeaderBufferSize = parseSize(removeSemicolon(size));
+            if (largeHeaderBuffers == 0 || largeHeaderBufferSize == 0) {
+                std::cerr << "Error: invalid large_client_header_buffers: " << line << std::endl;
+                return false;
+            }
+        } else if (directive == "client_header_timeout") {
+            std::string value;
+            iss >> value;
+            clientHeaderTimeout = parseSeconds(removeSemicolon(value));
+        } else if (directive == "client_body_timeout") {
+            std::string value;
+            iss >> value;
+            clientBodyTimeout = parseSeconds(removeSemicolon(value));
+        } else if (directive == "client_body_min_rate") {
+            std::string value;
+            iss >> value;
+            clientBodyMinRate = parseSize(removeSemicolon(value));
+        } else if (directive == "client_body_buffer_size") {
+            std::string size;
+            iss >> size;
+            clientBodyBufferSize = parseSize(removeSemicolon(size));
+        } else if (directive == "client_body_temp_path") {
+            std::string path;
+            iss >> path;
+            clientBodyTempPath = removeSemicolon(path);
+        } else if (directive == "open_file_cache") {
+            // "max=N [inactive=TIME]" or "off"
+            std::string token;
+            openFileCacheMax = 0;
+            while (iss >> token) {
+                token = removeSemicolon(token);
+                if (token.compare(0, 4, "max=") == 0) {
+                    openFileCacheMax = static_cast<size_t>(std::strtoul(token.c_str() + 4, NULL, 10));
+                } else if (token.compare(0, 9, "inactive=") == 0) {
+                    openFileCacheInactive = parseSeconds(token.substr(9));
+                } else if (token != "off") {
+                    std::cerr << "Error: invalid open_file_cache: " << line << std::endl;
+                    return false;
+                }
+            }
+        } else if (directive == "open_file_cache_valid") {
+            std::string value;
+            iss >> value;
+            openFileCacheValid = parseSeconds(removeSemicolon(value));
+        } else if (directive == "open_file_cache_errors") {
+            std::string value;
+            iss >> value;
+            openFileCacheErrors = (removeSemicolon(value) == "on");
+        } else if (directive == "aio") {
+            std::string value;
+            iss >> value;
+            value = removeSemicolon(value);
+            if (value != "threads" && value != "off") {
+                std::cerr << "Error: invalid aio: " << line << std::endl;
+                return false;
+            }
+            aioThreads = (value == "threads");
+        } else if (directive == "thread_pool") {
+            // "threads=N [max_queue=N]"
+            std::string token;
+            while (iss >> token) {
+                token = removeSemicolon(token);
+                if (token.compare(0, 8, "threads=") == 0) {
+                    threadPoolThreads = static_cast<size_t>(std::strtoul(token.c_str() + 8, NULL, 10));
+                } else if (token.compare(0, 10, "max_queue=") == 0) {
+                    threadPoolMaxQueue = static_cast<size_t>(std::strtoul(token.c_str() + 10, NULL, 10));
+                } else {
+                    std::cerr << "Error: invalid thread_pool: " << line << std::endl;
+                    return false;
+                }
+            }
+            if (threadPoolThreads == 0 || threadPoolMaxQueue == 0) {
+                std::cerr << "Error: invalid thread_pool: " << line << std::endl;
+                return false;
+            }
+        } else if (directive == "event_backend") {
+            std::string value;
+            iss >> value;
+            value = removeSemicolon(value);
+            if (value != "poll" && value != "io_uring") {
+                std::cerr << "Error: invalid event_backend: " << line << std::endl;
+                return false;
+            }
+            ioUring = (value == "io_uring");
+        } else if (directive == "worker_threads") {
+            // "N" or "auto" (one reactor per online CPU)
+            std::string value;
+            iss >> value;
+            value = removeSemicolon(value);
+            long count = value == "auto" ? sysconf(_SC_NPROCESSORS_ONLN) : std::strtol(value.c_str(), NULL, 10);
+            if (count < 1 || count > MAX_WORKER_THREADS) {
+                std::cerr << "Error: invalid worker_threads: " << line << std::endl;
+                return false;
+            }
+            workerThreads = static_cast<size_t>(count);
         } else if (directive == "allow_methods") {
             if (inLocationBlock) {
                 std::string method;
@@ -95,6 +266,10 @@ bool Config::parseConfig() {
                 iss >> value;
                 currentLocation.autoindex = (removeSemicolon(value) == "on");
             }
+        } else if (directive == "autoindex_page_size") {
+            if (inLocationBlock) {
+                iss >> currentLocation.autoindexPageSize;
+            }
         } else if (directive == "cgi_path") {
             if (inLocationBlock) {
                 std::string path;
@@ -107,11 +282,116 @@ bool Config::parseConfig() {
                 iss >> ext;
                 currentLocation.cgiExt.push_back(removeSemicolon(ext));
             }
+        } else if (directive == "cgi_warm") {
+            if (inLocationBlock) {
+                std::string ext;
+                iss >> ext;
+                currentLocation.cgiWarmExt.push_back(removeSemicolon(ext));
+            }
         } else if (directive == "upload_dir") {
             if (inLocationBlock) {
                 iss >> currentLocation.uploadDir;
                 currentLocation.uploadDir = removeSemicolon(currentLocation.uploadDir);
             }
+        } else if (directive == "upload_cache") {
+            if (inLocationBlock) {
+                std::string value;
+                iss >> value;
+                value = removeSemicolon(value);
+                if (value == "keep") {
+                    currentLocation.uploadCache = UploadWriter::CACHE_KEEP;
+                } else if (value == "drop") {
+                    currentLocation.uploadCache = UploadWriter::CACHE_DROP;
+                } else if (value == "direct") {
+                    currentLocation.uploadCache = UploadWriter::CACHE_DIRECT;
+                } else {
+                    std::cerr << "Error: invalid upload_cache: " << line << std::endl;
+                    return false;
+                }
+            }
+        } else if (directive == "upload_fsync") {
+            if (inLocationBlock) {
+                std::string value;
+                iss >> value;
+                value = removeSemicolon(value);
+                if (value == "off") {
+                    currentLocation.uploadFsync = UploadWriter::FSYNC_OFF;
+                } else if (value == "on") {
+                    currentLocation.uploadFsync = UploadWriter::FSYNC_ON;
+                } else if (value == "batch") {
+                    currentLocation.uploadFsync = UploadWriter::FSYNC_BATCH;
+                } else {
+                    std::cerr << "Error: invalid upload_fsync: " << line << std::endl;
+                    return false;
+                }
+            }
+        } else if (directive == "stub_status") {
+            if (inLocationBlock) {
+                std::string value;
+                iss >> value;
+                currentLocation.stubStatus = (removeSemicolon(value) != "off");
+            }
+        } else if (directive == "proxy_pass") {
+            if (inLocationBlock) {
+                iss >> currentLocation.proxyPass;
+                currentLocation.proxyPass = removeSemicolon(currentLocation.proxyPass);
+            }
+        } else if (directive == "proxy_timeout") {
+            if (inLocationBlock) {
+                iss >> currentLocation.proxyTimeout;
+            }
+        } else if (directive == "cgi_cache") {
+            if (inLocationBlock) {
+                std::string value;
+                iss >> value;
+                value = removeSemicolon(value);
+                currentLocation.cgiCacheTtl = (value == "off") ? 0 : parseSeconds(value);
+            }
+        } else if (directive == "cgi_cache_key") {
+            if (inLocationBlock) {
+                std::string keyTemplate;
+                iss >> keyTemplate;
+                keyTemplate = removeSemicolon(keyTemplate);
+                if (keyTemplate.length() >= 2 && keyTemplate[0] == '"' && keyTemplate[keyTemplate.length() - 1] == '"') {
+                    keyTemplate = keyTemplate.substr(1, keyTemplate.length() - 2);
+                }
+                currentLocation.cgiCacheKey = keyTemplate;
+            }
+        } else if (directive == "limit_zone") {
+            std::string size;
+            iss >> size;
+            limitZoneSize = parseSize(removeSemicolon(size));
+        } else if (directive == "limit_conn") {
+            iss >> limitConn;
+        } else if (directive == "limit_req") {
+            bool parsed = inLocationBlock ? parseLimitReq(iss, currentLocation.limitReqRate, currentLocation.limitReqBurst)
+                                          : parseLimitReq(iss, limitReqRate, limitReqBurst);
+            if (!parsed) {
+                std::cerr << "Error: invalid limit_req: " << line << std::endl;
+                return false;
+            }
+        } else if (directive == "cgi_cache_zone") {
+            std::string zoneSize;
+            std::string entrySize;
+            iss >> zoneSize >> entrySize;
+            cgiCacheZoneSize = parseSize(removeSemicolon(zoneSize));
+            if (!entrySize.empty()) {
+                cgiCacheEntrySize = parseSize(removeSemicolon(entrySize));
+            }
+        } else if (directive == "types") {
+            inTypesBlock = true;
+            typesConfigured = true;
+        } else if (directive == "include") {
+            std::string path;
+            iss >> path;
+            if (!parseTypesFile(resolveIncludePath(removeSemicolon(path)))) {
+                return false;
+            }
+            typesConfigured = true;
+        } else if (directive == "default_type") {
+            std::string type;
+            iss >> type;
+            mimeTypes.setDefaultType(removeSemicolon(type));
         } else if (directive == "error_page") {
             int code;
             std::string page;
@@ -123,11 +403,124 @@ bool Config::parseConfig() {
     if (inLocationBlock) {
         locations.push_back(currentLocation);
     }
+    if (!typesConfigured) {
+        mimeTypes.loadDefaults();
+    }
+    if (ssl && (sslCertificate.empty() || sslCertificateKey.empty())) {
+        std::cerr << "Error: listen ssl needs ssl_certificate and ssl_certificate_key" << std::endl;
+        return false;
+    }
     
     file.close();
     return true;
 }
 
+std::string Config::resolveIncludePath(const std::string& path) const {
+    // Relative includes are resolved against the including config file
+    if (path.empty() || path[0] == '/') {
+        return path;
+    }
+    size_t slash = configFile.find_last_of('/');
+    if (slash == std::string::npos) {
+        return path;
+    }
+    return configFile.substr(0, slash + 1) + path;
+}
+
+void Config::parseTypesEntry(const std::string& type, std::istringstream& extensions) {
+    std::string ext;
+    while (extensions >> ext) {
+        mimeTypes.add(removeSemicolon(ext), type);
+    }
+}
+
+bool Config::parseTypesFile(const std::string& path) {
+    std::ifstream file(path.c_str());
+    if (!file.is_open()) {
+        std::cerr << "Error: Could not open included file: " << path << std::endl;
+        return false;
+    }
+    
+    std::string line;
+    while (std::getline(file, line)) {
+        line = trim(line);
+        if (line.empty() || line[0] == '#') {
+            continue;
+        }
+        
+        std::istringstream iss(line);
+        std::string type;
+        iss >> type;
+        if (type == "types" || type == "}") {
+            continue;
+        }
+        parseTypesEntry(type, iss);
+    }
+    return true;
+}
+
+size_t Config::parseSize(const std::string& value) {
+    // "64k", "16m", "1g" or plain bytes
+    size_t size = static_cast<size_t>(std::strtoul(value.c_str(), NULL, 10));
+    char unit = value.empty() ? '\0' : static_cast<char>(std::tolower(value[value.length() - 1]));
+    if (unit == 'k') {
+        size *= 1024;
+    } else if (unit == 'm') {
+        size *= 1024 * 1024;
+    } else if (unit == 'g') {
+        size *= 1024 * 1024 * 1024;
+    }
+    return size;
+}
+
+int Config::parseSeconds(const std::string& value) {
+    // "30", "30s", "5m" or "1h"
+    int seconds = std::atoi(value.c_str());
+    char unit = value.empty() ? '\0' : static_cast<char>(std::tolower(value[value.length() - 1]));
+    if (unit == 'm') {
+        seconds *= 60;
+    } else if (unit == 'h') {
+        seconds *= 3600;
+    }
+    return seconds;
+}
+
+bool Config::parseLimitReq(std::istringstream& args, int& rate, size_t& burst) {
+    // "10r/s [burst=N]", "rate=60r/m burst=N" or "off"
+    std::string token;
+    rate = 0;
+    burst = 0;
+    while (args >> token) {
+        token = token.substr(0, token.find(';'));
+        if (token.empty() || token == "off") {
+            continue;
+        }
+        if (token.compare(0, 6, "burst=") == 0) {
+            burst = static_cast<size_t>(std::strtoul(token.c_str() + 6, NULL, 10));
+            continue;
+        }
+        if (token.compare(0, 5, "rate=") == 0) {
+            token.erase(0, 5);
+        }
+        size_t slash = token.find("r/");
+        if (slash == std::string::npos || slash + 3 != token.length()) {
+            return false;
+        }
+        int requests = std::atoi(token.c_str());
+        if (token[slash + 2] == 's') {
+            rate = requests * 1000;
+        } else if (token[slash + 2] == 'm') {
+            rate = requests * 1000 / 60;
+        } else {
+            return false;
+        }
+        if (rate <= 0) {
+            return false;
+        }
+    }
+    return true;
+}
+
 std::string Config::trim(const std::string& str) {
     size_t start = str.find_first_not_of(" \t\n\r");
     if (start == std::string::npos) return "";
@@ -142,13 +535,13 @@ std::string Config::removeSemicolon(const std::string& str) {
     return str;
 }
 
-const Location* Config::findLocation(const std::string& path) const {
+const Location* Config::findLocation(const StringView& path) const {
     const Location* bestMatch = NULL;
     size_t bestMatchLength = 0;
     
     for (size_t i = 0; i < locations.size(); ++i) {
         const std::string& locPath = locations[i].path;
-        if (path.find(locPath) == 0 && locPath.length() > bestMatchLength) {
+        if (locPath.length() > bestMatchLength && path.substr(0, locPath.length()) == locPath) {
             bestMatch = &locations[i];
             bestMatchLength = locPath.length();
         }
@@ -157,13 +550,13 @@ const Location* Config::findLocation(const std::string& path) const {
     return bestMatch;
 }
 
-bool Config::isMethodAllowed(const std::string& method, const Location* loc) const {
+bool Config::isMethodAllowed(const StringView& method, const Location* loc) const {
     if (!loc || loc->allowMethods.empty()) {
         return true; // Default: allow all methods
     }
     
     for (size_t i = 0; i < loc->allowMethods.size(); ++i) {
-        if (loc->allowMethods[i] == method) {
+        if (method == loc->allowMethods[i]) {
             return true;
         }
     }
@@ -6,60 +6,268 @@
 /*   By: aogbi <aogbi@student.42.fr>                +#+  +:+       +#+        */
 /*                                                +#+#+#+#+#+   +#+           */
 /*   Created: 2025/09/06 00:00:00 by aogbi             #+#    #+#             */
-/*   Updated: 2025/09/12 17:56:39 by aogbi            ###   ########.fr       */
+/*   Updated: 2026/10/19 00:00:00 by aogbi            ###   ########.fr       */
 /*                                                                            */
 /* ************************************************************************** */
 
 #include "connection_manager.hpp"
 #include "response.hpp"
+#include "request.hpp"
+#include "byte_scan.hpp"
 #include <unistd.h>
 #include <iostream>
 #include <algorithm>
 #include <sys/socket.h>
 #include <cstdlib>
+#include <cstring>
+#include <cerrno>
+#include <climits>
+#include <openssl/ssl.h>
+#include <openssl/err.h>
 
-ConnectionManager::ConnectionManager(int serverFd) {
-    struct pollfd serverPoll;
-    serverPoll.fd = serverFd;
-    serverPoll.events = POLLIN;
-    serverPoll.revents = 0;
-    pollFds.push_back(serverPoll);
+ConnectionManager::ConnectionManager(int serverFd, Metrics& metrics, const RequestLimits& limits, ClientLimiter* limiter,
+                                     TlsContext* tls, EventRing* ring)
+    : metrics(metrics), limits(limits), limiter(limiter), tls(tls), ring(ring), nextStreamId(-1) {
+    addPollFd(serverFd, POLLIN);
 }
 
-void ConnectionManager::addClient(int clientFd) {
+void ConnectionManager::addPollFd(int fd, short events, bool receive) {
+    if (ring) {
+        ring->watch(fd, events, receive);
+    }
+    struct pollfd entry;
+    entry.fd = fd;
+    entry.events = events;
+    entry.revents = 0;
+    pollIndex[fd] = pollFds.size();
+    pollFds.push_back(entry);
+}
+
+void ConnectionManager::removePollFd(int fd) {
+    std::map<int, size_t>::iterator it = pollIndex.find(fd);
+    if (it == pollIndex.end()) {
+        return;
+    }
+    if (ring) {
+        ring->unwatch(fd);
+    }
+    // Swap with the last slot so removal does not shift the whole set
+    size_t slot = it->second;
+    size_t last = pollFds.size() - 1;
+    if (slot != last) {
+        pollFds[slot] = pollFds[last];
+        pollIndex[pollFds[slot].fd] = slot;
+    }
+    pollFds.pop_back();
+    pollIndex.erase(fd);
+}
+
+void ConnectionManager::setEvents(int fd, short events) {
+    std::map<int, size_t>::iterator it = pollIndex.find(fd);
+    if (it != pollIndex.end()) {
+        pollFds[it->second].events = events;
+        if (ring) {
+            ring->setEvents(fd, events);
+        }
+    }
+}
+
+short ConnectionManager::getEvents(int fd) const {
+    std::map<int, size_t>::const_iterator it = pollIndex.find(fd);
+    return it != pollIndex.end() ? pollFds[it->second].events : 0;
+}
+
+bool ConnectionManager::addClient(int clientFd, const std::string& remoteAddr, uint32_t peerAddr, uint16_t remotePort) {
+    bool counted = false;
+    if (limiter && limiter->limitsConnections()) {
+        if (!limiter->acquireConnection(peerAddr)) {
+            static const char refusal[] = "HTTP/1.1 503 Service Unavailable\r\nContent-Type: text/plain\r\n"
+                                          "Content-Length: 20\r\nConnection: close\r\n\r\n"
+                                          "Too many connections";
+            if (!tls) {
+                send(clientFd, refusal, sizeof(refusal) - 1, MSG_NOSIGNAL | MSG_DONTWAIT);
+            }
+            close(clientFd);
+            metrics.recordLimitRejection(Metrics::LIMIT_CONN);
+            return false;
+        }
+        counted = true;
+    }
     ClientConnection client(clientFd);
+    if (tls) {
+        client.ssl = tls->accept(clientFd);
+        if (!client.ssl) {
+            if (counted) {
+                limiter->releaseConnection(peerAddr);
+            }
+            close(clientFd);
+            return false;
+        }
+        client.handshaking = true;
+    }
+    client.remoteAddr = remoteAddr;
+    client.remotePort = remotePort;
+    client.peerAddr = peerAddr;
+    client.countedByLimiter = counted;
     clients[clientFd] = client;
-    
-    struct pollfd clientPoll;
-    clientPoll.fd = clientFd;
-    clientPoll.events = POLLIN;
-    clientPoll.revents = 0;
-    pollFds.push_back(clientPoll);
+    metrics.connectionOpened();
+    addPollFd(clientFd, POLLIN, !tls);
+    return true;
+}
+
+int ConnectionManager::addStream(int parentFd) {
+    ClientConnection* parent = findClient(parentFd);
+    if (!parent) {
+        return 0;
+    }
+    int id = nextStreamId--;
+    ClientConnection stream(id);
+    stream.parentFd = parentFd;
+    stream.remoteAddr = parent->remoteAddr;
+    stream.remotePort = parent->remotePort;
+    stream.peerAddr = parent->peerAddr;
+    clients[id] = stream;
+    parent->streams++;
+    return id;
+}
+
+void ConnectionManager::takeStreamUpdates(std::vector<int>& ids) {
+    ids.swap(streamUpdates);
+    streamUpdates.clear();
 }
 
 void ConnectionManager::removeClient(int clientFd) {
     // Remove from clients map
-    clients.erase(clientFd);
-    
-    // Remove from poll fds
-    for (std::vector<struct pollfd>::iterator it = pollFds.begin(); it != pollFds.end(); ++it) {
-        if (it->fd == clientFd) {
-            pollFds.erase(it);
-            break;
+    std::map<int, ClientConnection>::iterator client = clients.find(clientFd);
+    if (client != clients.end() && client->second.parentFd >= 0) {
+        // A stream client owns no socket; its connection is told through the updates
+        ClientConnection* parent = findClient(client->second.parentFd);
+        if (parent) {
+            parent->streams--;
         }
+        clients.erase(client);
+        streamUpdates.push_back(clientFd);
+        return;
+    }
+    if (clientFd < 0) {
+        return; // a stream client already gone
+    }
+    if (client != clients.end()) {
+        if (client->second.streams > 0) {
+            std::map<int, ClientConnection>::iterator it = clients.begin();
+            while (it != clients.end()) {
+                if (it->second.parentFd == clientFd) {
+                    clients.erase(it++);
+                } else {
+                    ++it;
+                }
+            }
+        }
+        if (client->second.countedByLimiter) {
+            limiter->releaseConnection(client->second.peerAddr);
+        }
+        if (client->second.ssl) {
+            // Best-effort close_notify; the socket is closed right after either way
+            if (!client->second.handshaking) {
+                SSL_shutdown(client->second.ssl);
+            }
+            SSL_free(client->second.ssl);
+            ERR_clear_error();
+        }
+        metrics.connectionClosed(client->second.buffer.empty() && !client->second.headersRouted);
+        clients.erase(client);
     }
     
-    // Close the socket
-    close(clientFd);
+    removePollFd(clientFd);
+    
+    // Close the socket, from the ring when it may still have requests on it
+    if (ring) {
+        ring->closeFd(clientFd);
+    } else {
+        close(clientFd);
+    }
 }
 
-void ConnectionManager::handleTimeouts() {
+bool ConnectionManager::continueHandshake(int clientFd) {
+    ClientConnection* client = findClient(clientFd);
+    if (!client || !client->ssl) {
+        return false;
+    }
+    ERR_clear_error();
+    int result = SSL_do_handshake(client->ssl);
+    if (result == 1) {
+        client->handshaking = false;
+        metrics.recordTlsHandshake(SSL_session_reused(client->ssl) == 1, TlsContext::usesKtls(client->ssl));
+        setEvents(clientFd, POLLIN);
+        return true;
+    }
+    int error = SSL_get_error(client->ssl, result);
+    if (error == SSL_ERROR_WANT_READ) {
+        setEvents(clientFd, POLLIN);
+        return true;
+    }
+    if (error == SSL_ERROR_WANT_WRITE) {
+        setEvents(clientFd, POLLOUT);
+        return true;
+    }
+    // Scanners and clients rejecting the certificate end up here; not worth a log line each
+    metrics.recordTlsFailure();
+    ERR_clear_error();
+    return false;
+}
+
+ssize_t ConnectionManager::receive(int clientFd, char* buffer, size_t length) {
+    ClientConnection* client = findClient(clientFd);
+    if (!client || !client->ssl) {
+        return read(clientFd, buffer, length);
+    }
+    ERR_clear_error();
+    int received = SSL_read(client->ssl, buffer, length > INT_MAX ? INT_MAX : static_cast<int>(length));
+    if (received > 0) {
+        return received;
+    }
+    int error = SSL_get_error(client->ssl, received);
+    if (error == SSL_ERROR_ZERO_RETURN) {
+        return 0;
+    }
+    errno = (error == SSL_ERROR_WANT_READ || error == SSL_ERROR_WANT_WRITE) ? EAGAIN : ECONNRESET;
+    ERR_clear_error();
+    return -1;
+}
+
+ssize_t ConnectionManager::transmit(ClientConnection& client, const char* data, size_t length) {
+    if (!client.ssl) {
+        return send(client.fd, data, length, MSG_NOSIGNAL);
+    }
+    ERR_clear_error();
+    int sent = SSL_write(client.ssl, data, length > INT_MAX ? INT_MAX : static_cast<int>(length));
+    if (sent > 0) {
+        return sent;
+    }
+    int error = SSL_get_error(client.ssl, sent);
+    errno = (error == SSL_ERROR_WANT_WRITE || error == SSL_ERROR_WANT_READ) ? EAGAIN : EPIPE;
+    ERR_clear_error();
+    return -1;
+}
+
+ClientConnection* ConnectionManager::findClient(int clientFd) {
+    std::map<int, ClientConnection>::iterator it = clients.find(clientFd);
+    return it != clients.end() ? &it->second : NULL;
+}
+
+std::vector<int> ConnectionManager::handleTimeouts() {
     time_t currentTime = time(NULL);
     std::vector<int> clientsToRemove;
+    std::vector<int> slowClients;
     
     for (std::map<int, ClientConnection>::iterator it = clients.begin(); it != clients.end(); ++it) {
+        if (it->second.parentFd >= 0) {
+            continue; // streams live as long as their connection
+        }
         if (currentTime - it->second.lastActivity > CLIENT_TIMEOUT) {
             clientsToRemove.push_back(it->first);
+        } else if (tooSlow(it->second, currentTime)) {
+            slowClients.push_back(it->first);
         }
     }
     
@@ -68,50 +276,138 @@ void ConnectionManager::handleTimeouts() {
         std::cout << "Client " << clientsToRemove[i] << " timed out, removing..." << std::endl;
         removeClient(clientsToRemove[i]);
     }
+    for (size_t i = 0; i < slowClients.size(); ++i) {
+        std::cout << "Client " << slowClients[i] << " sent its request too slowly" << std::endl;
+        rejectRequest(slowClients[i], 408, "Request Timeout");
+        clientsToRemove.push_back(slowClients[i]);
+    }
+    return clientsToRemove;
 }
 
-bool ConnectionManager::isRequestComplete(const std::string& buffer) {
-    // Check for end of headers
-    size_t headerEnd = buffer.find("\r\n\r\n");
-    if (headerEnd == std::string::npos) {
-        headerEnd = buffer.find("\n\n");
-        if (headerEnd == std::string::npos) {
-            return false; // Headers not complete
+bool ConnectionManager::tooSlow(ClientConnection& client, time_t now) {
+    if (client.requestComplete || client.closeAfterWrite) {
+        return false;
+    }
+    if (client.headerEnd == std::string::npos) {
+        // A fixed deadline: dripping a byte now and then does not extend it
+        return now - client.acceptedAt >= limits.headerTimeout;
+    }
+    if (!(getEvents(client.fd) & POLLIN)) {
+        // Not reading (a proxied body waiting on the upstream): restart the window
+        client.rateWindowStart = now;
+        client.rateWindowBytes = 0;
+        return false;
+    }
+    time_t elapsed = now - client.rateWindowStart;
+    if (elapsed < limits.bodyTimeout) {
+        return false;
+    }
+    if (client.rateWindowBytes == 0 || client.rateWindowBytes < limits.bodyMinRate * static_cast<size_t>(elapsed)) {
+        return true;
+    }
+    client.rateWindowStart = now;
+    client.rateWindowBytes = 0;
+    return false;
+}
+
+bool ConnectionManager::checkRequestLimits(int clientFd) {
+    ClientConnection* client = findClient(clientFd);
+    if (!client) {
+        return false;
+    }
+    const std::string& buffer = client->buffer;
+    while (client->headerEnd == std::string::npos) {
+        size_t newline = buffer.find('\n', client->lineStart);
+        size_t lineEnd = (newline == std::string::npos) ? buffer.length() : newline + 1;
+        if (lineEnd - client->lineStart > limits.headerLineSize) {
+            if (client->lineStart == 0) {
+                rejectRequest(clientFd, 414, "URI Too Long");
+            } else {
+                rejectRequest(clientFd, 431, "Request Header Fields Too Large");
+            }
+            return false;
         }
-        headerEnd += 2;
-    } else {
-        headerEnd += 4;
+        if (newline == std::string::npos) {
+            break;
+        }
+        bool blank = (newline == client->lineStart) || (newline == client->lineStart + 1 && buffer[client->lineStart] == '\r');
+        if (blank && client->lineStart > 0) {
+            client->headerEnd = newline + 1;
+            // The body phase gets its own min-rate window
+            client->rateWindowStart = time(NULL);
+            client->rateWindowBytes = buffer.length() - client->headerEnd;
+        }
+        client->lineStart = newline + 1;
     }
     
-    // Parse headers to check for Content-Length
-    std::string headers = buffer.substr(0, headerEnd);
-    size_t contentLengthPos = headers.find("Content-Length:");
-    if (contentLengthPos == std::string::npos) {
-        contentLengthPos = headers.find("content-length:");
+    size_t headerBytes = (client->headerEnd == std::string::npos) ? buffer.length() : client->headerEnd;
+    if (headerBytes > limits.headerBlockSize) {
+        rejectRequest(clientFd, 431, "Request Header Fields Too Large");
+        return false;
+    }
+    if (client->headerEnd != std::string::npos && limits.maxBodySize > 0
+        && buffer.length() - client->headerEnd + client->body.size() > limits.maxBodySize) {
+        rejectRequest(clientFd, 413, "Payload Too Large");
+        return false;
+    }
+    return true;
+}
+
+void ConnectionManager::rejectRequest(int clientFd, int statusCode, const std::string& message) {
+    ClientConnection* client = findClient(clientFd);
+    if (!client) {
+        return;
+    }
+    if (client->writeStart != 0 || client->handshaking) {
+        // Part of a response is already out (or TLS is not up yet); closing is the only signal left
+        removeClient(clientFd);
+        return;
+    }
+    metrics.recordStatus(statusCode);
+    sendErrorResponse(clientFd, statusCode, message);
+    finishResponse(clientFd);
+}
+
+size_t ConnectionManager::findHeaderEnd(const std::string& buffer) {
+    size_t separator = 0;
+    size_t headerEnd = ByteScan::findHeadEnd(buffer.data(), buffer.length(), separator);
+    if (headerEnd == ByteScan::npos) {
+        return std::string::npos;
+    }
+    return headerEnd + separator;
+}
+
+bool ConnectionManager::spoolBody(ClientConnection& client) {
+    if (client.headerEnd == std::string::npos || client.buffer.length() <= client.headerEnd) {
+        return true;
+    }
+    const char* data = client.buffer.data() + client.headerEnd;
+    size_t length = client.buffer.length() - client.headerEnd;
+    bool ok = true;
+    if (!client.body.spooled() && limits.bodyBufferSize > 0 && client.body.size() + length > limits.bodyBufferSize) {
+        ok = client.body.spool(limits.bodyTempPath);
+    }
+    ok = ok && client.body.append(data, length);
+    client.buffer.erase(client.headerEnd);
+    return ok;
+}
+
+bool ConnectionManager::isRequestComplete(const std::string& buffer, size_t spooled) {
+    // Check for end of headers
+    size_t headerEnd = findHeaderEnd(buffer);
+    if (headerEnd == std::string::npos) {
+        return false; // Headers not complete
     }
     
-    if (contentLengthPos != std::string::npos) {
-        // Extract Content-Length value
-        size_t valueStart = headers.find(':', contentLengthPos) + 1;
-        size_t valueEnd = headers.find('\r', valueStart);
-        if (valueEnd == std::string::npos) {
-            valueEnd = headers.find('\n', valueStart);
-        }
-        
-        std::string lengthStr = headers.substr(valueStart, valueEnd - valueStart);
-        
-        // Trim whitespace
-        while (!lengthStr.empty() && lengthStr[0] == ' ') lengthStr.erase(0, 1);
-        while (!lengthStr.empty() && lengthStr[lengthStr.length() - 1] == ' ') lengthStr.erase(lengthStr.length() - 1);
-        
-        int contentLength = atoi(lengthStr.c_str());
-        size_t totalExpectedLength = headerEnd + contentLength;
-        
-        return buffer.length() >= totalExpectedLength;
+    // The handler's own parse decides where the body ends, so the two never disagree;
+    // a head it refuses is complete as it is, and answered with 400
+    Request head;
+    if (!head.parse(buffer, false)) {
+        return true;
     }
     
-    // No Content-Length header, request is complete after headers
-    return true;
+    // Without a Content-Length the request ends with its head
+    return head.getContentLength() <= buffer.length() + spooled - headerEnd;
 }
 
 void ConnectionManager::sendErrorResponse(int clientFd, int statusCode, const std::string& message) {
@@ -128,12 +424,104 @@ void ConnectionManager::sendErrorResponse(int clientFd, int statusCode, const st
     response.setBody(body.str());
     std::string responseStr = response.toString();
     
-    send(clientFd, responseStr.c_str(), responseStr.length(), 0);
+    ClientConnection* client = findClient(clientFd);
+    if (client) {
+        client->closeAfterWrite = true;
+        queueWrite(clientFd, responseStr);
+    }
+}
+
+void ConnectionManager::finishResponse(int clientFd) {
+    ClientConnection* client = findClient(clientFd);
+    if (client && client->parentFd >= 0) {
+        client->closeAfterWrite = true;
+        streamUpdates.push_back(clientFd);
+    } else if (client) {
+        client->closeAfterWrite = true;
+        closeIfFlushed(clientFd);
+    }
 }
 
-void ConnectionManager::updateClientActivity(int clientFd) {
+bool ConnectionManager::closeIfFlushed(int clientFd) {
+    ClientConnection* client = findClient(clientFd);
+    if (!client || client->parentFd >= 0 || !client->closeAfterWrite || client->pendingOutput() > 0) {
+        return false;
+    }
+    if (client->writeStart != 0) {
+        metrics.observePhase(Metrics::PHASE_WRITE, client->writeStart);
+    }
+    // Close connection after response (HTTP/1.0 behavior)
+    std::cout << "📤 Request completed, closing connection (fd: " << clientFd << ")" << std::endl;
+    removeClient(clientFd);
+    return true;
+}
+
+bool ConnectionManager::queueWrite(int clientFd, const char* data, size_t length) {
+    ClientConnection* client = findClient(clientFd);
+    if (!client) {
+        return false;
+    }
+    if (client->pendingOutput() == 0) {
+        client->outBuffer.clear();
+        client->outOffset = 0;
+        if (client->writeStart == 0) {
+            client->writeStart = Metrics::nowMicros();
+        }
+    }
+    client->outBuffer.append(data, length);
+    if (client->parentFd >= 0) {
+        streamUpdates.push_back(clientFd);
+        return true;
+    }
+    return flush(clientFd);
+}
+
+bool ConnectionManager::flush(int clientFd) {
+    ClientConnection* client = findClient(clientFd);
+    if (!client) {
+        return false;
+    }
+    if (client->parentFd >= 0) {
+        return true;
+    }
+    while (client->pendingOutput() > 0) {
+        ssize_t sent = transmit(*client, client->outBuffer.data() + client->outOffset, client->pendingOutput());
+        if (sent < 0) {
+            if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                break;
+            }
+            if (errno == EINTR) {
+                continue;
+            }
+            std::cerr << "❌ Send error to client " << clientFd << ": " << strerror(errno) << std::endl;
+            return false;
+        }
+        metrics.recordBytesOut(sent);
+        client->outOffset += sent;
+        client->lastActivity = time(NULL);
+    }
+
+    short events = getEvents(clientFd);
+    if (client->pendingOutput() > 0) {
+        setEvents(clientFd, events | POLLOUT);
+    } else {
+        // Release the buffer once drained so idle connections stay small
+        std::string().swap(client->outBuffer);
+        client->outOffset = 0;
+        setEvents(clientFd, events & ~POLLOUT);
+    }
+    return true;
+}
+
+
+
+void ConnectionManager::updateClientActivity(int clientFd, size_t bytesRead) {
     std::map<int, ClientConnection>::iterator it = clients.find(clientFd);
     if (it != clients.end()) {
         it->second.lastActivity = time(NULL);
+        it->second.rateWindowBytes += bytesRead;
+        if (it->second.parentFd >= 0) {
+            updateClientActivity(it->second.parentFd);
+        }
     }
 }
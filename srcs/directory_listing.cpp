@@ -0,0 +1,426 @@
+/* ************************************************************************** */
+/*                                                                            */
+/*                                                        :::      ::::::::   */
+/*   directory_listing.cpp                              :+:      :+:    :+:   */
+/*                                                    +:+ +:+         +:+     */
+/*   By: aogbi <aogbi@student.42.fr>                +#+  +:+       +#+        */
+/*                                                +#+#+#+#+#+   +#+           */
+/*   Created: 2026/10/19 00:00:00 by aogbi             #+#    #+#             */
+/*   Updated: 2026/10/19 00:00:00 by aogbi            ###   ########.fr       */
+/*                                                                            */
+/* ************************************************************************** */
+
+#include "directory_listing.hpp"
+#include <algorithm>
+#include <cstring>
+#include <cstdlib>
+#include <dirent.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+// --- formatting helpers ------------------------------------------------------
+
+static void appendUnsigned(std::string& out, unsigned long long value) {
+    char buf[24];
+    int pos = sizeof(buf);
+    do {
+        buf[--pos] = static_cast<char>('0' + value % 10);
+        value /= 10;
+    } while (value != 0);
+    out.append(buf + pos, sizeof(buf) - pos);
+}
+
+static void appendHtmlEscaped(std::string& out, const std::string& text) {
+    for (size_t i = 0; i < text.length(); ++i) {
+        switch (text[i]) {
+            case '&': out += "&amp;"; break;
+            case '<': out += "&lt;"; break;
+            case '>': out += "&gt;"; break;
+            case '"': out += "&quot;"; break;
+            case '\'': out += "&#39;"; break;
+            default: out += text[i];
+        }
+    }
+}
+
+static void appendUrlEncoded(std::string& out, const std::string& text) {
+    static const char HEX[] = "0123456789ABCDEF";
+    for (size_t i = 0; i < text.length(); ++i) {
+        unsigned char c = static_cast<unsigned char>(text[i]);
+        if ((c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9')
+            || c == '-' || c == '_' || c == '.' || c == '~') {
+            out += static_cast<char>(c);
+        } else {
+            out += '%';
+            out += HEX[c >> 4];
+            out += HEX[c & 0x0f];
+        }
+    }
+}
+
+static void appendJsonEscaped(std::string& out, const std::string& text) {
+    static const char HEX[] = "0123456789abcdef";
+    for (size_t i = 0; i < text.length(); ++i) {
+        unsigned char c = static_cast<unsigned char>(text[i]);
+        if (c == '"' || c == '\\') {
+            out += '\\';
+            out += static_cast<char>(c);
+        } else if (c < 0x20) {
+            out += "\\u00";
+            out += HEX[c >> 4];
+            out += HEX[c & 0x0f];
+        } else {
+            out += static_cast<char>(c);
+        }
+    }
+}
+
+static void appendTime(std::string& out, time_t t) {
+    struct tm tmInfo;
+    char buf[32];
+    gmtime_r(&t, &tmInfo);
+    size_t len = strftime(buf, sizeof(buf), "%Y-%m-%d %H:%M", &tmInfo);
+    out.append(buf, len);
+}
+
+static const char* sortName(ListingOptions::SortKey key) {
+    switch (key) {
+        case ListingOptions::SORT_SIZE: return "size";
+        case ListingOptions::SORT_MTIME: return "mtime";
+        default: return "name";
+    }
+}
+
+static void appendQuery(std::string& out, ListingOptions::SortKey sort, bool descending, size_t page) {
+    out += "?sort=";
+    out += sortName(sort);
+    out += descending ? "&amp;order=desc" : "&amp;order=asc";
+    if (page > 1) {
+        out += "&amp;page=";
+        appendUnsigned(out, page);
+    }
+}
+
+// --- options ------------------------------------------------------------------
+
+ListingOptions ListingOptions::fromQuery(const std::string& query, size_t pageSize) {
+    ListingOptions opts;
+    opts.pageSize = pageSize;
+
+    size_t pos = 0;
+    while (pos < query.length()) {
+        size_t amp = query.find('&', pos);
+        if (amp == std::string::npos) {
+            amp = query.length();
+        }
+        size_t eq = query.find('=', pos);
+        if (eq != std::string::npos && eq < amp) {
+            std::string key = query.substr(pos, eq - pos);
+            std::string value = query.substr(eq + 1, amp - eq - 1);
+            if (key == "sort") {
+                if (value == "size") opts.sort = SORT_SIZE;
+                else if (value == "mtime") opts.sort = SORT_MTIME;
+                else opts.sort = SORT_NAME;
+            } else if (key == "order") {
+                opts.descending = (value == "desc");
+            } else if (key == "page") {
+                long page = std::atol(value.c_str());
+                opts.page = (page > 0) ? static_cast<size_t>(page) : 1;
+            } else if (key == "format") {
+                opts.json = (value == "json");
+            }
+        }
+        pos = amp + 1;
+    }
+    return opts;
+}
+
+// --- cache ----------------------------------------------------------------------
+
+struct EntryNameLess {
+    bool operator()(const DirectoryEntry& a, const DirectoryEntry& b) const {
+        if (a.isDir != b.isDir) {
+            return a.isDir;
+        }
+        return a.name < b.name;
+    }
+};
+
+// Index permutations over the name-sorted entries; ties keep name order
+struct EntrySizeLess {
+    const std::vector<DirectoryEntry>* entries;
+    bool operator()(uint32_t a, uint32_t b) const {
+        const DirectoryEntry& x = (*entries)[a];
+        const DirectoryEntry& y = (*entries)[b];
+        return x.size != y.size ? x.size < y.size : a < b;
+    }
+};
+
+struct EntryMtimeLess {
+    const std::vector<DirectoryEntry>* entries;
+    bool operator()(uint32_t a, uint32_t b) const {
+        const DirectoryEntry& x = (*entries)[a];
+        const DirectoryEntry& y = (*entries)[b];
+        return x.mtime != y.mtime ? x.mtime < y.mtime : a < b;
+    }
+};
+
+DirectoryListingCache::DirectoryListingCache(Metrics& metrics, size_t maxDirectories)
+    : maxDirectories(maxDirectories), useClock(0), metrics(metrics) {
+}
+
+bool DirectoryListingCache::scan(const std::string& dirPath, std::vector<DirectoryEntry>& entries) {
+    DIR* dir = opendir(dirPath.c_str());
+    if (!dir) {
+        return false;
+    }
+    int dfd = dirfd(dir);
+
+    entries.clear();
+    struct dirent* ent;
+    while ((ent = readdir(dir)) != NULL) {
+        if (std::strcmp(ent->d_name, ".") == 0 || std::strcmp(ent->d_name, "..") == 0) {
+            continue;
+        }
+        DirectoryEntry entry;
+        entry.name = ent->d_name;
+        struct stat st;
+        if (fstatat(dfd, ent->d_name, &st, 0) == 0) {
+            entry.size = st.st_size;
+            entry.mtime = st.st_mtime;
+            entry.isDir = S_ISDIR(st.st_mode);
+        }
+        entries.push_back(entry);
+    }
+    closedir(dir);
+
+    std::sort(entries.begin(), entries.end(), EntryNameLess());
+    return true;
+}
+
+void DirectoryListingCache::fill(Snapshot& snapshot, const struct stat& dirStat) {
+    snapshot.bySize.clear();
+    snapshot.byMtime.clear();
+    snapshot.mtimeSec = dirStat.st_mtim.tv_sec;
+    snapshot.mtimeNsec = dirStat.st_mtim.tv_nsec;
+    snapshot.inode = dirStat.st_ino;
+}
+
+const std::vector<uint32_t>* DirectoryListingCache::sortOrder(Snapshot& snapshot, ListingOptions::SortKey key) {
+    if (key == ListingOptions::SORT_NAME) {
+        return NULL; // entries are already in name order
+    }
+    std::vector<uint32_t>& order = (key == ListingOptions::SORT_SIZE) ? snapshot.bySize : snapshot.byMtime;
+    if (order.size() != snapshot.entries.size()) {
+        order.resize(snapshot.entries.size());
+        for (size_t i = 0; i < order.size(); ++i) {
+            order[i] = static_cast<uint32_t>(i);
+        }
+        if (key == ListingOptions::SORT_SIZE) {
+            EntrySizeLess less;
+            less.entries = &snapshot.entries;
+            std::sort(order.begin(), order.end(), less);
+        } else {
+            EntryMtimeLess less;
+            less.entries = &snapshot.entries;
+            std::sort(order.begin(), order.end(), less);
+        }
+    }
+    return &order;
+}
+
+void DirectoryListingCache::evictIfFull() {
+    if (snapshots.size() < maxDirectories) {
+        return;
+    }
+    std::map<std::string, Snapshot>::iterator oldest = snapshots.begin();
+    for (std::map<std::string, Snapshot>::iterator it = snapshots.begin(); it != snapshots.end(); ++it) {
+        if (it->second.lastUsed < oldest->second.lastUsed) {
+            oldest = it;
+        }
+    }
+    snapshots.erase(oldest);
+}
+
+// "/dir" and "/dir/" share one snapshot
+static std::string snapshotKey(const std::string& dirPath) {
+    std::string key = dirPath;
+    while (key.length() > 1 && key[key.length() - 1] == '/') {
+        key.erase(key.length() - 1);
+    }
+    return key;
+}
+
+bool DirectoryListingCache::isFresh(const std::string& dirPath, const struct stat& dirStat) const {
+    std::map<std::string, Snapshot>::const_iterator it = snapshots.find(snapshotKey(dirPath));
+    return it != snapshots.end() && it->second.inode == dirStat.st_ino
+        && it->second.mtimeSec == dirStat.st_mtim.tv_sec && it->second.mtimeNsec == dirStat.st_mtim.tv_nsec;
+}
+
+bool DirectoryListingCache::render(const std::string& dirPath, const struct stat& dirStat,
+                                   const std::string& requestPath, const ListingOptions& opts,
+                                   std::string& out, std::vector<DirectoryEntry>* scanned) {
+    std::string key = snapshotKey(dirPath);
+    std::map<std::string, Snapshot>::iterator it = snapshots.find(key);
+    if (isFresh(dirPath, dirStat)) {
+        metrics.recordCacheHit(Metrics::CACHE_DIRLIST);
+    } else {
+        metrics.recordCacheMiss(Metrics::CACHE_DIRLIST);
+        std::vector<DirectoryEntry> entries;
+        if (scanned) {
+            entries.swap(*scanned);
+        } else if (!scan(dirPath, entries)) {
+            if (it != snapshots.end()) {
+                snapshots.erase(it);
+            }
+            return false;
+        }
+        if (it == snapshots.end()) {
+            evictIfFull();
+            it = snapshots.insert(std::make_pair(key, Snapshot())).first;
+        }
+        it->second.entries.swap(entries);
+        fill(it->second, dirStat);
+    }
+    Snapshot& snapshot = it->second;
+    snapshot.lastUsed = ++useClock;
+
+    const std::vector<uint32_t>* order = sortOrder(snapshot, opts.sort);
+    size_t total = snapshot.entries.size();
+    size_t pageSize = opts.pageSize ? opts.pageSize : (total ? total : 1);
+    size_t pages = total ? (total + pageSize - 1) / pageSize : 1;
+    size_t page = std::min(opts.page, pages);
+    size_t first = (page - 1) * pageSize;
+    size_t last = std::min(first + pageSize, total);
+
+    ListingOptions shown = opts;
+    shown.page = page;
+    shown.pageSize = pageSize;
+    out.clear();
+    out.reserve(256 + (last - first) * (opts.json ? 96 : 160));
+    if (opts.json) {
+        renderJson(out, snapshot, order, requestPath, shown, first, last, pages);
+    } else {
+        renderHtml(out, snapshot, order, requestPath, shown, first, last, pages);
+    }
+    return true;
+}
+
+// Position i of the requested order, honoring descending output
+static size_t entryAt(const std::vector<uint32_t>* order, size_t total, size_t i, bool descending) {
+    size_t pos = descending ? total - 1 - i : i;
+    return order ? (*order)[pos] : pos;
+}
+
+void DirectoryListingCache::renderHtml(std::string& out, const Snapshot& snapshot,
+                                       const std::vector<uint32_t>* order, const std::string& requestPath,
+                                       const ListingOptions& opts, size_t first, size_t last, size_t pages) {
+    std::string base = requestPath;
+    if (base.empty() || base[base.length() - 1] != '/') {
+        base += '/';
+    }
+
+    out += "<html><head><title>Index of ";
+    appendHtmlEscaped(out, base);
+    out += "</title></head><body><h1>Index of ";
+    appendHtmlEscaped(out, base);
+    out += "</h1><table><tr>";
+    static const ListingOptions::SortKey COLUMNS[] = {
+        ListingOptions::SORT_NAME, ListingOptions::SORT_SIZE, ListingOptions::SORT_MTIME
+    };
+    static const char* const TITLES[] = { "Name", "Size", "Last modified" };
+    for (int c = 0; c < 3; ++c) {
+        // Clicking the active column flips the order
+        bool desc = (COLUMNS[c] == opts.sort) ? !opts.descending : false;
+        out += "<th><a href=\"";
+        appendQuery(out, COLUMNS[c], desc, 1);
+        out += "\">";
+        out += TITLES[c];
+        out += "</a></th>";
+    }
+    out += "</tr>";
+    if (base != "/") {
+        out += "<tr><td><a href=\"../\">../</a></td><td>-</td><td>-</td></tr>";
+    }
+
+    size_t total = snapshot.entries.size();
+    for (size_t i = first; i < last; ++i) {
+        const DirectoryEntry& entry = snapshot.entries[entryAt(order, total, i, opts.descending)];
+        out += "<tr><td><a href=\"";
+        appendHtmlEscaped(out, base);
+        appendUrlEncoded(out, entry.name);
+        if (entry.isDir) {
+            out += '/';
+        }
+        out += "\">";
+        appendHtmlEscaped(out, entry.name);
+        if (entry.isDir) {
+            out += '/';
+        }
+        out += "</a></td><td>";
+        if (entry.isDir) {
+            out += '-';
+        } else {
+            appendUnsigned(out, static_cast<unsigned long long>(entry.size));
+        }
+        out += "</td><td>";
+        appendTime(out, entry.mtime);
+        out += "</td></tr>";
+    }
+    out += "</table>";
+
+    if (pages > 1) {
+        out += "<p>";
+        if (opts.page > 1) {
+            out += "<a href=\"";
+            appendQuery(out, opts.sort, opts.descending, opts.page - 1);
+            out += "\">&laquo; Previous</a> ";
+        }
+        out += "Page ";
+        appendUnsigned(out, opts.page);
+        out += " of ";
+        appendUnsigned(out, pages);
+        if (opts.page < pages) {
+            out += " <a href=\"";
+            appendQuery(out, opts.sort, opts.descending, opts.page + 1);
+            out += "\">Next &raquo;</a>";
+        }
+        out += "</p>";
+    }
+    out += "<hr><p>Webserv/1.0</p></body></html>";
+}
+
+void DirectoryListingCache::renderJson(std::string& out, const Snapshot& snapshot,
+                                       const std::vector<uint32_t>* order, const std::string& requestPath,
+                                       const ListingOptions& opts, size_t first, size_t last, size_t pages) {
+    size_t total = snapshot.entries.size();
+    out += "{\"path\":\"";
+    appendJsonEscaped(out, requestPath);
+    out += "\",\"sort\":\"";
+    out += sortName(opts.sort);
+    out += opts.descending ? "\",\"order\":\"desc\"" : "\",\"order\":\"asc\"";
+    out += ",\"page\":";
+    appendUnsigned(out, opts.page);
+    out += ",\"pages\":";
+    appendUnsigned(out, pages);
+    out += ",\"per_page\":";
+    appendUnsigned(out, opts.pageSize);
+    out += ",\"total\":";
+    appendUnsigned(out, total);
+    out += ",\"entries\":[";
+    for (size_t i = first; i < last; ++i) {
+        const DirectoryEntry& entry = snapshot.entries[entryAt(order, total, i, opts.descending)];
+        if (i != first) {
+            out += ',';
+        }
+        out += "{\"name\":\"";
+        appendJsonEscaped(out, entry.name);
+        out += entry.isDir ? "\",\"type\":\"directory\"" : "\",\"type\":\"file\"";
+        out += ",\"size\":";
+        appendUnsigned(out, static_cast<unsigned long long>(entry.size));
+        out += ",\"mtime\":";
+        appendUnsigned(out, static_cast<unsigned long long>(entry.mtime));
+        out += '}';
+    }
+    out += "]}";
+}
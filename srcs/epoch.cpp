@@ -0,0 +1,108 @@
+/* ************************************************************************** */
+/*                                                                            */
+/*                                                        :::      ::::::::   */
+/*   epoch.cpp                                          :+:      :+:    :+:   */
+/*                                                    +:+ +:+         +:+     */
+/*   By: aogbi <aogbi@student.42.fr>                +#+  +:+       +#+        */
+/*                                                +#+#+#+#+#+   +#+           */
+/*   Created: 2026/10/19 00:00:00 by aogbi             #+#    #+#             */
+/*   Updated: 2026/10/19 00:00:00 by aogbi            ###   ########.fr       */
+/*                                                                            */
+/* ************************************************************************** */
+
+#include "epoch.hpp"
+#include <cstring>
+#include <climits>
+#include <cstdlib>
+#include <new>
+
+EpochDomain::EpochDomain() : readers(NULL), readerCount(0), epoch(1), pending(0) {
+    void* memory = NULL;
+    if (posix_memalign(&memory, sizeof(Reader), MAX_READERS * sizeof(Reader)) != 0) {
+        throw std::bad_alloc();
+    }
+    readers = static_cast<Reader*>(memory);
+    std::memset(readers, 0, MAX_READERS * sizeof(Reader));
+    pthread_mutex_init(&lock, NULL);
+}
+
+EpochDomain::~EpochDomain() {
+    // The readers are gone: everything retired can go
+    for (size_t i = 0; i < retired.size(); ++i) {
+        retired[i].reclaim(retired[i].object);
+    }
+    pthread_mutex_destroy(&lock);
+    free(readers);
+}
+
+int EpochDomain::addReader() {
+    if (readerCount == MAX_READERS) {
+        return -1;
+    }
+    readers[readerCount].epoch = epoch;
+    return readerCount++;
+}
+
+void EpochDomain::quiescent(int reader) {
+    // Release: the reader's earlier loads from retired objects are done before it says so
+    __atomic_store_n(&readers[reader].epoch, __atomic_load_n(&epoch, __ATOMIC_ACQUIRE), __ATOMIC_RELEASE);
+    // Another reader already reclaiming is as good as this one doing it
+    if (__atomic_load_n(&pending, __ATOMIC_RELAXED) && pthread_mutex_trylock(&lock) == 0) {
+        reclaimLocked();
+        pthread_mutex_unlock(&lock);
+    }
+}
+
+void EpochDomain::offline(int reader) {
+    __atomic_store_n(&readers[reader].epoch, 0, __ATOMIC_RELEASE);
+}
+
+void EpochDomain::online(int reader) {
+    // Store then load, both seq_cst, against the retire's increment then the reclaimer's
+    // load: either the reclaimer sees this reader online, or the reader sees the new epoch
+    // (and with it the unlink that came before)
+    __atomic_store_n(&readers[reader].epoch, __atomic_load_n(&epoch, __ATOMIC_RELAXED), __ATOMIC_SEQ_CST);
+    __atomic_store_n(&readers[reader].epoch, __atomic_load_n(&epoch, __ATOMIC_SEQ_CST), __ATOMIC_RELEASE);
+}
+
+void EpochDomain::retire(void* object, Reclaim reclaim) {
+    Retired entry;
+    entry.object = object;
+    entry.reclaim = reclaim;
+    pthread_mutex_lock(&lock);
+    entry.epoch = __atomic_add_fetch(&epoch, 1, __ATOMIC_SEQ_CST);
+    retired.push_back(entry);
+    __atomic_store_n(&pending, retired.size(), __ATOMIC_RELAXED);
+    pthread_mutex_unlock(&lock);
+}
+
+unsigned long EpochDomain::oldestSeen() const {
+    unsigned long oldest = ULONG_MAX;
+    for (int i = 0; i < readerCount; ++i) {
+        unsigned long seen = __atomic_load_n(&readers[i].epoch, __ATOMIC_SEQ_CST);
+        if (seen != 0 && seen < oldest) {
+            oldest = seen;
+        }
+    }
+    return oldest;
+}
+
+void EpochDomain::reclaim() {
+    pthread_mutex_lock(&lock);
+    reclaimLocked();
+    pthread_mutex_unlock(&lock);
+}
+
+void EpochDomain::reclaimLocked() {
+    unsigned long oldest = oldestSeen();
+    size_t kept = 0;
+    for (size_t i = 0; i < retired.size(); ++i) {
+        if (retired[i].epoch <= oldest) {
+            retired[i].reclaim(retired[i].object);
+        } else {
+            retired[kept++] = retired[i];
+        }
+    }
+    retired.resize(kept);
+    __atomic_store_n(&pending, retired.size(), __ATOMIC_RELAXED);
+}
@@ -0,0 +1,524 @@
+/* ************************************************************************** */
+/*                                                                            */
+/*                                                        :::      ::::::::   */
+/*   event_ring.cpp                                     :+:      :+:    :+:   */
+/*                                                    +:+ +:+         +:+     */
+/*   By: aogbi <aogbi@student.42.fr>                +#+  +:+       +#+        */
+/*                                                +#+#+#+#+#+   +#+           */
+/*   Created: 2026/10/19 00:00:00 by aogbi             #+#    #+#             */
+/*   Updated: 2026/10/19 00:00:00 by aogbi            ###   ########.fr       */
+/*                                                                            */
+/* ************************************************************************** */
+
+#include "event_ring.hpp"
+#include <iostream>
+#include <algorithm>
+#include <cstring>
+#include <cerrno>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+
+static int ringSetup(unsigned entries, struct io_uring_params* params) {
+    return static_cast<int>(syscall(__NR_io_uring_setup, entries, params));
+}
+
+static int ringRegister(int fd, unsigned opcode, void* arg, unsigned count) {
+    return static_cast<int>(syscall(__NR_io_uring_register, fd, opcode, arg, count));
+}
+
+EventRing::EventRing()
+    : ringFd(-1), enterFd(-1), enterFlags(0), sqRing(MAP_FAILED), sqRingSize(0), cqRing(MAP_FAILED),
+      cqRingSize(0), sqes(static_cast<struct io_uring_sqe*>(MAP_FAILED)), sqesSize(0), sqHead(NULL), sqTail(NULL),
+      sqMask(0), sqEntries(0), sqLocalTail(0), cqHead(NULL), cqTail(NULL), cqMask(0), cqes(NULL), disabled(false),
+      bufRing(static_cast<struct io_uring_buf*>(MAP_FAILED)), bufMemory(NULL), bufTail(0), listenFd(-1),
+      listenFixed(false), acceptOp(NULL), nextSerial(0), acceptMultishot(true), recvMultishot(true) {}
+
+EventRing::~EventRing() {
+    release();
+}
+
+bool EventRing::init(int listenFd) {
+    // Completions are only run when the loop waits for them, on the one thread that submits.
+    // That thread is fixed when start() enables the ring, not here
+    struct io_uring_params params;
+    std::memset(&params, 0, sizeof(params));
+    params.flags = IORING_SETUP_CQSIZE | IORING_SETUP_SUBMIT_ALL | IORING_SETUP_COOP_TASKRUN
+                   | IORING_SETUP_SINGLE_ISSUER | IORING_SETUP_DEFER_TASKRUN | IORING_SETUP_R_DISABLED;
+    params.cq_entries = CQ_ENTRIES;
+    ringFd = ringSetup(ENTRIES, &params);
+    disabled = ringFd >= 0;
+    if (ringFd < 0 && errno == EINVAL) {
+        std::memset(&params, 0, sizeof(params));
+        params.flags = IORING_SETUP_CQSIZE;
+        params.cq_entries = CQ_ENTRIES;
+        ringFd = ringSetup(ENTRIES, &params);
+    }
+    if (ringFd < 0) {
+        std::cerr << "io_uring_setup failed: " << strerror(errno) << std::endl;
+        return false;
+    }
+    // The wait needs its timeout in the same call, and completions must never be dropped
+    if (!(params.features & IORING_FEAT_EXT_ARG) || !(params.features & IORING_FEAT_NODROP)) {
+        std::cerr << "io_uring: kernel too old for the event loop" << std::endl;
+        release();
+        return false;
+    }
+    if (!setupRings(params)) {
+        std::cerr << "io_uring mmap failed: " << strerror(errno) << std::endl;
+        release();
+        return false;
+    }
+
+    // A registered listening socket spares a file lookup per accept
+    enterFd = ringFd;
+    this->listenFd = listenFd;
+    listenFixed = ringRegister(ringFd, IORING_REGISTER_FILES, &listenFd, 1) == 0;
+
+    // Without provided buffers, client sockets are polled for POLLIN and read as usual
+    recvMultishot = setupBuffers();
+    return true;
+}
+
+bool EventRing::start() {
+    if (disabled) {
+        if (ringRegister(ringFd, IORING_REGISTER_ENABLE_RINGS, NULL, 0) < 0) {
+            std::cerr << "io_uring enable failed: " << strerror(errno) << std::endl;
+            return false;
+        }
+        disabled = false;
+    }
+    // The registered ring descriptor belongs to this thread and spares a file lookup per call
+    struct io_uring_rsrc_update update;
+    std::memset(&update, 0, sizeof(update));
+    update.offset = -1U;
+    update.data = ringFd;
+    if (ringRegister(ringFd, IORING_REGISTER_RING_FDS, &update, 1) == 1) {
+        enterFd = update.offset;
+        enterFlags = IORING_ENTER_REGISTERED_RING;
+    }
+    return true;
+}
+
+bool EventRing::setupRings(const struct io_uring_params& params) {
+    sqRingSize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    cqRingSize = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+    bool single = (params.features & IORING_FEAT_SINGLE_MMAP) != 0;
+    if (single) {
+        sqRingSize = cqRingSize = std::max(sqRingSize, cqRingSize);
+    }
+    sqRing = mmap(NULL, sqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ringFd, IORING_OFF_SQ_RING);
+    if (sqRing == MAP_FAILED) {
+        return false;
+    }
+    if (!single) {
+        cqRing = mmap(NULL, cqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ringFd, IORING_OFF_CQ_RING);
+        if (cqRing == MAP_FAILED) {
+            return false;
+        }
+    }
+    sqesSize = params.sq_entries * sizeof(struct io_uring_sqe);
+    void* entries = mmap(NULL, sqesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ringFd, IORING_OFF_SQES);
+    if (entries == MAP_FAILED) {
+        return false;
+    }
+    sqes = static_cast<struct io_uring_sqe*>(entries);
+
+    char* sq = static_cast<char*>(sqRing);
+    char* cq = static_cast<char*>(single ? sqRing : cqRing);
+    sqHead = reinterpret_cast<unsigned*>(sq + params.sq_off.head);
+    sqTail = reinterpret_cast<unsigned*>(sq + params.sq_off.tail);
+    sqMask = *reinterpret_cast<unsigned*>(sq + params.sq_off.ring_mask);
+    sqEntries = params.sq_entries;
+    sqLocalTail = *sqTail;
+    cqHead = reinterpret_cast<unsigned*>(cq + params.cq_off.head);
+    cqTail = reinterpret_cast<unsigned*>(cq + params.cq_off.tail);
+    cqMask = *reinterpret_cast<unsigned*>(cq + params.cq_off.ring_mask);
+    cqes = reinterpret_cast<struct io_uring_cqe*>(cq + params.cq_off.cqes);
+
+    // Entries are always used in ring order, so the index array never changes
+    unsigned* array = reinterpret_cast<unsigned*>(sq + params.sq_off.array);
+    for (unsigned i = 0; i < sqEntries; ++i) {
+        array[i] = i;
+    }
+    return true;
+}
+
+bool EventRing::setupBuffers() {
+    void* ring = mmap(NULL, BUFFER_COUNT * sizeof(struct io_uring_buf), PROT_READ | PROT_WRITE,
+                      MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (ring == MAP_FAILED) {
+        return false;
+    }
+    struct io_uring_buf_reg reg;
+    std::memset(&reg, 0, sizeof(reg));
+    reg.ring_addr = reinterpret_cast<uintptr_t>(ring);
+    reg.ring_entries = BUFFER_COUNT;
+    reg.bgid = BUFFER_GROUP;
+    if (ringRegister(ringFd, IORING_REGISTER_PBUF_RING, &reg, 1) < 0) {
+        munmap(ring, BUFFER_COUNT * sizeof(struct io_uring_buf));
+        return false;
+    }
+    bufRing = static_cast<struct io_uring_buf*>(ring);
+    bufMemory = new char[BUFFER_COUNT * BUFFER_SIZE];
+    for (unsigned i = 0; i < BUFFER_COUNT; ++i) {
+        provide(static_cast<unsigned short>(i));
+    }
+    publishBuffers();
+    return true;
+}
+
+void EventRing::release() {
+    if (sqes != MAP_FAILED) {
+        munmap(sqes, sqesSize);
+    }
+    if (cqRing != MAP_FAILED) {
+        munmap(cqRing, cqRingSize);
+    }
+    if (sqRing != MAP_FAILED) {
+        munmap(sqRing, sqRingSize);
+    }
+    if (ringFd >= 0) {
+        close(ringFd);
+    }
+    if (bufRing != MAP_FAILED) {
+        munmap(bufRing, BUFFER_COUNT * sizeof(struct io_uring_buf));
+    }
+    delete[] bufMemory;
+    sqes = static_cast<struct io_uring_sqe*>(MAP_FAILED);
+    cqRing = sqRing = MAP_FAILED;
+    bufRing = static_cast<struct io_uring_buf*>(MAP_FAILED);
+    bufMemory = NULL;
+    ringFd = -1;
+
+    // Requests still in flight died with the ring
+    std::set<Op*> ops;
+    for (std::map<int, Watch>::iterator it = watches.begin(); it != watches.end(); ++it) {
+        ops.insert(it->second.poll);
+        ops.insert(it->second.recv);
+    }
+    ops.insert(acceptOp);
+    for (std::set<Op*>::iterator it = ops.begin(); it != ops.end(); ++it) {
+        delete *it;
+    }
+    watches.clear();
+    dirty.clear();
+    acceptOp = NULL;
+}
+
+void EventRing::provide(unsigned short bufferId) {
+    struct io_uring_buf& buf = bufRing[bufTail & (BUFFER_COUNT - 1)];
+    buf.addr = reinterpret_cast<uintptr_t>(bufMemory + bufferId * BUFFER_SIZE);
+    buf.len = BUFFER_SIZE;
+    buf.bid = bufferId;
+    ++bufTail;
+}
+
+void EventRing::publishBuffers() {
+    __atomic_store_n(&bufRing[0].resv, bufTail, __ATOMIC_RELEASE);
+}
+
+int EventRing::enter(unsigned minComplete, unsigned flags, void* arg, size_t argSize) {
+    __atomic_store_n(sqTail, sqLocalTail, __ATOMIC_RELEASE);
+    unsigned toSubmit = sqLocalTail - __atomic_load_n(sqHead, __ATOMIC_ACQUIRE);
+    return static_cast<int>(syscall(__NR_io_uring_enter, enterFd, toSubmit, minComplete, flags | enterFlags, arg,
+                                    argSize));
+}
+
+struct io_uring_sqe* EventRing::nextSqe() {
+    // A full submission queue is handed to the kernel before the wait
+    while (sqLocalTail - __atomic_load_n(sqHead, __ATOMIC_ACQUIRE) >= sqEntries) {
+        if (enter(0, 0, NULL, 0) < 0 && errno != EINTR) {
+            std::cerr << "io_uring_enter failed: " << strerror(errno) << std::endl;
+            break;
+        }
+    }
+    struct io_uring_sqe* sqe = &sqes[sqLocalTail & sqMask];
+    std::memset(sqe, 0, sizeof(*sqe));
+    ++sqLocalTail;
+    return sqe;
+}
+
+EventRing::Op* EventRing::newOp(OpKind kind, int fd, unsigned serial) {
+    Op* op = new Op();
+    op->kind = kind;
+    op->fd = fd;
+    op->serial = serial;
+    op->owner = NULL;
+    op->buffer = NULL;
+    op->length = 0;
+    op->done = 0;
+    return op;
+}
+
+void EventRing::submitPoll(Watch& watch, int fd, short mask) {
+    // One-shot, and armed while the condition already holds: the same level semantics as poll()
+    Op* op = newOp(OP_POLL, fd, watch.serial);
+    struct io_uring_sqe* sqe = nextSqe();
+    sqe->opcode = IORING_OP_POLL_ADD;
+    sqe->fd = fd;
+    sqe->poll32_events = static_cast<unsigned>(mask | POLLERR | POLLHUP);
+    sqe->user_data = reinterpret_cast<uintptr_t>(op);
+    watch.poll = op;
+    watch.pollMask = mask;
+}
+
+void EventRing::submitRecv(Watch& watch, int fd) {
+    Op* op = newOp(OP_RECV, fd, watch.serial);
+    struct io_uring_sqe* sqe = nextSqe();
+    sqe->opcode = IORING_OP_RECV;
+    sqe->fd = fd;
+    sqe->ioprio = IORING_RECV_MULTISHOT;
+    sqe->flags = IOSQE_BUFFER_SELECT;
+    sqe->buf_group = BUFFER_GROUP;
+    sqe->user_data = reinterpret_cast<uintptr_t>(op);
+    watch.recv = op;
+}
+
+void EventRing::submitAccept() {
+    acceptOp = newOp(OP_ACCEPT, listenFd, 0);
+    struct io_uring_sqe* sqe = nextSqe();
+    sqe->opcode = IORING_OP_ACCEPT;
+    sqe->fd = listenFixed ? 0 : listenFd;
+    sqe->flags = listenFixed ? IOSQE_FIXED_FILE : 0;
+    sqe->ioprio = IORING_ACCEPT_MULTISHOT;
+    sqe->accept_flags = SOCK_NONBLOCK | SOCK_CLOEXEC;
+    sqe->user_data = reinterpret_cast<uintptr_t>(acceptOp);
+}
+
+void EventRing::submitRead(Op* op) {
+    struct io_uring_sqe* sqe = nextSqe();
+    sqe->opcode = IORING_OP_READ;
+    sqe->fd = op->fd;
+    sqe->addr = reinterpret_cast<uintptr_t>(op->buffer + op->done);
+    sqe->len = static_cast<unsigned>(op->length - op->done);
+    sqe->off = op->done;
+    sqe->user_data = reinterpret_cast<uintptr_t>(op);
+}
+
+void EventRing::cancel(Op* op) {
+    // The request is found by its user_data; the cancel's own completion has none
+    struct io_uring_sqe* sqe = nextSqe();
+    sqe->opcode = IORING_OP_ASYNC_CANCEL;
+    sqe->fd = -1;
+    sqe->addr = reinterpret_cast<uintptr_t>(op);
+}
+
+void EventRing::arm(int fd) {
+    std::map<int, Watch>::iterator it = watches.find(fd);
+    if (it == watches.end()) {
+        return;
+    }
+    Watch& watch = it->second;
+    if (fd == listenFd && acceptMultishot) {
+        if (!acceptOp) {
+            submitAccept();
+        }
+        return;
+    }
+
+    bool receive = watch.receive && recvMultishot && (watch.events & POLLIN);
+    short mask = receive ? watch.events & ~POLLIN : watch.events;
+    if (receive && !watch.recv) {
+        submitRecv(watch, fd);
+    } else if (!receive && watch.recv) {
+        // Bytes the recv completes before the cancel lands are still delivered
+        cancel(watch.recv);
+        watch.recv = NULL;
+    }
+    if (watch.poll && watch.pollMask != mask) {
+        cancel(watch.poll);
+        watch.poll = NULL;
+    }
+    // Without a recv, an empty mask still reports errors and hangups, as in poll()
+    if (!watch.poll && (mask || !receive)) {
+        submitPoll(watch, fd, mask);
+    }
+}
+
+void EventRing::watch(int fd, short events, bool receive) {
+    Watch& watch = watches[fd];
+    watch.serial = ++nextSerial;
+    watch.events = events;
+    watch.receive = receive;
+    dirty.insert(fd);
+}
+
+void EventRing::setEvents(int fd, short events) {
+    std::map<int, Watch>::iterator it = watches.find(fd);
+    if (it != watches.end() && it->second.events != events) {
+        it->second.events = events;
+        dirty.insert(fd);
+    }
+}
+
+void EventRing::unwatch(int fd) {
+    std::map<int, Watch>::iterator it = watches.find(fd);
+    if (it == watches.end()) {
+        return;
+    }
+    if (it->second.poll) {
+        cancel(it->second.poll);
+    }
+    if (it->second.recv) {
+        cancel(it->second.recv);
+    }
+    dirty.erase(fd);
+    watches.erase(it);
+}
+
+void EventRing::closeFd(int fd) {
+    // Queued behind the cancels, so the number is not reused while they are in flight
+    unwatch(fd);
+    struct io_uring_sqe* sqe = nextSqe();
+    sqe->opcode = IORING_OP_CLOSE;
+    sqe->fd = fd;
+}
+
+void EventRing::read(int fd, char* buffer, size_t length, void* owner) {
+    Op* op = newOp(OP_READ, fd, 0);
+    op->owner = owner;
+    op->buffer = buffer;
+    op->length = length;
+    submitRead(op);
+}
+
+int EventRing::wait(int timeoutMs, RingEvents& out) {
+    out.clear();
+    for (size_t i = 0; i < handedOut.size(); ++i) {
+        provide(handedOut[i]);
+    }
+    handedOut.clear();
+    publishBuffers();
+    for (std::set<int>::iterator it = dirty.begin(); it != dirty.end(); ++it) {
+        arm(*it);
+    }
+    dirty.clear();
+
+    struct __kernel_timespec timeout;
+    timeout.tv_sec = timeoutMs / 1000;
+    timeout.tv_nsec = (timeoutMs % 1000) * 1000000LL;
+    struct io_uring_getevents_arg arg;
+    std::memset(&arg, 0, sizeof(arg));
+    arg.ts = reinterpret_cast<uintptr_t>(&timeout);
+    int rc = enter(1, IORING_ENTER_GETEVENTS | IORING_ENTER_EXT_ARG, &arg, sizeof(arg));
+    // A signal ends the wait like the timeout; the loop checks g_running either way
+    if (rc < 0 && errno != ETIME && errno != EINTR && errno != EBUSY) {
+        return -1;
+    }
+
+    unsigned head = *cqHead;
+    unsigned tail = __atomic_load_n(cqTail, __ATOMIC_ACQUIRE);
+    for (; head != tail; ++head) {
+        complete(cqes[head & cqMask], out);
+    }
+    __atomic_store_n(cqHead, head, __ATOMIC_RELEASE);
+    publishBuffers();
+
+    return static_cast<int>(out.ready.size() + out.accepted.size() + out.received.size() + out.reads.size());
+}
+
+void EventRing::complete(const struct io_uring_cqe& cqe, RingEvents& out) {
+    Op* op = reinterpret_cast<Op*>(static_cast<uintptr_t>(cqe.user_data));
+    if (!op) {
+        return; // cancel or close
+    }
+    bool more = (cqe.flags & IORING_CQE_F_MORE) != 0;
+    int res = cqe.res;
+    Watch* watch = NULL;
+    if (op->kind == OP_POLL || op->kind == OP_RECV) {
+        std::map<int, Watch>::iterator it = watches.find(op->fd);
+        if (it != watches.end() && it->second.serial == op->serial) {
+            watch = &it->second;
+        }
+    }
+
+    switch (op->kind) {
+    case OP_POLL:
+        if (watch && watch->poll == op) {
+            watch->poll = NULL;
+            dirty.insert(op->fd);
+            if (res != -ECANCELED) {
+                struct pollfd ready;
+                ready.fd = op->fd;
+                ready.events = watch->events;
+                ready.revents = res < 0 ? POLLERR : static_cast<short>(res);
+                out.ready.push_back(ready);
+            }
+        }
+        delete op;
+        break;
+
+    case OP_RECV: {
+        bool current = watch && watch->recv == op;
+        if (cqe.flags & IORING_CQE_F_BUFFER) {
+            unsigned short bufferId = static_cast<unsigned short>(cqe.flags >> IORING_CQE_BUFFER_SHIFT);
+            if (watch && res > 0) {
+                RingRecv received;
+                received.fd = op->fd;
+                received.data = bufMemory + bufferId * BUFFER_SIZE;
+                received.length = res;
+                out.received.push_back(received);
+                handedOut.push_back(bufferId);
+            } else {
+                provide(bufferId);
+            }
+        } else if (current && res == -EINVAL && recvMultishot) {
+            // Multishot recv is not supported: every client socket goes back to POLLIN
+            recvMultishot = false;
+            for (std::map<int, Watch>::iterator w = watches.begin(); w != watches.end(); ++w) {
+                if (w->second.receive) {
+                    dirty.insert(w->first);
+                }
+            }
+        } else if (current && res != -ENOBUFS && res != -ECANCELED) {
+            // End of stream or an error; a recv being cancelled leaves those to the next one
+            RingRecv received;
+            received.fd = op->fd;
+            received.data = NULL;
+            received.length = res;
+            out.received.push_back(received);
+        }
+        if (!more) {
+            if (current) {
+                watch->recv = NULL;
+                dirty.insert(op->fd);
+            }
+            delete op;
+        }
+        break;
+    }
+
+    case OP_ACCEPT:
+        if (res >= 0) {
+            out.accepted.push_back(res);
+        } else if (res == -EINVAL && acceptMultishot) {
+            // Multishot accept is not supported: the listening socket is polled instead
+            acceptMultishot = false;
+        }
+        if (!more) {
+            acceptOp = NULL;
+            dirty.insert(listenFd);
+            delete op;
+        }
+        break;
+
+    case OP_READ:
+        if (res == -EINTR || res == -EAGAIN || (res > 0 && op->done + res < op->length)) {
+            // Short read: the rest is asked for again
+            op->done += res > 0 ? res : 0;
+            submitRead(op);
+            break;
+        }
+        if (res > 0) {
+            op->done += res;
+        }
+        RingRead done;
+        done.owner = op->owner;
+        done.result = op->done > 0 || res >= 0 ? static_cast<ssize_t>(op->done) : res;
+        out.reads.push_back(done);
+        delete op;
+        break;
+    }
+}
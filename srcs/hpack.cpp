@@ -0,0 +1,380 @@
+/* ************************************************************************** */
+/*                                                                            */
+/*                                                        :::      ::::::::   */
+/*   hpack.cpp                                          :+:      :+:    :+:   */
+/*                                                    +:+ +:+         +:+     */
+/*   By: aogbi <aogbi@student.42.fr>                +#+  +:+       +#+        */
+/*                                                +#+#+#+#+#+   +#+           */
+/*   Created: 2026/10/19 00:00:00 by aogbi             #+#    #+#             */
+/*   Updated: 2026/10/19 00:00:00 by aogbi            ###   ########.fr       */
+/*                                                                            */
+/* ************************************************************************** */
+
+#include "hpack.hpp"
+#include <stdint.h>
+
+static const char* const STATIC_TABLE[HpackTable::STATIC_COUNT][2] = {
+    {":authority", ""}, {":method", "GET"}, {":method", "POST"}, {":path", "/"},
+    {":path", "/index.html"}, {":scheme", "http"}, {":scheme", "https"}, {":status", "200"},
+    {":status", "204"}, {":status", "206"}, {":status", "304"}, {":status", "400"},
+    {":status", "404"}, {":status", "500"}, {"accept-charset", ""}, {"accept-encoding", "gzip, deflate"},
+    {"accept-language", ""}, {"accept-ranges", ""}, {"accept", ""}, {"access-control-allow-origin", ""},
+    {"age", ""}, {"allow", ""}, {"authorization", ""}, {"cache-control", ""},
+    {"content-disposition", ""}, {"content-encoding", ""}, {"content-language", ""}, {"content-length", ""},
+    {"content-location", ""}, {"content-range", ""}, {"content-type", ""}, {"cookie", ""},
+    {"date", ""}, {"etag", ""}, {"expect", ""}, {"expires", ""},
+    {"from", ""}, {"host", ""}, {"if-match", ""}, {"if-modified-since", ""},
+    {"if-none-match", ""}, {"if-range", ""}, {"if-unmodified-since", ""}, {"last-modified", ""},
+    {"link", ""}, {"location", ""}, {"max-forwards", ""}, {"proxy-authenticate", ""},
+    {"proxy-authorization", ""}, {"range", ""}, {"referer", ""}, {"refresh", ""},
+    {"retry-after", ""}, {"server", ""}, {"set-cookie", ""}, {"strict-transport-security", ""},
+    {"transfer-encoding", ""}, {"user-agent", ""}, {"vary", ""}, {"via", ""},
+    {"www-authenticate", ""}
+};
+
+// Code length of every symbol (256 = EOS); the code is canonical, so the
+// codes themselves follow from the lengths
+static const unsigned char HUFFMAN_BITS[257] = {
+    13, 23, 28, 28, 28, 28, 28, 28, 28, 24, 30, 28, 28, 30, 28, 28,
+    28, 28, 28, 28, 28, 28, 30, 28, 28, 28, 28, 28, 28, 28, 28, 28,
+    6, 10, 10, 12, 13, 6, 8, 11, 10, 10, 8, 11, 8, 6, 6, 6,
+    5, 5, 5, 6, 6, 6, 6, 6, 6, 6, 7, 8, 15, 6, 12, 10,
+    13, 6, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7,
+    7, 7, 7, 7, 7, 7, 7, 7, 8, 7, 8, 13, 19, 13, 14, 6,
+    15, 5, 6, 5, 6, 5, 6, 6, 6, 5, 7, 7, 6, 6, 6, 5,
+    6, 7, 6, 5, 5, 6, 7, 7, 7, 7, 7, 15, 11, 14, 13, 28,
+    20, 22, 20, 20, 22, 22, 22, 23, 22, 23, 23, 23, 23, 23, 24, 23,
+    24, 24, 22, 23, 24, 23, 23, 23, 23, 21, 22, 23, 22, 23, 23, 24,
+    22, 21, 20, 22, 22, 23, 23, 21, 23, 22, 22, 24, 21, 22, 23, 23,
+    21, 21, 22, 21, 23, 22, 23, 23, 20, 22, 22, 22, 23, 22, 22, 23,
+    26, 26, 20, 19, 22, 23, 22, 25, 26, 26, 26, 27, 27, 26, 24, 25,
+    19, 21, 26, 27, 27, 26, 27, 24, 21, 21, 26, 26, 28, 27, 27, 27,
+    20, 24, 20, 21, 22, 21, 21, 23, 22, 22, 25, 25, 24, 24, 26, 23,
+    26, 27, 26, 26, 27, 27, 27, 27, 27, 28, 27, 27, 27, 27, 27, 26,
+    30
+};
+
+static const int HUFFMAN_EOS = 256;
+
+static uint32_t huffmanCodes[257];
+// Decoding tree: a positive entry is the next node, a negative one the leaf -(symbol + 1)
+static int huffmanTree[256][2];
+
+static bool buildHuffman() {
+    uint32_t code = 0;
+    for (int bits = 1; bits <= 30; ++bits) {
+        for (int symbol = 0; symbol <= HUFFMAN_EOS; ++symbol) {
+            if (HUFFMAN_BITS[symbol] == bits) {
+                huffmanCodes[symbol] = code++;
+            }
+        }
+        code <<= 1;
+    }
+    int nodes = 1;
+    for (int symbol = 0; symbol <= HUFFMAN_EOS; ++symbol) {
+        int node = 0;
+        for (int bit = HUFFMAN_BITS[symbol] - 1; bit > 0; --bit) {
+            int branch = (huffmanCodes[symbol] >> bit) & 1;
+            if (huffmanTree[node][branch] == 0) {
+                huffmanTree[node][branch] = nodes++;
+            }
+            node = huffmanTree[node][branch];
+        }
+        huffmanTree[node][huffmanCodes[symbol] & 1] = -(symbol + 1);
+    }
+    return true;
+}
+
+// Built during static initialization, before any reactor thread can race to it
+static const bool huffmanReady = buildHuffman();
+
+static bool huffmanDecode(const unsigned char* data, size_t length, std::string& out) {
+    int node = 0;
+    int depth = 0;
+    bool allOnes = true;
+    for (size_t i = 0; i < length; ++i) {
+        for (int bit = 7; bit >= 0; --bit) {
+            int branch = (data[i] >> bit) & 1;
+            int next = huffmanTree[node][branch];
+            if (next < 0) {
+                if (-next - 1 == HUFFMAN_EOS) {
+                    return false;
+                }
+                out += static_cast<char>(-next - 1);
+                node = 0;
+                depth = 0;
+                allOnes = true;
+            } else {
+                node = next;
+                ++depth;
+                allOnes = allOnes && branch;
+            }
+        }
+    }
+    // Only a prefix of EOS, shorter than a byte, may pad the last byte
+    return depth < 8 && allOnes;
+}
+
+static size_t huffmanLength(const std::string& data) {
+    size_t bits = 0;
+    for (size_t i = 0; i < data.length(); ++i) {
+        bits += HUFFMAN_BITS[static_cast<unsigned char>(data[i])];
+    }
+    return (bits + 7) / 8;
+}
+
+static void huffmanEncode(const std::string& data, std::string& out) {
+    uint64_t pending = 0;
+    int pendingBits = 0;
+    for (size_t i = 0; i < data.length(); ++i) {
+        unsigned char symbol = data[i];
+        pending = (pending << HUFFMAN_BITS[symbol]) | huffmanCodes[symbol];
+        pendingBits += HUFFMAN_BITS[symbol];
+        while (pendingBits >= 8) {
+            pendingBits -= 8;
+            out += static_cast<char>(pending >> pendingBits);
+        }
+        pending &= (static_cast<uint64_t>(1) << pendingBits) - 1;
+    }
+    if (pendingBits > 0) {
+        out += static_cast<char>((pending << (8 - pendingBits)) | (0xff >> pendingBits));
+    }
+}
+
+static bool decodeInteger(const unsigned char*& pos, const unsigned char* end, int prefixBits, size_t& value) {
+    if (pos >= end) {
+        return false;
+    }
+    size_t max = (static_cast<size_t>(1) << prefixBits) - 1;
+    value = *pos++ & max;
+    if (value < max) {
+        return true;
+    }
+    for (int shift = 0; pos < end && shift <= 28; shift += 7) {
+        unsigned char byte = *pos++;
+        value += static_cast<size_t>(byte & 0x7f) << shift;
+        if (!(byte & 0x80)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static void encodeInteger(std::string& out, unsigned char flags, int prefixBits, size_t value) {
+    size_t max = (static_cast<size_t>(1) << prefixBits) - 1;
+    if (value < max) {
+        out += static_cast<char>(flags | value);
+        return;
+    }
+    out += static_cast<char>(flags | max);
+    value -= max;
+    while (value >= 0x80) {
+        out += static_cast<char>((value & 0x7f) | 0x80);
+        value >>= 7;
+    }
+    out += static_cast<char>(value);
+}
+
+static bool decodeString(const unsigned char*& pos, const unsigned char* end, std::string& out) {
+    if (pos >= end) {
+        return false;
+    }
+    bool huffman = (*pos & 0x80) != 0;
+    size_t length;
+    if (!decodeInteger(pos, end, 7, length) || length > static_cast<size_t>(end - pos)) {
+        return false;
+    }
+    out.clear();
+    if (huffman) {
+        if (!huffmanDecode(pos, length, out)) {
+            return false;
+        }
+    } else {
+        out.assign(reinterpret_cast<const char*>(pos), length);
+    }
+    pos += length;
+    return true;
+}
+
+static void encodeString(std::string& out, const std::string& value) {
+    size_t huffman = huffmanLength(value);
+    if (huffman < value.length()) {
+        encodeInteger(out, 0x80, 7, huffman);
+        huffmanEncode(value, out);
+    } else {
+        encodeInteger(out, 0, 7, value.length());
+        out += value;
+    }
+}
+
+static size_t entrySize(const HeaderField& field) {
+    return field.first.length() + field.second.length() + 32;
+}
+
+bool HpackTable::get(size_t index, HeaderField& field) const {
+    if (index == 0) {
+        return false;
+    }
+    if (index <= STATIC_COUNT) {
+        field.first = STATIC_TABLE[index - 1][0];
+        field.second = STATIC_TABLE[index - 1][1];
+        return true;
+    }
+    index -= STATIC_COUNT + 1;
+    if (index >= entries.size()) {
+        return false;
+    }
+    field = entries[index];
+    return true;
+}
+
+void HpackTable::evict(size_t limit) {
+    while (size > limit && !entries.empty()) {
+        size -= entrySize(entries.back());
+        entries.pop_back();
+    }
+}
+
+void HpackTable::add(const std::string& name, const std::string& value) {
+    HeaderField field(name, value);
+    size_t needed = entrySize(field);
+    if (needed > maxSize) {
+        // Too large for the table: adding it just empties the table
+        evict(0);
+        return;
+    }
+    evict(maxSize - needed);
+    entries.push_front(field);
+    size += needed;
+}
+
+void HpackTable::resize(size_t newMaxSize) {
+    maxSize = newMaxSize;
+    evict(maxSize);
+}
+
+size_t HpackTable::find(const std::string& name, const std::string& value, bool& exact) const {
+    size_t nameMatch = 0;
+    exact = false;
+    for (size_t i = 0; i < STATIC_COUNT; ++i) {
+        if (name == STATIC_TABLE[i][0]) {
+            if (value == STATIC_TABLE[i][1]) {
+                exact = true;
+                return i + 1;
+            }
+            if (nameMatch == 0) {
+                nameMatch = i + 1;
+            }
+        }
+    }
+    for (size_t i = 0; i < entries.size(); ++i) {
+        if (entries[i].first == name) {
+            if (entries[i].second == value) {
+                exact = true;
+                return STATIC_COUNT + 1 + i;
+            }
+            if (nameMatch == 0) {
+                nameMatch = STATIC_COUNT + 1 + i;
+            }
+        }
+    }
+    return nameMatch;
+}
+
+bool HpackDecoder::decode(const unsigned char* data, size_t length, HeaderList& headers) {
+    const unsigned char* pos = data;
+    const unsigned char* end = data + length;
+    bool fieldSeen = false;
+    while (pos < end) {
+        unsigned char first = *pos;
+        if (first & 0x80) {
+            size_t index;
+            HeaderField field;
+            if (!decodeInteger(pos, end, 7, index) || !table.get(index, field)) {
+                return false;
+            }
+            headers.push_back(field);
+            fieldSeen = true;
+            continue;
+        }
+        if ((first & 0xe0) == 0x20) {
+            // Table size updates are only allowed ahead of the first field
+            size_t size;
+            if (fieldSeen || !decodeInteger(pos, end, 5, size) || size > settingsLimit) {
+                return false;
+            }
+            table.resize(size);
+            continue;
+        }
+
+        bool indexing = (first & 0xc0) == 0x40;
+        size_t index;
+        HeaderField field;
+        if (!decodeInteger(pos, end, indexing ? 6 : 4, index)) {
+            return false;
+        }
+        if (index > 0) {
+            HeaderField named;
+            if (!table.get(index, named)) {
+                return false;
+            }
+            field.first = named.first;
+        } else if (!decodeString(pos, end, field.first)) {
+            return false;
+        }
+        if (!decodeString(pos, end, field.second)) {
+            return false;
+        }
+        if (indexing) {
+            table.add(field.first, field.second);
+        }
+        headers.push_back(field);
+        fieldSeen = true;
+    }
+    return true;
+}
+
+void HpackEncoder::setMaxTableSize(size_t size) {
+    if (size > 4096) {
+        size = 4096;
+    }
+    if (size != table.getMaxSize()) {
+        table.resize(size);
+        pendingResize = size;
+    }
+}
+
+// Values that change with every response would only churn the dynamic table
+static bool perResponse(const std::string& name) {
+    return name == "content-length" || name == "date" || name == "last-modified" || name == "etag"
+        || name == "expires" || name == "age" || name == "location" || name == "content-range";
+}
+
+void HpackEncoder::encode(const HeaderList& headers, std::string& out) {
+    if (pendingResize != NO_RESIZE) {
+        encodeInteger(out, 0x20, 5, pendingResize);
+        pendingResize = NO_RESIZE;
+    }
+    for (size_t i = 0; i < headers.size(); ++i) {
+        const std::string& name = headers[i].first;
+        const std::string& value = headers[i].second;
+        bool exact;
+        size_t index = table.find(name, value, exact);
+        if (exact) {
+            encodeInteger(out, 0x80, 7, index);
+            continue;
+        }
+        if (name == "set-cookie") {
+            encodeInteger(out, 0x10, 4, index); // never indexed, not even by intermediaries
+        } else if (perResponse(name)) {
+            encodeInteger(out, 0x00, 4, index);
+        } else {
+            encodeInteger(out, 0x40, 6, index);
+            table.add(name, value);
+        }
+        if (index == 0) {
+            encodeString(out, name);
+        }
+        encodeString(out, value);
+    }
+}
@@ -0,0 +1,1152 @@
+/* ************************************************************************** */
+/*                                                                            */
+/*                                                        :::      ::::::::   */
+/*   http2_handler.cpp                                  :+:      :+:    :+:   */
+/*                                                    +:+ +:+         +:+     */
+/*   By: aogbi <aogbi@student.42.fr>                +#+  +:+       +#+        */
+/*                                                +#+#+#+#+#+   +#+           */
+/*   Created: 2026/10/19 00:00:00 by aogbi             #+#    #+#             */
+/*   Updated: 2026/10/19 00:00:00 by aogbi            ###   ########.fr       */
+/*                                                                            */
+/* ************************************************************************** */
+
+#include "http2_handler.hpp"
+#include "utils.hpp"
+#include <cstring>
+#include <cstdlib>
+#include <cctype>
+#include <sstream>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+
+enum FrameType {
+    FRAME_DATA, FRAME_HEADERS, FRAME_PRIORITY, FRAME_RST_STREAM, FRAME_SETTINGS,
+    FRAME_PUSH_PROMISE, FRAME_PING, FRAME_GOAWAY, FRAME_WINDOW_UPDATE, FRAME_CONTINUATION
+};
+
+enum ErrorCode {
+    H2_NO_ERROR = 0x0, H2_PROTOCOL_ERROR = 0x1, H2_INTERNAL_ERROR = 0x2, H2_FLOW_CONTROL_ERROR = 0x3,
+    H2_STREAM_CLOSED = 0x5, H2_FRAME_SIZE_ERROR = 0x6, H2_REFUSED_STREAM = 0x7,
+    H2_COMPRESSION_ERROR = 0x9, H2_ENHANCE_YOUR_CALM = 0xb
+};
+
+enum SettingId {
+    SETTINGS_HEADER_TABLE_SIZE = 0x1, SETTINGS_ENABLE_PUSH = 0x2, SETTINGS_MAX_CONCURRENT_STREAMS = 0x3,
+    SETTINGS_INITIAL_WINDOW_SIZE = 0x4, SETTINGS_MAX_FRAME_SIZE = 0x5, SETTINGS_MAX_HEADER_LIST_SIZE = 0x6
+};
+
+static const uint8_t FLAG_END_STREAM = 0x1;
+static const uint8_t FLAG_ACK = 0x1;
+static const uint8_t FLAG_END_HEADERS = 0x4;
+static const uint8_t FLAG_PADDED = 0x8;
+static const uint8_t FLAG_PRIORITY = 0x20;
+
+static const char PREFACE[] = "PRI * HTTP/2.0\r\n\r\nSM\r\n\r\n";
+static const size_t PREFACE_LENGTH = sizeof(PREFACE) - 1;
+static const size_t FRAME_HEADER_LENGTH = 9;
+static const int64_t DEFAULT_WINDOW = 65535;
+static const int64_t MAX_WINDOW = 0x7fffffff;
+static const size_t PULL_SIZE = 64 * 1024;     // raw response bytes unframed per stream at a time
+
+static uint32_t readUint32(const unsigned char* p) {
+    return (static_cast<uint32_t>(p[0]) << 24) | (static_cast<uint32_t>(p[1]) << 16)
+         | (static_cast<uint32_t>(p[2]) << 8) | p[3];
+}
+
+static void appendUint32(std::string& out, uint32_t value) {
+    out += static_cast<char>(value >> 24);
+    out += static_cast<char>(value >> 16);
+    out += static_cast<char>(value >> 8);
+    out += static_cast<char>(value);
+}
+
+static void appendFrame(std::string& out, uint8_t type, uint8_t flags, uint32_t streamId,
+                        const char* payload, size_t length) {
+    out += static_cast<char>(length >> 16);
+    out += static_cast<char>(length >> 8);
+    out += static_cast<char>(length);
+    out += static_cast<char>(type);
+    out += static_cast<char>(flags);
+    appendUint32(out, streamId);
+    out.append(payload, length);
+}
+
+static void appendSetting(std::string& out, uint16_t id, uint32_t value) {
+    out += static_cast<char>(id >> 8);
+    out += static_cast<char>(id);
+    appendUint32(out, value);
+}
+
+static void appendWindowUpdate(std::string& out, uint32_t streamId, uint32_t increment) {
+    std::string payload;
+    appendUint32(payload, increment);
+    appendFrame(out, FRAME_WINDOW_UPDATE, 0, streamId, payload.data(), payload.length());
+}
+
+static void appendRstStream(std::string& out, uint32_t streamId, uint32_t code) {
+    std::string payload;
+    appendUint32(payload, code);
+    appendFrame(out, FRAME_RST_STREAM, 0, streamId, payload.data(), payload.length());
+}
+
+static bool hasToken(const std::string& list, const std::string& token) {
+    std::string lower = toLower(list);
+    size_t start = 0;
+    while (start <= lower.length()) {
+        size_t end = lower.find(',', start);
+        if (end == std::string::npos) {
+            end = lower.length();
+        }
+        size_t first = lower.find_first_not_of(" \t", start);
+        size_t last = lower.find_last_not_of(" \t", end == 0 ? 0 : end - 1);
+        if (first < end && last != std::string::npos && last >= first
+            && lower.compare(first, last - first + 1, token) == 0) {
+            return true;
+        }
+        start = end + 1;
+    }
+    return false;
+}
+
+// Hop-by-hop headers have no place in an HTTP/2 message
+static bool connectionSpecific(const std::string& name) {
+    return name == "connection" || name == "keep-alive" || name == "proxy-connection"
+        || name == "transfer-encoding" || name == "upgrade";
+}
+
+static std::string base64UrlDecode(const std::string& text) {
+    std::string out;
+    uint32_t bits = 0;
+    int count = 0;
+    for (size_t i = 0; i < text.length(); ++i) {
+        char c = text[i];
+        int value;
+        if (c >= 'A' && c <= 'Z') value = c - 'A';
+        else if (c >= 'a' && c <= 'z') value = c - 'a' + 26;
+        else if (c >= '0' && c <= '9') value = c - '0' + 52;
+        else if (c == '-' || c == '+') value = 62;
+        else if (c == '_' || c == '/') value = 63;
+        else continue;
+        bits = (bits << 6) | value;
+        count += 6;
+        if (count >= 8) {
+            count -= 8;
+            out += static_cast<char>(bits >> count);
+        }
+    }
+    return out;
+}
+
+Http2Handler::Http2Handler(const Config& config, Metrics& metrics)
+    : config(config), metrics(metrics), connections(NULL), http2(false), maxHeaderBlock(0) {
+}
+
+Http2Handler::~Http2Handler() {
+    for (std::map<int, Connection*>::iterator it = byClient.begin(); it != byClient.end(); ++it) {
+        for (std::map<uint32_t, Stream*>::iterator s = it->second->streams.begin(); s != it->second->streams.end(); ++s) {
+            delete s->second;
+        }
+        delete it->second;
+    }
+}
+
+void Http2Handler::setup(ConnectionManager* manager) {
+    connections = manager;
+    http2 = config.getHttp2();
+    maxHeaderBlock = config.getLargeHeaderBuffers() * config.getLargeHeaderBufferSize();
+}
+
+Http2Handler::Preface Http2Handler::matchPreface(const std::string& buffer) {
+    size_t length = buffer.length() < PREFACE_LENGTH ? buffer.length() : PREFACE_LENGTH;
+    if (length == 0 || buffer.compare(0, length, PREFACE, length) != 0) {
+        return PREFACE_NONE;
+    }
+    return length == PREFACE_LENGTH ? PREFACE_FULL : PREFACE_PARTIAL;
+}
+
+bool Http2Handler::canUpgrade(const Request& req) const {
+    if (!http2 || req.getVersion() != "HTTP/1.1" || !req.hasHeader(Request::HEADER_HTTP2_SETTINGS)) {
+        return false;
+    }
+    // Upgrading with a body would mean relaying it as stream 1; those requests stay HTTP/1.1
+    if (req.isChunked() || req.getContentLength() > 0) {
+        return false;
+    }
+    return hasToken(req.getHeader(Request::HEADER_UPGRADE).str(), "h2c");
+}
+
+Http2Handler::Connection* Http2Handler::createConnection(int clientFd) {
+    ClientConnection* client = connections->findClient(clientFd);
+    if (client) {
+        // The connection is no longer a pending HTTP/1.1 request: no header deadline or body rate
+        if (!client->headersRouted && client->buffer.empty()) {
+            metrics.connectionBusy();
+        }
+        client->headersRouted = true;
+        client->requestComplete = true;
+        std::string().swap(client->buffer);
+    }
+    // Flow control makes the peer wait for the tail of each burst; Nagle would hold it back
+    int on = 1;
+    setsockopt(clientFd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+
+    Connection* conn = new Connection();
+    conn->fd = clientFd;
+    conn->prefaceSeen = false;
+    conn->settingsSeen = false;
+    conn->lastStreamId = 0;
+    conn->headerStream = 0;
+    conn->headerFlags = 0;
+    conn->sendWindow = DEFAULT_WINDOW;
+    conn->recvWindow = CONNECTION_WINDOW;
+    conn->peerInitialWindow = DEFAULT_WINDOW;
+    conn->peerMaxFrame = MAX_FRAME_SIZE;
+    conn->peerGoaway = false;
+    byClient[clientFd] = conn;
+    metrics.recordHttp2Connection();
+
+    // Server preface, then the connection window opened past its 64k default
+    std::string settings;
+    appendSetting(settings, SETTINGS_MAX_CONCURRENT_STREAMS, MAX_CONCURRENT_STREAMS);
+    appendSetting(settings, SETTINGS_INITIAL_WINDOW_SIZE, STREAM_WINDOW);
+    appendSetting(settings, SETTINGS_MAX_HEADER_LIST_SIZE, maxHeaderBlock);
+    appendFrame(conn->out, FRAME_SETTINGS, 0, 0, settings.data(), settings.length());
+    appendWindowUpdate(conn->out, 0, CONNECTION_WINDOW - DEFAULT_WINDOW);
+    return conn;
+}
+
+void Http2Handler::open(int clientFd) {
+    flushOut(createConnection(clientFd));
+}
+
+void Http2Handler::upgrade(int clientFd, const Request& req, const std::string& rawHead) {
+    static const char switching[] = "HTTP/1.1 101 Switching Protocols\r\nConnection: Upgrade\r\nUpgrade: h2c\r\n\r\n";
+    if (!connections->queueWrite(clientFd, switching, sizeof(switching) - 1)) {
+        connections->removeClient(clientFd);
+        return;
+    }
+    Connection* conn = createConnection(clientFd);
+
+    // HTTP2-Settings is the client's SETTINGS payload; the 101 acknowledges it
+    std::string settings = base64UrlDecode(req.getHeader(Request::HEADER_HTTP2_SETTINGS).str());
+    for (size_t i = 0; i + 6 <= settings.length(); i += 6) {
+        const unsigned char* p = reinterpret_cast<const unsigned char*>(settings.data()) + i;
+        if (!applySetting(conn, static_cast<uint16_t>((p[0] << 8) | p[1]), readUint32(p + 2))) {
+            return;
+        }
+    }
+
+    // The upgrading request becomes stream 1, already half-closed by the client
+    std::string request;
+    size_t lineStart = 0;
+    while (lineStart < rawHead.length()) {
+        size_t lineEnd = rawHead.find('\n', lineStart);
+        lineEnd = (lineEnd == std::string::npos) ? rawHead.length() : lineEnd + 1;
+        std::string line = rawHead.substr(lineStart, lineEnd - lineStart);
+        size_t colon = line.find(':');
+        std::string name = (colon == std::string::npos || lineStart == 0) ? "" : toLower(line.substr(0, colon));
+        if (name != "http2-settings" && !connectionSpecific(name)) {
+            request += line;
+        }
+        lineStart = lineEnd;
+    }
+    Stream* stream = createStream(conn, 1);
+    conn->lastStreamId = 1;
+    stream->remoteClosed = true;
+    stream->headRequest = (req.getMethod() == "HEAD");
+    int id = connections->addStream(clientFd);
+    if (id != 0) {
+        connections->findClient(id)->buffer.swap(request);
+        stream->clientId = id;
+        byStream[id] = conn;
+        events.ready.push_back(id);
+        metrics.recordHttp2Stream();
+    }
+    flushOut(conn);
+}
+
+Http2Handler::Stream* Http2Handler::createStream(Connection* conn, uint32_t id) {
+    Stream* stream = new Stream();
+    stream->id = id;
+    stream->clientId = 0;
+    stream->remoteClosed = false;
+    stream->refused = false;
+    stream->sendWindow = conn->peerInitialWindow;
+    stream->recvWindow = STREAM_WINDOW;
+    stream->dependsOn = 0;
+    stream->weight = 16;
+    stream->urgency = 3;
+    stream->sentBytes = 0;
+    stream->headRequest = false;
+    stream->headersSent = false;
+    stream->chunked = false;
+    stream->bodyDone = false;
+    stream->truncated = false;
+    stream->endSent = false;
+    conn->streams[id] = stream;
+    return stream;
+}
+
+void Http2Handler::closeStream(Connection* conn, Stream* stream) {
+    if (stream->clientId != 0) {
+        byStream.erase(stream->clientId);
+        events.closed.push_back(stream->clientId);
+        connections->removeClient(stream->clientId);
+    }
+    conn->streams.erase(stream->id);
+    delete stream;
+}
+
+void Http2Handler::resetStream(Connection* conn, Stream* stream, uint32_t code) {
+    appendRstStream(conn->out, stream->id, code);
+    closeStream(conn, stream);
+}
+
+void Http2Handler::destroy(Connection* conn) {
+    while (!conn->streams.empty()) {
+        closeStream(conn, conn->streams.begin()->second);
+    }
+    byClient.erase(conn->fd);
+    awake.erase(conn->fd);
+    delete conn;
+}
+
+void Http2Handler::connectionError(Connection* conn, uint32_t code) {
+    std::string payload;
+    appendUint32(payload, conn->lastStreamId);
+    appendUint32(payload, code);
+    appendFrame(conn->out, FRAME_GOAWAY, 0, 0, payload.data(), payload.length());
+    int clientFd = conn->fd;
+    std::string out;
+    out.swap(conn->out);
+    destroy(conn);
+    if (connections->queueWrite(clientFd, out)) {
+        connections->finishResponse(clientFd);
+    } else {
+        connections->removeClient(clientFd);
+    }
+}
+
+bool Http2Handler::flushOut(Connection* conn) {
+    if (conn->out.empty()) {
+        return true;
+    }
+    std::string out;
+    out.swap(conn->out);
+    if (!connections->queueWrite(conn->fd, out)) {
+        int clientFd = conn->fd;
+        destroy(conn);
+        connections->removeClient(clientFd);
+        return false;
+    }
+    return true;
+}
+
+void Http2Handler::onClientData(int clientFd, const char* data, size_t length) {
+    std::map<int, Connection*>::iterator it = byClient.find(clientFd);
+    if (it == byClient.end()) {
+        return;
+    }
+    Connection* conn = it->second;
+    conn->in.append(data, length);
+    if (processInput(conn)) {
+        flushOut(conn);
+    }
+}
+
+bool Http2Handler::processInput(Connection* conn) {
+    size_t offset = 0;
+    if (!conn->prefaceSeen) {
+        if (matchPreface(conn->in) == PREFACE_NONE) {
+            connectionError(conn, H2_PROTOCOL_ERROR);
+            return false;
+        }
+        if (conn->in.length() < PREFACE_LENGTH) {
+            return true;
+        }
+        conn->prefaceSeen = true;
+        offset = PREFACE_LENGTH;
+    }
+
+    while (conn->in.length() - offset >= FRAME_HEADER_LENGTH) {
+        const unsigned char* header = reinterpret_cast<const unsigned char*>(conn->in.data()) + offset;
+        size_t length = (static_cast<size_t>(header[0]) << 16) | (header[1] << 8) | header[2];
+        uint8_t type = header[3];
+        uint8_t flags = header[4];
+        uint32_t streamId = readUint32(header + 5) & 0x7fffffff;
+        if (length > MAX_FRAME_SIZE) {
+            connectionError(conn, H2_FRAME_SIZE_ERROR);
+            return false;
+        }
+        if (conn->in.length() - offset < FRAME_HEADER_LENGTH + length) {
+            break;
+        }
+        // The client preface ends with a SETTINGS frame
+        if (!conn->settingsSeen && type != FRAME_SETTINGS) {
+            connectionError(conn, H2_PROTOCOL_ERROR);
+            return false;
+        }
+        if (!handleFrame(conn, type, flags, streamId, header + FRAME_HEADER_LENGTH, length)) {
+            return false;
+        }
+        offset += FRAME_HEADER_LENGTH + length;
+    }
+    conn->in.erase(0, offset);
+    return true;
+}
+
+bool Http2Handler::handleFrame(Connection* conn, uint8_t type, uint8_t flags, uint32_t streamId,
+                               const unsigned char* payload, size_t length) {
+    // Nothing may come between a header block's frames
+    if (conn->headerStream != 0 && (type != FRAME_CONTINUATION || streamId != conn->headerStream)) {
+        connectionError(conn, H2_PROTOCOL_ERROR);
+        return false;
+    }
+    std::map<uint32_t, Stream*>::iterator it = conn->streams.find(streamId);
+    Stream* stream = (it != conn->streams.end()) ? it->second : NULL;
+
+    switch (type) {
+        case FRAME_DATA:
+            return handleData(conn, flags, streamId, payload, length);
+        case FRAME_HEADERS:
+            return handleHeaders(conn, flags, streamId, payload, length);
+        case FRAME_PRIORITY:
+            if (streamId == 0 || length != 5) {
+                connectionError(conn, streamId == 0 ? H2_PROTOCOL_ERROR : H2_FRAME_SIZE_ERROR);
+                return false;
+            }
+            if (stream) {
+                uint32_t dependsOn = readUint32(payload) & 0x7fffffff;
+                if (dependsOn == streamId) {
+                    resetStream(conn, stream, H2_PROTOCOL_ERROR);
+                    return true;
+                }
+                stream->dependsOn = dependsOn;
+                stream->weight = payload[4] + 1;
+            }
+            return true;
+        case FRAME_RST_STREAM:
+            if (streamId == 0 || streamId > conn->lastStreamId || length != 4) {
+                connectionError(conn, length != 4 ? H2_FRAME_SIZE_ERROR : H2_PROTOCOL_ERROR);
+                return false;
+            }
+            if (stream) {
+                closeStream(conn, stream);
+            }
+            return true;
+        case FRAME_SETTINGS:
+            return handleSettings(conn, flags, payload, length);
+        case FRAME_PUSH_PROMISE:
+            connectionError(conn, H2_PROTOCOL_ERROR);
+            return false;
+        case FRAME_PING:
+            if (streamId != 0 || length != 8) {
+                connectionError(conn, streamId != 0 ? H2_PROTOCOL_ERROR : H2_FRAME_SIZE_ERROR);
+                return false;
+            }
+            if (!(flags & FLAG_ACK)) {
+                appendFrame(conn->out, FRAME_PING, FLAG_ACK, 0, reinterpret_cast<const char*>(payload), length);
+            }
+            return true;
+        case FRAME_GOAWAY:
+            if (streamId != 0) {
+                connectionError(conn, H2_PROTOCOL_ERROR);
+                return false;
+            }
+            // Streams already open are finished, then the connection is closed
+            conn->peerGoaway = true;
+            awake.insert(conn->fd);
+            return true;
+        case FRAME_WINDOW_UPDATE:
+            return handleWindowUpdate(conn, streamId, payload, length);
+        case FRAME_CONTINUATION:
+            if (conn->headerStream == 0) {
+                connectionError(conn, H2_PROTOCOL_ERROR);
+                return false;
+            }
+            conn->headerBlock.append(reinterpret_cast<const char*>(payload), length);
+            if (conn->headerBlock.length() > maxHeaderBlock) {
+                connectionError(conn, H2_ENHANCE_YOUR_CALM);
+                return false;
+            }
+            if (flags & FLAG_END_HEADERS) {
+                return endHeaderBlock(conn);
+            }
+            return true;
+        default:
+            return true; // unknown frame types are ignored
+    }
+}
+
+bool Http2Handler::handleHeaders(Connection* conn, uint8_t flags, uint32_t streamId,
+                                 const unsigned char* payload, size_t length) {
+    if (streamId == 0) {
+        connectionError(conn, H2_PROTOCOL_ERROR);
+        return false;
+    }
+    size_t padding = 0;
+    if (flags & FLAG_PADDED) {
+        if (length < 1) {
+            connectionError(conn, H2_FRAME_SIZE_ERROR);
+            return false;
+        }
+        padding = payload[0];
+        ++payload;
+        --length;
+    }
+    uint32_t dependsOn = 0;
+    int weight = 16;
+    if (flags & FLAG_PRIORITY) {
+        if (length < 5) {
+            connectionError(conn, H2_FRAME_SIZE_ERROR);
+            return false;
+        }
+        dependsOn = readUint32(payload) & 0x7fffffff;
+        weight = payload[4] + 1;
+        payload += 5;
+        length -= 5;
+    }
+    if (padding > length) {
+        connectionError(conn, H2_PROTOCOL_ERROR);
+        return false;
+    }
+    length -= padding;
+
+    std::map<uint32_t, Stream*>::iterator it = conn->streams.find(streamId);
+    Stream* stream = (it != conn->streams.end()) ? it->second : NULL;
+    if (!stream && streamId > conn->lastStreamId) {
+        if (streamId % 2 == 0) {
+            connectionError(conn, H2_PROTOCOL_ERROR);
+            return false;
+        }
+        conn->lastStreamId = streamId;
+        stream = createStream(conn, streamId);
+    } else if (stream && stream->remoteClosed) {
+        connectionError(conn, H2_STREAM_CLOSED);
+        return false;
+    }
+    // Without a stream (already reset) the block is still decoded to keep HPACK in step
+    if (stream && (flags & FLAG_PRIORITY)) {
+        if (dependsOn == streamId) {
+            resetStream(conn, stream, H2_PROTOCOL_ERROR);
+        } else {
+            stream->dependsOn = dependsOn;
+            stream->weight = weight;
+        }
+    }
+    conn->headerStream = streamId;
+    conn->headerFlags = flags;
+    conn->headerBlock.assign(reinterpret_cast<const char*>(payload), length);
+    if (flags & FLAG_END_HEADERS) {
+        return endHeaderBlock(conn);
+    }
+    return true;
+}
+
+bool Http2Handler::endHeaderBlock(Connection* conn) {
+    uint32_t streamId = conn->headerStream;
+    bool endStream = (conn->headerFlags & FLAG_END_STREAM) != 0;
+    conn->headerStream = 0;
+    HeaderList headers;
+    bool decoded = conn->decoder.decode(reinterpret_cast<const unsigned char*>(conn->headerBlock.data()),
+                                        conn->headerBlock.length(), headers);
+    std::string().swap(conn->headerBlock);
+    if (!decoded) {
+        connectionError(conn, H2_COMPRESSION_ERROR);
+        return false;
+    }
+    std::map<uint32_t, Stream*>::iterator it = conn->streams.find(streamId);
+    if (it == conn->streams.end()) {
+        return true;
+    }
+    Stream* stream = it->second;
+
+    if (!stream->headers.empty()) {
+        // Trailers: they end the request, their fields are not passed on
+        if (!endStream) {
+            resetStream(conn, stream, H2_PROTOCOL_ERROR);
+            return true;
+        }
+        stream->remoteClosed = true;
+        dispatch(conn, stream);
+        return true;
+    }
+    if (headers.empty()) {
+        resetStream(conn, stream, H2_PROTOCOL_ERROR);
+        return true;
+    }
+    stream->headers.swap(headers);
+    if (conn->streams.size() > MAX_CONCURRENT_STREAMS || conn->peerGoaway) {
+        resetStream(conn, stream, H2_REFUSED_STREAM);
+        return true;
+    }
+    // Extensible priorities (RFC 9218): "u=0" is the most urgent, 3 the default
+    for (size_t i = 0; i < stream->headers.size(); ++i) {
+        if (stream->headers[i].first == "priority") {
+            size_t urgency = stream->headers[i].second.find("u=");
+            if (urgency != std::string::npos && urgency + 2 < stream->headers[i].second.length()) {
+                char digit = stream->headers[i].second[urgency + 2];
+                if (digit >= '0' && digit <= '7') {
+                    stream->urgency = digit - '0';
+                }
+            }
+        }
+    }
+    if (endStream) {
+        stream->remoteClosed = true;
+        dispatch(conn, stream);
+    }
+    return true;
+}
+
+bool Http2Handler::handleData(Connection* conn, uint8_t flags, uint32_t streamId,
+                              const unsigned char* payload, size_t length) {
+    if (streamId == 0 || streamId > conn->lastStreamId) {
+        connectionError(conn, H2_PROTOCOL_ERROR);
+        return false;
+    }
+    // Padding counts against the windows too
+    conn->recvWindow -= length;
+    if (conn->recvWindow < 0) {
+        connectionError(conn, H2_FLOW_CONTROL_ERROR);
+        return false;
+    }
+    size_t padding = 0;
+    if (flags & FLAG_PADDED) {
+        if (length < 1 || payload[0] > length - 1) {
+            connectionError(conn, H2_PROTOCOL_ERROR);
+            return false;
+        }
+        padding = payload[0];
+    }
+    const char* data = reinterpret_cast<const char*>(payload) + ((flags & FLAG_PADDED) ? 1 : 0);
+    size_t dataLength = length - padding - ((flags & FLAG_PADDED) ? 1 : 0);
+
+    std::map<uint32_t, Stream*>::iterator it = conn->streams.find(streamId);
+    Stream* stream = (it != conn->streams.end()) ? it->second : NULL;
+    if (stream && stream->remoteClosed) {
+        resetStream(conn, stream, H2_STREAM_CLOSED);
+    } else if (stream) {
+        stream->recvWindow -= length;
+        if (stream->recvWindow < 0) {
+            resetStream(conn, stream, H2_FLOW_CONTROL_ERROR);
+        } else {
+            if (!stream->refused) {
+                stream->body.append(data, dataLength);
+                size_t maxBody = config.getClientMaxBodySize();
+                if (maxBody > 0 && stream->body.length() > maxBody) {
+                    // Dispatched now so the usual limit check answers 413; the rest is dropped
+                    stream->refused = true;
+                    dispatch(conn, stream);
+                }
+            }
+            if (flags & FLAG_END_STREAM) {
+                stream->remoteClosed = true;
+                dispatch(conn, stream);
+            } else if (stream->recvWindow <= STREAM_WINDOW / 2) {
+                appendWindowUpdate(conn->out, streamId, STREAM_WINDOW - stream->recvWindow);
+                stream->recvWindow = STREAM_WINDOW;
+            }
+        }
+    }
+    if (conn->recvWindow <= CONNECTION_WINDOW / 2) {
+        appendWindowUpdate(conn->out, 0, CONNECTION_WINDOW - conn->recvWindow);
+        conn->recvWindow = CONNECTION_WINDOW;
+    }
+    return true;
+}
+
+bool Http2Handler::handleSettings(Connection* conn, uint8_t flags, const unsigned char* payload, size_t length) {
+    if (flags & FLAG_ACK) {
+        if (length != 0) {
+            connectionError(conn, H2_FRAME_SIZE_ERROR);
+            return false;
+        }
+        return true;
+    }
+    if (length % 6 != 0) {
+        connectionError(conn, H2_FRAME_SIZE_ERROR);
+        return false;
+    }
+    for (size_t i = 0; i < length; i += 6) {
+        if (!applySetting(conn, static_cast<uint16_t>((payload[i] << 8) | payload[i + 1]), readUint32(payload + i + 2))) {
+            return false;
+        }
+    }
+    conn->settingsSeen = true;
+    appendFrame(conn->out, FRAME_SETTINGS, FLAG_ACK, 0, NULL, 0);
+    awake.insert(conn->fd);
+    return true;
+}
+
+bool Http2Handler::applySetting(Connection* conn, uint16_t id, uint32_t value) {
+    switch (id) {
+        case SETTINGS_HEADER_TABLE_SIZE:
+            conn->encoder.setMaxTableSize(value);
+            return true;
+        case SETTINGS_ENABLE_PUSH:
+            if (value > 1) {
+                connectionError(conn, H2_PROTOCOL_ERROR);
+                return false;
+            }
+            return true;
+        case SETTINGS_INITIAL_WINDOW_SIZE: {
+            if (value > MAX_WINDOW) {
+                connectionError(conn, H2_FLOW_CONTROL_ERROR);
+                return false;
+            }
+            // Applies to every open stream, possibly leaving windows negative
+            int64_t delta = static_cast<int64_t>(value) - conn->peerInitialWindow;
+            for (std::map<uint32_t, Stream*>::iterator it = conn->streams.begin(); it != conn->streams.end(); ++it) {
+                it->second->sendWindow += delta;
+            }
+            conn->peerInitialWindow = value;
+            return true;
+        }
+        case SETTINGS_MAX_FRAME_SIZE:
+            if (value < 16384 || value > 16777215) {
+                connectionError(conn, H2_PROTOCOL_ERROR);
+                return false;
+            }
+            conn->peerMaxFrame = value;
+            return true;
+        default:
+            return true;
+    }
+}
+
+bool Http2Handler::handleWindowUpdate(Connection* conn, uint32_t streamId, const unsigned char* payload, size_t length) {
+    if (length != 4) {
+        connectionError(conn, H2_FRAME_SIZE_ERROR);
+        return false;
+    }
+    uint32_t increment = readUint32(payload) & 0x7fffffff;
+    if (streamId == 0) {
+        conn->sendWindow += increment;
+        if (increment == 0 || conn->sendWindow > MAX_WINDOW) {
+            connectionError(conn, increment == 0 ? H2_PROTOCOL_ERROR : H2_FLOW_CONTROL_ERROR);
+            return false;
+        }
+    } else {
+        std::map<uint32_t, Stream*>::iterator it = conn->streams.find(streamId);
+        if (it == conn->streams.end()) {
+            return true; // may cross our own END_STREAM or RST_STREAM
+        }
+        it->second->sendWindow += increment;
+        if (increment == 0 || it->second->sendWindow > MAX_WINDOW) {
+            resetStream(conn, it->second, increment == 0 ? H2_PROTOCOL_ERROR : H2_FLOW_CONTROL_ERROR);
+            return true;
+        }
+    }
+    awake.insert(conn->fd);
+    return true;
+}
+
+std::string Http2Handler::buildRequest(const Stream* stream, bool& malformed) const {
+    std::string method;
+    std::string path;
+    std::string authority;
+    std::string fields;
+    std::string cookies;
+    bool regularSeen = false;
+    bool hasHost = false;
+    malformed = false;
+
+    for (size_t i = 0; i < stream->headers.size() && !malformed; ++i) {
+        const std::string& name = stream->headers[i].first;
+        const std::string& value = stream->headers[i].second;
+        // Nothing that could break out of the HTTP/1.1 header block we build
+        if (name.empty() || name.find_first_of("\r\n", 0) != std::string::npos
+            || value.find_first_of("\r\n", 0) != std::string::npos
+            || name.find('\0') != std::string::npos || value.find('\0') != std::string::npos) {
+            malformed = true;
+            break;
+        }
+        if (name[0] == ':') {
+            if (regularSeen) {
+                malformed = true;
+            } else if (name == ":method") {
+                method = value;
+            } else if (name == ":path") {
+                path = value;
+            } else if (name == ":authority") {
+                authority = value;
+            } else if (name != ":scheme") {
+                malformed = true;
+            }
+            continue;
+        }
+        regularSeen = true;
+        for (size_t c = 0; c < name.length(); ++c) {
+            if (std::isupper(static_cast<unsigned char>(name[c])) || name[c] == ':' || name[c] == ' ') {
+                malformed = true;
+            }
+        }
+        if (connectionSpecific(name) || (name == "te" && value != "trailers")) {
+            malformed = true;
+        } else if (name == "cookie") {
+            // Split cookie fields are joined back into one header
+            cookies += (cookies.empty() ? "" : "; ") + value;
+        } else if (name != "content-length" && name != "te" && name != "expect") {
+            hasHost = hasHost || name == "host";
+            fields += name + ": " + value + "\r\n";
+        }
+    }
+    if (malformed || method.empty() || path.empty() || method.find(' ') != std::string::npos
+        || path.find(' ') != std::string::npos || (path[0] != '/' && path != "*")) {
+        malformed = true;
+        return "";
+    }
+
+    std::string request = method + " " + path + " HTTP/1.1\r\n";
+    if (!hasHost && !authority.empty()) {
+        request += "Host: " + authority + "\r\n";
+    }
+    request += fields;
+    if (!cookies.empty()) {
+        request += "Cookie: " + cookies + "\r\n";
+    }
+    if (!stream->body.empty() || method == "POST" || method == "PUT") {
+        std::ostringstream length;
+        length << stream->body.length();
+        request += "Content-Length: " + length.str() + "\r\n";
+    }
+    request += "\r\n";
+    request += stream->body;
+    return request;
+}
+
+void Http2Handler::dispatch(Connection* conn, Stream* stream) {
+    if (stream->clientId != 0) {
+        return;
+    }
+    bool malformed;
+    std::string request = buildRequest(stream, malformed);
+    if (malformed) {
+        resetStream(conn, stream, H2_PROTOCOL_ERROR);
+        return;
+    }
+    int id = connections->addStream(conn->fd);
+    if (id == 0) {
+        return;
+    }
+    connections->findClient(id)->buffer.swap(request);
+    std::string().swap(stream->body);
+    for (size_t i = 0; i < stream->headers.size(); ++i) {
+        if (stream->headers[i].first == ":method") {
+            stream->headRequest = (stream->headers[i].second == "HEAD");
+        }
+    }
+    stream->clientId = id;
+    byStream[id] = conn;
+    events.ready.push_back(id);
+    metrics.recordHttp2Stream();
+}
+
+bool Http2Handler::sendResponseHead(Connection* conn, Stream* stream, ClientConnection& client, size_t headEnd) {
+    std::string head(client.outBuffer, client.outOffset, headEnd);
+    client.outOffset += headEnd;
+    if (head.compare(0, 5, "HTTP/") != 0 || head.length() < 12) {
+        resetStream(conn, stream, H2_INTERNAL_ERROR);
+        return false;
+    }
+    int status = std::atoi(head.c_str() + 9);
+    if (status >= 100 && status < 200) {
+        return true; // interim responses (100 Continue) are not relayed
+    }
+
+    HeaderList fields;
+    fields.push_back(HeaderField(":status", head.substr(9, 3)));
+    bool hasLength = false;
+    uint64_t length = 0;
+    size_t lineStart = head.find('\n') + 1;
+    while (lineStart < head.length()) {
+        size_t lineEnd = head.find('\n', lineStart);
+        if (lineEnd == std::string::npos) {
+            lineEnd = head.length();
+        }
+        std::string line = head.substr(lineStart, lineEnd - lineStart);
+        lineStart = lineEnd + 1;
+        size_t colon = line.find(':');
+        if (colon == std::string::npos || colon == 0) {
+            continue;
+        }
+        std::string name = toLower(line.substr(0, colon));
+        size_t valueStart = line.find_first_not_of(" \t", colon + 1);
+        size_t valueEnd = line.find_last_not_of(" \t\r");
+        std::string value = (valueStart == std::string::npos || valueEnd < valueStart)
+                          ? "" : line.substr(valueStart, valueEnd - valueStart + 1);
+        if (name == "transfer-encoding") {
+            stream->chunked = toLower(value).find("chunked") != std::string::npos;
+            continue;
+        }
+        if (connectionSpecific(name)) {
+            continue;
+        }
+        if (name == "content-length") {
+            hasLength = true;
+            length = std::strtoull(value.c_str(), NULL, 10);
+        }
+        fields.push_back(HeaderField(name, value));
+    }
+
+    if (stream->headRequest || status == 204 || status == 304) {
+        stream->framing.setNone();
+        stream->chunked = false;
+        stream->bodyDone = true;
+    } else if (stream->chunked) {
+        stream->chunks = ChunkedScanner();
+    } else if (hasLength) {
+        stream->framing.setLength(length);
+        stream->bodyDone = (length == 0);
+    } else {
+        stream->framing.setUntilClose();
+    }
+
+    // HEADERS, then CONTINUATION frames for whatever exceeds the peer's frame size
+    std::string block;
+    conn->encoder.encode(fields, block);
+    size_t offset = 0;
+    do {
+        size_t chunk = block.length() - offset;
+        if (chunk > conn->peerMaxFrame) {
+            chunk = conn->peerMaxFrame;
+        }
+        uint8_t flags = (offset + chunk == block.length()) ? FLAG_END_HEADERS : 0;
+        if (offset == 0 && stream->bodyDone) {
+            flags |= FLAG_END_STREAM;
+        }
+        appendFrame(conn->out, offset == 0 ? FRAME_HEADERS : FRAME_CONTINUATION, flags, stream->id,
+                    block.data() + offset, chunk);
+        offset += chunk;
+    } while (offset < block.length());
+    stream->headersSent = true;
+    if (stream->bodyDone) {
+        stream->endSent = true;
+        if (!stream->remoteClosed) {
+            appendRstStream(conn->out, stream->id, H2_NO_ERROR);
+        }
+        closeStream(conn, stream);
+        return false;
+    }
+    return true;
+}
+
+bool Http2Handler::pullOutput(Connection* conn, Stream* stream) {
+    ClientConnection* client = connections->findClient(stream->clientId);
+    if (!client) {
+        // The stream client was dropped by its handler before the response was complete
+        stream->clientId = 0;
+        resetStream(conn, stream, H2_INTERNAL_ERROR);
+        return false;
+    }
+    size_t before = client->pendingOutput();
+    while (!stream->headersSent) {
+        const char* raw = client->outBuffer.data() + client->outOffset;
+        size_t headEnd = std::string(raw, client->pendingOutput()).find("\r\n\r\n");
+        if (headEnd == std::string::npos) {
+            if (client->closeAfterWrite) {
+                resetStream(conn, stream, H2_INTERNAL_ERROR);
+                return false;
+            }
+            return true;
+        }
+        if (!sendResponseHead(conn, stream, *client, headEnd + 4)) {
+            return false;
+        }
+    }
+
+    while (!stream->bodyDone && stream->data.length() < PULL_SIZE && client->pendingOutput() > 0) {
+        const char* raw = client->outBuffer.data() + client->outOffset;
+        size_t available = client->pendingOutput() < PULL_SIZE ? client->pendingOutput() : PULL_SIZE;
+        size_t used;
+        if (stream->chunked) {
+            used = stream->chunks.feed(raw, available, &stream->data);
+            stream->bodyDone = stream->chunks.done() || stream->chunks.failed();
+            stream->truncated = stream->chunks.failed();
+        } else {
+            used = stream->framing.consume(raw, available);
+            stream->data.append(raw, used);
+            stream->bodyDone = stream->framing.complete();
+        }
+        client->outOffset += used;
+    }
+    if (!stream->bodyDone && client->closeAfterWrite && client->pendingOutput() == 0) {
+        // Output ended: the end of an unframed body, or a response cut short
+        stream->bodyDone = true;
+        stream->truncated = stream->chunked || stream->framing.getMode() != BodyFraming::UNTIL_CLOSE;
+    }
+    if (stream->bodyDone) {
+        client->outOffset = client->outBuffer.length();
+    }
+    if (client->pendingOutput() == 0) {
+        std::string().swap(client->outBuffer);
+        client->outOffset = 0;
+    }
+    if (client->pendingOutput() < before) {
+        events.drained.push_back(stream->clientId);
+    }
+    return true;
+}
+
+bool Http2Handler::canSend(const Connection* conn, const Stream* stream) const {
+    if (!stream->headersSent || stream->endSent) {
+        return false;
+    }
+    if (stream->data.empty()) {
+        return stream->bodyDone;
+    }
+    return stream->sendWindow > 0 && conn->sendWindow > 0;
+}
+
+Http2Handler::Stream* Http2Handler::nextToSend(Connection* conn) const {
+    Stream* best = NULL;
+    Stream* fallback = NULL;
+    for (std::map<uint32_t, Stream*>::const_iterator it = conn->streams.begin(); it != conn->streams.end(); ++it) {
+        Stream* stream = it->second;
+        if (!canSend(conn, stream)) {
+            continue;
+        }
+        if (!fallback) {
+            fallback = stream;
+        }
+        // A stream waits while the one it depends on can still send
+        std::map<uint32_t, Stream*>::const_iterator parent = conn->streams.find(stream->dependsOn);
+        if (stream->dependsOn != 0 && parent != conn->streams.end() && canSend(conn, parent->second)) {
+            continue;
+        }
+        // Most urgent first, then the smallest share of bytes sent relative to weight
+        if (!best || stream->urgency < best->urgency
+            || (stream->urgency == best->urgency
+                && stream->sentBytes * best->weight < best->sentBytes * stream->weight)) {
+            best = stream;
+        }
+    }
+    return best ? best : fallback; // a dependency cycle must not stall the connection
+}
+
+bool Http2Handler::send(Connection* conn) {
+    std::vector<uint32_t> ids;
+    for (std::map<uint32_t, Stream*>::iterator it = conn->streams.begin(); it != conn->streams.end(); ++it) {
+        if (it->second->clientId != 0) {
+            ids.push_back(it->first);
+        }
+    }
+    for (size_t i = 0; i < ids.size(); ++i) {
+        std::map<uint32_t, Stream*>::iterator it = conn->streams.find(ids[i]);
+        if (it != conn->streams.end()) {
+            pullOutput(conn, it->second);
+        }
+    }
+
+    // Frames are queued up to the high-water mark and handed to the socket, until it falls behind
+    bool full = true;
+    while (full) {
+        full = false;
+        ClientConnection* parent = connections->findClient(conn->fd);
+        Stream* stream;
+        while (parent && parent->pendingOutput() == 0 && (stream = nextToSend(conn)) != NULL) {
+            if (conn->out.length() >= HIGH_WATER) {
+                full = true;
+                break;
+            }
+            sendData(conn, stream);
+        }
+        if (!flushOut(conn)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+void Http2Handler::sendData(Connection* conn, Stream* stream) {
+    size_t length = stream->data.length();
+    if (length > conn->peerMaxFrame) {
+        length = conn->peerMaxFrame;
+    }
+    if (length > 0 && static_cast<int64_t>(length) > stream->sendWindow) {
+        length = static_cast<size_t>(stream->sendWindow);
+    }
+    if (length > 0 && static_cast<int64_t>(length) > conn->sendWindow) {
+        length = static_cast<size_t>(conn->sendWindow);
+    }
+    bool last = stream->bodyDone && length == stream->data.length();
+    if (last && stream->truncated) {
+        appendFrame(conn->out, FRAME_DATA, 0, stream->id, stream->data.data(), length);
+        resetStream(conn, stream, H2_INTERNAL_ERROR);
+        return;
+    }
+    appendFrame(conn->out, FRAME_DATA, last ? FLAG_END_STREAM : 0, stream->id, stream->data.data(), length);
+    stream->data.erase(0, length);
+    stream->sendWindow -= length;
+    conn->sendWindow -= length;
+    stream->sentBytes += length;
+    if (last) {
+        stream->endSent = true;
+        if (!stream->remoteClosed) {
+            appendRstStream(conn->out, stream->id, H2_NO_ERROR);
+        }
+        closeStream(conn, stream);
+    } else if (stream->data.empty()) {
+        pullOutput(conn, stream);
+    }
+}
+
+void Http2Handler::onClientDrained(int clientFd) {
+    if (hasSession(clientFd)) {
+        awake.insert(clientFd);
+    }
+}
+
+void Http2Handler::onClientClosed(int clientFd, std::vector<int>& closedStreams) {
+    std::map<int, Connection*>::iterator it = byClient.find(clientFd);
+    if (it == byClient.end()) {
+        return;
+    }
+    // The stream clients go away with the connection's own client
+    Connection* conn = it->second;
+    for (std::map<uint32_t, Stream*>::iterator s = conn->streams.begin(); s != conn->streams.end(); ++s) {
+        if (s->second->clientId != 0) {
+            byStream.erase(s->second->clientId);
+            closedStreams.push_back(s->second->clientId);
+        }
+        delete s->second;
+    }
+    awake.erase(clientFd);
+    byClient.erase(it);
+    delete conn;
+}
+
+bool Http2Handler::pump(Http2Events& out) {
+    std::vector<int> updates;
+    connections->takeStreamUpdates(updates);
+    for (size_t i = 0; i < updates.size(); ++i) {
+        std::map<int, Connection*>::iterator it = byStream.find(updates[i]);
+        if (it != byStream.end()) {
+            awake.insert(it->second->fd);
+        }
+    }
+    std::set<int> fds;
+    fds.swap(awake);
+    for (std::set<int>::iterator fd = fds.begin(); fd != fds.end(); ++fd) {
+        std::map<int, Connection*>::iterator it = byClient.find(*fd);
+        if (it == byClient.end()) {
+            continue;
+        }
+        Connection* conn = it->second;
+        if (!send(conn)) {
+            continue;
+        }
+        if (conn->peerGoaway && conn->streams.empty()) {
+            destroy(conn);
+            connections->finishResponse(*fd);
+        }
+    }
+
+    out.ready.insert(out.ready.end(), events.ready.begin(), events.ready.end());
+    out.drained.insert(out.drained.end(), events.drained.begin(), events.drained.end());
+    out.closed.insert(out.closed.end(), events.closed.begin(), events.closed.end());
+    events.clear();
+    return !out.empty();
+}
@@ -6,7 +6,7 @@
 /*   By: aogbi <aogbi@student.42.fr>                +#+  +:+       +#+        */
 /*                                                +#+#+#+#+#+   +#+           */
 /*   Created: 2025/09/06 00:00:00 by aogbi             #+#    #+#             */
-/*   Updated: 2025/09/06 12:16:17 by aogbi            ###   ########.fr       */
+/*   Updated: 2026/10/19 00:00:00 by aogbi            ###   ########.fr       */
 /*                                                                            */
 /* ************************************************************************** */
 
@@ -16,7 +16,36 @@
 #include <cstring>
 #include <cerrno>
 
-HttpHandler::HttpHandler(const Config& config) : config(config) {
+HttpHandler::HttpHandler(const Config& config, Metrics& metrics, OpenFileCache& openFiles)
+    : config(config), metrics(metrics), dirListingCache(metrics), uploadWriter(false), openFiles(openFiles),
+      lastSync(0), syncing(false) {
+}
+
+HttpHandler::~HttpHandler() {
+    for (size_t i = 0; i < syncBatch.size(); ++i) {
+        delete syncBatch[i];
+    }
+}
+
+// The cache is shared by the reactors, so its hits and misses are counted here, per reactor
+bool HttpHandler::openCached(const std::string& path, OpenFile& file) {
+    bool hit = openFiles.open(path, file);
+    if (hit) {
+        metrics.recordCacheHit(Metrics::CACHE_OPEN_FILE);
+    } else if (openFiles.enabled()) {
+        metrics.recordCacheMiss(Metrics::CACHE_OPEN_FILE);
+    }
+    return hit;
+}
+
+bool HttpHandler::lookupCached(const std::string& path, OpenFile& file) {
+    bool hit = openFiles.lookup(path, file);
+    if (hit) {
+        metrics.recordCacheHit(Metrics::CACHE_OPEN_FILE);
+    } else if (openFiles.enabled()) {
+        metrics.recordCacheMiss(Metrics::CACHE_OPEN_FILE);
+    }
+    return hit;
 }
 
 std::string HttpHandler::handleRequest(const Request& req) {
@@ -25,16 +54,14 @@ std::string HttpHandler::handleRequest(const Request& req) {
     // Find matching location
     const Location* location = config.findLocation(req.getPath());
     
-    // Check if method is allowed
-    if (!config.isMethodAllowed(req.getMethod(), location)) {
-        response.setStatus(405, "Method Not Allowed");
-        response.setContentType("text/html");
-        response.setBody(generateErrorPage(405, "Method Not Allowed"));
-        return response.toString();
+    // Check if method is allowed and the body fits
+    std::string refusal = checkRequestHead(req, location);
+    if (!refusal.empty()) {
+        return refusal;
     }
     
     // Handle different HTTP methods
-    std::string method = req.getMethod();
+    StringView method = req.getMethod();
     if (method == "GET" || method == "HEAD") {
         return handleGetRequest(req, location);
     } else if (method == "POST") {
@@ -49,9 +76,31 @@ std::string HttpHandler::handleRequest(const Request& req) {
     }
 }
 
-std::string HttpHandler::handleGetRequest(const Request& req, const Location* location) {
-    std::string requestPath = req.getPath();
+std::string HttpHandler::checkRequestHead(const Request& req, const Location* location) {
+    Response response;
+    if (!config.isMethodAllowed(req.getMethod(), location)) {
+        response.setStatus(405, "Method Not Allowed");
+        response.setContentType("text/html");
+        response.setBody(generateErrorPage(405, "Method Not Allowed"));
+        return response.toString();
+    }
     
+    size_t length = req.getContentLength();
+    size_t limit = config.getClientMaxBodySize();
+    if (limit > 0 && length > limit) {
+        response.setStatus(413, "Payload Too Large");
+        response.setContentType("text/html");
+        response.setBody(generateErrorPage(413, "Payload Too Large"));
+        return response.toString();
+    }
+    if (length > MAX_UPLOAD_SIZE && req.getMethod() == "POST" && location && !location->uploadDir.empty()
+        && req.getHeader(Request::HEADER_CONTENT_TYPE).find("multipart/form-data") != StringView::npos) {
+        return uploadTooLarge(length);
+    }
+    return "";
+}
+
+std::string HttpHandler::handleGetRequest(const Request& req, const Location* location) {
     // Handle redirect
     if (location && !location->redirect.empty()) {
         Response response;
@@ -59,15 +108,18 @@ std::string HttpHandler::handleGetRequest(const Request& req, const Location* lo
         return response.toString();
     }
     
-    return serveFile(requestPath, req);
+    if (location && location->stubStatus) {
+        return handleStubStatus(req);
+    }
+    
+    return serveFile(req);
 }
 
 std::string HttpHandler::handlePostRequest(const Request& req, const Location* location) {
     Response response;
     
     // Check if this is a file upload request
-    std::string contentType = req.getHeader("content-type");
-    if (contentType.find("multipart/form-data") != std::string::npos && location && !location->uploadDir.empty()) {
+    if (isUpload(req, location)) {
         return handleFileUpload(req, location);
     } else {
         // Regular POST request
@@ -75,15 +127,31 @@ std::string HttpHandler::handlePostRequest(const Request& req, const Location* l
         response.setContentType("text/html");
         std::ostringstream bodyStr;
         bodyStr << "<html><body><h1>POST request received</h1><p>Body length: " 
-                << req.getBody().length() << " bytes</p></body></html>";
+                << req.getBodySource().size() << " bytes</p></body></html>";
         response.setBody(bodyStr.str());
         return response.toString();
     }
 }
 
+bool HttpHandler::isUpload(const Request& req, const Location* location) {
+    return req.getHeader(Request::HEADER_CONTENT_TYPE).find("multipart/form-data") != StringView::npos
+        && location && !location->uploadDir.empty();
+}
+
 std::string HttpHandler::handleDeleteRequest(const Request& req, const Location* location) {
+    std::string fullPath;
+    std::string filename;
+    std::string refusal = deleteTarget(req, location, fullPath, filename);
+    if (!refusal.empty()) {
+        return refusal;
+    }
+    return deleteResponse(fullPath, filename, UploadWriter::remove(fullPath));
+}
+
+std::string HttpHandler::deleteTarget(const Request& req, const Location* location, std::string& fullPath,
+                                      std::string& filename) {
     Response response;
-    std::string requestPath = req.getPath();
+    std::string requestPath = req.getPath().str();
     
     // Security check: Only allow deletion in uploads directory
     if (requestPath.find("/uploads/") != 0) {
@@ -94,7 +162,7 @@ std::string HttpHandler::handleDeleteRequest(const Request& req, const Location*
     }
     
     // Extract filename from path
-    std::string filename = requestPath.substr(9); // Remove "/uploads/" prefix
+    filename = requestPath.substr(9); // Remove "/uploads/" prefix
     if (filename.empty() || filename.find("..") != std::string::npos) {
         response.setStatus(400, "Bad Request");
         response.setContentType("application/json");
@@ -103,9 +171,35 @@ std::string HttpHandler::handleDeleteRequest(const Request& req, const Location*
     }
     
     // Construct full file path
+    fullPath = uploadDirFor(location) + "/" + filename;
+    return "";
+}
+
+std::string HttpHandler::deleteResponse(const std::string& fullPath, const std::string& filename, int error) {
+    Response response;
+    response.setContentType("application/json");
+    if (error == ENOENT) {
+        response.setStatus(404, "Not Found");
+        response.setBody("{\"error\": \"File not found\"}");
+    } else if (error == EISDIR) {
+        response.setStatus(400, "Bad Request");
+        response.setBody("{\"error\": \"Cannot delete directories\"}");
+    } else if (error == 0) {
+        openFiles.clear();
+        response.setStatus(200, "OK");
+        response.setBody("{\"message\": \"File deleted successfully\", \"filename\": \"" + filename + "\"}");
+        std::cout << "File deleted: " << fullPath << std::endl;
+    } else {
+        response.setStatus(500, "Internal Server Error");
+        response.setBody("{\"error\": \"Failed to delete file\"}");
+        std::cerr << "Failed to delete file: " << fullPath << " - " << strerror(error) << std::endl;
+    }
+    return response.toString();
+}
+
+std::string HttpHandler::uploadDirFor(const Location* location) const {
     std::string uploadDir;
     if (location && !location->uploadDir.empty()) {
-        // Use location-specific upload directory
         if (location->uploadDir[0] == '/') {
             // Absolute path
             uploadDir = location->uploadDir;
@@ -125,172 +219,319 @@ std::string HttpHandler::handleDeleteRequest(const Request& req, const Location*
         }
         uploadDir += "uploads";
     }
-    
-    std::string fullPath = uploadDir + "/" + filename;
-    
-    // Check if file exists
-    struct stat fileStat;
-    if (stat(fullPath.c_str(), &fileStat) != 0) {
-        response.setStatus(404, "Not Found");
-        response.setContentType("application/json");
-        response.setBody("{\"error\": \"File not found\"}");
-        return response.toString();
-    }
-    
-    // Check if it's a regular file (not directory)
-    if (!S_ISREG(fileStat.st_mode)) {
-        response.setStatus(400, "Bad Request");
-        response.setContentType("application/json");
-        response.setBody("{\"error\": \"Cannot delete directories\"}");
-        return response.toString();
-    }
-    
-    // Attempt to delete the file
-    if (unlink(fullPath.c_str()) == 0) {
-        response.setStatus(200, "OK");
-        response.setContentType("application/json");
-        response.setBody("{\"message\": \"File deleted successfully\", \"filename\": \"" + filename + "\"}");
-        std::cout << "File deleted: " << fullPath << std::endl;
-    } else {
-        response.setStatus(500, "Internal Server Error");
-        response.setContentType("application/json");
-        response.setBody("{\"error\": \"Failed to delete file\"}");
-        std::cerr << "Failed to delete file: " << fullPath << " - " << strerror(errno) << std::endl;
-    }
-    
-    return response.toString();
+    return uploadDir;
 }
 
-std::string HttpHandler::serveFile(const std::string& requestPath, const Request& req) {
-    (void)req; // Suppress unused parameter warning
-    Response response;
+void HttpHandler::resolveTarget(const Request& req, std::string& requestPath, std::string& query,
+                                std::string& fullPath) const {
+    // The query string only carries listing options (or busts client caches), never part of the file name
+    requestPath = req.getPath().str();
+    query = req.getQuery().str();
     
     // Construct full file path
-    std::string fullPath = config.getRoot() + requestPath;
+    fullPath = config.getRoot() + requestPath;
     
     // Remove leading slash if present to avoid double slash
     if (!fullPath.empty() && fullPath[0] == '/' && fullPath[1] == '/') {
         fullPath = fullPath.substr(1);
     }
-    
-    struct stat fileStat;
-    if (stat(fullPath.c_str(), &fileStat) == -1) {
-        response.setStatus(404, "Not Found");
-        response.setContentType("text/html");
-        response.setBody(generateErrorPage(404, "File Not Found"));
-        return response.toString();
+}
+
+static std::string indexPathFor(const std::string& dirPath, const std::string& index) {
+    std::string indexPath = dirPath;
+    if (indexPath[indexPath.length() - 1] != '/') {
+        indexPath += "/";
+    }
+    return indexPath + index;
+}
+
+std::string HttpHandler::serveFile(const Request& req) {
+    std::string requestPath;
+    std::string query;
+    std::string fullPath;
+    resolveTarget(req, requestPath, query, fullPath);
+    bool head = req.getMethod() == "HEAD";
+    
+    // Descriptors and stat results come from the open_file_cache when it is on
+    OpenFile file;
+    openCached(fullPath, file);
+    if (file.statError) {
+        return errorResponse(404, "Not Found", "File Not Found", true);
     }
     
     // Check if it's a directory
-    if (S_ISDIR(fileStat.st_mode)) {
+    if (S_ISDIR(file.info.st_mode)) {
         // Try to serve index file
-        std::string indexPath = fullPath;
-        if (indexPath[indexPath.length() - 1] != '/') {
-            indexPath += "/";
-        }
-        indexPath += config.getIndex();
-        
-        if (stat(indexPath.c_str(), &fileStat) == 0 && S_ISREG(fileStat.st_mode)) {
+        std::string indexPath = indexPathFor(fullPath, config.getIndex());
+        OpenFile index;
+        openCached(indexPath, index);
+        if (!index.statError && S_ISREG(index.info.st_mode)) {
             fullPath = indexPath;
+            file = index;
         } else {
-            // Generate directory listing
-            const Location* location = config.findLocation(requestPath);
-            if (location && location->autoindex) {
-                response.setStatus(200, "OK");
-                response.setContentType("text/html");
-                if (req.getMethod() != "HEAD") {
-                    response.setBody(generateDirectoryListing(fullPath, requestPath));
-                }
-                return response.toString();
-            } else {
-                response.setStatus(403, "Forbidden");
-                response.setContentType("text/html");
-                if (req.getMethod() != "HEAD") {
-                    response.setBody(generateErrorPage(403, "Directory listing forbidden"));
-                }
-                return response.toString();
-            }
+            return listingResponse(fullPath, file.info, requestPath, query, head, NULL);
         }
     }
     
     // Serve regular file
-    std::ifstream file(fullPath.c_str(), std::ios::binary);
-    if (!file.is_open()) {
-        response.setStatus(403, "Forbidden");
-        response.setContentType("text/html");
-        if (req.getMethod() != "HEAD") {
-            response.setBody(generateErrorPage(403, "Access Forbidden"));
-        }
-        return response.toString();
+    std::string content;
+    if (!head && file.fd >= 0) {
+        OpenFileCache::readContent(file, content);
+    }
+    std::string response = fileResponse(file, fullPath, content, head);
+    if (file.fd >= 0 && !file.cached) {
+        close(file.fd);
+    }
+    return response;
+}
+
+std::string HttpHandler::fileResponse(const OpenFile& file, const std::string& fullPath, const std::string& content,
+                                      bool head) {
+    if (file.fd < 0) {
+        return errorResponse(403, "Forbidden", "Access Forbidden", !head);
     }
     
-    std::string content;
-    if (req.getMethod() != "HEAD") {
-        content = std::string((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
-    } else {
+    Response response;
+    if (head) {
         // For HEAD requests, we need to get the file size for Content-Length header
         // Use the stat information we already have
-        std::ostringstream sizeStr;
-        sizeStr << fileStat.st_size;
-        response.setHeader("Content-Length", sizeStr.str());
+        response.setContentLength(file.info.st_size);
     }
-    file.close();
-    
     response.setStatus(200, "OK");
     response.setContentType(getMimeType(fullPath));
-    if (req.getMethod() != "HEAD") {
+    if (!head) {
         response.setBody(content);
     }
     return response.toString();
 }
 
-std::string HttpHandler::generateDirectoryListing(const std::string& dirPath, const std::string& requestPath) {
-    std::ostringstream html;
-    html << "<html><head><title>Directory Listing</title></head><body>";
-    html << "<h1>Directory Listing for " << requestPath << "</h1><ul>";
-    
-    DIR* dir = opendir(dirPath.c_str());
-    if (dir) {
-        struct dirent* entry;
-        while ((entry = readdir(dir)) != NULL) {
-            std::string name = entry->d_name;
-            if (name != ".") {
-                std::string link = requestPath;
-                if (link[link.length() - 1] != '/') {
-                    link += "/";
-                }
-                link += name;
-                html << "<li><a href=\"" << link << "\">" << name << "</a></li>";
+bool HttpHandler::autoindexOn(const std::string& requestPath) const {
+    const Location* location = config.findLocation(requestPath);
+    return location && location->autoindex;
+}
+
+std::string HttpHandler::listingResponse(const std::string& dirPath, const struct stat& dirStat,
+                                         const std::string& requestPath, const std::string& query, bool head,
+                                         std::vector<DirectoryEntry>* scanned) {
+    // Generate directory listing
+    const Location* location = config.findLocation(requestPath);
+    if (!location || !location->autoindex) {
+        return errorResponse(403, "Forbidden", "Directory listing forbidden", !head);
+    }
+    ListingOptions opts = ListingOptions::fromQuery(query, location->autoindexPageSize);
+    std::string listing;
+    if (!dirListingCache.render(dirPath, dirStat, requestPath, opts, listing, scanned)) {
+        return errorResponse(403, "Forbidden", "Directory not readable", true);
+    }
+    Response response;
+    response.setStatus(200, "OK");
+    response.setContentType(opts.json ? "application/json" : "text/html");
+    if (!head) {
+        response.setBody(listing);
+    }
+    return response.toString();
+}
+
+AioTask* HttpHandler::startRequest(const Request& req, std::string& response) {
+    const Location* location = config.findLocation(req.getPath());
+    response = checkRequestHead(req, location);
+    if (!response.empty()) {
+        return NULL;
+    }
+    
+    StringView method = req.getMethod();
+    bool noFile = location && (!location->redirect.empty() || location->stubStatus);
+    if ((method == "GET" || method == "HEAD") && !noFile) {
+        return startServe(req, response);
+    } else if (method == "POST" && isUpload(req, location)) {
+        return startUpload(req, location, response);
+    } else if (method == "DELETE") {
+        return startDelete(req, location, response);
+    }
+    // Redirects, the status page, plain POSTs and unknown methods touch no file
+    response = handleRequest(req);
+    return NULL;
+}
+
+AioTask* HttpHandler::startServe(const Request& req, std::string& response) {
+    AioTask* task = new AioTask(AioTask::AIO_SERVE);
+    resolveTarget(req, task->requestPath, task->query, task->path);
+    task->indexPath = indexPathFor(task->path, config.getIndex());
+    task->head = req.getMethod() == "HEAD";
+    
+    // Fresh open_file_cache entries cost no system call; a miss is loaded by the worker
+    bool known = lookupCached(task->path, task->file);
+    if (known && !task->file.statError && S_ISDIR(task->file.info.st_mode)) {
+        known = lookupCached(task->indexPath, task->index);
+    }
+    if (!known) {
+        task->file = OpenFile();
+        task->index = OpenFile();
+        task->index.statError = ENOENT;
+        return task;
+    }
+    task->loaded = true;
+    
+    // Only the read is left: pages already cached are copied here, anything else goes to a worker
+    // (or the event ring) with its own descriptor, as the cache may close its copy
+    OpenFile& target = task->readTarget();
+    if (!task->head && !target.statError && S_ISREG(target.info.st_mode) && target.fd >= 0
+        && !OpenFileCache::readCached(target, task->content)) {
+        target.fd = dup(target.fd);
+        target.cached = false;
+        if (target.fd < 0) {
+            std::cerr << "dup failed: " << strerror(errno) << std::endl;
+        }
+        return task;
+    }
+    if (finishTask(*task, response)) {
+        delete task;
+        return NULL;
+    }
+    return task;
+}
+
+AioTask* HttpHandler::startUpload(const Request& req, const Location* location, std::string& response) {
+    std::string filename;
+    size_t contentStart;
+    size_t contentLength;
+    response = parseUpload(req, filename, contentStart, contentLength);
+    if (!response.empty()) {
+        return NULL;
+    }
+    AioTask* task = new AioTask(AioTask::AIO_UPLOAD);
+    task->dir = uploadDirFor(location);
+    task->filename = filename;
+    task->path = task->dir + "/" + filename;
+    task->body = req.getBodySource();   // a dup() of the spool file, or a copy of a small body
+    task->dataOffset = contentStart;
+    task->dataLength = contentLength;
+    task->cacheMode = location->uploadCache;
+    task->fsync = location->uploadFsync;
+    return task;
+}
+
+AioTask* HttpHandler::startDelete(const Request& req, const Location* location, std::string& response) {
+    std::string fullPath;
+    std::string filename;
+    response = deleteTarget(req, location, fullPath, filename);
+    if (!response.empty()) {
+        return NULL;
+    }
+    AioTask* task = new AioTask(AioTask::AIO_DELETE);
+    task->path = fullPath;
+    task->filename = filename;
+    return task;
+}
+
+bool HttpHandler::finishTask(AioTask& task, std::string& response) {
+    switch (task.kind) {
+    case AioTask::AIO_SERVE:
+        return finishServe(task, response);
+    case AioTask::AIO_LIST:
+        if (task.error) {
+            response = errorResponse(403, "Forbidden", "Directory not readable", true);
+        } else {
+            response = listingResponse(task.path, task.file.info, task.requestPath, task.query, task.head,
+                                       &task.entries);
+        }
+        return true;
+    case AioTask::AIO_DELETE:
+        response = deleteResponse(task.path, task.filename, task.error);
+        return true;
+    case AioTask::AIO_UPLOAD:
+        if (!task.error) {
+            // Cached descriptors, sizes and 404s for the upload tree are stale now
+            openFiles.clear();
+            if (task.fsync == UploadWriter::FSYNC_BATCH && !task.cancelled) {
+                syncBatch.push_back(&task);
+                return false;
             }
         }
-        closedir(dir);
+        response = finishUpload(task);
+        return true;
+    case AioTask::AIO_SYNC:
+        syncing = false;
+        return true;
+    }
+    return true;
+}
+
+std::string HttpHandler::finishUpload(const AioTask& task) {
+    if (!task.error) {
+        std::cout << "File uploaded successfully: " << task.path << " (" << task.dataLength << " bytes)"
+                  << std::endl;
+    }
+    return uploadResponse(!task.error, task.filename, task.dataLength, task.dir);
+}
+
+AioTask* HttpHandler::takeSyncBatch() {
+    time_t now = time(NULL);
+    if (syncBatch.empty() || syncing || now - lastSync < SYNC_INTERVAL) {
+        return NULL;
+    }
+    lastSync = now;
+    syncing = true;
+    AioTask* task = new AioTask(AioTask::AIO_SYNC);
+    task->batch.swap(syncBatch);
+    return task;
+}
+
+bool HttpHandler::finishServe(AioTask& task, std::string& response) {
+    // What a worker loaded is kept for the next requests
+    if (!task.loaded) {
+        openFiles.store(task.path, task.file);
+        if (!task.file.statError && S_ISDIR(task.file.info.st_mode)) {
+            openFiles.store(task.indexPath, task.index);
+        }
     }
     
-    html << "</ul></body></html>";
-    return html.str();
+    if (task.file.statError) {
+        response = errorResponse(404, "Not Found", "File Not Found", true);
+    } else if (task.servesIndex()) {
+        response = fileResponse(task.index, task.indexPath, task.content, task.head);
+    } else if (S_ISDIR(task.file.info.st_mode)) {
+        if (autoindexOn(task.requestPath) && !dirListingCache.isFresh(task.path, task.file.info)) {
+            task.kind = AioTask::AIO_LIST;
+            return false;
+        }
+        response = listingResponse(task.path, task.file.info, task.requestPath, task.query, task.head, NULL);
+    } else {
+        response = fileResponse(task.file, task.path, task.content, task.head);
+    }
+    
+    if (task.file.fd >= 0 && !task.file.cached) {
+        close(task.file.fd);
+    }
+    if (task.index.fd >= 0 && !task.index.cached) {
+        close(task.index.fd);
+    }
+    return true;
 }
 
 std::string HttpHandler::handleFileUpload(const Request& req, const Location* location) {
+    std::string filename;
+    size_t contentStart;
+    size_t contentLength;
+    std::string refusal = parseUpload(req, filename, contentStart, contentLength);
+    if (!refusal.empty()) {
+        return refusal;
+    }
+    std::string uploadDir = uploadDirFor(location);
+    bool saved = saveUploadedFile(req.getBody().data() + contentStart, contentLength, filename, uploadDir, location);
+    return uploadResponse(saved, filename, contentLength, uploadDir);
+}
+
+std::string HttpHandler::parseUpload(const Request& req, std::string& filename, size_t& contentStart,
+                                     size_t& contentLength) {
     Response response;
     
-    std::string contentType = req.getHeader("content-type");
-    std::string body = req.getBody();
+    std::string contentType = req.getHeader(Request::HEADER_CONTENT_TYPE).str();
+    StringView body = req.getBody();
     
     // Check file size limit (default: 10MB)
-    const size_t MAX_FILE_SIZE = 10 * 1024 * 1024; // 10MB
-    if (body.length() > MAX_FILE_SIZE) {
-        response.setStatus(413, "Payload Too Large");
-        response.setContentType("text/html");
-        std::ostringstream errorBody;
-        errorBody << "<html><head><title>File Too Large</title></head><body>";
-        errorBody << "<h1>❌ File Too Large</h1>";
-        errorBody << "<p>The uploaded file exceeds the maximum size limit of " << (MAX_FILE_SIZE / (1024 * 1024)) << " MB.</p>";
-        errorBody << "<p><strong>Your file size:</strong> " << (body.length() / 1024) << " KB</p>";
-        errorBody << "<div style='margin-top: 20px;'>";
-        errorBody << "<a href='/upload.html' style='text-decoration: none; background: #007bff; color: white; padding: 10px 20px; border-radius: 5px;'>🔄 Try Again</a>";
-        errorBody << "</div></body></html>";
-        response.setBody(errorBody.str());
-        return response.toString();
+    if (body.length() > MAX_UPLOAD_SIZE) {
+        return uploadTooLarge(body.length());
     }
     
     // Extract boundary from Content-Type
@@ -324,7 +565,7 @@ std::string HttpHandler::handleFileUpload(const Request& req, const Location* lo
     
     filenamePos += 10; // Skip 'filename="'
     size_t filenameEnd = body.find("\"", filenamePos);
-    std::string filename = body.substr(filenamePos, filenameEnd - filenamePos);
+    filename = body.substr(filenamePos, filenameEnd - filenamePos).str();
     
     // Validate filename - prevent directory traversal and illegal characters
     if (filename.empty() || filename.find("..") != std::string::npos || 
@@ -349,7 +590,7 @@ std::string HttpHandler::handleFileUpload(const Request& req, const Location* lo
     }
     
     // Find file content start (after headers)
-    size_t contentStart = body.find("\r\n\r\n", fileStart);
+    contentStart = body.find("\r\n\r\n", fileStart);
     if (contentStart == std::string::npos) {
         contentStart = body.find("\n\n", fileStart);
         if (contentStart == std::string::npos) {
@@ -377,37 +618,22 @@ std::string HttpHandler::handleFileUpload(const Request& req, const Location* lo
         contentEnd--;
     }
     
-    std::string fileContent = body.substr(contentStart, contentEnd - contentStart);
-    
-    // Construct upload directory path
-    std::string uploadDir;
-    if (location && !location->uploadDir.empty()) {
-        if (location->uploadDir[0] == '/') {
-            uploadDir = location->uploadDir;
-        } else {
-            uploadDir = config.getRoot();
-            if (uploadDir[uploadDir.length() - 1] != '/') {
-                uploadDir += "/";
-            }
-            uploadDir += location->uploadDir;
-        }
-    } else {
-        uploadDir = config.getRoot();
-        if (uploadDir[uploadDir.length() - 1] != '/') {
-            uploadDir += "/";
-        }
-        uploadDir += "uploads";
-    }
-    
-    // Save the file
-    if (saveUploadedFile(fileContent, filename, uploadDir)) {
+    // The content is used where it is, in the buffered or mapped body
+    contentLength = contentEnd - contentStart;
+    return "";
+}
+
+std::string HttpHandler::uploadResponse(bool saved, const std::string& filename, size_t size,
+                                        const std::string& uploadDir) {
+    Response response;
+    if (saved) {
         response.setStatus(200, "OK");
         response.setContentType("text/html");
         std::ostringstream responseBody;
         responseBody << "<html><head><title>Upload Success</title></head><body>";
         responseBody << "<h1>✅ File Upload Successful</h1>";
         responseBody << "<p>File <strong>" << filename << "</strong> has been uploaded successfully.</p>";
-        responseBody << "<p><strong>File size:</strong> " << fileContent.length() << " bytes</p>";
+        responseBody << "<p><strong>File size:</strong> " << size << " bytes</p>";
         responseBody << "<p><strong>Upload directory:</strong> " << uploadDir << "</p>";
         responseBody << "<div style='margin-top: 20px;'>";
         responseBody << "<a href='/' style='text-decoration: none; background: #007bff; color: white; padding: 10px 20px; border-radius: 5px; margin-right: 10px;'>🏠 Home</a>";
@@ -425,59 +651,76 @@ std::string HttpHandler::handleFileUpload(const Request& req, const Location* lo
     return response.toString();
 }
 
-bool HttpHandler::saveUploadedFile(const std::string& content, const std::string& filename, const std::string& uploadDir) {
+std::string HttpHandler::uploadTooLarge(size_t bodyLength) {
+    Response response;
+    response.setStatus(413, "Payload Too Large");
+    response.setContentType("text/html");
+    std::ostringstream errorBody;
+    errorBody << "<html><head><title>File Too Large</title></head><body>";
+    errorBody << "<h1>❌ File Too Large</h1>";
+    errorBody << "<p>The uploaded file exceeds the maximum size limit of " << (MAX_UPLOAD_SIZE / (1024 * 1024)) << " MB.</p>";
+    errorBody << "<p><strong>Your file size:</strong> " << (bodyLength / 1024) << " KB</p>";
+    errorBody << "<div style='margin-top: 20px;'>";
+    errorBody << "<a href='/upload.html' style='text-decoration: none; background: #007bff; color: white; padding: 10px 20px; border-radius: 5px;'>🔄 Try Again</a>";
+    errorBody << "</div></body></html>";
+    response.setBody(errorBody.str());
+    return response.toString();
+}
+
+bool HttpHandler::saveUploadedFile(const char* content, size_t length, const std::string& filename,
+                                   const std::string& uploadDir, const Location* location) {
     // Create upload directory if it doesn't exist
-    struct stat st;
-    if (stat(uploadDir.c_str(), &st) != 0) {
-        if (mkdir(uploadDir.c_str(), 0755) != 0) {
-            std::cerr << "Failed to create upload directory: " << uploadDir << std::endl;
-            return false;
-        }
+    if (!UploadWriter::makeDir(uploadDir)) {
+        return false;
     }
     
     // Create full file path
     std::string filePath = uploadDir + "/" + filename;
     
-    // Write file
-    std::ofstream file(filePath.c_str(), std::ios::binary);
-    if (!file.is_open()) {
-        std::cerr << "Failed to open file for writing: " << filePath << std::endl;
-        return false;
+    // Write file with the location's page cache and fsync policy
+    UploadWriter::CacheMode cacheMode = location ? location->uploadCache : UploadWriter::CACHE_KEEP;
+    UploadWriter::FsyncPolicy fsyncPolicy = location ? location->uploadFsync : UploadWriter::FSYNC_OFF;
+    if (fsyncPolicy == UploadWriter::FSYNC_BATCH) {
+        fsyncPolicy = UploadWriter::FSYNC_ON; // no batch to wait for on this path
     }
-    
-    file.write(content.c_str(), content.length());
-    file.close();
-    
-    if (file.fail()) {
-        std::cerr << "Failed to write file: " << filePath << std::endl;
+    if (!uploadWriter.write(uploadDir, filePath, content, length, cacheMode, fsyncPolicy)) {
         return false;
     }
+    // Cached descriptors, sizes and 404s for the upload tree are stale now
+    openFiles.clear();
     
-    std::cout << "File uploaded successfully: " << filePath << " (" << content.length() << " bytes)" << std::endl;
+    std::cout << "File uploaded successfully: " << filePath << " (" << length << " bytes)" << std::endl;
     return true;
 }
 
-std::string HttpHandler::getMimeType(const std::string& filename) {
-    size_t pos = filename.find_last_of('.');
-    if (pos == std::string::npos) {
-        return "application/octet-stream";
-    }
-    
-    std::string extension = filename.substr(pos);
-    
-    if (extension == ".html" || extension == ".htm") return "text/html";
-    if (extension == ".css") return "text/css";
-    if (extension == ".js") return "application/javascript";
-    if (extension == ".json") return "application/json";
-    if (extension == ".jpg" || extension == ".jpeg") return "image/jpeg";
-    if (extension == ".png") return "image/png";
-    if (extension == ".gif") return "image/gif";
-    if (extension == ".svg") return "image/svg+xml";
-    if (extension == ".txt") return "text/plain";
-    if (extension == ".xml") return "application/xml";
-    if (extension == ".pdf") return "application/pdf";
+const std::string& HttpHandler::getMimeType(const std::string& filename) {
+    return config.getMimeTypes().lookup(filename);
+}
+
+std::string HttpHandler::handleStubStatus(const Request& req) {
+    Response response;
+    response.setStatus(200, "OK");
+    response.setContentType("text/plain; version=0.0.4");
+    response.setHeader("Cache-Control", "no-store");
     
-    return "application/octet-stream";
+    std::string body = metrics.renderPrometheus();
+    if (req.getMethod() == "HEAD") {
+        response.setContentLength(body.length());
+    } else {
+        response.setBody(body);
+    }
+    return response.toString();
+}
+
+std::string HttpHandler::errorResponse(int statusCode, const std::string& reason, const std::string& message,
+                                       bool withBody) {
+    Response response;
+    response.setStatus(statusCode, reason);
+    response.setContentType("text/html");
+    if (withBody) {
+        response.setBody(generateErrorPage(statusCode, message));
+    }
+    return response.toString();
 }
 
 std::string HttpHandler::generateErrorPage(int statusCode, const std::string& message) {
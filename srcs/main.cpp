@@ -6,7 +6,7 @@
 /*   By: aogbi <aogbi@student.42.fr>                +#+  +:+       +#+        */
 /*                                                +#+#+#+#+#+   +#+           */
 /*   Created: 2025/08/19 18:56:58 by aogbi             #+#    #+#             */
-/*   Updated: 2025/09/12 17:56:39 by aogbi            ###   ########.fr       */
+/*   Updated: 2026/10/19 00:00:00 by aogbi            ###   ########.fr       */
 /*                                                                            */
 /* ************************************************************************** */
 
@@ -16,19 +16,80 @@
 #include <iostream>
 #include <string>
 #include <exception>
+#include <vector>
+#include <cstring>
+#include <csignal>
+#include <pthread.h>
+
+static ServerShared* g_shared = NULL;
+static std::vector<Server*> g_reactors;
+
+static void stopReactors() {
+    __atomic_store_n(&g_running, false, __ATOMIC_RELEASE);
+    for (size_t i = 0; i < g_reactors.size(); ++i) {
+        g_reactors[i]->wake();
+    }
+}
+
+static void* runReactor(void* reactor) {
+    static_cast<Server*>(reactor)->run();
+    // A reactor that stops on its own (poll error) takes the others down with it:
+    // its listener would otherwise keep getting a share of the new connections
+    stopReactors();
+    return NULL;
+}
+
+/**
+ * @brief Run reactor 0 on this thread and the others on threads of their own
+ *
+ * Shutdown signals are blocked in the other reactors, so they interrupt
+ * the poll() of this one; once it stops it wakes the rest through their
+ * eventfd.
+ */
+static void runReactors() {
+    sigset_t stopSignals;
+    sigset_t previous;
+    sigemptyset(&stopSignals);
+    sigaddset(&stopSignals, SIGINT);
+    sigaddset(&stopSignals, SIGTERM);
+    sigaddset(&stopSignals, SIGQUIT);
+    pthread_sigmask(SIG_BLOCK, &stopSignals, &previous);
+    std::vector<pthread_t> threads;
+    for (size_t i = 1; i < g_reactors.size(); ++i) {
+        pthread_t thread;
+        int rc = pthread_create(&thread, NULL, runReactor, g_reactors[i]);
+        if (rc != 0) {
+            std::cerr << "❌ Error: Failed to start reactor thread: " << strerror(rc) << std::endl;
+            stopReactors();
+            break;
+        }
+        threads.push_back(thread);
+    }
+    pthread_sigmask(SIG_SETMASK, &previous, NULL);
+
+    runReactor(g_reactors[0]);
+    for (size_t i = 0; i < threads.size(); ++i) {
+        pthread_join(threads[i], NULL);
+    }
+}
 
 bool initializeAndRunServer(const std::string& configFile) {
     std::cout << "🌐 Starting Webserv..." << std::endl;
     std::cout << "📁 Using config file: " << configFile << std::endl;
-    g_server = new Server(configFile);
-    if (!g_server->setup()) {
+    g_shared = new ServerShared(configFile);
+    if (!g_shared->setup()) {
         std::cerr << "❌ Error: Failed to setup server" << std::endl;
-        delete g_server;
-        g_server = NULL;
         return false;
     }
+    for (size_t i = 0; i < g_shared->config.getWorkerThreads(); ++i) {
+        g_reactors.push_back(new Server(*g_shared));
+        if (!g_reactors.back()->setup()) {
+            std::cerr << "❌ Error: Failed to setup server" << std::endl;
+            return false;
+        }
+    }
     std::cout << "✅ Server setup complete. Running..." << std::endl;
-    g_server->run();
+    runReactors();
     std::cout << "🛑 Server shutdown complete." << std::endl;
     return true;
 }
@@ -37,10 +98,13 @@ bool initializeAndRunServer(const std::string& configFile) {
  * @brief Clean up server resources
  */
 void cleanup() {
-    if (g_server) {
-        delete g_server;
-        g_server = NULL;
+    // Reactors first: they hold references into the shared state
+    for (size_t i = 0; i < g_reactors.size(); ++i) {
+        delete g_reactors[i];
     }
+    g_reactors.clear();
+    delete g_shared;
+    g_shared = NULL;
 }
 
 int main(int argc, char *argv[]) {
@@ -51,6 +115,7 @@ int main(int argc, char *argv[]) {
     try {
         std::string configFile = getConfigFile(argc, argv);
         if (!initializeAndRunServer(configFile)) {
+            cleanup();
             return 1;
         }
         cleanup();
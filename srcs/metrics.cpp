@@ -0,0 +1,294 @@
+/* ************************************************************************** */
+/*                                                                            */
+/*                                                        :::      ::::::::   */
+/*   metrics.cpp                                        :+:      :+:    :+:   */
+/*                                                    +:+ +:+         +:+     */
+/*   By: aogbi <aogbi@student.42.fr>                +#+  +:+       +#+        */
+/*                                                +#+#+#+#+#+   +#+           */
+/*   Created: 2026/10/19 00:00:00 by aogbi             #+#    #+#             */
+/*   Updated: 2026/10/19 00:00:00 by aogbi            ###   ########.fr       */
+/*                                                                            */
+/* ************************************************************************** */
+
+#include "metrics.hpp"
+#include <sstream>
+#include <cstring>
+#include <ctime>
+
+const uint64_t LatencyHistogram::BUCKET_BOUNDS_US[LatencyHistogram::BUCKET_COUNT] = {
+    50, 100, 250, 500, 1000, 2500, 5000, 10000, 25000, 50000,
+    100000, 250000, 500000, 1000000, 2500000
+};
+
+// Prometheus wants bucket bounds in seconds; keep them as literals so
+// rendering never has to format floating point values.
+const char* const LatencyHistogram::BUCKET_LABELS[LatencyHistogram::BUCKET_COUNT] = {
+    "0.00005", "0.0001", "0.00025", "0.0005", "0.001", "0.0025", "0.005", "0.01",
+    "0.025", "0.05", "0.1", "0.25", "0.5", "1", "2.5"
+};
+
+LatencyHistogram::LatencyHistogram() : count(0), sumMicros(0) {
+    std::memset(buckets, 0, sizeof(buckets));
+}
+
+void LatencyHistogram::observe(uint64_t micros) {
+    int i = 0;
+    while (i < BUCKET_COUNT && micros > BUCKET_BOUNDS_US[i]) {
+        ++i;
+    }
+    bumpCounter(buckets[i]);
+    bumpCounter(count);
+    bumpCounter(sumMicros, micros);
+}
+
+// Relaxed loads: the counters belong to another reactor that keeps adding to them
+static void addCounter(uint64_t& total, const uint64_t& counter) {
+    total += __atomic_load_n(&counter, __ATOMIC_RELAXED);
+}
+
+void LatencyHistogram::addTo(LatencyHistogram& total) const {
+    for (int i = 0; i <= BUCKET_COUNT; ++i) {
+        addCounter(total.buckets[i], buckets[i]);
+    }
+    addCounter(total.count, count);
+    addCounter(total.sumMicros, sumMicros);
+}
+
+static const char* const PHASE_NAMES[Metrics::PHASE_COUNT] = {
+    "parse", "handle", "write", "cgi", "upstream"
+};
+
+static const char* const METHOD_NAMES[Metrics::METHOD_COUNT] = {
+    "GET", "HEAD", "POST", "DELETE", "OTHER"
+};
+
+static const char* const CACHE_NAMES[Metrics::CACHE_KIND_COUNT] = {
+    "dirlist", "cgi", "open_file"
+};
+
+static const char* const LIMIT_NAMES[Metrics::LIMIT_KIND_COUNT] = {
+    "conn", "req"
+};
+
+// Six fixed decimals keep the value exact without touching floating point
+static void writeSeconds(std::ostringstream& out, uint64_t micros) {
+    char frac[7];
+    uint64_t rest = micros % 1000000;
+    for (int d = 5; d >= 0; --d) {
+        frac[d] = static_cast<char>('0' + rest % 10);
+        rest /= 10;
+    }
+    frac[6] = '\0';
+    out << (micros / 1000000) << "." << frac;
+}
+
+Metrics::Metrics()
+    : acceptedConnections(0), activeConnections(0), idleConnections(0),
+      bytesIn(0), bytesOut(0), cgiSpawns(0), cgiFailures(0),
+      upstreamConnects(0), upstreamReuses(0), upstreamFailures(0),
+      tlsHandshakes(0), tlsResumed(0), tlsKtls(0), tlsFailures(0),
+      http2Connections(0), http2Streams(0), group(NULL) {
+    std::memset(requestsByMethod, 0, sizeof(requestsByMethod));
+    std::memset(responsesByStatus, 0, sizeof(responsesByStatus));
+    std::memset(cacheHits, 0, sizeof(cacheHits));
+    std::memset(cacheMisses, 0, sizeof(cacheMisses));
+    std::memset(limitRejections, 0, sizeof(limitRejections));
+}
+
+uint64_t Metrics::nowMicros() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return static_cast<uint64_t>(ts.tv_sec) * 1000000 + ts.tv_nsec / 1000;
+}
+
+Metrics::Method Metrics::methodIndex(const StringView& method) {
+    if (method == "GET") return METHOD_GET;
+    if (method == "HEAD") return METHOD_HEAD;
+    if (method == "POST") return METHOD_POST;
+    if (method == "DELETE") return METHOD_DELETE;
+    return METHOD_OTHER;
+}
+
+void Metrics::connectionOpened() {
+    bumpCounter(acceptedConnections);
+    bumpCounter(activeConnections);
+    bumpCounter(idleConnections);
+}
+
+void Metrics::connectionBusy() {
+    if (idleConnections > 0) {
+        dropCounter(idleConnections);
+    }
+}
+
+void Metrics::connectionClosed(bool wasIdle) {
+    if (activeConnections > 0) {
+        dropCounter(activeConnections);
+    }
+    if (wasIdle) {
+        connectionBusy();
+    }
+}
+
+void Metrics::recordRequest(const StringView& method) {
+    bumpCounter(requestsByMethod[methodIndex(method)]);
+}
+
+void Metrics::recordStatus(int statusCode) {
+    if (statusCode >= STATUS_MIN && statusCode <= STATUS_MAX) {
+        bumpCounter(responsesByStatus[statusCode - STATUS_MIN]);
+    }
+}
+
+void Metrics::observePhase(Phase phase, uint64_t startMicros) {
+    uint64_t now = nowMicros();
+    phases[phase].observe(now > startMicros ? now - startMicros : 0);
+}
+
+void Metrics::addTo(Metrics& total) const {
+    addCounter(total.acceptedConnections, acceptedConnections);
+    addCounter(total.activeConnections, activeConnections);
+    addCounter(total.idleConnections, idleConnections);
+    for (int i = 0; i < METHOD_COUNT; ++i) {
+        addCounter(total.requestsByMethod[i], requestsByMethod[i]);
+    }
+    for (int i = 0; i <= STATUS_MAX - STATUS_MIN; ++i) {
+        addCounter(total.responsesByStatus[i], responsesByStatus[i]);
+    }
+    addCounter(total.bytesIn, bytesIn);
+    addCounter(total.bytesOut, bytesOut);
+    addCounter(total.cgiSpawns, cgiSpawns);
+    addCounter(total.cgiFailures, cgiFailures);
+    addCounter(total.upstreamConnects, upstreamConnects);
+    addCounter(total.upstreamReuses, upstreamReuses);
+    addCounter(total.upstreamFailures, upstreamFailures);
+    addCounter(total.tlsHandshakes, tlsHandshakes);
+    addCounter(total.tlsResumed, tlsResumed);
+    addCounter(total.tlsKtls, tlsKtls);
+    addCounter(total.tlsFailures, tlsFailures);
+    addCounter(total.http2Connections, http2Connections);
+    addCounter(total.http2Streams, http2Streams);
+    for (int i = 0; i < CACHE_KIND_COUNT; ++i) {
+        addCounter(total.cacheHits[i], cacheHits[i]);
+        addCounter(total.cacheMisses[i], cacheMisses[i]);
+    }
+    for (int i = 0; i < LIMIT_KIND_COUNT; ++i) {
+        addCounter(total.limitRejections[i], limitRejections[i]);
+    }
+    for (int i = 0; i < PHASE_COUNT; ++i) {
+        phases[i].addTo(total.phases[i]);
+    }
+}
+
+std::string Metrics::renderPrometheus() const {
+    if (group) {
+        Metrics total;
+        for (size_t i = 0; i < group->size(); ++i) {
+            (*group)[i]->addTo(total);
+        }
+        return total.renderPrometheus();
+    }
+
+    std::ostringstream out;
+
+    out << "# HELP webserv_connections_accepted_total Accepted client connections.\n";
+    out << "# TYPE webserv_connections_accepted_total counter\n";
+    out << "webserv_connections_accepted_total " << acceptedConnections << "\n";
+    out << "# HELP webserv_connections_active Open client connections.\n";
+    out << "# TYPE webserv_connections_active gauge\n";
+    out << "webserv_connections_active " << activeConnections << "\n";
+    out << "# HELP webserv_connections_idle Open connections with no request bytes received.\n";
+    out << "# TYPE webserv_connections_idle gauge\n";
+    out << "webserv_connections_idle " << idleConnections << "\n";
+
+    out << "# HELP webserv_requests_total Parsed requests by method.\n";
+    out << "# TYPE webserv_requests_total counter\n";
+    for (int i = 0; i < METHOD_COUNT; ++i) {
+        out << "webserv_requests_total{method=\"" << METHOD_NAMES[i] << "\"} " << requestsByMethod[i] << "\n";
+    }
+
+    out << "# HELP webserv_responses_total Responses by status code.\n";
+    out << "# TYPE webserv_responses_total counter\n";
+    for (int code = STATUS_MIN; code <= STATUS_MAX; ++code) {
+        if (responsesByStatus[code - STATUS_MIN] != 0) {
+            out << "webserv_responses_total{status=\"" << code << "\"} "
+                << responsesByStatus[code - STATUS_MIN] << "\n";
+        }
+    }
+
+    out << "# HELP webserv_bytes_received_total Bytes read from client sockets.\n";
+    out << "# TYPE webserv_bytes_received_total counter\n";
+    out << "webserv_bytes_received_total " << bytesIn << "\n";
+    out << "# HELP webserv_bytes_sent_total Bytes written to client sockets.\n";
+    out << "# TYPE webserv_bytes_sent_total counter\n";
+    out << "webserv_bytes_sent_total " << bytesOut << "\n";
+
+    out << "# HELP webserv_cgi_spawns_total CGI processes started.\n";
+    out << "# TYPE webserv_cgi_spawns_total counter\n";
+    out << "webserv_cgi_spawns_total " << cgiSpawns << "\n";
+    out << "# HELP webserv_cgi_failures_total CGI executions that failed.\n";
+    out << "# TYPE webserv_cgi_failures_total counter\n";
+    out << "webserv_cgi_failures_total " << cgiFailures << "\n";
+
+    out << "# HELP webserv_upstream_connections_total Upstream connections used by proxied requests.\n";
+    out << "# TYPE webserv_upstream_connections_total counter\n";
+    out << "webserv_upstream_connections_total{reused=\"false\"} " << upstreamConnects << "\n";
+    out << "webserv_upstream_connections_total{reused=\"true\"} " << upstreamReuses << "\n";
+    out << "# HELP webserv_upstream_failures_total Upstream connect, read or write failures.\n";
+    out << "# TYPE webserv_upstream_failures_total counter\n";
+    out << "webserv_upstream_failures_total " << upstreamFailures << "\n";
+
+    out << "# HELP webserv_tls_handshakes_total Completed TLS handshakes.\n";
+    out << "# TYPE webserv_tls_handshakes_total counter\n";
+    out << "webserv_tls_handshakes_total{resumed=\"false\"} " << tlsHandshakes - tlsResumed << "\n";
+    out << "webserv_tls_handshakes_total{resumed=\"true\"} " << tlsResumed << "\n";
+    out << "# HELP webserv_tls_ktls_connections_total TLS connections whose record encryption moved to the kernel.\n";
+    out << "# TYPE webserv_tls_ktls_connections_total counter\n";
+    out << "webserv_tls_ktls_connections_total " << tlsKtls << "\n";
+    out << "# HELP webserv_tls_handshake_failures_total TLS handshakes that failed.\n";
+    out << "# TYPE webserv_tls_handshake_failures_total counter\n";
+    out << "webserv_tls_handshake_failures_total " << tlsFailures << "\n";
+    out << "# HELP webserv_http2_connections_total Connections served over HTTP/2.\n";
+    out << "# TYPE webserv_http2_connections_total counter\n";
+    out << "webserv_http2_connections_total " << http2Connections << "\n";
+    out << "# HELP webserv_http2_streams_total HTTP/2 streams dispatched as requests.\n";
+    out << "# TYPE webserv_http2_streams_total counter\n";
+    out << "webserv_http2_streams_total " << http2Streams << "\n";
+
+    out << "# HELP webserv_cache_hits_total Cache lookups served from memory.\n";
+    out << "# TYPE webserv_cache_hits_total counter\n";
+    for (int i = 0; i < CACHE_KIND_COUNT; ++i) {
+        out << "webserv_cache_hits_total{cache=\"" << CACHE_NAMES[i] << "\"} " << cacheHits[i] << "\n";
+    }
+    out << "# HELP webserv_cache_misses_total Cache lookups that fell through.\n";
+    out << "# TYPE webserv_cache_misses_total counter\n";
+    for (int i = 0; i < CACHE_KIND_COUNT; ++i) {
+        out << "webserv_cache_misses_total{cache=\"" << CACHE_NAMES[i] << "\"} " << cacheMisses[i] << "\n";
+    }
+
+    out << "# HELP webserv_limit_rejections_total Connections (503) and requests (429) refused by limit_conn/limit_req.\n";
+    out << "# TYPE webserv_limit_rejections_total counter\n";
+    for (int i = 0; i < LIMIT_KIND_COUNT; ++i) {
+        out << "webserv_limit_rejections_total{limit=\"" << LIMIT_NAMES[i] << "\"} " << limitRejections[i] << "\n";
+    }
+
+    out << "# HELP webserv_phase_duration_seconds Time spent per request phase.\n";
+    out << "# TYPE webserv_phase_duration_seconds histogram\n";
+    for (int p = 0; p < PHASE_COUNT; ++p) {
+        const LatencyHistogram& h = phases[p];
+        uint64_t cumulative = 0;
+        for (int b = 0; b < LatencyHistogram::BUCKET_COUNT; ++b) {
+            cumulative += h.buckets[b];
+            out << "webserv_phase_duration_seconds_bucket{phase=\"" << PHASE_NAMES[p]
+                << "\",le=\"" << LatencyHistogram::BUCKET_LABELS[b] << "\"} " << cumulative << "\n";
+        }
+        out << "webserv_phase_duration_seconds_bucket{phase=\"" << PHASE_NAMES[p]
+            << "\",le=\"+Inf\"} " << h.count << "\n";
+        out << "webserv_phase_duration_seconds_sum{phase=\"" << PHASE_NAMES[p] << "\"} ";
+        writeSeconds(out, h.sumMicros);
+        out << "\n";
+        out << "webserv_phase_duration_seconds_count{phase=\"" << PHASE_NAMES[p] << "\"} " << h.count << "\n";
+    }
+
+    return out.str();
+}
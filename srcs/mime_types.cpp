@@ -0,0 +1,128 @@
+/* ************************************************************************** */
+/*                                                                            */
+/*                                                        :::      ::::::::   */
+/*   mime_types.cpp                                     :+:      :+:    :+:   */
+/*                                                    +:+ +:+         +:+     */
+/*   By: aogbi <aogbi@student.42.fr>                +#+  +:+       +#+        */
+/*                                                +#+#+#+#+#+   +#+           */
+/*   Created: 2026/10/19 00:00:00 by aogbi             #+#    #+#             */
+/*   Updated: 2026/10/19 00:00:00 by aogbi            ###   ########.fr       */
+/*                                                                            */
+/* ************************************************************************** */
+
+#include "mime_types.hpp"
+#include "utils.hpp"
+
+static const size_t INITIAL_CAPACITY = 64;
+
+MimeTypes::MimeTypes() : table(INITIAL_CAPACITY), count(0), defaultType("application/octet-stream") {
+}
+
+bool MimeTypes::equalsLower(const std::string& stored, const char* ext, size_t len) {
+    if (stored.length() != len) {
+        return false;
+    }
+    for (size_t i = 0; i < len; ++i) {
+        if (stored[i] != StringView::lower(ext[i])) {
+            return false;
+        }
+    }
+    return true;
+}
+
+void MimeTypes::grow() {
+    std::vector<Entry> old;
+    old.swap(table);
+    table.resize(old.size() * 2);
+    size_t mask = table.size() - 1;
+    for (size_t i = 0; i < old.size(); ++i) {
+        if (!old[i].used) {
+            continue;
+        }
+        size_t slot = old[i].hash & mask;
+        while (table[slot].used) {
+            slot = (slot + 1) & mask;
+        }
+        table[slot] = old[i];
+    }
+}
+
+void MimeTypes::add(const std::string& extension, const std::string& type) {
+    if (extension.empty()) {
+        return;
+    }
+    // Keep the load factor at or below one half so probe runs stay short
+    if ((count + 1) * 2 > table.size()) {
+        grow();
+    }
+    uint32_t hash = hashLower(extension);
+    size_t mask = table.size() - 1;
+    size_t slot = hash & mask;
+    while (table[slot].used) {
+        if (table[slot].hash == hash && equalsLower(table[slot].extension, extension.c_str(), extension.length())) {
+            table[slot].type = type;
+            return;
+        }
+        slot = (slot + 1) & mask;
+    }
+    Entry& entry = table[slot];
+    entry.extension.resize(extension.length());
+    for (size_t i = 0; i < extension.length(); ++i) {
+        entry.extension[i] = StringView::lower(extension[i]);
+    }
+    entry.type = type;
+    entry.hash = hash;
+    entry.used = true;
+    ++count;
+}
+
+void MimeTypes::clear() {
+    table.assign(INITIAL_CAPACITY, Entry());
+    count = 0;
+}
+
+void MimeTypes::loadDefaults() {
+    static const char* const DEFAULTS[][2] = {
+        { "html", "text/html" }, { "htm", "text/html" }, { "css", "text/css" },
+        { "js", "application/javascript" }, { "mjs", "application/javascript" },
+        { "json", "application/json" }, { "xml", "application/xml" },
+        { "txt", "text/plain" }, { "csv", "text/csv" }, { "md", "text/markdown" },
+        { "jpg", "image/jpeg" }, { "jpeg", "image/jpeg" }, { "png", "image/png" },
+        { "gif", "image/gif" }, { "svg", "image/svg+xml" }, { "ico", "image/x-icon" },
+        { "webp", "image/webp" }, { "avif", "image/avif" }, { "bmp", "image/bmp" },
+        { "woff", "font/woff" }, { "woff2", "font/woff2" }, { "ttf", "font/ttf" },
+        { "otf", "font/otf" }, { "mp4", "video/mp4" }, { "webm", "video/webm" },
+        { "mp3", "audio/mpeg" }, { "ogg", "audio/ogg" }, { "wav", "audio/wav" },
+        { "wasm", "application/wasm" }, { "pdf", "application/pdf" },
+        { "zip", "application/zip" }, { "gz", "application/gzip" }
+    };
+    for (size_t i = 0; i < sizeof(DEFAULTS) / sizeof(DEFAULTS[0]); ++i) {
+        add(DEFAULTS[i][0], DEFAULTS[i][1]);
+    }
+}
+
+const std::string* MimeTypes::find(const char* ext, size_t len) const {
+    if (len == 0 || count == 0) {
+        return NULL;
+    }
+    uint32_t hash = hashLower(StringView(ext, len));
+    size_t mask = table.size() - 1;
+    size_t slot = hash & mask;
+    while (table[slot].used) {
+        if (table[slot].hash == hash && equalsLower(table[slot].extension, ext, len)) {
+            return &table[slot].type;
+        }
+        slot = (slot + 1) & mask;
+    }
+    return NULL;
+}
+
+const std::string& MimeTypes::lookup(const std::string& filename) const {
+    // Only the last path segment can carry the extension
+    size_t dot = filename.find_last_of("./");
+    if (dot == std::string::npos || filename[dot] != '.') {
+        return defaultType;
+    }
+    const std::string* type = find(filename.c_str() + dot + 1, filename.length() - dot - 1);
+    return type ? *type : defaultType;
+}
@@ -0,0 +1,306 @@
+/* ************************************************************************** */
+/*                                                                            */
+/*                                                        :::      ::::::::   */
+/*   open_file_cache.cpp                                :+:      :+:    :+:   */
+/*                                                    +:+ +:+         +:+     */
+/*   By: aogbi <aogbi@student.42.fr>                +#+  +:+       +#+        */
+/*                                                +#+#+#+#+#+   +#+           */
+/*   Created: 2026/10/19 00:00:00 by aogbi             #+#    #+#             */
+/*   Updated: 2026/10/19 00:00:00 by aogbi            ###   ########.fr       */
+/*                                                                            */
+/* ************************************************************************** */
+
+#include "open_file_cache.hpp"
+#include "utils.hpp"
+#include <cerrno>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/uio.h>
+
+OpenFileCache::OpenFileCache(EpochDomain& epochs)
+    : buckets(NULL), bucketMask(0), count(0), maxEntries(0), inactive(20), validity(60), cacheErrors(false),
+      useClock(0), lastSweep(0), epochs(epochs) {
+    pthread_mutex_init(&writeLock, NULL);
+}
+
+OpenFileCache::~OpenFileCache() {
+    destroy();
+    pthread_mutex_destroy(&writeLock);
+}
+
+void OpenFileCache::configure(size_t maxEntries, int inactive, int validity, bool cacheErrors) {
+    destroy();
+    this->maxEntries = maxEntries;
+    this->inactive = inactive;
+    this->validity = validity;
+    this->cacheErrors = cacheErrors;
+    if (maxEntries == 0) {
+        return;
+    }
+    // About one entry per bucket when full; the array never grows, so readers need no resize protocol
+    size_t size = 16;
+    while (size < maxEntries) {
+        size <<= 1;
+    }
+    buckets = new Entry*[size]();
+    bucketMask = size - 1;
+}
+
+void OpenFileCache::load(const std::string& path, OpenFile& file) {
+    file.fd = -1;
+    file.statError = 0;
+    if (stat(path.c_str(), &file.info) != 0) {
+        file.statError = errno;
+        return;
+    }
+    if (S_ISREG(file.info.st_mode)) {
+        file.fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    }
+}
+
+bool OpenFileCache::sameFile(const struct stat& a, const struct stat& b) {
+    return a.st_ino == b.st_ino && a.st_dev == b.st_dev && a.st_size == b.st_size
+        && a.st_mtim.tv_sec == b.st_mtim.tv_sec && a.st_mtim.tv_nsec == b.st_mtim.tv_nsec
+        && a.st_mode == b.st_mode;
+}
+
+OpenFileCache::Entry* OpenFileCache::find(const std::string& path, size_t hash) const {
+    Entry* entry = __atomic_load_n(&buckets[hash & bucketMask], __ATOMIC_ACQUIRE);
+    while (entry && (entry->hash != hash || entry->path != path)) {
+        entry = __atomic_load_n(&entry->next, __ATOMIC_ACQUIRE);
+    }
+    return entry;
+}
+
+void OpenFileCache::touch(Entry* entry, time_t now) {
+    // Written only when they change, so a hot entry's line stays shared between cores
+    if (__atomic_load_n(&entry->lastUsed, __ATOMIC_RELAXED) != now) {
+        __atomic_store_n(&entry->lastUsed, now, __ATOMIC_RELAXED);
+    }
+    unsigned long stamp = __atomic_load_n(&useClock, __ATOMIC_RELAXED);
+    if (__atomic_load_n(&entry->useStamp, __ATOMIC_RELAXED) != stamp) {
+        __atomic_store_n(&entry->useStamp, stamp, __ATOMIC_RELAXED);
+    }
+}
+
+bool OpenFileCache::open(const std::string& path, OpenFile& file) {
+    if (maxEntries == 0) {
+        load(path, file);
+        file.cached = false;
+        return false;
+    }
+
+    time_t now = time(NULL);
+    sweep(now);
+    Entry* entry = find(path, hashBytes(path));
+    if (entry && now - __atomic_load_n(&entry->validated, __ATOMIC_RELAXED) >= validity) {
+        // Revalidate with one stat(); an unchanged file keeps its descriptor
+        struct stat current;
+        bool exists = stat(path.c_str(), &current) == 0;
+        bool unchanged = entry->file.statError ? !exists : (exists && sameFile(current, entry->file.info));
+        if (unchanged) {
+            __atomic_store_n(&entry->validated, now, __ATOMIC_RELAXED);
+        } else {
+            remove(entry);
+            entry = NULL;
+        }
+    }
+    if (entry) {
+        touch(entry, now);
+        file = entry->file;
+        return true;
+    }
+
+    load(path, file);
+    store(path, file);
+    return false;
+}
+
+bool OpenFileCache::lookup(const std::string& path, OpenFile& file) {
+    if (maxEntries == 0) {
+        return false;
+    }
+    time_t now = time(NULL);
+    sweep(now);
+    Entry* entry = find(path, hashBytes(path));
+    if (!entry || now - __atomic_load_n(&entry->validated, __ATOMIC_RELAXED) >= validity) {
+        // Revalidating would take a stat(); the caller loads the path again instead
+        return false;
+    }
+    touch(entry, now);
+    file = entry->file;
+    return true;
+}
+
+void OpenFileCache::store(const std::string& path, OpenFile& file) {
+    file.cached = false;
+    if (maxEntries == 0 || (file.statError && !cacheErrors)) {
+        return;
+    }
+    time_t now = time(NULL);
+    Entry* entry = new Entry;
+    entry->hash = hashBytes(path);
+    entry->path = path;
+    entry->file = file;
+    entry->file.cached = true;
+    entry->validated = now;
+    entry->lastUsed = now;
+
+    pthread_mutex_lock(&writeLock);
+    Entry* previous = find(path, entry->hash);
+    if (previous) {
+        unlink(previous);
+    }
+    evictIfFull();
+    __atomic_store_n(&useClock, useClock + 1, __ATOMIC_RELAXED);
+    entry->useStamp = useClock;
+    Entry** bucket = &buckets[entry->hash & bucketMask];
+    entry->next = *bucket;
+    // Release: a reader that finds the entry sees it complete
+    __atomic_store_n(bucket, entry, __ATOMIC_RELEASE);
+    ++count;
+    pthread_mutex_unlock(&writeLock);
+    file.cached = true;
+}
+
+void OpenFileCache::readContent(const OpenFile& file, std::string& content) {
+    content.resize(file.info.st_size);
+    size_t done = 0;
+    while (done < content.length()) {
+        ssize_t n = pread(file.fd, &content[done], content.length() - done, done);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            break;
+        }
+        done += n;
+    }
+    content.resize(done);
+}
+
+bool OpenFileCache::readCached(const OpenFile& file, std::string& content) {
+    content.resize(file.info.st_size);
+    size_t done = 0;
+    while (done < content.length()) {
+        struct iovec iov;
+        iov.iov_base = &content[done];
+        iov.iov_len = content.length() - done;
+        ssize_t n = preadv2(file.fd, &iov, 1, done, RWF_NOWAIT);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            // EAGAIN: not in the page cache; EOPNOTSUPP: the file system cannot tell
+            content.clear();
+            return false;
+        }
+        done += n;
+    }
+    return true;
+}
+
+void OpenFileCache::sweep(time_t now) {
+    // Inactive entries are looked for at most once a second, by whichever reactor gets there first
+    time_t last = __atomic_load_n(&lastSweep, __ATOMIC_RELAXED);
+    if (now == last || !__atomic_compare_exchange_n(&lastSweep, &last, now, false, __ATOMIC_RELAXED,
+                                                    __ATOMIC_RELAXED)) {
+        return;
+    }
+    pthread_mutex_lock(&writeLock);
+    for (size_t i = 0; i <= bucketMask; ++i) {
+        Entry* entry = buckets[i];
+        while (entry) {
+            Entry* next = entry->next;
+            if (now - __atomic_load_n(&entry->lastUsed, __ATOMIC_RELAXED) >= inactive) {
+                unlink(entry);
+            }
+            entry = next;
+        }
+    }
+    pthread_mutex_unlock(&writeLock);
+}
+
+void OpenFileCache::evictIfFull() {
+    if (count < maxEntries) {
+        return;
+    }
+    Entry* oldest = NULL;
+    for (size_t i = 0; i <= bucketMask; ++i) {
+        for (Entry* entry = buckets[i]; entry; entry = entry->next) {
+            if (!oldest || __atomic_load_n(&entry->useStamp, __ATOMIC_RELAXED)
+                               < __atomic_load_n(&oldest->useStamp, __ATOMIC_RELAXED)) {
+                oldest = entry;
+            }
+        }
+    }
+    if (oldest) {
+        unlink(oldest);
+    }
+}
+
+void OpenFileCache::unlink(Entry* entry) {
+    // Caller holds writeLock. Readers already on the entry still find their way down its chain
+    Entry** link = &buckets[entry->hash & bucketMask];
+    while (*link != entry) {
+        link = &(*link)->next;
+    }
+    __atomic_store_n(link, entry->next, __ATOMIC_RELEASE);
+    --count;
+    epochs.retire(entry, reclaimEntry);
+}
+
+void OpenFileCache::remove(Entry* entry) {
+    pthread_mutex_lock(&writeLock);
+    // Another reactor may have replaced or dropped it meanwhile; the pointer is still
+    // safe to compare, as nothing retired is reclaimed before this reactor's next quiescent point
+    if (find(entry->path, entry->hash) == entry) {
+        unlink(entry);
+    }
+    pthread_mutex_unlock(&writeLock);
+}
+
+void OpenFileCache::reclaimEntry(void* object) {
+    Entry* entry = static_cast<Entry*>(object);
+    if (entry->file.fd >= 0) {
+        close(entry->file.fd);
+    }
+    delete entry;
+}
+
+void OpenFileCache::clear() {
+    if (maxEntries == 0) {
+        return;
+    }
+    pthread_mutex_lock(&writeLock);
+    for (size_t i = 0; i <= bucketMask; ++i) {
+        Entry* entry = buckets[i];
+        __atomic_store_n(&buckets[i], static_cast<Entry*>(NULL), __ATOMIC_RELEASE);
+        while (entry) {
+            Entry* next = entry->next;
+            epochs.retire(entry, reclaimEntry);
+            entry = next;
+        }
+    }
+    count = 0;
+    pthread_mutex_unlock(&writeLock);
+}
+
+void OpenFileCache::destroy() {
+    // No reader left (shutdown) or none started yet (configure)
+    if (!buckets) {
+        return;
+    }
+    for (size_t i = 0; i <= bucketMask; ++i) {
+        Entry* entry = buckets[i];
+        while (entry) {
+            Entry* next = entry->next;
+            reclaimEntry(entry);
+            entry = next;
+        }
+    }
+    delete[] buckets;
+    buckets = NULL;
+    bucketMask = 0;
+    count = 0;
+}
@@ -0,0 +1,855 @@
+/* ************************************************************************** */
+/*                                                                            */
+/*                                                        :::      ::::::::   */
+/*   proxy_handler.cpp                                  :+:      :+:    :+:   */
+/*                                                    +:+ +:+         +:+     */
+/*   By: aogbi <aogbi@student.42.fr>                +#+  +:+       +#+        */
+/*                                                +#+#+#+#+#+   +#+           */
+/*   Created: 2026/10/19 00:00:00 by aogbi             #+#    #+#             */
+/*   Updated: 2026/10/19 00:00:00 by aogbi            ###   ########.fr       */
+/*                                                                            */
+/* ************************************************************************** */
+
+#include "proxy_handler.hpp"
+#include "utils.hpp"
+#include <sys/socket.h>
+#include <netinet/tcp.h>
+#include <netdb.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <cerrno>
+#include <cstring>
+#include <cstdlib>
+#include <iostream>
+#include <sstream>
+
+// Request bytes kept for replaying on a fresh connection; larger bodies are
+// streamed and dropped once sent
+static const size_t REPLAY_LIMIT = 64 * 1024;
+static const size_t MAX_RESPONSE_HEAD = 64 * 1024;
+
+// Headers that describe a single hop and must not be relayed
+static bool isHopByHop(const std::string& name) {
+    return name == "connection" || name == "keep-alive" || name == "proxy-connection"
+        || name == "te" || name == "trailer" || name == "upgrade";
+}
+
+static std::string trimValue(const std::string& value) {
+    size_t start = value.find_first_not_of(" \t");
+    if (start == std::string::npos) {
+        return "";
+    }
+    size_t end = value.find_last_not_of(" \t");
+    return value.substr(start, end - start + 1);
+}
+
+ProxyHandler::ProxyHandler(const Config& config, Metrics& metrics)
+    : config(config), metrics(metrics), connections(NULL) {
+}
+
+ProxyHandler::~ProxyHandler() {
+    for (std::map<int, Session*>::iterator it = byClient.begin(); it != byClient.end(); ++it) {
+        if (it->second->upstreamFd >= 0) {
+            close(it->second->upstreamFd);
+        }
+        delete it->second;
+    }
+    for (std::map<int, std::pair<UpstreamPool*, size_t> >::iterator it = idleOwners.begin();
+         it != idleOwners.end(); ++it) {
+        close(it->first);
+    }
+}
+
+bool ProxyHandler::addPeer(UpstreamPool& pool, const std::string& address) {
+    size_t colon = address.rfind(':');
+    std::string host = (colon == std::string::npos) ? address : address.substr(0, colon);
+    std::string port = (colon == std::string::npos) ? "80" : address.substr(colon + 1);
+
+    struct addrinfo hints;
+    struct addrinfo* res = NULL;
+    std::memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_INET;
+    hints.ai_socktype = SOCK_STREAM;
+    int rc = getaddrinfo(host.c_str(), port.c_str(), &hints, &res);
+    if (rc != 0) {
+        std::cerr << "Error: Cannot resolve upstream " << address << ": " << gai_strerror(rc) << std::endl;
+        return false;
+    }
+
+    UpstreamPeer peer;
+    peer.address = host + ":" + port;
+    std::memcpy(&peer.addr, res->ai_addr, sizeof(peer.addr));
+    freeaddrinfo(res);
+    pool.peers.push_back(peer);
+    return true;
+}
+
+bool ProxyHandler::setup(ConnectionManager* manager) {
+    connections = manager;
+
+    const std::map<std::string, Upstream>& upstreams = config.getUpstreams();
+    for (std::map<std::string, Upstream>::const_iterator it = upstreams.begin(); it != upstreams.end(); ++it) {
+        UpstreamPool& pool = pools[it->first];
+        pool.leastConn = it->second.leastConn;
+        pool.keepalive = it->second.keepalive;
+        for (size_t i = 0; i < it->second.servers.size(); ++i) {
+            if (!addPeer(pool, it->second.servers[i])) {
+                return false;
+            }
+        }
+        if (pool.peers.empty()) {
+            std::cerr << "Error: Upstream " << it->first << " has no servers" << std::endl;
+            return false;
+        }
+    }
+
+    const std::vector<Location>& locations = config.getLocations();
+    for (size_t i = 0; i < locations.size(); ++i) {
+        if (isProxyLocation(&locations[i]) && !resolveTarget(locations[i].proxyPass)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+const ProxyHandler::Target* ProxyHandler::resolveTarget(const std::string& proxyPass) {
+    std::map<std::string, Target>::iterator cached = targets.find(proxyPass);
+    if (cached != targets.end()) {
+        return &cached->second;
+    }
+    if (proxyPass.compare(0, 7, "http://") != 0) {
+        std::cerr << "Error: proxy_pass only supports http:// upstreams: " << proxyPass << std::endl;
+        return NULL;
+    }
+
+    std::string rest = proxyPass.substr(7);
+    size_t slash = rest.find('/');
+    std::string authority = rest.substr(0, slash);
+
+    Target target;
+    target.hasPath = (slash != std::string::npos);
+    target.pathPrefix = target.hasPath ? rest.substr(slash) : "";
+
+    // Either a named upstream block or a literal host:port
+    std::map<std::string, UpstreamPool>::iterator pool = pools.find(authority);
+    if (pool == pools.end()) {
+        pool = pools.insert(std::make_pair(authority, UpstreamPool())).first;
+        if (!addPeer(pool->second, authority)) {
+            pools.erase(pool);
+            return NULL;
+        }
+    }
+    target.pool = &pool->second;
+    return &(targets[proxyPass] = target);
+}
+
+size_t ProxyHandler::selectPeer(UpstreamPool& pool) {
+    size_t count = pool.peers.size();
+    size_t pick = pool.next % count;
+    if (pool.leastConn) {
+        // Scan from the cursor so ties rotate instead of piling onto peer 0
+        for (size_t k = 1; k < count; ++k) {
+            size_t i = (pool.next + k) % count;
+            if (pool.peers[i].active < pool.peers[pick].active) {
+                pick = i;
+            }
+        }
+    }
+    pool.next = pick + 1;
+    return pick;
+}
+
+bool ProxyHandler::ownsFd(int fd) const {
+    return byUpstream.find(fd) != byUpstream.end() || idleOwners.find(fd) != idleOwners.end();
+}
+
+std::string ProxyHandler::buildRequestHead(const Request& req, const Location* location,
+                                           const Target& target, const std::string& rawHeaders,
+                                           const std::string& remoteAddr) const {
+    std::string uri = req.getTarget().str();
+    if (target.hasPath) {
+        // nginx semantics: a URI part in proxy_pass replaces the location prefix
+        size_t prefix = location->path.length() < uri.length() ? location->path.length() : uri.length();
+        uri = target.pathPrefix + uri.substr(prefix);
+    }
+
+    std::string head;
+    head.reserve(rawHeaders.length() + 128);
+    StringView method = req.getMethod();
+    head.append(method.data(), method.length());
+    head += ' ';
+    head += uri;
+    head += " HTTP/1.1\r\n";
+
+    // Relay the client's header lines verbatim, minus hop-by-hop ones and the body framing
+    size_t pos = rawHeaders.find('\n');
+    pos = (pos == std::string::npos) ? rawHeaders.length() : pos + 1;
+    while (pos < rawHeaders.length()) {
+        size_t eol = rawHeaders.find('\n', pos);
+        if (eol == std::string::npos) {
+            eol = rawHeaders.length();
+        }
+        size_t end = eol;
+        if (end > pos && rawHeaders[end - 1] == '\r') {
+            --end;
+        }
+        size_t lineStart = pos;
+        pos = eol + 1;
+        if (end == lineStart) {
+            break;
+        }
+        size_t colon = rawHeaders.find(':', lineStart);
+        if (colon == std::string::npos || colon >= end) {
+            continue;
+        }
+        std::string name = toLower(rawHeaders.substr(lineStart, colon - lineStart));
+        // Expect: 100-continue is answered by the server, so the upstream never sends a 100
+        if (isHopByHop(name) || name == "x-forwarded-for" || name == "expect" || name == "content-length"
+            || name == "transfer-encoding") {
+            continue;
+        }
+        head.append(rawHeaders, lineStart, end - lineStart);
+        head += "\r\n";
+    }
+
+    if (!req.hasHeader(Request::HEADER_HOST)) {
+        head += "Host: " + config.getServerName() + "\r\n";
+    }
+    // The one framing header, for the framing start() relays the body with: on a pooled
+    // connection, anything else would let the body run into the next client's request
+    if (req.isChunked()) {
+        StringView codings = req.getHeader(Request::HEADER_TRANSFER_ENCODING);
+        head += "Transfer-Encoding: ";
+        head.append(codings.data(), codings.length());
+        head += "\r\n";
+    } else if (req.hasHeader(Request::HEADER_CONTENT_LENGTH)) {
+        std::ostringstream length;
+        length << req.getContentLength();
+        head += "Content-Length: " + length.str() + "\r\n";
+    }
+    if (!remoteAddr.empty()) {
+        std::string forwardedFor = req.getHeader(Request::HEADER_X_FORWARDED_FOR).str();
+        head += "X-Forwarded-For: ";
+        if (!forwardedFor.empty()) {
+            head += forwardedFor + ", ";
+        }
+        head += remoteAddr + "\r\n";
+    }
+    head += config.isSsl() ? "X-Forwarded-Proto: https\r\n" : "X-Forwarded-Proto: http\r\n";
+    if (target.pool->keepalive == 0) {
+        head += "Connection: close\r\n";
+    }
+    head += "\r\n";
+    return head;
+}
+
+void ProxyHandler::start(int clientFd, const Request& req, const Location* location, size_t headerEnd) {
+    ClientConnection* client = connections->findClient(clientFd);
+    if (!client) {
+        return;
+    }
+    std::map<std::string, Target>::const_iterator target = targets.find(location->proxyPass);
+    if (target == targets.end()) {
+        metrics.recordStatus(502);
+        connections->sendErrorResponse(clientFd, 502, "Bad Gateway");
+        connections->finishResponse(clientFd);
+        return;
+    }
+
+    Session* session = new Session();
+    session->clientFd = clientFd;
+    session->upstreamFd = -1;
+    session->pool = target->second.pool;
+    session->peer = 0;
+    session->attempts = 1;
+    session->reused = false;
+    session->connecting = false;
+    session->toUpstreamOffset = 0;
+    session->replayable = true;
+    session->requestBodyBytes = 0;
+    session->requestDone = false;
+    session->headersForwarded = false;
+    session->responseStarted = false;
+    session->upstreamKeepAlive = false;
+    session->headRequest = (req.getMethod() == "HEAD");
+    session->clientHttp11 = (req.getVersion() == "HTTP/1.1");
+    session->clientPaused = false;
+    session->upstreamPaused = false;
+    session->timeout = location->proxyTimeout;
+    session->lastActivity = time(NULL);
+    session->startMicros = Metrics::nowMicros();
+
+    if (req.isChunked()) {
+        session->requestBody.setChunked();
+    } else if (req.hasHeader(Request::HEADER_CONTENT_LENGTH)) {
+        session->requestBody.setLength(req.getContentLength());
+    }
+    session->toUpstream = buildRequestHead(req, location, target->second,
+                                           client->buffer.substr(0, headerEnd), client->remoteAddr);
+    byClient[clientFd] = session;
+
+    // Body bytes that arrived in the same reads as the headers
+    const char* body = client->buffer.data() + headerEnd;
+    size_t taken = session->requestBody.consume(body, client->buffer.length() - headerEnd);
+    if (session->requestBody.failed()) {
+        fail(session, 400, "Bad Request");
+        return;
+    }
+    if (!relayBody(session, body, taken)) {
+        return;
+    }
+
+    session->peer = selectPeer(*session->pool);
+    if (!connectUpstream(session, true)) {
+        retryOrFail(session);
+    }
+}
+
+bool ProxyHandler::connectUpstream(Session* session, bool allowPooled) {
+    UpstreamPeer& peer = session->pool->peers[session->peer];
+
+    if (allowPooled && !peer.idle.empty()) {
+        int fd = peer.idle.back().fd;
+        peer.idle.pop_back();
+        idleOwners.erase(fd);
+        session->upstreamFd = fd;
+        session->reused = true;
+        session->connecting = false;
+        peer.active++;
+        byUpstream[fd] = session;
+        metrics.recordUpstreamConnect(true);
+        updateUpstreamEvents(session);
+        return true;
+    }
+
+    int fd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+        std::cerr << "❌ Upstream socket failed: " << strerror(errno) << std::endl;
+        return false;
+    }
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL, 0) | O_NONBLOCK);
+    int one = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+
+    int rc = connect(fd, reinterpret_cast<struct sockaddr*>(&peer.addr), sizeof(peer.addr));
+    if (rc < 0 && errno != EINPROGRESS) {
+        std::cerr << "❌ Upstream " << peer.address << " connect failed: " << strerror(errno) << std::endl;
+        close(fd);
+        return false;
+    }
+
+    session->upstreamFd = fd;
+    session->reused = false;
+    session->connecting = (rc < 0);
+    peer.active++;
+    byUpstream[fd] = session;
+    connections->addWatch(fd, 0);
+    metrics.recordUpstreamConnect(false);
+    updateUpstreamEvents(session);
+    return true;
+}
+
+void ProxyHandler::releaseUpstream(Session* session, bool reusable) {
+    int fd = session->upstreamFd;
+    if (fd < 0) {
+        return;
+    }
+    UpstreamPeer& peer = session->pool->peers[session->peer];
+    peer.active--;
+    byUpstream.erase(fd);
+    session->upstreamFd = -1;
+
+    if (reusable && peer.idle.size() < session->pool->keepalive) {
+        // Parked connections are watched for the server closing them
+        UpstreamPeer::IdleConnection idle;
+        idle.fd = fd;
+        idle.since = time(NULL);
+        peer.idle.push_back(idle);
+        idleOwners[fd] = std::make_pair(session->pool, session->peer);
+        connections->setEvents(fd, POLLIN);
+        return;
+    }
+    connections->removeWatch(fd);
+    close(fd);
+}
+
+bool ProxyHandler::retryOrFail(Session* session) {
+    bool wasReused = session->reused;
+    metrics.recordUpstreamFailure();
+    while (session->replayable && session->attempts <= session->pool->peers.size()) {
+        session->attempts++;
+        // A stale pooled connection is retried on the same server
+        if (!wasReused) {
+            session->peer = selectPeer(*session->pool);
+        }
+        wasReused = false;
+        session->toUpstreamOffset = 0;
+        session->responseHead.clear();
+        session->responseStarted = false;
+        if (connectUpstream(session, false)) {
+            return true;
+        }
+        metrics.recordUpstreamFailure();
+    }
+    fail(session, 502, "Bad Gateway");
+    return false;
+}
+
+bool ProxyHandler::upstreamError(Session* session) {
+    releaseUpstream(session, false);
+    if (!session->responseStarted) {
+        return retryOrFail(session);
+    }
+    metrics.recordUpstreamFailure();
+    fail(session, 502, "Bad Gateway");
+    return false;
+}
+
+void ProxyHandler::destroy(Session* session) {
+    byClient.erase(session->clientFd);
+    delete session;
+}
+
+void ProxyHandler::fail(Session* session, int statusCode, const std::string& message) {
+    releaseUpstream(session, false);
+    int clientFd = session->clientFd;
+    bool canRespond = !session->headersForwarded;
+    destroy(session);
+
+    if (canRespond) {
+        metrics.recordStatus(statusCode);
+        connections->sendErrorResponse(clientFd, statusCode, message);
+        connections->finishResponse(clientFd);
+    } else {
+        // Part of the response is already out; closing is the only signal left
+        connections->removeClient(clientFd);
+    }
+}
+
+void ProxyHandler::finish(Session* session) {
+    bool reusable = session->upstreamKeepAlive && session->requestDone
+        && session->toUpstreamOffset == session->toUpstream.length();
+    releaseUpstream(session, reusable);
+    int clientFd = session->clientFd;
+    destroy(session);
+    connections->finishResponse(clientFd);
+}
+
+void ProxyHandler::updateUpstreamEvents(Session* session) {
+    short events = 0;
+    if (session->connecting) {
+        events = POLLOUT;
+    } else {
+        if (session->toUpstreamOffset < session->toUpstream.length()) {
+            events |= POLLOUT;
+        }
+        if (!session->upstreamPaused) {
+            events |= POLLIN;
+        }
+    }
+    connections->setEvents(session->upstreamFd, events);
+}
+
+bool ProxyHandler::writeUpstream(Session* session) {
+    while (session->toUpstreamOffset < session->toUpstream.length()) {
+        ssize_t sent = send(session->upstreamFd, session->toUpstream.data() + session->toUpstreamOffset,
+                            session->toUpstream.length() - session->toUpstreamOffset, MSG_NOSIGNAL);
+        if (sent < 0) {
+            if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                break;
+            }
+            if (errno == EINTR) {
+                continue;
+            }
+            return upstreamError(session);
+        }
+        session->toUpstreamOffset += sent;
+        session->lastActivity = time(NULL);
+    }
+
+    if (session->toUpstream.length() > REPLAY_LIMIT) {
+        session->replayable = false;
+        session->toUpstream.erase(0, session->toUpstreamOffset);
+        session->toUpstreamOffset = 0;
+    }
+    size_t pending = session->toUpstream.length() - session->toUpstreamOffset;
+    if (session->clientPaused && pending < HIGH_WATER) {
+        session->clientPaused = false;
+        connections->setEvents(session->clientFd, connections->getEvents(session->clientFd) | POLLIN);
+    }
+    updateUpstreamEvents(session);
+    return true;
+}
+
+bool ProxyHandler::forwardBody(Session* session, const char* data, size_t length) {
+    size_t body = session->responseBody.consume(data, length);
+    if (session->responseBody.failed()) {
+        metrics.recordUpstreamFailure();
+        fail(session, 502, "Bad Gateway");
+        return false;
+    }
+    if (body > 0 && !connections->queueWrite(session->clientFd, data, body)) {
+        int clientFd = session->clientFd;
+        releaseUpstream(session, false);
+        destroy(session);
+        connections->removeClient(clientFd);
+        return false;
+    }
+    if (session->responseBody.complete()) {
+        if (body < length) {
+            session->upstreamKeepAlive = false; // bytes after the response: do not trust the connection
+        }
+        finish(session);
+        return false;
+    }
+
+    ClientConnection* client = connections->findClient(session->clientFd);
+    if (client && client->pendingOutput() > HIGH_WATER && !session->upstreamPaused) {
+        session->upstreamPaused = true;
+        updateUpstreamEvents(session);
+    }
+    return true;
+}
+
+bool ProxyHandler::sendResponseHead(Session* session, size_t headerEnd) {
+    const std::string& head = session->responseHead;
+    size_t lineEnd = head.find('\n');
+    std::string statusLine = head.substr(0, lineEnd);
+    if (!statusLine.empty() && statusLine[statusLine.length() - 1] == '\r') {
+        statusLine.erase(statusLine.length() - 1);
+    }
+    size_t space = statusLine.find(' ');
+    if (statusLine.compare(0, 5, "HTTP/") != 0 || space == std::string::npos) {
+        metrics.recordUpstreamFailure();
+        fail(session, 502, "Bad Gateway");
+        return false;
+    }
+    std::string version = statusLine.substr(0, space);
+    int status = std::atoi(statusLine.c_str() + space + 1);
+
+    bool chunked = false;
+    bool hasLength = false;
+    uint64_t contentLength = 0;
+    bool connectionClose = false;
+    bool connectionKeepAlive = false;
+
+    std::string out;
+    out.reserve(headerEnd + 32);
+    out += "HTTP/1.1";
+    out.append(statusLine, space, std::string::npos);
+    out += "\r\n";
+
+    size_t pos = lineEnd + 1;
+    while (pos < headerEnd) {
+        size_t eol = head.find('\n', pos);
+        if (eol == std::string::npos || eol > headerEnd) {
+            eol = headerEnd;
+        }
+        size_t end = eol;
+        if (end > pos && head[end - 1] == '\r') {
+            --end;
+        }
+        size_t lineStart = pos;
+        pos = eol + 1;
+        if (end == lineStart) {
+            break;
+        }
+        size_t colon = head.find(':', lineStart);
+        if (colon == std::string::npos || colon >= end) {
+            continue;
+        }
+        std::string name = toLower(head.substr(lineStart, colon - lineStart));
+        if (name == "connection") {
+            std::string value = toLower(head.substr(colon + 1, end - colon - 1));
+            connectionClose = connectionClose || value.find("close") != std::string::npos;
+            connectionKeepAlive = connectionKeepAlive || value.find("keep-alive") != std::string::npos;
+            continue;
+        }
+        if (isHopByHop(name)) {
+            continue;
+        }
+        if (name == "transfer-encoding") {
+            chunked = toLower(head.substr(colon + 1, end - colon - 1)).find("chunked") != std::string::npos;
+        } else if (name == "content-length") {
+            hasLength = true;
+            contentLength = std::strtoull(trimValue(head.substr(colon + 1, end - colon - 1)).c_str(), NULL, 10);
+        }
+        out.append(head, lineStart, end - lineStart);
+        out += "\r\n";
+    }
+    out += "Connection: close\r\n\r\n";
+
+    if (session->headRequest || status == 204 || status == 304) {
+        session->responseBody.setNone();
+    } else if (chunked) {
+        session->responseBody.setChunked();
+    } else if (hasLength) {
+        session->responseBody.setLength(contentLength);
+    } else {
+        session->responseBody.setUntilClose();
+    }
+    session->upstreamKeepAlive = (version == "HTTP/1.1" ? !connectionClose : connectionKeepAlive)
+        && session->responseBody.getMode() != BodyFraming::UNTIL_CLOSE;
+
+    metrics.observePhase(Metrics::PHASE_UPSTREAM, session->startMicros);
+    metrics.recordStatus(status);
+    session->headersForwarded = true;
+    if (!connections->queueWrite(session->clientFd, out)) {
+        int clientFd = session->clientFd;
+        releaseUpstream(session, false);
+        destroy(session);
+        connections->removeClient(clientFd);
+        return false;
+    }
+    return true;
+}
+
+bool ProxyHandler::readUpstream(Session* session) {
+    char buffer[65536];
+    ssize_t received = recv(session->upstreamFd, buffer, sizeof(buffer), 0);
+    if (received < 0) {
+        if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR) {
+            return true;
+        }
+        return upstreamError(session);
+    }
+    session->lastActivity = time(NULL);
+    connections->updateClientActivity(session->clientFd);
+
+    if (received == 0) {
+        if (session->headersForwarded && session->responseBody.getMode() == BodyFraming::UNTIL_CLOSE) {
+            session->upstreamKeepAlive = false;
+            finish(session);
+            return false;
+        }
+        return upstreamError(session);
+    }
+
+    session->responseStarted = true;
+    if (session->headersForwarded) {
+        return forwardBody(session, buffer, received);
+    }
+
+    session->responseHead.append(buffer, received);
+    for (;;) {
+        size_t headerEnd = ConnectionManager::findHeaderEnd(session->responseHead);
+        if (headerEnd == std::string::npos) {
+            if (session->responseHead.length() > MAX_RESPONSE_HEAD) {
+                metrics.recordUpstreamFailure();
+                fail(session, 502, "Bad Gateway");
+                return false;
+            }
+            return true;
+        }
+
+        // Interim 1xx responses are relayed (100-continue) and the final one parsed next
+        int status = std::atoi(session->responseHead.c_str() + session->responseHead.find(' ') + 1);
+        if (status >= 100 && status < 200) {
+            if (status == 101) {
+                metrics.recordUpstreamFailure();
+                fail(session, 502, "Bad Gateway");
+                return false;
+            }
+            if (session->clientHttp11
+                && !connections->queueWrite(session->clientFd, session->responseHead.data(), headerEnd)) {
+                int clientFd = session->clientFd;
+                releaseUpstream(session, false);
+                destroy(session);
+                connections->removeClient(clientFd);
+                return false;
+            }
+            session->responseHead.erase(0, headerEnd);
+            continue;
+        }
+
+        if (!sendResponseHead(session, headerEnd)) {
+            return false;
+        }
+        std::string rest = session->responseHead.substr(headerEnd);
+        std::string().swap(session->responseHead);
+        if (!rest.empty()) {
+            return forwardBody(session, rest.data(), rest.length());
+        }
+        if (session->responseBody.complete()) {
+            finish(session);
+            return false;
+        }
+        return true;
+    }
+}
+
+bool ProxyHandler::relayBody(Session* session, const char* data, size_t length) {
+    session->requestBodyBytes += length;
+    size_t limit = config.getClientMaxBodySize();
+    if (limit > 0 && session->requestBodyBytes > limit) {
+        fail(session, 413, "Payload Too Large");
+        return false;
+    }
+    session->toUpstream.append(data, length);
+    session->requestDone = session->requestBody.complete();
+    if (session->requestDone) {
+        // Ends the client's request read phase, so its min-rate timeout no longer applies
+        ClientConnection* client = connections->findClient(session->clientFd);
+        if (client) {
+            client->requestComplete = true;
+        }
+    }
+    return true;
+}
+
+void ProxyHandler::onClientData(int clientFd, const char* data, size_t length) {
+    std::map<int, Session*>::iterator it = byClient.find(clientFd);
+    if (it == byClient.end()) {
+        return;
+    }
+    Session* session = it->second;
+    if (session->requestDone) {
+        return; // anything after the request is dropped; the connection closes after the response
+    }
+
+    size_t body = session->requestBody.consume(data, length);
+    if (session->requestBody.failed()) {
+        fail(session, 400, "Bad Request");
+        return;
+    }
+    if (!relayBody(session, data, body)) {
+        return;
+    }
+
+    if (session->upstreamFd >= 0 && !session->connecting && !writeUpstream(session)) {
+        return;
+    }
+    if (session->upstreamFd >= 0 && session->connecting) {
+        updateUpstreamEvents(session);
+    }
+    if (!session->clientPaused && session->toUpstream.length() - session->toUpstreamOffset >= HIGH_WATER) {
+        session->clientPaused = true;
+        connections->setEvents(clientFd, connections->getEvents(clientFd) & ~POLLIN);
+    }
+}
+
+void ProxyHandler::onClientEof(int clientFd) {
+    std::map<int, Session*>::iterator it = byClient.find(clientFd);
+    if (it == byClient.end()) {
+        return;
+    }
+    Session* session = it->second;
+    if (session->requestDone) {
+        // Half-closed client: keep streaming the response
+        connections->setEvents(clientFd, connections->getEvents(clientFd) & ~POLLIN);
+        return;
+    }
+    releaseUpstream(session, false);
+    destroy(session);
+    connections->removeClient(clientFd);
+}
+
+void ProxyHandler::onClientDrained(int clientFd) {
+    std::map<int, Session*>::iterator it = byClient.find(clientFd);
+    if (it == byClient.end() || !it->second->upstreamPaused) {
+        return;
+    }
+    ClientConnection* client = connections->findClient(clientFd);
+    if (client && client->pendingOutput() < HIGH_WATER / 2) {
+        it->second->upstreamPaused = false;
+        it->second->lastActivity = time(NULL);
+        updateUpstreamEvents(it->second);
+    }
+}
+
+void ProxyHandler::onClientClosed(int clientFd) {
+    std::map<int, Session*>::iterator it = byClient.find(clientFd);
+    if (it == byClient.end()) {
+        return;
+    }
+    releaseUpstream(it->second, false);
+    destroy(it->second);
+}
+
+void ProxyHandler::handleIdleEvent(int fd) {
+    // Data or EOF on a parked connection means the server gave up on it
+    std::map<int, std::pair<UpstreamPool*, size_t> >::iterator owner = idleOwners.find(fd);
+    std::vector<UpstreamPeer::IdleConnection>& idle = owner->second.first->peers[owner->second.second].idle;
+    for (size_t i = 0; i < idle.size(); ++i) {
+        if (idle[i].fd == fd) {
+            idle.erase(idle.begin() + i);
+            break;
+        }
+    }
+    idleOwners.erase(owner);
+    connections->removeWatch(fd);
+    close(fd);
+}
+
+void ProxyHandler::handleEvent(int fd, short revents) {
+    if (idleOwners.find(fd) != idleOwners.end()) {
+        handleIdleEvent(fd);
+        return;
+    }
+    std::map<int, Session*>::iterator it = byUpstream.find(fd);
+    if (it == byUpstream.end()) {
+        return;
+    }
+    Session* session = it->second;
+
+    if (session->connecting) {
+        if (!(revents & (POLLOUT | POLLERR | POLLHUP))) {
+            return;
+        }
+        int error = 0;
+        socklen_t length = sizeof(error);
+        if (getsockopt(fd, SOL_SOCKET, SO_ERROR, &error, &length) < 0 || error != 0) {
+            std::cerr << "❌ Upstream " << session->pool->peers[session->peer].address
+                      << " connect failed: " << strerror(error ? error : errno) << std::endl;
+            upstreamError(session);
+            return;
+        }
+        session->connecting = false;
+        session->lastActivity = time(NULL);
+        if (!writeUpstream(session)) {
+            return;
+        }
+    }
+
+    if ((revents & (POLLIN | POLLHUP | POLLERR)) && !readUpstream(session)) {
+        return;
+    }
+    if ((revents & POLLOUT) && !writeUpstream(session)) {
+        return;
+    }
+}
+
+void ProxyHandler::handleTimeouts() {
+    time_t now = time(NULL);
+
+    std::vector<Session*> expired;
+    for (std::map<int, Session*>::iterator it = byClient.begin(); it != byClient.end(); ++it) {
+        Session* session = it->second;
+        // A paused upstream is waiting on the client, whose own timeout applies
+        if (!session->upstreamPaused && now - session->lastActivity > session->timeout) {
+            expired.push_back(session);
+        }
+    }
+    for (size_t i = 0; i < expired.size(); ++i) {
+        std::cerr << "⏱️  Upstream timed out for client " << expired[i]->clientFd << std::endl;
+        metrics.recordUpstreamFailure();
+        fail(expired[i], 504, "Gateway Timeout");
+    }
+
+    for (std::map<std::string, UpstreamPool>::iterator pool = pools.begin(); pool != pools.end(); ++pool) {
+        for (size_t p = 0; p < pool->second.peers.size(); ++p) {
+            std::vector<UpstreamPeer::IdleConnection>& idle = pool->second.peers[p].idle;
+            size_t kept = 0;
+            for (size_t i = 0; i < idle.size(); ++i) {
+                if (now - idle[i].since > IDLE_TIMEOUT) {
+                    idleOwners.erase(idle[i].fd);
+                    connections->removeWatch(idle[i].fd);
+                    close(idle[i].fd);
+                } else {
+                    idle[kept++] = idle[i];
+                }
+            }
+            idle.resize(kept);
+        }
+    }
+}
@@ -6,166 +6,469 @@
 /*   By: aogbi <aogbi@student.42.fr>                +#+  +:+       +#+        */
 /*                                                +#+#+#+#+#+   +#+           */
 /*   Created: 2025/08/19 23:02:46 by aogbi             #+#    #+#             */
-/*   Updated: 2025/09/05 16:40:38 by aogbi            ###   ########.fr       */
+/*   Updated: 2026/10/19 00:00:00 by aogbi            ###   ########.fr       */
 /*                                                                            */
 /* ************************************************************************** */
 
 #include "request.hpp"
+#include "byte_scan.hpp"
+#include "utils.hpp"
+#include <cstring>
 
-Request::Request() {}
+// Lowercase names of the HeaderId slots
+static const char *const KNOWN_NAMES[Request::HEADER_COUNT] = {
+	"host", "content-length", "content-type", "transfer-encoding", "connection",
+	"expect", "upgrade", "http2-settings", "x-forwarded-for"
+};
 
-bool Request::parse(const std::string &raw) {
-	// Clear any previous data
-	method.clear();
-	path.clear();
-	version.clear();
-	headers.clear();
-	body.clear();
+struct KnownHashes {
+	uint32_t values[Request::HEADER_COUNT];
 	
-	if (raw.empty()) {
-		return false;
+	KnownHashes() {
+		for (int i = 0; i < Request::HEADER_COUNT; ++i) {
+			values[i] = hashLower(KNOWN_NAMES[i]);
+		}
 	}
-	
-	// Find the end of headers (double CRLF or double LF)
-	size_t headerEnd = raw.find("\r\n\r\n");
-	bool useCRLF = true;
-	
-	if (headerEnd == std::string::npos) {
-		headerEnd = raw.find("\n\n");
-		useCRLF = false;
-		if (headerEnd == std::string::npos) {
-			// No body separator found, treat entire request as headers
-			headerEnd = raw.length();
+};
+
+static const KnownHashes knownHashes;
+
+// HeaderId of a name, or -1
+static int knownHeader(const StringView &name, uint32_t hash) {
+	for (int i = 0; i < Request::HEADER_COUNT; ++i) {
+		if (knownHashes.values[i] == hash && name.equalsIgnoreCase(KNOWN_NAMES[i])) {
+			return i;
+		}
+	}
+	return -1;
+}
+
+Request::Request()
+	: arena(storage, sizeof(storage)), head(ArenaAllocator<char>(&arena)), fields(ArenaAllocator<char>(&arena)) {
+	method = target = path = query = version = makeSpan(0, 0);
+	for (int i = 0; i < HEADER_COUNT; ++i) {
+		known[i] = -1;
+	}
+}
+
+Request::Request(const Request &other)
+	: arena(storage, sizeof(storage)), head(ArenaAllocator<char>(&arena)), fields(ArenaAllocator<char>(&arena)) {
+	copyFrom(other);
+}
+
+Request &Request::operator=(const Request &other) {
+	if (this != &other) {
+		clear();
+		copyFrom(other);
+	}
+	return *this;
+}
+
+void Request::clear() {
+	// Every container lets go of its arena memory before the arena is rewound
+	ArenaAllocator<char> alloc(&arena);
+	ArenaString(alloc).swap(head);
+	FieldList(alloc).swap(fields);
+	arena.reset();
+	body.clear();
+	method = target = path = query = version = makeSpan(0, 0);
+	for (int i = 0; i < HEADER_COUNT; ++i) {
+		known[i] = -1;
+	}
+}
+
+void Request::copyFrom(const Request &other) {
+	// Spans are offsets, so they stay valid over a copy of the head
+	head.assign(other.head.data(), other.head.length());
+	body = other.body;
+	fields.assign(other.fields.begin(), other.fields.end());
+	method = other.method;
+	target = other.target;
+	path = other.path;
+	query = other.query;
+	version = other.version;
+	for (int i = 0; i < HEADER_COUNT; ++i) {
+		known[i] = other.known[i];
+	}
+}
+
+Request::Span Request::makeSpan(size_t start, size_t end) {
+	Span span;
+	span.offset = static_cast<uint32_t>(start);
+	span.length = static_cast<uint32_t>(end - start);
+	return span;
+}
+
+StringView Request::view(const Span &span) const {
+	return StringView(head.data() + span.offset, span.length);
+}
+
+int Request::findField(const StringView &name, uint32_t hash) const {
+	for (size_t i = 0; i < fields.size(); ++i) {
+		if (fields[i].hash == hash && view(fields[i].name).equalsIgnoreCase(name)) {
+			return static_cast<int>(i);
+		}
+	}
+	return -1;
+}
+
+int Request::lookup(const StringView &name) const {
+	uint32_t hash = hashLower(name);
+	int id = knownHeader(name, hash);
+	return id >= 0 ? known[id] : findField(name, hash);
+}
+
+static bool isBlank(char c) {
+	return c == ' ' || c == '\t';
+}
+
+// Next blank-separated word of [pos, end), as istream >> would read it
+static bool nextWord(const char *data, size_t &pos, size_t end, size_t &start) {
+	while (pos < end && std::isspace(static_cast<unsigned char>(data[pos]))) {
+		++pos;
+	}
+	start = pos;
+	while (pos < end && !std::isspace(static_cast<unsigned char>(data[pos]))) {
+		++pos;
+	}
+	return pos > start;
+}
+
+static int hexValue(char c) {
+	if (c >= '0' && c <= '9') {
+		return c - '0';
+	}
+	c = StringView::lower(c);
+	return (c >= 'a' && c <= 'f') ? c - 'a' + 10 : -1;
+}
+
+// Decode %XX escapes over [path, path + length), shrinking length; a bad escape or a NUL fails
+static bool percentDecode(char *path, size_t &length) {
+	size_t out = 0;
+	for (size_t i = 0; i < length; ++i) {
+		char c = path[i];
+		if (c == '%') {
+			int high = i + 2 < length ? hexValue(path[i + 1]) : -1;
+			int low = high >= 0 ? hexValue(path[i + 2]) : -1;
+			if (low < 0 || (high == 0 && low == 0)) {
+				return false;
+			}
+			c = static_cast<char>(high * 16 + low);
+			i += 2;
+		}
+		path[out++] = c;
+	}
+	length = out;
+	return true;
+}
+
+// Drop "." segments and empty ones, and let ".." eat its parent (RFC 3986 section 5.2.4);
+// a ".." above the root fails. path starts with '/'
+static bool removeDotSegments(char *path, size_t &length) {
+	size_t out = 0;
+	size_t pos = 0;
+	while (pos < length) {
+		size_t segmentEnd = pos + 1;
+		while (segmentEnd < length && path[segmentEnd] != '/') {
+			++segmentEnd;
+		}
+		size_t segment = segmentEnd - pos - 1;
+		bool last = segmentEnd == length;
+		if (segment == 0 && !last) {
+			// Repeated slash
+		} else if (segment == 1 && path[pos + 1] == '.') {
+			if (last) {
+				path[out++] = '/';
+			}
+		} else if (segment == 2 && path[pos + 1] == '.' && path[pos + 2] == '.') {
+			if (out == 0) {
+				return false;
+			}
+			while (path[--out] != '/') {
+			}
+			if (last) {
+				path[out++] = '/';
+			}
+		} else {
+			std::memmove(path + out, path + pos, segmentEnd - pos);
+			out += segmentEnd - pos;
 		}
+		pos = segmentEnd;
+	}
+	if (out == 0) {
+		path[out++] = '/';
+	}
+	length = out;
+	return true;
+}
+
+bool Request::splitTarget() {
+	StringView raw = view(target);
+	size_t pathEnd = raw.length();
+	size_t fragment = raw.find('#');
+	if (fragment != StringView::npos) {
+		pathEnd = fragment;
+	}
+	size_t mark = raw.substr(0, pathEnd).find('?');
+	if (mark != StringView::npos) {
+		query = makeSpan(target.offset + mark + 1, target.offset + pathEnd);
+		pathEnd = mark;
 	}
 	
-	// Parse headers section
-	std::string headerSection = raw.substr(0, headerEnd);
-	std::istringstream stream(headerSection);
-	std::string line;
+	// Only origin-form targets name a file; "*" and the like are left alone
+	if (pathEnd == 0 || raw[0] != '/') {
+		path = makeSpan(target.offset, target.offset + pathEnd);
+		return true;
+	}
 	
-	// Parse request line
-	if (!std::getline(stream, line)) {
+	// Decoded in place in a copy after the head, so the raw target stays intact
+	size_t start = head.length();
+	head.append(head, target.offset, pathEnd);
+	size_t length = pathEnd;
+	char *decoded = &head[start];
+	if (!percentDecode(decoded, length) || !removeDotSegments(decoded, length)) {
 		return false;
 	}
+	head.resize(start + length);
+	path = makeSpan(start, start + length);
+	return true;
+}
+
+bool Request::parse(const std::string &raw, bool withBody) {
+	// Clear any previous data
+	clear();
 	
-	// Remove trailing \r if present
-	if (!line.empty() && line[line.length() - 1] == '\r') {
-		line.erase(line.length() - 1);
+	if (raw.empty()) {
+		return false;
 	}
 	
-	std::istringstream firstLine(line);
-	if (!(firstLine >> method >> path >> version)) {
+	// Find the end of headers (double CRLF or double LF)
+	size_t separator = 0;
+	size_t headerEnd = ByteScan::findHeadEnd(raw.data(), raw.length(), separator);
+	if (headerEnd == ByteScan::npos) {
+		// No body separator found, treat entire request as headers
+		headerEnd = raw.length();
+	}
+	if (headerEnd == 0) {
 		return false;
 	}
 	
-	// Parse headers
-	while (std::getline(stream, line)) {
-		// Remove trailing \r if present
-		if (!line.empty() && line[line.length() - 1] == '\r') {
-			line.erase(line.length() - 1);
+	// The one copy of the head; everything else points into it. Room is left
+	// for the decoded path, which can only be shorter than the request line
+	const void *firstNewline = std::memchr(raw.data(), '\n', headerEnd);
+	size_t firstLine = firstNewline ? static_cast<const char *>(firstNewline) - raw.data() : headerEnd;
+	// Spans are 32-bit; header limits keep real heads far below that
+	if (static_cast<uint64_t>(headerEnd) + firstLine > 0xffffffffu) {
+		return false;
+	}
+	head.reserve(headerEnd + firstLine);
+	head.assign(raw.data(), headerEnd);
+	const char *data = head.data();
+	fields.reserve(INLINE_FIELDS);
+	size_t lineStart = 0;
+	bool requestLine = true;
+	while (lineStart < headerEnd) {
+		// Header lines are scanned once for whichever of ':' and '\n' comes first
+		size_t colon = ByteScan::npos;
+		size_t next;
+		if (requestLine) {
+			const void *newline = std::memchr(data + lineStart, '\n', headerEnd - lineStart);
+			next = newline ? static_cast<const char *>(newline) - data : headerEnd;
+		} else {
+			next = lineStart + ByteScan::findColonOrNewline(data + lineStart, headerEnd - lineStart);
+			if (next < headerEnd && data[next] == ':') {
+				colon = next;
+				const void *newline = std::memchr(data + colon, '\n', headerEnd - colon);
+				next = newline ? static_cast<const char *>(newline) - data : headerEnd;
+			}
 		}
+		size_t lineEnd = next;
 		
-		if (line.empty()) {
-			break; // End of headers
+		// Remove trailing \r if present
+		if (lineEnd > lineStart && data[lineEnd - 1] == '\r') {
+			--lineEnd;
 		}
 		
-		size_t colon = line.find(":");
-		if (colon != std::string::npos) {
-			std::string key = line.substr(0, colon);
-			std::string value = line.substr(colon + 1);
-			
-			// Trim leading whitespace from value
-			while (!value.empty() && (value[0] == ' ' || value[0] == '\t')) {
-				value.erase(0, 1);
+		if (requestLine) {
+			// Parse request line
+			size_t pos = lineStart;
+			size_t start;
+			if (!nextWord(data, pos, lineEnd, start)) {
+				return false;
 			}
-			
-			// Trim trailing whitespace from value
-			while (!value.empty() && (value[value.length()-1] == ' ' || value[value.length()-1] == '\t')) {
-				value.erase(value.length()-1);
+			method = makeSpan(start, pos);
+			if (!ByteScan::isToken(data + start, pos - start)) {
+				return false;
 			}
+			if (!nextWord(data, pos, lineEnd, start)) {
+				return false;
+			}
+			target = makeSpan(start, pos);
+			if (!nextWord(data, pos, lineEnd, start)) {
+				return false;
+			}
+			version = makeSpan(start, pos);
+			requestLine = false;
+		} else if (lineEnd == lineStart) {
+			break; // End of headers
+		} else if (colon != ByteScan::npos) {
+			// Field names are tokens: no whitespace before the colon (RFC 9112 section 5.1)
+			if (!ByteScan::isToken(data + lineStart, colon - lineStart)) {
+				return false;
+			}
+			size_t valueStart = colon + 1;
+			size_t valueEnd = lineEnd;
 			
-			// Convert header name to lowercase for case-insensitive comparison
-			for (size_t i = 0; i < key.length(); ++i) {
-				key[i] = std::tolower(key[i]);
+			// Trim whitespace around the value
+			while (valueStart < valueEnd && isBlank(data[valueStart])) {
+				++valueStart;
+			}
+			while (valueEnd > valueStart && isBlank(data[valueEnd - 1])) {
+				--valueEnd;
 			}
 			
-			headers[key] = value;
+			// A repeated header keeps its last value; a second, different length is a 400
+			StringView name(data + lineStart, colon - lineStart);
+			uint32_t hash = hashLower(name);
+			int id = knownHeader(name, hash);
+			int index = id >= 0 ? known[id] : findField(name, hash);
+			if (index >= 0 && id == HEADER_CONTENT_LENGTH
+				&& view(fields[index].value) != StringView(data + valueStart, valueEnd - valueStart)) {
+				return false;
+			}
+			if (index >= 0) {
+				fields[index].value = makeSpan(valueStart, valueEnd);
+			} else {
+				HeaderField field;
+				field.hash = hash;
+				field.name = makeSpan(lineStart, colon);
+				field.value = makeSpan(valueStart, valueEnd);
+				fields.push_back(field);
+				if (id >= 0) {
+					known[id] = static_cast<int>(fields.size() - 1);
+				}
+			}
 		}
+		lineStart = next + 1;
+	}
+	if (requestLine || !splitTarget()) {
+		return false;
+	}
+	// A length that is not plain digits, or does not fit, is a 400 (RFC 9112 section 6.3),
+	// and so is a body framed twice or by a coding that does not end in chunked
+	size_t contentLength;
+	if (known[HEADER_CONTENT_LENGTH] >= 0 && !parseDigits(getHeader(HEADER_CONTENT_LENGTH), contentLength)) {
+		return false;
+	}
+	if (known[HEADER_TRANSFER_ENCODING] >= 0 && (known[HEADER_CONTENT_LENGTH] >= 0 || !isChunked())) {
+		return false;
 	}
 	
 	// Parse body if present
-	if (headerEnd < raw.length()) {
-		size_t bodyStart = headerEnd + (useCRLF ? 4 : 2);
+	if (withBody && headerEnd < raw.length()) {
+		size_t bodyStart = headerEnd + separator;
 		if (bodyStart < raw.length()) {
-			body = raw.substr(bodyStart);
+			body.assign(raw.data() + bodyStart, raw.length() - bodyStart);
 		}
 	}
 	
 	return true;
 }
 
-std::string Request::getMethod() const {
-	return method;
+StringView Request::getMethod() const {
+	return view(method);
+}
+
+StringView Request::getTarget() const {
+	return view(target);
 }
 
-std::string Request::getPath() const {
-	return path;
+StringView Request::getPath() const {
+	return view(path);
 }
 
-std::string Request::getVersion() const {
-	return version;
+StringView Request::getQuery() const {
+	return view(query);
 }
 
-std::string Request::getHeader(const std::string &key) const {
-	std::map<std::string, std::string>::const_iterator it = headers.find(key);
-	if (it != headers.end())
-		return it->second;
-	return "";
+StringView Request::getVersion() const {
+	return view(version);
 }
 
-std::string Request::getBody() const {
+StringView Request::getHeader(const StringView &key) const {
+	int index = lookup(key);
+	return index >= 0 ? view(fields[index].value) : StringView();
+}
+
+StringView Request::getHeader(HeaderId id) const {
+	return known[id] >= 0 ? view(fields[known[id]].value) : StringView();
+}
+
+StringView Request::getBody() const {
+	return body.view();
+}
+
+const BodySource &Request::getBodySource() const {
 	return body;
 }
 
-const std::map<std::string, std::string>& Request::getHeaders() const {
-	return headers;
+void Request::takeBody(BodySource &source) {
+	body.clear();
+	body.swap(source);
 }
 
-bool Request::hasHeader(const std::string &key) const {
-	std::string lowerKey = key;
-	for (size_t i = 0; i < lowerKey.length(); ++i) {
-		lowerKey[i] = std::tolower(lowerKey[i]);
-	}
-	return headers.find(lowerKey) != headers.end();
+size_t Request::getHeaderCount() const {
+	return fields.size();
+}
+
+StringView Request::getHeaderName(size_t index) const {
+	return view(fields[index].name);
+}
+
+StringView Request::getHeaderValue(size_t index) const {
+	return view(fields[index].value);
+}
+
+bool Request::hasHeader(const StringView &key) const {
+	return lookup(key) >= 0;
+}
+
+bool Request::hasHeader(HeaderId id) const {
+	return known[id] >= 0;
 }
 
 size_t Request::getContentLength() const {
-	std::string contentLength = getHeader("content-length");
-	if (contentLength.empty()) {
-		return 0;
-	}
-	return static_cast<size_t>(atol(contentLength.c_str()));
+	// parse() has refused any value parseDigits does not take
+	size_t contentLength = 0;
+	parseDigits(getHeader(HEADER_CONTENT_LENGTH), contentLength);
+	return contentLength;
 }
 
 bool Request::isChunked() const {
-	std::string transferEncoding = getHeader("transfer-encoding");
-	return transferEncoding.find("chunked") != std::string::npos;
+	// The last transfer coding frames the body (RFC 9112 section 6.1)
+	StringView codings = getHeader(HEADER_TRANSFER_ENCODING);
+	size_t end = codings.length();
+	while (end > 0 && (isBlank(codings[end - 1]) || codings[end - 1] == ',')) {
+		--end;
+	}
+	size_t start = end;
+	while (start > 0 && codings[start - 1] != ',' && !isBlank(codings[start - 1])) {
+		--start;
+	}
+	return codings.substr(start, end - start).equalsIgnoreCase("chunked");
 }
 
 bool Request::isKeepAlive() const {
-	std::string connection = getHeader("connection");
-	if (version == "HTTP/1.1") {
+	StringView connection = getHeader(HEADER_CONNECTION);
+	if (getVersion() == "HTTP/1.1") {
 		// HTTP/1.1 defaults to keep-alive unless explicitly closed
-		return connection != "close";
+		return !hasHeader(HEADER_CONNECTION) || connection != "close";
 	} else {
 		// HTTP/1.0 defaults to close unless explicitly keep-alive
 		return connection == "keep-alive";
 	}
 }
 
-std::string Request::getContentType() const {
-	return getHeader("content-type");
+StringView Request::getContentType() const {
+	return getHeader(HEADER_CONTENT_TYPE);
 }
-
-
@@ -6,27 +6,83 @@
 /*   By: aogbi <aogbi@student.42.fr>                +#+  +:+       +#+        */
 /*                                                +#+#+#+#+#+   +#+           */
 /*   Created: 2025/09/04 12:00:01 by aogbi             #+#    #+#             */
-/*   Updated: 2025/09/05 16:40:38 by aogbi            ###   ########.fr       */
+/*   Updated: 2026/10/19 00:00:00 by aogbi            ###   ########.fr       */
 /*                                                                            */
 /* ************************************************************************** */
 
 #include "response.hpp"
 
-Response::Response() : statusCode(200), statusMessage("OK") {}
+Response::Response()
+	: arena(storage, sizeof(storage)), statusCode(200), statusMessage("OK", ArenaAllocator<char>(&arena)),
+	  headers(std::less<ArenaString>(), ArenaAllocator<char>(&arena)) {}
+
+Response::Response(const Response &other)
+	: arena(storage, sizeof(storage)), statusCode(other.statusCode),
+	  statusMessage(other.statusMessage.data(), other.statusMessage.length(), ArenaAllocator<char>(&arena)),
+	  headers(std::less<ArenaString>(), ArenaAllocator<char>(&arena)), body(other.body) {
+	for (ArenaHeaderMap::const_iterator it = other.headers.begin(); it != other.headers.end(); ++it) {
+		putHeader(it->first.data(), it->first.length(), it->second.data(), it->second.length());
+	}
+}
+
+Response &Response::operator=(const Response &other) {
+	if (this != &other) {
+		// Let go of the arena before rewinding it, then rebuild in it
+		ArenaAllocator<char> alloc(&arena);
+		ArenaString(alloc).swap(statusMessage);
+		ArenaHeaderMap(std::less<ArenaString>(), alloc).swap(headers);
+		arena.reset();
+		statusCode = other.statusCode;
+		statusMessage.assign(other.statusMessage.data(), other.statusMessage.length());
+		for (ArenaHeaderMap::const_iterator it = other.headers.begin(); it != other.headers.end(); ++it) {
+			putHeader(it->first.data(), it->first.length(), it->second.data(), it->second.length());
+		}
+		body = other.body;
+	}
+	return *this;
+}
 
 void Response::setStatus(int code, const std::string &message) {
 	statusCode = code;
-	statusMessage = message;
+	statusMessage.assign(message.data(), message.length());
+}
+
+void Response::putHeader(const char *key, size_t keyLength, const char *value, size_t valueLength) {
+	ArenaAllocator<char> alloc(&arena);
+	ArenaString name(key, keyLength, alloc);
+	ArenaHeaderMap::iterator it = headers.find(name);
+	if (it != headers.end()) {
+		it->second.assign(value, valueLength);
+	} else {
+		headers.insert(std::make_pair(name, ArenaString(value, valueLength, alloc)));
+	}
 }
 
 void Response::setHeader(const std::string &key, const std::string &value) {
-	headers[key] = value;
+	putHeader(key.data(), key.length(), value.data(), value.length());
 }
 
 void Response::setBody(const std::string &b) {
 	body = b;
 }
 
+// Decimal digits of value, written backwards from end; returns the first digit
+static char *formatNumber(size_t value, char *end) {
+	char *p = end;
+	do {
+		*--p = static_cast<char>('0' + value % 10);
+		value /= 10;
+	} while (value);
+	return p;
+}
+
+void Response::setContentLength(size_t length) {
+	char buffer[24];
+	char *end = buffer + sizeof(buffer);
+	char *digits = formatNumber(length, end);
+	putHeader("Content-Length", 14, digits, end - digits);
+}
+
 void Response::setContentType(const std::string &mimeType) {
 	setHeader("Content-Type", mimeType);
 }
@@ -43,12 +99,13 @@ void Response::setCookie(const std::string &name, const std::string &value, cons
 
 void Response::setDate() {
 	time_t rawTime;
-	struct tm* timeInfo;
+	struct tm timeInfo;
 	char buffer[80];
 	
+	// gmtime_r: the reactors of worker_threads build responses concurrently
 	time(&rawTime);
-	timeInfo = gmtime(&rawTime);
-	strftime(buffer, sizeof(buffer), "%a, %d %b %Y %H:%M:%S GMT", timeInfo);
+	gmtime_r(&rawTime, &timeInfo);
+	strftime(buffer, sizeof(buffer), "%a, %d %b %Y %H:%M:%S GMT", &timeInfo);
 	
 	setHeader("Date", std::string(buffer));
 }
@@ -61,45 +118,84 @@ int Response::getStatusCode() const {
 	return statusCode;
 }
 
-std::string Response::toString() const {
-	std::ostringstream resp;
+size_t Response::headLength() const {
+	// Status line, every header line, and room for the defaults (Content-Length, Server, Date)
+	size_t length = 32 + statusMessage.length() + 128;
+	for (ArenaHeaderMap::const_iterator it = headers.begin(); it != headers.end(); ++it) {
+		length += it->first.length() + it->second.length() + 4;
+	}
+	return length;
+}
+
+void Response::writeHead(std::string &out, bool addContentLength) const {
+	char number[24];
+	char *numberEnd = number + sizeof(number);
+	char *digits;
 	
 	// Status line
-	resp << "HTTP/1.1 " << statusCode << " " << statusMessage << "\r\n";
+	out.append("HTTP/1.1 ", 9);
+	digits = formatNumber(statusCode, numberEnd);
+	out.append(digits, numberEnd - digits);
+	out += ' ';
+	out.append(statusMessage.data(), statusMessage.length());
+	out.append("\r\n", 2);
 	
 	// Headers
-	for (std::map<std::string, std::string>::const_iterator it = headers.begin(); it != headers.end(); ++it) {
-		resp << it->first << ": " << it->second << "\r\n";
+	for (ArenaHeaderMap::const_iterator it = headers.begin(); it != headers.end(); ++it) {
+		out.append(it->first.data(), it->first.length());
+		out.append(": ", 2);
+		out.append(it->second.data(), it->second.length());
+		out.append("\r\n", 2);
 	}
 	
+	ArenaAllocator<char> alloc(&arena);
+	
 	// Add Content-Length if not already set
-	if (headers.find("Content-Length") == headers.end()) {
-		resp << "Content-Length: " << body.size() << "\r\n";
+	if (addContentLength && headers.find(ArenaString("Content-Length", alloc)) == headers.end()) {
+		out.append("Content-Length: ", 16);
+		digits = formatNumber(body.size(), numberEnd);
+		out.append(digits, numberEnd - digits);
+		out.append("\r\n", 2);
 	}
 	
 	// Add Server header if not set
-	if (headers.find("Server") == headers.end()) {
-		resp << "Server: Webserv/1.0\r\n";
+	if (headers.find(ArenaString("Server", alloc)) == headers.end()) {
+		out.append("Server: Webserv/1.0\r\n", 21);
 	}
 	
 	// Add Date header if not set
-	if (headers.find("Date") == headers.end()) {
+	if (headers.find(ArenaString("Date", alloc)) == headers.end()) {
 		time_t rawTime;
-		struct tm* timeInfo;
+		struct tm timeInfo;
 		char buffer[80];
 		
 		time(&rawTime);
-		timeInfo = gmtime(&rawTime);
-		strftime(buffer, sizeof(buffer), "%a, %d %b %Y %H:%M:%S GMT", timeInfo);
+		gmtime_r(&rawTime, &timeInfo);
+		size_t length = strftime(buffer, sizeof(buffer), "%a, %d %b %Y %H:%M:%S GMT", &timeInfo);
 		
-		resp << "Date: " << buffer << "\r\n";
+		out.append("Date: ", 6);
+		out.append(buffer, length);
+		out.append("\r\n", 2);
 	}
 	
 	// End of headers
-	resp << "\r\n";
+	out.append("\r\n", 2);
+}
+
+std::string Response::toString() const {
+	std::string resp;
+	resp.reserve(headLength() + body.size());
+	writeHead(resp, true);
 	
 	// Body
-	resp << body;
+	resp += body;
 	
-	return resp.str();
+	return resp;
+}
+
+std::string Response::headToString() const {
+	std::string resp;
+	resp.reserve(headLength());
+	writeHead(resp, false);
+	return resp;
 }
@@ -6,26 +6,83 @@
 /*   By: aogbi <aogbi@student.42.fr>                +#+  +:+       +#+        */
 /*                                                +#+#+#+#+#+   +#+           */
 /*   Created: 2025/09/06 00:00:00 by aogbi             #+#    #+#             */
-/*   Updated: 2025/09/12 17:56:39 by aogbi            ###   ########.fr       */
+/*   Updated: 2026/10/19 00:00:00 by aogbi            ###   ########.fr       */
 /*                                                                            */
 /* ************************************************************************** */
 
 #include "server.hpp"
 #include "request.hpp"
 #include "response.hpp"
+#include "utils.hpp"
 #include <poll.h>
 #include <sys/socket.h>
+#include <sys/eventfd.h>
 #include <cstring>
 #include <cerrno>
 #include <stdexcept>
+#include <cstdlib>
+#include <cctype>
 
-Server::Server(const std::string& configFile) 
-    : config(configFile), httpHandler(config), cgiHandler(config), connectionManager(NULL), server_fd(-1) {
-    
+// Text and network-order forms of a client address, and its port
+static void describePeer(const struct sockaddr_in& peer, std::string& remoteAddr, uint32_t& peerAddr,
+                         uint16_t& remotePort) {
+    peerAddr = peer.sin_addr.s_addr;
+    remotePort = ntohs(peer.sin_port);
+    char text[INET_ADDRSTRLEN];
+    if (inet_ntop(AF_INET, &peer.sin_addr, text, sizeof(text))) {
+        remoteAddr = text;
+    }
+}
+
+// Status code of a serialized response ("HTTP/1.1 200 OK..."), or 0
+static int responseStatusCode(const std::string& response) {
+    if (response.length() < 12 || response.compare(0, 5, "HTTP/") != 0) {
+        return 0;
+    }
+    return std::atoi(response.c_str() + 9);
+}
+
+ServerShared::ServerShared(const std::string& configFile) : config(configFile), openFiles(epochs) {
     if (!config.parseConfig()) {
         std::cerr << "Failed to parse configuration file" << std::endl;
         throw std::runtime_error("Failed to parse configuration file");
     }
+}
+
+bool ServerShared::setup() {
+    openFiles.configure(config.getOpenFileCacheMax(), config.getOpenFileCacheInactive(),
+                        config.getOpenFileCacheValid(), config.getOpenFileCacheErrors());
+    
+    // The limiter table is only allocated when a limit is configured
+    bool requestLimits = config.getLimitReqRate() > 0;
+    bool cgiCaching = false;
+    const std::vector<Location>& locations = config.getLocations();
+    for (size_t i = 0; i < locations.size(); ++i) {
+        requestLimits = requestLimits || locations[i].limitReqRate > 0;
+        cgiCaching = cgiCaching || locations[i].cgiCacheTtl > 0;
+    }
+    if (config.getLimitConn() > 0 || requestLimits) {
+        limiter.init(config.getLimitZoneSize(), config.getLimitConn());
+    }
+    if (cgiCaching && !cgiCache.init(config.getCgiCacheZoneSize(), config.getCgiCacheEntrySize())) {
+        return false;
+    }
+    return !config.isSsl() || tls.init(config);
+}
+
+Server::Server(ServerShared& shared)
+    : shared(shared), config(shared.config), reader(shared.epochs.addReader()),
+      httpHandler(config, metrics, shared.openFiles), cgiHandler(config, metrics, shared.cgiCache),
+      proxyHandler(config, metrics), http2Handler(config, metrics), connectionManager(NULL), wakeFd(-1), server_fd(-1) {
+    
+    if (reader < 0) {
+        throw std::runtime_error("Too many worker threads");
+    }
+    // Alone, a reactor renders its own counters; otherwise the metrics page sums every reactor's
+    shared.metrics.push_back(&metrics);
+    if (config.getWorkerThreads() > 1) {
+        metrics.setGroup(&shared.metrics);
+    }
     
     std::memset(&hints, 0, sizeof(hints));
     hints.ai_family = AF_INET;
@@ -46,9 +103,13 @@ Server::Server(const std::string& configFile)
 }
 
 Server::~Server() {
+    aioPool.stop();
     if (connectionManager) {
         delete connectionManager;
     }
+    if (wakeFd != -1) {
+        close(wakeFd);
+    }
     if (server_fd != -1) {
         close(server_fd);
         std::cout << "Server closed" << std::endl;
@@ -56,13 +117,20 @@ Server::~Server() {
 }
 
 bool Server::setup() {
-    server_fd = socket(AF_INET, SOCK_STREAM, 0);
+    // Close-on-exec: CGI processes must not inherit the listening socket
+    server_fd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
     if (server_fd == -1) {
         std::cerr << "socket failed: " << strerror(errno) << std::endl;
         return false;
     }
     int opt = 1;
     setsockopt(server_fd, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt));
+    // Every reactor listens on the port itself; the kernel hashes new connections across them.
+    // Only then, so a second server started on the same port still fails to bind
+    if (config.getWorkerThreads() > 1 && setsockopt(server_fd, SOL_SOCKET, SO_REUSEPORT, &opt, sizeof(opt)) < 0) {
+        std::cerr << "SO_REUSEPORT failed: " << strerror(errno) << std::endl;
+        return false;
+    }
     if (bind(server_fd, (struct sockaddr*)&address, sizeof(address)) < 0) {
         std::cerr << "bind failed: " << strerror(errno) << std::endl;
         return false;
@@ -71,8 +139,46 @@ bool Server::setup() {
         std::cerr << "listen failed: " << strerror(errno) << std::endl;
         return false;
     }
-    connectionManager = new ConnectionManager(server_fd);
-    std::cout << "Server listening on port " << config.getPort() << std::endl;
+    
+    RequestLimits limits;
+    limits.headerLineSize = config.getLargeHeaderBufferSize();
+    limits.headerBlockSize = config.getLargeHeaderBuffers() * config.getLargeHeaderBufferSize();
+    limits.maxBodySize = config.getClientMaxBodySize();
+    limits.headerTimeout = config.getClientHeaderTimeout();
+    limits.bodyTimeout = config.getClientBodyTimeout();
+    limits.bodyMinRate = config.getClientBodyMinRate();
+    limits.bodyBufferSize = config.getClientBodyBufferSize();
+    limits.bodyTempPath = config.getClientBodyTempPath();
+    if (config.getIoUring() && !ring.init(server_fd)) {
+        std::cerr << "io_uring unavailable, falling back to poll" << std::endl;
+    }
+    connectionManager = new ConnectionManager(server_fd, metrics, limits, &shared.limiter,
+                                              config.isSsl() ? &shared.tls : NULL, ring.enabled() ? &ring : NULL);
+    if (config.getAioThreads()) {
+        if (!aioPool.start(config.getThreadPoolThreads(), config.getThreadPoolMaxQueue())) {
+            return false;
+        }
+        connectionManager->addWatch(aioPool.getEventFd(), POLLIN);
+    }
+    wakeFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (wakeFd < 0) {
+        std::cerr << "eventfd failed: " << strerror(errno) << std::endl;
+        return false;
+    }
+    connectionManager->addWatch(wakeFd, POLLIN);
+    http2Handler.setup(connectionManager);
+    cgiHandler.setup(connectionManager);
+    if (!proxyHandler.setup(connectionManager)) {
+        return false;
+    }
+    if (reader == 0) {
+        std::cout << "Server listening on port " << config.getPort() << (config.isSsl() ? " (ssl)" : "")
+                  << (ring.enabled() ? " (io_uring)" : "");
+        if (config.getWorkerThreads() > 1) {
+            std::cout << " (" << config.getWorkerThreads() << " reactors)";
+        }
+        std::cout << std::endl;
+    }
     return true;
 }
 
@@ -80,31 +186,67 @@ int Server::getSocket() const {
     return server_fd;
 }
 
-int Server::acceptClient() {
-    addrlen = sizeof(address);
-    int client_fd = accept(server_fd, (struct sockaddr*)&address, &addrlen);
+int Server::acceptClient(std::string& remoteAddr, uint32_t& peerAddr, uint16_t& remotePort) {
+    struct sockaddr_in peer;
+    socklen_t peerLen = sizeof(peer);
+    // Non-blocking and close-on-exec from the start, like the sockets of the ring's accept
+    int client_fd = accept4(server_fd, (struct sockaddr*)&peer, &peerLen, SOCK_NONBLOCK | SOCK_CLOEXEC);
     if (client_fd < 0) {
         std::cerr << "accept failed: " << strerror(errno) << std::endl;
         return -1;
     }
+    describePeer(peer, remoteAddr, peerAddr, remotePort);
     std::cout << "New connection accepted" << std::endl;
     return client_fd;
 }
 
+void Server::registerClient(int clientFd, const std::string& remoteAddr, uint32_t peerAddr, uint16_t remotePort) {
+    if (connectionManager->addClient(clientFd, remoteAddr, peerAddr, remotePort)) {
+        std::cout << "📝 Client connected (fd: " << clientFd << ")" << std::endl;
+    }
+}
+
 void Server::run() {
     const int POLL_TIMEOUT = 1000;
+    const int WAITER_POLL_TIMEOUT = 5;
+    const int SYNC_POLL_TIMEOUT = 100;
+    std::vector<struct pollfd> ready;
     
-    std::cout << "🚀 Server running... (Press Ctrl+C to stop)" << std::endl;
+    if (reader == 0) {
+        std::cout << "🚀 Server running... (Press Ctrl+C to stop)" << std::endl;
+    }
+    // The ring was created during setup, on the main thread; it is driven from this one
+    if (ring.enabled() && !ring.start()) {
+        shared.epochs.offline(reader);
+        return;
+    }
 
-    while (g_running) {
-        // Handle client timeouts periodically
-        connectionManager->handleTimeouts();
+    while (__atomic_load_n(&g_running, __ATOMIC_ACQUIRE)) {
+        // Top of the loop: nothing read from the shared caches is held any more
+        shared.epochs.quiescent(reader);
+        
+        // Handle client and upstream timeouts periodically
+        std::vector<int> expired = connectionManager->handleTimeouts();
+        for (size_t i = 0; i < expired.size(); ++i) {
+            releaseClient(expired[i]);
+        }
+        proxyHandler.handleTimeouts();
+        cgiHandler.handleTimeouts();
+        syncUploads();
+        serveHttp2();
         
+        // Requests parked behind another process's cache fill are retried often
+        int timeout = cgiHandler.hasWaiters() ? WAITER_POLL_TIMEOUT : POLL_TIMEOUT;
+        if (timeout > SYNC_POLL_TIMEOUT && httpHandler.hasSyncBatch()) {
+            timeout = SYNC_POLL_TIMEOUT; // uploads wait for the next batch sync
+        }
         std::vector<struct pollfd>& fds = connectionManager->getPollFds();
-        int activity = poll(&fds[0], fds.size(), POLL_TIMEOUT);
+        shared.epochs.offline(reader);
+        int activity = ring.enabled() ? ring.wait(timeout, ringEvents) : poll(&fds[0], fds.size(), timeout);
+        shared.epochs.online(reader);
         
         if (activity < 0) {
-            if (errno == EINTR && !g_running) {
+            if (errno == EINTR && !__atomic_load_n(&g_running, __ATOMIC_ACQUIRE)) {
                 break; // Interrupted by signal, check g_running flag
             }
             std::cerr << "❌ Poll error: " << strerror(errno) << std::endl;
@@ -115,82 +257,510 @@ void Server::run() {
             continue; // Timeout, check g_running flag and continue
         }
 
-        // Check for new connections on server socket
-        if (fds[0].revents & POLLIN) {
-            int client_fd = acceptClient();
-            if (client_fd != -1) {
-                connectionManager->addClient(client_fd);
-                std::cout << "📝 Client connected (fd: " << client_fd << ")" << std::endl;
+        // Handlers add and remove descriptors, so work from a copy of the ready set
+        ready.clear();
+        if (ring.enabled()) {
+            ready.swap(ringEvents.ready);
+            serveRing();
+        } else {
+            for (size_t i = 0; i < fds.size(); ++i) {
+                if (fds[i].revents) {
+                    ready.push_back(fds[i]);
+                }
             }
         }
 
-        // Handle existing client connections
-        std::map<int, ClientConnection>& clients = connectionManager->getClients();
-        
-        for (size_t i = 1; i < fds.size() && g_running; i++) {
-            int client_fd = fds[i].fd;
-            
-            // Handle client disconnection or errors
-            if (fds[i].revents & (POLLHUP | POLLERR | POLLNVAL)) {
-                std::cout << "📤 Client disconnected (fd: " << client_fd << ")" << std::endl;
-                connectionManager->removeClient(client_fd);
-                i--; // Adjust index after removal
-                continue;
-            }
+        for (size_t i = 0; i < ready.size() && __atomic_load_n(&g_running, __ATOMIC_ACQUIRE); ++i) {
+            int fd = ready[i].fd;
             
-            // Handle incoming data
-            if (fds[i].revents & POLLIN) {
-                char buffer[4096] = {0};
-                ssize_t bytes_read = read(client_fd, buffer, sizeof(buffer) - 1);
-                
-                if (bytes_read <= 0) {
-                    if (bytes_read == 0) {
-                        std::cout << "📤 Client closed connection (fd: " << client_fd << ")" << std::endl;
-                    } else {
-                        std::cerr << "❌ Read error on client " << client_fd << ": " << strerror(errno) << std::endl;
-                    }
-                    connectionManager->removeClient(client_fd);
-                    i--; // Adjust index after removal
-                    continue;
+            // Check for new connections on server socket
+            if (fd == server_fd) {
+                std::string remoteAddr;
+                uint32_t peerAddr = 0;
+                uint16_t remotePort = 0;
+                int client_fd = acceptClient(remoteAddr, peerAddr, remotePort);
+                if (client_fd != -1) {
+                    registerClient(client_fd, remoteAddr, peerAddr, remotePort);
                 }
-                
-                // Update client activity and append to buffer
-                connectionManager->updateClientActivity(client_fd);
-                clients[client_fd].buffer.append(buffer, bytes_read);
-                
-                // Check if we have a complete request
-                if (connectionManager->isRequestComplete(clients[client_fd].buffer)) {
-                    clients[client_fd].requestComplete = true;
-                    
-                    // Parse and handle the request
-                    Request req;
-                    if (req.parse(clients[client_fd].buffer)) {
-                        std::string responseStr;
-                        
-                        // Check if this is a CGI request
-                        const Location* location = config.findLocation(req.getPath());
-                        if (cgiHandler.isCgiRequest(req.getPath(), location)) {
-                            responseStr = cgiHandler.executeCgi(req.getPath(), req, location);
-                        } else {
-                            responseStr = httpHandler.handleRequest(req);
-                        }
-                        
-                        ssize_t sent = send(client_fd, responseStr.c_str(), responseStr.length(), MSG_NOSIGNAL);
-                        if (sent < 0) {
-                            std::cerr << "❌ Send error to client " << client_fd << ": " << strerror(errno) << std::endl;
-                        }
-                    } else {
-                        connectionManager->sendErrorResponse(client_fd, 400, "Bad Request");
-                    }
-                    
-                    // Close connection after response (HTTP/1.0 behavior)
-                    std::cout << "📤 Request completed, closing connection (fd: " << client_fd << ")" << std::endl;
-                    connectionManager->removeClient(client_fd);
-                    i--; // Adjust index after removal
+            } else if (fd == wakeFd) {
+                uint64_t count;
+                while (read(wakeFd, &count, sizeof(count)) < 0 && errno == EINTR) {
                 }
+            } else if (aioPool.running() && fd == aioPool.getEventFd()) {
+                completeTasks();
+            } else if (connectionManager->findClient(fd)) {
+                handleClientEvent(fd, ready[i].revents);
+            } else if (proxyHandler.ownsFd(fd)) {
+                proxyHandler.handleEvent(fd, ready[i].revents);
+            } else if (cgiHandler.ownsFd(fd)) {
+                cgiHandler.handleEvent(fd, ready[i].revents);
             }
         }
     }
+    // Stopped: this reactor no longer holds reclamation up for the others
+    shared.epochs.offline(reader);
+    if (reader == 0) {
+        std::cout << "✅ Server shutdown complete." << std::endl;
+    }
+}
+
+void Server::wake() {
+    uint64_t one = 1;
+    while (write(wakeFd, &one, sizeof(one)) < 0 && errno == EINTR) {
+    }
+}
+
+void Server::serveRing() {
+    // Sockets from the multishot accept only lack their peer address
+    for (size_t i = 0; i < ringEvents.accepted.size(); ++i) {
+        int client_fd = ringEvents.accepted[i];
+        struct sockaddr_in peer;
+        socklen_t peerLen = sizeof(peer);
+        std::string remoteAddr;
+        uint32_t peerAddr = 0;
+        uint16_t remotePort = 0;
+        if (getpeername(client_fd, (struct sockaddr*)&peer, &peerLen) == 0) {
+            describePeer(peer, remoteAddr, peerAddr, remotePort);
+        }
+        std::cout << "New connection accepted" << std::endl;
+        registerClient(client_fd, remoteAddr, peerAddr, remotePort);
+    }
+    
+    // Bytes of the multishot recv, in the order they arrived
+    for (size_t i = 0; i < ringEvents.received.size() && __atomic_load_n(&g_running, __ATOMIC_ACQUIRE); ++i) {
+        const RingRecv& received = ringEvents.received[i];
+        if (!connectionManager->findClient(received.fd)) {
+            continue; // closed by an earlier event of this batch
+        }
+        if (received.length < 0) {
+            std::cerr << "❌ Read error on client " << received.fd << ": " << strerror(-received.length) << std::endl;
+            closeClient(received.fd);
+            continue;
+        }
+        clientData(received.fd, received.data, received.length);
+    }
+    
+    for (size_t i = 0; i < ringEvents.reads.size(); ++i) {
+        AioTask* task = static_cast<AioTask*>(ringEvents.reads[i].owner);
+        ssize_t result = ringEvents.reads[i].result;
+        task->content.resize(result > 0 ? result : 0);
+        if (!task->cancelled) {
+            aioTasks.erase(task->clientFd);
+        }
+        finishTask(task);
+    }
+}
+
+void Server::handleClientEvent(int clientFd, short revents) {
+    // Handle client disconnection or errors
+    if ((revents & (POLLERR | POLLNVAL)) || ((revents & POLLHUP) && !(revents & POLLIN))) {
+        std::cout << "📤 Client disconnected (fd: " << clientFd << ")" << std::endl;
+        closeClient(clientFd);
+        return;
+    }
+    
+    ClientConnection* client = connectionManager->findClient(clientFd);
+    if (client->handshaking) {
+        if (!connectionManager->continueHandshake(clientFd)) {
+            closeClient(clientFd);
+        } else if (!client->handshaking) {
+            readClient(clientFd); // the request often arrives right behind the handshake
+        }
+        return;
+    }
+    
+    if (revents & POLLOUT) {
+        if (!connectionManager->flush(clientFd)) {
+            closeClient(clientFd);
+            return;
+        }
+        if (connectionManager->closeIfFlushed(clientFd)) {
+            return;
+        }
+        proxyHandler.onClientDrained(clientFd);
+        cgiHandler.onClientDrained(clientFd);
+        http2Handler.onClientDrained(clientFd);
+    }
     
-    std::cout << "✅ Server shutdown complete." << std::endl;
+    if (revents & (POLLIN | POLLHUP)) {
+        readClient(clientFd);
+    }
+}
+
+void Server::readClient(int clientFd) {
+    char buffer[16384];
+    ssize_t bytes_read = connectionManager->receive(clientFd, buffer, sizeof(buffer));
+    
+    if (bytes_read < 0) {
+        if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR) {
+            return;
+        }
+        std::cerr << "❌ Read error on client " << clientFd << ": " << strerror(errno) << std::endl;
+        closeClient(clientFd);
+        return;
+    }
+    clientData(clientFd, buffer, bytes_read);
+}
+
+void Server::clientData(int clientFd, const char* buffer, size_t bytes_read) {
+    if (bytes_read == 0) {
+        if (proxyHandler.hasSession(clientFd)) {
+            proxyHandler.onClientEof(clientFd);
+            return;
+        }
+        if (cgiHandler.hasSession(clientFd)) {
+            // Half-closed client: the script's output is still delivered
+            connectionManager->setEvents(clientFd, connectionManager->getEvents(clientFd) & ~POLLIN);
+            return;
+        }
+        std::cout << "📤 Client closed connection (fd: " << clientFd << ")" << std::endl;
+        closeClient(clientFd);
+        return;
+    }
+    
+    // Update client activity and append to buffer
+    connectionManager->updateClientActivity(clientFd, bytes_read);
+    metrics.recordBytesIn(bytes_read);
+    if (proxyHandler.hasSession(clientFd)) {
+        proxyHandler.onClientData(clientFd, buffer, bytes_read);
+        return;
+    }
+    if (http2Handler.hasSession(clientFd)) {
+        http2Handler.onClientData(clientFd, buffer, bytes_read);
+        return;
+    }
+    
+    ClientConnection* client = connectionManager->findClient(clientFd);
+    if (client->closeAfterWrite || cgiHandler.hasSession(clientFd) || aioTasks.count(clientFd)) {
+        return; // response already under way; the connection closes once it drains
+    }
+    if (client->buffer.empty()) {
+        metrics.connectionBusy();
+    }
+    client->buffer.append(buffer, bytes_read);
+    if (http2Handler.enabled() && !client->headersRouted && startHttp2(clientFd, *client)) {
+        return;
+    }
+    processRequest(clientFd, *client);
+}
+
+bool Server::startHttp2(int clientFd, ClientConnection& client) {
+    if (client.ssl) {
+        if (!TlsContext::negotiatedHttp2(client.ssl)) {
+            return false;
+        }
+    } else {
+        // Cleartext HTTP/2 with prior knowledge starts with the connection preface
+        Http2Handler::Preface preface = Http2Handler::matchPreface(client.buffer);
+        if (preface != Http2Handler::PREFACE_FULL) {
+            return preface == Http2Handler::PREFACE_PARTIAL;
+        }
+    }
+    std::string received(client.buffer);
+    http2Handler.open(clientFd);
+    http2Handler.onClientData(clientFd, received.data(), received.length());
+    return true;
+}
+
+void Server::serveHttp2() {
+    // Streams are dispatched like requests read from their own socket
+    Http2Events events;
+    while (http2Handler.pump(events)) {
+        for (size_t i = 0; i < events.closed.size(); ++i) {
+            proxyHandler.onClientClosed(events.closed[i]);
+            cgiHandler.onClientClosed(events.closed[i]);
+            cancelTask(events.closed[i]);
+        }
+        for (size_t i = 0; i < events.ready.size(); ++i) {
+            ClientConnection* stream = connectionManager->findClient(events.ready[i]);
+            if (stream) {
+                processRequest(events.ready[i], *stream);
+            }
+        }
+        for (size_t i = 0; i < events.drained.size(); ++i) {
+            proxyHandler.onClientDrained(events.drained[i]);
+            cgiHandler.onClientDrained(events.drained[i]);
+        }
+        events.clear();
+    }
+}
+
+void Server::processRequest(int clientFd, ClientConnection& client) {
+    // Oversized headers or bodies are refused before more of them is buffered
+    if (!connectionManager->checkRequestLimits(clientFd) || client.headerEnd == std::string::npos) {
+        return;
+    }
+    
+    // Requests are checked, and proxied ones started, as soon as the headers are in
+    if (!client.headersRouted) {
+        client.headersRouted = true;
+        if (routeHeaders(clientFd, client)) {
+            return;
+        }
+    }
+    
+    // Past the headers, body bytes leave the buffer for memory or a temporary file
+    if (!connectionManager->spoolBody(client)) {
+        client.requestComplete = true;
+        metrics.recordStatus(500);
+        connectionManager->sendErrorResponse(clientFd, 500, "Internal Server Error");
+        connectionManager->finishResponse(clientFd);
+        return;
+    }
+    
+    // Check if we have a complete request
+    if (connectionManager->isRequestComplete(client.buffer, client.body.size())) {
+        handleRequest(clientFd, client);
+    }
+}
+
+bool Server::routeHeaders(int clientFd, ClientConnection& client) {
+    Request req;
+    uint64_t phaseStart = Metrics::nowMicros();
+    bool parsed = req.parse(client.buffer);
+    metrics.observePhase(Metrics::PHASE_PARSE, phaseStart);
+    if (!parsed) {
+        return false; // answered with 400 once the request is complete
+    }
+    if (!client.ssl && client.parentFd < 0 && http2Handler.canUpgrade(req)) {
+        http2Handler.upgrade(clientFd, req, client.buffer.substr(0, client.headerEnd));
+        return true;
+    }
+    const Location* location = config.findLocation(req.getPath());
+    bool proxied = proxyHandler.enabled() && ProxyHandler::isProxyLocation(location);
+    
+    // A body that would be refused anyway is refused before the client sends it
+    std::string refusal = httpHandler.checkRequestHead(req, location);
+    if (!proxied && refusal.empty()) {
+        sendContinue(clientFd, client, req);
+        return false;
+    }
+    
+    metrics.recordRequest(req.getMethod());
+    if (rejectedByLimit(clientFd, client, location)) {
+        return true;
+    }
+    if (!refusal.empty()) {
+        metrics.recordStatus(responseStatusCode(refusal));
+        if (!connectionManager->queueWrite(clientFd, refusal)) {
+            closeClient(clientFd);
+            return true;
+        }
+        connectionManager->finishResponse(clientFd);
+        return true;
+    }
+    sendContinue(clientFd, client, req);
+    proxyHandler.start(clientFd, req, location, client.headerEnd);
+    return true;
+}
+
+void Server::sendContinue(int clientFd, ClientConnection& client, const Request& req) {
+    // Only useful while the client is still holding its body back
+    if (req.getVersion() != "HTTP/1.1" || client.buffer.length() > client.headerEnd) {
+        return;
+    }
+    std::string expect = toLower(req.getHeader(Request::HEADER_EXPECT));
+    if (expect != "100-continue") {
+        return;
+    }
+    static const char interim[] = "HTTP/1.1 100 Continue\r\n\r\n";
+    connectionManager->queueWrite(clientFd, interim, sizeof(interim) - 1);
+    client.writeStart = 0; // an interim response does not start the final one
+}
+
+bool Server::rejectedByLimit(int clientFd, const ClientConnection& client, const Location* location) {
+    if (!shared.limiter.enabled()) {
+        return false;
+    }
+    // A location with its own limit_req has its own bucket (zone index + 1)
+    int rate = config.getLimitReqRate();
+    size_t burst = config.getLimitReqBurst();
+    uint32_t zone = 0;
+    if (location && location->limitReqRate >= 0) {
+        rate = location->limitReqRate;
+        burst = location->limitReqBurst;
+        zone = static_cast<uint32_t>(location - &config.getLocations()[0]) + 1;
+    }
+    if (rate <= 0 || shared.limiter.allowRequest(client.peerAddr, zone, rate, burst)) {
+        return false;
+    }
+    
+    // Fixed response: no error page lookup, no filesystem access
+    static const char rejection[] = "HTTP/1.1 429 Too Many Requests\r\nContent-Type: text/plain\r\n"
+                                    "Content-Length: 17\r\nRetry-After: 1\r\nConnection: close\r\n\r\n"
+                                    "Too Many Requests";
+    metrics.recordLimitRejection(Metrics::LIMIT_REQ);
+    metrics.recordStatus(429);
+    if (!connectionManager->queueWrite(clientFd, rejection, sizeof(rejection) - 1)) {
+        closeClient(clientFd);
+        return true;
+    }
+    connectionManager->finishResponse(clientFd);
+    return true;
+}
+
+void Server::handleRequest(int clientFd, ClientConnection& client) {
+    client.requestComplete = true;
+    
+    // Parse and handle the request
+    Request req;
+    uint64_t phaseStart = Metrics::nowMicros();
+    bool parsed = req.parse(client.buffer);
+    metrics.observePhase(Metrics::PHASE_PARSE, phaseStart);
+    if (!parsed) {
+        metrics.recordStatus(400);
+        connectionManager->sendErrorResponse(clientFd, 400, "Bad Request");
+        connectionManager->finishResponse(clientFd);
+        return;
+    }
+    req.takeBody(client.body);
+    
+    metrics.recordRequest(req.getMethod());
+    const Location* location = config.findLocation(req.getPath());
+    if (rejectedByLimit(clientFd, client, location)) {
+        return;
+    }
+    
+    // CGI responses are streamed from the poll loop as the script produces them
+    phaseStart = Metrics::nowMicros();
+    if (cgiHandler.isCgiRequest(req.getPath(), location)) {
+        cgiHandler.start(clientFd, req, location);
+        metrics.observePhase(Metrics::PHASE_HANDLE, phaseStart);
+        return;
+    }
+    
+    // With aio threads or the event ring, file system calls are handed off and the response follows
+    // from completeTasks() or serveRing(); batched uploads always take this path to wait for their sync
+    std::string responseStr;
+    bool batched = location && location->uploadFsync == UploadWriter::FSYNC_BATCH;
+    if (aioPool.running() || ring.enabled() || batched) {
+        AioTask* task = httpHandler.startRequest(req, responseStr);
+        if (task) {
+            task->clientFd = clientFd;
+            task->started = phaseStart;
+            submitTask(task);
+            return;
+        }
+    } else {
+        responseStr = httpHandler.handleRequest(req);
+    }
+    metrics.observePhase(Metrics::PHASE_HANDLE, phaseStart);
+    sendResponse(clientFd, responseStr);
+}
+
+void Server::sendResponse(int clientFd, const std::string& responseStr) {
+    metrics.recordStatus(responseStatusCode(responseStr));
+    
+    // Whatever the socket does not take now is sent as it becomes writable
+    if (!connectionManager->queueWrite(clientFd, responseStr)) {
+        closeClient(clientFd);
+        return;
+    }
+    connectionManager->finishResponse(clientFd);
+}
+
+void Server::submitTask(AioTask* task) {
+    // A file that is open and only has to be read is read through the ring
+    OpenFile& target = task->readTarget();
+    if (ring.enabled() && task->kind == AioTask::AIO_SERVE && task->loaded && !task->head && !target.statError
+        && S_ISREG(target.info.st_mode) && target.fd >= 0 && target.info.st_size > 0) {
+        task->content.resize(target.info.st_size);
+        ring.read(target.fd, &task->content[0], task->content.length(), task);
+        aioTasks[task->clientFd] = task;
+        return;
+    }
+    if (aioPool.running() && aioPool.submit(task)) {
+        if (task->kind != AioTask::AIO_SYNC) {
+            aioTasks[task->clientFd] = task;
+        }
+        return;
+    }
+    // No pool, or its queue is full: the loop does the work itself rather than refuse the request
+    httpHandler.runTask(*task);
+    finishTask(task);
+}
+
+void Server::finishTask(AioTask* task) {
+    if (task->kind == AioTask::AIO_SYNC) {
+        finishSync(task);
+        return;
+    }
+    std::string responseStr;
+    if (!httpHandler.finishTask(*task, responseStr)) {
+        // An upload written under upload_fsync batch waits for its sync, a directory listing still has to be read
+        if (task->kind == AioTask::AIO_UPLOAD) {
+            aioTasks[task->clientFd] = task;
+        } else if (task->cancelled) {
+            delete task;
+        } else {
+            submitTask(task);
+        }
+        return;
+    }
+    int clientFd = task->clientFd;
+    bool cancelled = task->cancelled;
+    metrics.observePhase(Metrics::PHASE_HANDLE, task->started);
+    delete task;
+    if (!cancelled) {
+        sendResponse(clientFd, responseStr);
+    }
+}
+
+void Server::syncUploads() {
+    // The fdatasyncs go to a worker like any other blocking call; finishSync() answers the uploads
+    AioTask* task = httpHandler.takeSyncBatch();
+    if (task) {
+        submitTask(task);
+    }
+}
+
+void Server::finishSync(AioTask* task) {
+    std::string none;
+    httpHandler.finishTask(*task, none);
+    for (size_t i = 0; i < task->batch.size(); ++i) {
+        AioTask* upload = task->batch[i];
+        if (!upload->cancelled) {
+            aioTasks.erase(upload->clientFd);
+            metrics.observePhase(Metrics::PHASE_HANDLE, upload->started);
+            sendResponse(upload->clientFd, httpHandler.finishUpload(*upload));
+        }
+    }
+    delete task; // with its uploads
+}
+
+void Server::completeTasks() {
+    std::vector<AioTask*> done;
+    aioPool.takeCompleted(done);
+    for (size_t i = 0; i < done.size(); ++i) {
+        if (!done[i]->cancelled && done[i]->kind != AioTask::AIO_SYNC) {
+            aioTasks.erase(done[i]->clientFd);
+        }
+        finishTask(done[i]);
+    }
+}
+
+void Server::cancelTask(int clientFd) {
+    // The worker still finishes; its result only updates the caches
+    std::map<int, AioTask*>::iterator it = aioTasks.find(clientFd);
+    if (it != aioTasks.end()) {
+        it->second->cancelled = true;
+        aioTasks.erase(it);
+    }
+}
+
+void Server::releaseClient(int clientFd) {
+    // The streams of an HTTP/2 connection go with it
+    std::vector<int> closed;
+    http2Handler.onClientClosed(clientFd, closed);
+    closed.push_back(clientFd);
+    for (size_t i = 0; i < closed.size(); ++i) {
+        proxyHandler.onClientClosed(closed[i]);
+        cgiHandler.onClientClosed(closed[i]);
+        cancelTask(closed[i]);
+    }
+}
+
+void Server::closeClient(int clientFd) {
+    releaseClient(clientFd);
+    connectionManager->removeClient(clientFd);
 }
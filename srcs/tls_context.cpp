@@ -0,0 +1,121 @@
+/* ************************************************************************** */
+/*                                                                            */
+/*                                                        :::      ::::::::   */
+/*   tls_context.cpp                                    :+:      :+:    :+:   */
+/*                                                    +:+ +:+         +:+     */
+/*   By: aogbi <aogbi@student.42.fr>                +#+  +:+       +#+        */
+/*                                                +#+#+#+#+#+   +#+           */
+/*   Created: 2026/10/19 00:00:00 by aogbi             #+#    #+#             */
+/*   Updated: 2026/10/19 00:00:00 by aogbi            ###   ########.fr       */
+/*                                                                            */
+/* ************************************************************************** */
+
+#include "tls_context.hpp"
+#include <openssl/ssl.h>
+#include <openssl/err.h>
+#include <iostream>
+#include <cstring>
+
+static const unsigned char SESSION_ID_CONTEXT[] = "webserv";
+static const unsigned char ALPN_HTTP2[] = "\x02h2\x08http/1.1";
+static const unsigned char ALPN_HTTP1[] = "\x08http/1.1";
+
+// Pick from the client's list in our order of preference (arg is our wire-format list)
+static int selectProtocol(SSL*, const unsigned char** out, unsigned char* outlen,
+                          const unsigned char* in, unsigned int inlen, void* arg) {
+    const unsigned char* ours = static_cast<const unsigned char*>(arg);
+    unsigned char* selected;
+    if (SSL_select_next_proto(&selected, outlen, ours, std::strlen(reinterpret_cast<const char*>(ours)),
+                              in, inlen) != OPENSSL_NPN_NEGOTIATED) {
+        return SSL_TLSEXT_ERR_NOACK;
+    }
+    *out = selected;
+    return SSL_TLSEXT_ERR_OK;
+}
+
+TlsContext::TlsContext() : ctx(NULL) {
+}
+
+TlsContext::~TlsContext() {
+    if (ctx) {
+        SSL_CTX_free(ctx);
+    }
+}
+
+bool TlsContext::init(const Config& config) {
+    ctx = SSL_CTX_new(TLS_server_method());
+    if (!ctx) {
+        logErrors("SSL_CTX_new");
+        return false;
+    }
+    SSL_CTX_set_min_proto_version(ctx, TLS1_2_VERSION);
+    if (SSL_CTX_use_certificate_chain_file(ctx, config.getSslCertificate().c_str()) != 1
+        || SSL_CTX_use_PrivateKey_file(ctx, config.getSslCertificateKey().c_str(), SSL_FILETYPE_PEM) != 1
+        || SSL_CTX_check_private_key(ctx) != 1) {
+        logErrors("ssl_certificate");
+        SSL_CTX_free(ctx);
+        ctx = NULL;
+        return false;
+    }
+
+    // Clients that vanish without close_notify read as a plain EOF
+    uint64_t options = SSL_OP_IGNORE_UNEXPECTED_EOF | SSL_OP_NO_RENEGOTIATION | SSL_OP_CIPHER_SERVER_PREFERENCE;
+    if (!config.getSslSessionTickets()) {
+        options |= SSL_OP_NO_TICKET;
+    }
+    if (config.getSslKtls()) {
+        options |= SSL_OP_ENABLE_KTLS;
+    }
+    SSL_CTX_set_options(ctx, options);
+
+    // outBuffer may grow, and move, between a partial SSL_write and its retry
+    SSL_CTX_set_mode(ctx, SSL_MODE_ENABLE_PARTIAL_WRITE | SSL_MODE_ACCEPT_MOVING_WRITE_BUFFER
+                          | SSL_MODE_RELEASE_BUFFERS);
+
+    SSL_CTX_set_session_id_context(ctx, SESSION_ID_CONTEXT, sizeof(SESSION_ID_CONTEXT) - 1);
+    SSL_CTX_set_timeout(ctx, config.getSslSessionTimeout());
+    if (config.getSslSessionCache() > 0) {
+        SSL_CTX_set_session_cache_mode(ctx, SSL_SESS_CACHE_SERVER);
+        SSL_CTX_sess_set_cache_size(ctx, config.getSslSessionCache());
+    } else {
+        SSL_CTX_set_session_cache_mode(ctx, SSL_SESS_CACHE_OFF);
+    }
+    SSL_CTX_set_alpn_select_cb(ctx, selectProtocol,
+                               const_cast<unsigned char*>(config.getHttp2() ? ALPN_HTTP2 : ALPN_HTTP1));
+    return true;
+}
+
+SSL* TlsContext::accept(int fd) {
+    SSL* ssl = SSL_new(ctx);
+    if (!ssl) {
+        logErrors("SSL_new");
+        return NULL;
+    }
+    if (SSL_set_fd(ssl, fd) != 1) {
+        logErrors("SSL_set_fd");
+        SSL_free(ssl);
+        return NULL;
+    }
+    SSL_set_accept_state(ssl);
+    return ssl;
+}
+
+bool TlsContext::usesKtls(SSL* ssl) {
+    return BIO_get_ktls_send(SSL_get_wbio(ssl)) > 0;
+}
+
+bool TlsContext::negotiatedHttp2(SSL* ssl) {
+    const unsigned char* protocol;
+    unsigned int length;
+    SSL_get0_alpn_selected(ssl, &protocol, &length);
+    return length == 2 && protocol[0] == 'h' && protocol[1] == '2';
+}
+
+void TlsContext::logErrors(const char* context) {
+    unsigned long error;
+    while ((error = ERR_get_error()) != 0) {
+        char text[256];
+        ERR_error_string_n(error, text, sizeof(text));
+        std::cerr << "❌ TLS " << context << ": " << text << std::endl;
+    }
+}
@@ -0,0 +1,195 @@
+/* ************************************************************************** */
+/*                                                                            */
+/*                                                        :::      ::::::::   */
+/*   upload_writer.cpp                                  :+:      :+:    :+:   */
+/*                                                    +:+ +:+         +:+     */
+/*   By: aogbi <aogbi@student.42.fr>                +#+  +:+       +#+        */
+/*                                                +#+#+#+#+#+   +#+           */
+/*   Created: 2026/10/19 00:00:00 by aogbi             #+#    #+#             */
+/*   Updated: 2026/10/19 00:00:00 by aogbi            ###   ########.fr       */
+/*                                                                            */
+/* ************************************************************************** */
+
+#include "upload_writer.hpp"
+#include <iostream>
+#include <cstring>
+#include <cstdlib>
+#include <cerrno>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+UploadWriter::UploadWriter(bool blocking) : alignedBuffer(NULL), blocking(blocking) {
+}
+
+UploadWriter::~UploadWriter() {
+    free(alignedBuffer);
+}
+
+bool UploadWriter::write(const std::string& dir, const std::string& path, const char* data, size_t length,
+                         CacheMode mode, FsyncPolicy fsync) {
+    int fd = open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0) {
+        std::cerr << "Failed to open file for writing: " << path << ": " << strerror(errno) << std::endl;
+        return false;
+    }
+
+    // Reserve the whole extent at once; file systems without fallocate just skip it
+    if (length > 0 && fallocate(fd, 0, 0, length) != 0 && errno == ENOSPC) {
+        std::cerr << "No space left for upload: " << path << std::endl;
+        close(fd);
+        unlink(path.c_str());
+        return false;
+    }
+
+    size_t offset = 0;
+    bool ok = true;
+    if (mode == CACHE_DIRECT) {
+        int flags = fcntl(fd, F_GETFL);
+        if (fcntl(fd, F_SETFL, flags | O_DIRECT) == 0) {
+            ok = writeDirect(fd, data, length, offset);
+            fcntl(fd, F_SETFL, flags);
+            if (!ok && errno == EINVAL) {
+                // The file system took the flag but not the write: reopen and go through the cache
+                close(fd);
+                fd = open(path.c_str(), O_WRONLY | O_CLOEXEC);
+                if (fd < 0) {
+                    std::cerr << "Failed to reopen file for writing: " << path << ": " << strerror(errno)
+                              << std::endl;
+                    unlink(path.c_str());
+                    return false;
+                }
+                ok = lseek(fd, offset, SEEK_SET) == static_cast<off_t>(offset);
+            }
+        }
+        mode = CACHE_DROP; // the unaligned tail, or everything without O_DIRECT support
+    }
+    ok = ok && writeAll(fd, data + offset, length - offset, mode, offset);
+
+    if (ok && fsync == FSYNC_ON) {
+        // The directory entry must be durable too, not only the data
+        ok = fdatasync(fd) == 0;
+        int dirFd = open(dir.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+        if (dirFd >= 0) {
+            ::fsync(dirFd);
+            close(dirFd);
+        }
+    }
+
+    if (close(fd) != 0) {
+        ok = false;
+    }
+    if (!ok) {
+        std::cerr << "Failed to write file: " << path << ": " << strerror(errno) << std::endl;
+        unlink(path.c_str());
+    }
+    return ok;
+}
+
+bool UploadWriter::writeAll(int fd, const char* data, size_t length, CacheMode mode, size_t& offset) {
+    size_t previous = 0;
+    size_t previousLength = 0;
+    size_t done = 0;
+    while (done < length) {
+        size_t chunk = (length - done < CHUNK) ? length - done : CHUNK;
+        ssize_t written = ::write(fd, data + done, chunk);
+        if (written < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return false;
+        }
+        if (mode != CACHE_KEEP) {
+            // Start writeback of this chunk and retire the one before it
+            dropWritten(fd, offset, written, false);
+            if (previousLength > 0) {
+                dropWritten(fd, previous, previousLength, true);
+            }
+            previous = offset;
+            previousLength = written;
+        }
+        offset += written;
+        done += written;
+    }
+    if (previousLength > 0) {
+        dropWritten(fd, previous, previousLength, true);
+    }
+    return true;
+}
+
+bool UploadWriter::writeDirect(int fd, const char* data, size_t length, size_t& offset) {
+    if (!alignedBuffer && posix_memalign(reinterpret_cast<void**>(&alignedBuffer), ALIGNMENT, CHUNK) != 0) {
+        alignedBuffer = NULL;
+        return true; // nothing written, the caller writes it all through the cache
+    }
+    size_t aligned = length - length % ALIGNMENT;
+    while (offset < aligned) {
+        size_t chunk = (aligned - offset < CHUNK) ? aligned - offset : CHUNK;
+        std::memcpy(alignedBuffer, data + offset, chunk);
+        ssize_t written = ::write(fd, alignedBuffer, chunk);
+        if (written < 0 && errno == EINTR) {
+            continue;
+        }
+        if (written < 0 || written % ALIGNMENT != 0) {
+            return false;
+        }
+        offset += written;
+    }
+    return true;
+}
+
+void UploadWriter::dropWritten(int fd, size_t offset, size_t length, bool wait) {
+    if (!wait) {
+        sync_file_range(fd, offset, length, SYNC_FILE_RANGE_WRITE);
+        return;
+    }
+    if (!blocking) {
+        // On the poll loop only the pages already clean are dropped
+        posix_fadvise(fd, offset, length, POSIX_FADV_DONTNEED);
+        return;
+    }
+    // Pages are only dropped once clean, so wait for their writeback first
+    sync_file_range(fd, offset, length,
+                    SYNC_FILE_RANGE_WAIT_BEFORE | SYNC_FILE_RANGE_WRITE | SYNC_FILE_RANGE_WAIT_AFTER);
+    posix_fadvise(fd, offset, length, POSIX_FADV_DONTNEED);
+}
+
+bool UploadWriter::makeDir(const std::string& dir) {
+    struct stat st;
+    if (stat(dir.c_str(), &st) != 0 && mkdir(dir.c_str(), 0755) != 0) {
+        std::cerr << "Failed to create upload directory: " << dir << std::endl;
+        return false;
+    }
+    return true;
+}
+
+int UploadWriter::remove(const std::string& path) {
+    struct stat st;
+    if (stat(path.c_str(), &st) != 0) {
+        return ENOENT;
+    }
+    if (!S_ISREG(st.st_mode)) {
+        return EISDIR;
+    }
+    return unlink(path.c_str()) == 0 ? 0 : errno;
+}
+
+int UploadWriter::syncFile(const std::string& path) {
+    int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return errno;
+    }
+    int error = fdatasync(fd) == 0 ? 0 : errno;
+    close(fd);
+    return error;
+}
+
+int UploadWriter::syncDir(const std::string& dir) {
+    int fd = open(dir.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (fd < 0) {
+        return errno;
+    }
+    int error = ::fsync(fd) == 0 ? 0 : errno;
+    close(fd);
+    return error;
+}
@@ -6,7 +6,7 @@
 /*   By: aogbi <aogbi@student.42.fr>                +#+  +:+       +#+        */
 /*                                                +#+#+#+#+#+   +#+           */
 /*   Created: 2025/09/06 00:00:00 by aogbi             #+#    #+#             */
-/*   Updated: 2025/09/06 10:44:49 by aogbi            ###   ########.fr       */
+/*   Updated: 2026/10/19 00:00:00 by aogbi            ###   ########.fr       */
 /*                                                                            */
 /* ************************************************************************** */
 
@@ -30,3 +30,34 @@ bool validateArguments(int argc, char* argv[]) {
 std::string getConfigFile(int argc, char* argv[]) {
     return (argc == 1) ? "./configs/default.conf" : argv[1];
 }
+
+std::string toLower(const StringView& value) {
+    std::string lower(value.data(), value.length());
+    toLowerInPlace(lower);
+    return lower;
+}
+
+void toLowerInPlace(std::string& value) {
+    for (size_t i = 0; i < value.length(); ++i) {
+        value[i] = StringView::lower(value[i]);
+    }
+}
+
+bool parseDigits(const StringView& text, size_t& value) {
+    if (text.empty()) {
+        return false;
+    }
+    size_t result = 0;
+    for (size_t i = 0; i < text.length(); ++i) {
+        if (text[i] < '0' || text[i] > '9') {
+            return false;
+        }
+        size_t digit = static_cast<size_t>(text[i] - '0');
+        if (result > (static_cast<size_t>(-1) - digit) / 10) {
+            return false;
+        }
+        result = result * 10 + digit;
+    }
+    value = result;
+    return true;
+}